@@ -2,7 +2,7 @@
     "targets": [
         {
             "target_name": "nodejs-simconnect",
-            "sources": [ "src/addon.cc" ],
+            "sources": [ "src/addon.cc", "src/arrow_writer.cc", "src/expression.cc", "src/facility_cache.cc", "src/message_decoder.cc", "src/rule.cc", "src/telemetry_bus.cc", "src/telemetry_codec.cc", "src/trace.cc" ],
             "include_dirs": [
 				"<!(node -e \"require('nan')\")",
 				"./SimConnect SDK/include"
@@ -12,6 +12,44 @@
                     "../SimConnect SDK/lib/SimConnect"
                 ]
             }
+        },
+        {
+            "target_name": "message_decoder_test",
+            "type": "executable",
+            "sources": [ "test/message_decoder_test.cc", "src/message_decoder.cc" ],
+            "include_dirs": [
+				"./SimConnect SDK/include"
+            ]
+        },
+        {
+            "target_name": "telemetry_codec_test",
+            "type": "executable",
+            "sources": [ "test/telemetry_codec_test.cc", "src/telemetry_codec.cc" ],
+            "include_dirs": [
+				"./SimConnect SDK/include"
+            ]
+        },
+        {
+            "target_name": "telemetry_bus_test",
+            "type": "executable",
+            "sources": [ "test/telemetry_bus_test.cc", "src/telemetry_bus.cc" ],
+            "include_dirs": [
+				"./SimConnect SDK/include"
+            ],
+            "conditions": [
+                [ "OS!='win'", {
+                    "cflags": [ "-pthread" ],
+                    "libraries": [ "-pthread", "-lrt" ]
+                } ]
+            ]
+        },
+        {
+            "target_name": "arrow_writer_test",
+            "type": "executable",
+            "sources": [ "test/arrow_writer_test.cc", "src/arrow_writer.cc" ],
+            "include_dirs": [
+				"./SimConnect SDK/include"
+            ]
         }
     ]
 }
\ No newline at end of file
@@ -55,4 +55,93 @@ simConnectLibrary.period = {
     SECOND: 4,
 }
 
+simConnectLibrary.clientDataPeriod = {
+    NEVER: 0,
+    ONCE: 1,
+    VISUAL_FRAME: 2,
+    ON_SET: 3,
+    SECOND: 4,
+}
+
+simConnectLibrary.clientDataRequestFlag = {
+    DEFAULT: 0,
+    CHANGED: 1,
+    TAGGED: 2
+}
+
+simConnectLibrary.clientDataType = {
+    INT8: -1,
+    INT16: -2,
+    INT32: -3,
+    INT64: -4,
+    FLOAT32: -5,
+    FLOAT64: -6
+}
+
+simConnectLibrary.facilityType = {
+    AIRPORT: 0,
+    WAYPOINT: 1,
+    NDB: 2,
+    VOR: 3
+}
+
+simConnectLibrary.groupPriority = {
+    HIGHEST: 1,
+    HIGHEST_MASKABLE: 10000000,
+    STANDARD: 1900000000,
+    DEFAULT: 2000000000,
+    LOWEST: 4000000000
+}
+
+simConnectLibrary.threadPriority = {
+    LOWEST: -2,
+    BELOW_NORMAL: -1,
+    NORMAL: 0,
+    ABOVE_NORMAL: 1,
+    HIGHEST: 2,
+    TIME_CRITICAL: 15
+}
+
+simConnectLibrary.dispatchLane = {
+    HIGH: 0,
+    NORMAL: 1,
+    LOW: 2
+}
+
+simConnectLibrary.laneTarget = {
+    RECV_ID: 0,
+    REQUEST: 1,
+    EVENT: 2
+}
+
+simConnectLibrary.recvId = {
+    NULL: 0,
+    EXCEPTION: 1,
+    OPEN: 2,
+    QUIT: 3,
+    EVENT: 4,
+    EVENT_OBJECT_ADDREMOVE: 5,
+    EVENT_FILENAME: 6,
+    EVENT_FRAME: 7,
+    SIMOBJECT_DATA: 8,
+    SIMOBJECT_DATA_BYTYPE: 9,
+    WEATHER_OBSERVATION: 10,
+    CLOUD_STATE: 11,
+    ASSIGNED_OBJECT_ID: 12,
+    RESERVED_KEY: 13,
+    CUSTOM_ACTION: 14,
+    SYSTEM_STATE: 15,
+    CLIENT_DATA: 16,
+    EVENT_WEATHER_MODE: 17,
+    AIRPORT_LIST: 18,
+    VOR_LIST: 19,
+    NDB_LIST: 20,
+    WAYPOINT_LIST: 21,
+    EVENT_MULTIPLAYER_SERVER_STARTED: 22,
+    EVENT_MULTIPLAYER_CLIENT_STARTED: 23,
+    EVENT_MULTIPLAYER_SESSION_ENDED: 24,
+    EVENT_RACE_END: 25,
+    EVENT_RACE_LAP: 26
+}
+
 module.exports = simConnectLibrary
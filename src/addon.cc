@@ -1,6 +1,8 @@
 #include "addon.h"
 
 #include <winternl.h>
+#include <algorithm>
+#include <atomic>
 #include <stack>
 
 uv_loop_t *loop;
@@ -8,9 +10,75 @@ uv_async_t async;
 
 std::map<DWORD, DataDefinition> dataDefinitions;
 std::map<DWORD, Nan::Callback *> systemEventCallbacks;
+std::map<DWORD, std::string> systemEventNames; // Subscribed system events, replayed after a reconnect
 std::map<DWORD, Nan::Callback *> systemStateCallbacks;
-std::map<DWORD, Nan::Callback *> dataRequestCallbacks;
+std::map<DWORD, DataRequest> dataRequests;
+std::map<DWORD, SampleStrings> sampleStrings; // By definition id
+std::map<std::string, SIMCONNECT_CLIENT_EVENT_ID> clientEventIds; // Mapped sim events, by name
+std::map<std::string, SIMCONNECT_CLIENT_DATA_ID> clientDataIds; // Mapped client data areas, by name
+std::map<DWORD, ClientDataArea> clientDataAreas;
+std::map<DWORD, ClientDataDefinition> clientDataDefinitions;
+std::map<DWORD, ClientDataRequest> clientDataRequests;
+std::vector<EventRoute> eventRoutes; // Client and input events, indexed by event id
+std::map<DWORD, DWORD> notificationGroupPriorities;
+std::map<DWORD, DWORD> inputGroupPriorities;
+std::map<DWORD, DWORD> inputGroupStates;
+std::vector<uint32_t> eventBatch; // [eventId, data] pairs received since the last frame
+Nan::Callback *eventBatchCallback = NULL;
+SIMCONNECT_CLIENT_EVENT_ID eventBatchEventId;
+std::map<DWORD, AIBatch> aiBatches;
+std::map<DWORD, ObjectRegistry> objectRegistries;
+std::map<DWORD, DWORD> aiRequestBatches; // Batch of every pending AI request, by request id
+std::map<DWORD, DWORD> aiSendRequests; // Request id of every pending AI request, by send id
+std::map<DWORD, DWORD> aiMarkerBatches; // Batch of every removal marker, by request id
+typedef void (*MessageHandler)(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData);
+MessageHandler messageHandlers[messageIdCount]; // Indexed by SIMCONNECT_RECV_ID
+Nan::Callback *messageCallbacks[messageIdCount]; // For messages without dedicated handling
+DecodedMessage decodedMessage; // Reused for every decoded message
+uint64_t unknownMessages;
+uint64_t malformedMessages;
+std::vector<Nan::Callback *> retiredCallbacks;
+static const DWORD sentCallCount = 4096; // Calls that can be in flight before their exceptions lose the origin
+SentCall sentCalls[sentCallCount]; // By packet id modulo sentCallCount
+bool dispatching = false; // A message is being handled by messageReceiver
+uint64_t currentDispatchTime; // Dispatch time of the message being handled
+bool sampleTiming = false; // Pass timing information to data callbacks
+std::map<DWORD, TelemetryEncoder *> telemetryEncoders;
+std::map<DWORD, TelemetryBus *> telemetryBuses;
+std::map<DWORD, ArrowExport> arrowExports;
+std::vector<DatumSlice> sampleSlices; // Reused for every received sample
+uv_timer_t sampleBatchTimer; // Delivers partial sample blocks once their interval is up
+bool sampleBatchTimerInitialized = false;
+uint64_t sampleBatchDeadline = 0; // uv_hrtime() the timer is due, 0 when stopped
+std::map<DWORD, FrameSample> frameSamples; // Samples held back until the end of the frame, by request id
+std::map<DWORD, Nan::Callback *> simFrameCallbacks;
+bool frameBarrier = false;
+SIMCONNECT_CLIENT_EVENT_ID frameBarrierEventId;
 Nan::Callback *errorCallback;
+std::string simVersion; // Application name and version from the open message
+FacilityCache *facilityCache = NULL;
+FacilityDownload *facilityDownload = NULL;
+uv_mutex_t facilityMutex;
+std::map<DWORD, TrajectoryPlayer> trajectoryPlayers;
+SIMCONNECT_CLIENT_EVENT_ID trajectoryEventId; // Frame event, subscribed while there are players
+SIMCONNECT_DATA_DEFINITION_ID trajectoryDefineId = SIMCONNECT_UNUSED;
+uv_mutex_t trajectoryMutex; // The worker plays the trajectories, JS controls them
+uv_mutex_t sendMutex; // Keeps the worker's sends from coming between a call and the read of its packet id
+std::map<SIMCONNECT_DATA_DEFINITION_ID, DefinitionRegistration *> definitionRegistrations; // Not registered yet, JS thread only
+std::vector<DefinitionRegistration *> registrationQueue; // For the worker, guarded by registrationMutex
+std::vector<DefinitionRegistration *> registeredDefinitions; // Back from the worker, guarded by registrationMutex
+std::atomic<bool> registrationsQueued(false);
+uv_mutex_t registrationMutex;
+DispatchLane dispatchLanes[dispatchLaneCount];
+int messageLanes[messageIdCount]; // Lane by message id, unless set by request or event id
+std::map<DWORD, int> requestLanes; // Guarded by laneMutex, like the lanes' messages
+std::map<DWORD, int> eventLanes;
+std::vector<std::vector<char>> spareMessageBuffers; // Re-used for the copies of the messages
+std::atomic<uint32_t> queuedMessages(0);
+static const uint32_t dispatchQueueLimit = 1024; // The worker stops fetching until the main thread catches up
+static const int laneDrainBudget = 64; // Messages per wakeup, before the event loop gets a turn
+std::atomic<bool> slotPending(false); // dispatchData holds an error or a reconnect
+uv_mutex_t laneMutex;
 
 // Special events to listen for from the beginning
 SIMCONNECT_CLIENT_EVENT_ID openEventId;
@@ -21,8 +89,21 @@ SIMCONNECT_CLIENT_EVENT_ID exceptionEventId;
 SIMCONNECT_DATA_DEFINITION_ID defineIdCounter;
 SIMCONNECT_CLIENT_EVENT_ID eventIdCounter;
 SIMCONNECT_DATA_REQUEST_ID requestIdCounter;
-
-std::stack<SIMCONNECT_DATA_REQUEST_ID> unusedReqIds;
+DWORD encoderIdCounter;
+DWORD busIdCounter;
+DWORD arrowIdCounter;
+DWORD simFrameIdCounter;
+DWORD ruleIdCounter;
+DWORD clientDataIdCounter;
+DWORD aiBatchIdCounter;
+DWORD registryIdCounter;
+DWORD trajectoryIdCounter;
+DWORD clientDataDefineIdCounter;
+
+std::deque<SIMCONNECT_DATA_REQUEST_ID> unusedReqIds; // Re-used first in, first out
+static const size_t requestIdQuarantine = dispatchQueueLimit; // Released ids held back, answers to a cancelled request may still be on their way
+std::stack<SIMCONNECT_DATA_DEFINITION_ID> unusedDefineIds;
+std::stack<SIMCONNECT_CLIENT_EVENT_ID> unusedEventIds;
 
 // Semaphores
 uv_sem_t workerSem;
@@ -31,67 +112,233 @@ uv_sem_t eventIdSem;
 uv_sem_t reqIdSem;
 
 
-HANDLE ghSimConnect = NULL;
+std::atomic<HANDLE> ghSimConnect(NULL); // Set by the main thread, read by the worker
+
+// Dispatch worker thread
+uv_thread_t dispatchThread;
+std::atomic<bool> dispatchRunning(false);
+CallbackData dispatchData; // Outlives the thread, a message may still be pending when it stops
+uint32_t dispatchGeneration; // Tells messages of a stopped thread from those of its successor
+bool asyncInitialized = false;
+int dispatchPriority = THREAD_PRIORITY_NORMAL;
+uint64_t dispatchAffinity = 0; // CPU mask, 0 for any
+std::atomic<bool> dispatchPriorityChanged(false);
+
+// Automatic reconnect. The worker re-opens the connection, the main thread replays the state.
+// The backoff is moved on by whichever of them saw the attempt fail.
+std::string connectionAppName;
+std::atomic<bool> autoReconnect(false);
+std::atomic<bool> reconnecting(false);
+std::atomic<HANDLE> lostSimConnect(NULL); // Closed by whichever thread gets to it first
+std::atomic<DWORD> reconnectDelayMin(500);
+std::atomic<DWORD> reconnectDelayMax(30000);
+std::atomic<DWORD> reconnectDelay;
+std::atomic<uint64_t> nextReconnectAttempt; // uv_hrtime()
+uint64_t connectionLostTime;
+std::atomic<DWORD> reconnectAttempts;
+DWORD reconnectCount;
+double lastRecoveryTime = -1; // Milliseconds from losing the connection to having replayed the state
+
+// Waits the current delay before the next attempt and doubles it for the one after
+void scheduleReconnect()
+{
+	DWORD delay = reconnectDelay;
+	nextReconnectAttempt = uv_hrtime() + (uint64_t)delay * 1000000;
+	reconnectDelay = delay * 2 < reconnectDelayMax ? delay * 2 : (DWORD)reconnectDelayMax;
+}
+
+void closeLostConnection()
+{
+	HANDLE hSimConnect = lostSimConnect.exchange(NULL);
+	if (hSimConnect)
+	{
+		SimConnect_Close(hSimConnect);
+	}
+}
 
-class DispatchWorker : public Nan::AsyncWorker
+// Applies the priority and affinity set with setDispatchPriority to the calling thread
+void applyDispatchPriority()
 {
-public:
-	DispatchWorker(Nan::Callback *callback) : AsyncWorker(callback)
+	SetThreadPriority(GetCurrentThread(), dispatchPriority);
+	if (dispatchAffinity)
 	{
+		SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)dispatchAffinity);
 	}
-	~DispatchWorker() {}
+}
+
+// The dispatch worker, on a thread of its own so it does not occupy a slot of the libuv pool
+void dispatchLoop(void *arg)
+{
+	nameTraceThread("dispatch worker");
+	CallbackData &data = dispatchData; // Read by the main thread until it posts workerSem
+	uint32_t generation = dispatchGeneration;
 
-	void Execute()
+	while (dispatchRunning)
 	{
-		uv_async_init(loop, &async, messageReceiver); // Must be called from worker thread
+		if (dispatchPriorityChanged.exchange(false))
+		{
+			applyDispatchPriority();
+		}
 
-		while (true)
+		if (ghSimConnect && registerQueuedDefinitions())
 		{
+			uv_sem_wait(&workerSem);
+			if (!dispatchRunning)
+				break;
+
+			// Handed over before the next fetch, so the packet ids are recorded before any exception for them
+			data.pData = NULL;
+			data.ntstatus = 0;
+			data.hReconnected = NULL;
+			data.definitionsRegistered = true;
+			data.generation = generation;
+			async.data = &data;
+			slotPending = true;
+			uv_async_send(&async);
+			continue;
+		}
 
-			if (ghSimConnect)
-			{
-				uv_sem_wait(&workerSem); // Wait for mainthread to process the previous dispatch
+		if (ghSimConnect && queuedMessages >= dispatchQueueLimit)
+		{
+			Sleep(1); // Fetched no further than the main thread can keep up with
+		}
+		else if (ghSimConnect)
+		{
+			uv_sem_wait(&workerSem); // Wait for mainthread to process what it was handed in dispatchData
+			if (!dispatchRunning)
+				break;
 
-				SIMCONNECT_RECV *pData;
-				DWORD cbData;
+			SIMCONNECT_RECV *pData;
+			DWORD cbData;
 
-				HRESULT hr = SimConnect_GetNextDispatch(ghSimConnect, &pData, &cbData);
+			uint64_t fetchStart = traceEnabled.load(std::memory_order_relaxed) ? uv_hrtime() : 0;
+			HRESULT hr = SimConnect_GetNextDispatch(ghSimConnect, &pData, &cbData);
+			data.dispatchTime = uv_hrtime();
+			if (fetchStart && hr == S_OK)
+			{
+				traceSpan("fetch", fetchStart, data.dispatchTime, "recvId", pData->dwID); // Empty polls are not traced
+			}
 
-				if (SUCCEEDED(hr))
-				{
-					CallbackData data;
-					data.pData = pData;
-					data.cbData = cbData;
-					data.ntstatus = 0;
-					async.data = &data;
-					uv_async_send(&async);
-				}
-				else if (NT_ERROR(hr))
-				{
-					CallbackData data;
-					data.ntstatus = (NTSTATUS)hr;
-					async.data = &data;
-					uv_async_send(&async);
-				}
-				else
-				{
-					uv_sem_post(&workerSem); // Continue
-					Sleep(1);
-				}
+			if (SUCCEEDED(hr) && collectFacilitiesList(pData, cbData))
+			{
+				uv_sem_post(&workerSem); // A page of a facility list, kept by the worker
+			}
+			else if (SUCCEEDED(hr) && tickTrajectories(pData, data.dispatchTime))
+			{
+				uv_sem_post(&workerSem); // Trajectories written, the main thread is not needed
+			}
+			else if (SUCCEEDED(hr))
+			{
+				queueMessage(pData, cbData, data.dispatchTime);
+				uv_sem_post(&workerSem); // The copy is handled by the main thread, fetch the next one
+			}
+			else if (NT_ERROR(hr))
+			{
+				data.pData = NULL;
+				data.ntstatus = (NTSTATUS)hr;
+				data.hReconnected = NULL;
+				data.definitionsRegistered = false;
+				data.generation = generation;
+				async.data = &data;
+				slotPending = true;
+				uv_async_send(&async);
+			}
+			else
+			{
+				uv_sem_post(&workerSem); // Continue
+				Sleep(1);
+			}
+		}
+		else if (reconnecting && uv_hrtime() >= nextReconnectAttempt)
+		{
+			uv_sem_wait(&workerSem);
+			if (!dispatchRunning)
+				break;
+
+			// Checked again, the connection may have been re-opened or closed while waiting
+			HANDLE hSimConnect = NULL;
+			HRESULT hr = E_FAIL;
+			if (reconnecting && !ghSimConnect)
+			{
+				closeLostConnection();
+				hr = SimConnect_Open(&hSimConnect, connectionAppName.c_str(), NULL, 0, 0, 0);
+				reconnectAttempts++;
+			}
+
+			if (SUCCEEDED(hr) && hSimConnect)
+			{
+				data.pData = NULL;
+				data.ntstatus = 0;
+				data.hReconnected = hSimConnect;
+				data.definitionsRegistered = false;
+				data.generation = generation;
+				async.data = &data;
+				slotPending = true;
+				uv_async_send(&async);
 			}
 			else
 			{
-				Sleep(10);
+				scheduleReconnect();
+				uv_sem_post(&workerSem);
 			}
 		}
+		else
+		{
+			Sleep(10);
+		}
 	}
-};
+}
+
+void startDispatchThread()
+{
+	if (dispatchRunning)
+	{
+		return;
+	}
+	if (!asyncInitialized)
+	{
+		uv_async_init(loop, &async, messageReceiver);
+		asyncInitialized = true;
+	}
+	uv_ref((uv_handle_t *)&async); // Keeps node running while connected
+
+	uv_sem_init(&workerSem, 1);
+	dispatchGeneration++;
+	async.data = &dispatchData;
+	dispatchRunning = true;
+	dispatchPriorityChanged = true;
+	uv_thread_create(&dispatchThread, dispatchLoop, NULL);
+}
+
+// Stops the worker before the connection is closed, so no thread is using the handle
+void stopDispatchThread()
+{
+	if (!dispatchRunning.exchange(false))
+	{
+		return;
+	}
+	uv_sem_post(&workerSem); // It may be waiting for a message that will now be skipped
+	uv_thread_join(&dispatchThread);
+	uv_sem_destroy(&workerSem);
+	slotPending = false;
+	clearLanes(); // Messages of the stopped worker are dropped, like its pending dispatch
+	uv_unref((uv_handle_t *)&async);
+}
 
 SIMCONNECT_DATA_DEFINITION_ID getUniqueDefineId()
 {
 	uv_sem_wait(&defineIdSem);
-	SIMCONNECT_DATA_DEFINITION_ID id = defineIdCounter;
-	defineIdCounter++;
+	SIMCONNECT_DATA_DEFINITION_ID id;
+	if (!unusedDefineIds.empty())
+	{
+		id = unusedDefineIds.top();
+		unusedDefineIds.pop();
+	}
+	else
+	{
+		id = defineIdCounter;
+		defineIdCounter++;
+	}
 	uv_sem_post(&defineIdSem);
 	return id;
 }
@@ -99,8 +346,17 @@ SIMCONNECT_DATA_DEFINITION_ID getUniqueDefineId()
 SIMCONNECT_CLIENT_EVENT_ID getUniqueEventId()
 {
 	uv_sem_wait(&eventIdSem);
-	SIMCONNECT_CLIENT_EVENT_ID id = eventIdCounter;
-	eventIdCounter++;
+	SIMCONNECT_CLIENT_EVENT_ID id;
+	if (!unusedEventIds.empty())
+	{
+		id = unusedEventIds.top();
+		unusedEventIds.pop();
+	}
+	else
+	{
+		id = eventIdCounter;
+		eventIdCounter++;
+	}
 	uv_sem_post(&eventIdSem);
 	return id;
 }
@@ -109,10 +365,10 @@ SIMCONNECT_DATA_REQUEST_ID getUniqueRequestId()
 {
 	uv_sem_wait(&reqIdSem);
 	SIMCONNECT_DATA_REQUEST_ID id;
-	if (!unusedReqIds.empty())
+	if (unusedReqIds.size() > requestIdQuarantine)
 	{
-		id = unusedReqIds.top();
-		unusedReqIds.pop();
+		id = unusedReqIds.front();
+		unusedReqIds.pop_front();
 	}
 	else
 	{
@@ -123,6 +379,258 @@ SIMCONNECT_DATA_REQUEST_ID getUniqueRequestId()
 	return id;
 }
 
+void releaseRequestId(SIMCONNECT_DATA_REQUEST_ID id)
+{
+	uv_sem_wait(&reqIdSem);
+	unusedReqIds.push_back(id);
+	uv_sem_post(&reqIdSem);
+}
+
+void releaseDefineId(SIMCONNECT_DATA_DEFINITION_ID id)
+{
+	uv_sem_wait(&defineIdSem);
+	unusedDefineIds.push(id);
+	uv_sem_post(&defineIdSem);
+}
+
+void releaseEventId(SIMCONNECT_CLIENT_EVENT_ID id)
+{
+	uv_sem_wait(&eventIdSem);
+	unusedEventIds.push(id);
+	uv_sem_post(&eventIdSem);
+}
+
+// Callbacks can cancel their own request, so they are deleted once the current message is handled
+void retireCallback(Nan::Callback *callback)
+{
+	retiredCallbacks.push_back(callback);
+}
+
+void freeRetiredCallbacks()
+{
+	for (auto callback : retiredCallbacks)
+		delete callback;
+	retiredCallbacks.clear();
+}
+
+// Sends a call and reads its packet id under sendMutex, as the worker sends trajectories meanwhile.
+// The id is 0 when it could not be read.
+template <typename Send>
+HRESULT sendWithId(HANDLE hSimConnect, Send send, DWORD &sendId)
+{
+	sendId = 0;
+	uv_mutex_lock(&sendMutex);
+	HRESULT hr = send();
+	if (!NT_ERROR(hr) && NT_ERROR(SimConnect_GetLastSentPacketID(hSimConnect, &sendId)))
+		sendId = 0;
+	uv_mutex_unlock(&sendMutex);
+	return hr;
+}
+
+// Sends a call and remembers its packet, the callback is retired when the call fails
+template <typename Send>
+HRESULT sendAndRecord(HANDLE hSimConnect, Send send, const char *call, DWORD id, DWORD index = SIMCONNECT_UNUSED, const char *detail = NULL, Nan::Callback *jsCallback = NULL)
+{
+	DWORD sendId;
+	HRESULT hr = sendWithId(hSimConnect, send, sendId);
+	if (!NT_ERROR(hr) && sendId)
+		recordSentCallId(sendId, call, id, index, detail, jsCallback);
+	else if (jsCallback)
+		retireCallback(jsCallback);
+	return hr;
+}
+
+void recordSentCallId(DWORD sendId, const char *call, DWORD id, DWORD index, const char *detail, Nan::Callback *jsCallback)
+{
+	SentCall &entry = sentCalls[sendId % sentCallCount];
+	if (entry.jsCallback)
+		retireCallback(entry.jsCallback);
+	entry.sendId = sendId;
+	entry.call = call;
+	entry.id = id;
+	entry.index = index;
+	entry.detail.assign(detail ? detail : "");
+	entry.jsCallback = jsCallback;
+}
+
+void releaseSentCalls()
+{
+	for (auto &entry : sentCalls)
+	{
+		if (entry.jsCallback)
+			retireCallback(entry.jsCallback);
+		entry.call = NULL;
+		entry.jsCallback = NULL;
+	}
+}
+
+void releaseReusedSample(DataRequest &request)
+{
+	if (request.reusedSample)
+	{
+		request.reusedSample->Reset();
+		delete request.reusedSample;
+		request.reusedSample = NULL;
+	}
+}
+
+// Frees the callback of a finished or cancelled data request and recycles its id. Samples
+// still collected in a batch are delivered first.
+void releaseDataRequest(SIMCONNECT_DATA_REQUEST_ID reqId)
+{
+	auto request = dataRequests.find(reqId);
+	if (request != dataRequests.end() && request->second.batch)
+	{
+		deliverSampleBatch(Isolate::GetCurrent(), reqId);
+		request = dataRequests.find(reqId); // The callback may have released the request itself
+	}
+	if (request == dataRequests.end())
+	{
+		return;
+	}
+
+	retireCallback(request->second.jsCallback);
+	releaseReusedSample(request->second);
+	delete request->second.batch;
+	if (request->second.ownsDefinition)
+	{
+		if (ghSimConnect)
+		{
+			sendAndRecord(ghSimConnect, [&] { return SimConnect_ClearDataDefinition(ghSimConnect, request->second.defineId); }, "clearDataDefinition", request->second.defineId);
+		}
+		releaseDataDefinition(request->second.defineId);
+	}
+	dataRequests.erase(request);
+	frameSamples.erase(reqId);
+	releaseRequestId(reqId);
+}
+
+// Stops encoders and buses from recording a definition whose id is about to be re-used
+void detachRecorders(SIMCONNECT_DATA_DEFINITION_ID defineId)
+{
+	for (auto &entry : telemetryEncoders)
+		if (defineId == SIMCONNECT_UNUSED || entry.second->defineId == defineId)
+			entry.second->defineId = SIMCONNECT_UNUSED;
+	for (auto &entry : telemetryBuses)
+		if (defineId == SIMCONNECT_UNUSED || entry.second->defineId == defineId)
+			entry.second->defineId = SIMCONNECT_UNUSED;
+	for (auto &entry : arrowExports)
+		if (defineId == SIMCONNECT_UNUSED || entry.second.writer->defineId == defineId)
+			entry.second.writer->defineId = SIMCONNECT_UNUSED;
+}
+
+void releaseDataDefinition(SIMCONNECT_DATA_DEFINITION_ID defineId)
+{
+	auto definition = dataDefinitions.find(defineId);
+	if (definition != dataDefinitions.end())
+	{
+		for (auto &rule : definition->second.rules)
+			retireCallback(rule.jsCallback);
+		dataDefinitions.erase(definition);
+		releaseSampleStrings(defineId);
+		detachRecorders(defineId);
+		releaseDefineId(defineId);
+	}
+}
+
+void releaseSystemEvent(SIMCONNECT_CLIENT_EVENT_ID eventId)
+{
+	auto callback = systemEventCallbacks.find(eventId);
+	if (callback != systemEventCallbacks.end())
+	{
+		retireCallback(callback->second);
+		systemEventCallbacks.erase(callback);
+		systemEventNames.erase(eventId);
+		releaseEventId(eventId);
+	}
+}
+
+// Frees every callback, definition and id, eg. when the connection is closed
+void releaseAll()
+{
+	for (auto &entry : systemEventCallbacks)
+		retireCallback(entry.second);
+	for (auto &entry : systemStateCallbacks)
+		retireCallback(entry.second);
+	for (auto &entry : dataRequests)
+	{
+		retireCallback(entry.second.jsCallback);
+		releaseReusedSample(entry.second);
+		delete entry.second.batch;
+	}
+	for (auto &entry : simFrameCallbacks)
+		retireCallback(entry.second);
+	for (auto &entry : clientDataRequests)
+	{
+		retireCallback(entry.second.jsCallback);
+	}
+	for (auto &entry : dataDefinitions)
+		for (auto &rule : entry.second.rules)
+			retireCallback(rule.jsCallback);
+	for (auto &route : eventRoutes)
+		if (route.active && route.jsCallback)
+			retireCallback(route.jsCallback);
+	if (eventBatchCallback)
+		retireCallback(eventBatchCallback);
+	for (auto &entry : objectRegistries)
+		retireCallback(entry.second.jsCallback);
+	for (DWORD id = 0; id < messageIdCount; id++)
+	{
+		if (messageCallbacks[id])
+			retireCallback(messageCallbacks[id]);
+		messageCallbacks[id] = NULL;
+	}
+	if (errorCallback)
+		retireCallback(errorCallback);
+	releaseSentCalls();
+	releaseTrajectoryPlayers();
+	rejectAIBatches(v8::Isolate::GetCurrent(), "The connection was closed");
+	rejectDefinitionRegistrations(v8::Isolate::GetCurrent(), "The connection was closed");
+	uv_mutex_lock(&laneMutex);
+	requestLanes.clear(); // The ids are handed out again
+	eventLanes.clear();
+	uv_mutex_unlock(&laneMutex);
+	uv_mutex_lock(&facilityMutex);
+	if (facilityDownload)
+	{
+		retireCallback(facilityDownload->jsCallback);
+		delete facilityDownload->cache;
+		delete facilityDownload;
+		facilityDownload = NULL;
+	}
+	uv_mutex_unlock(&facilityMutex);
+	if (!dispatching)
+		freeRetiredCallbacks();
+	systemEventCallbacks.clear();
+	systemEventNames.clear();
+	systemStateCallbacks.clear();
+	dataRequests.clear();
+	dataDefinitions.clear();
+	releaseSampleStrings(SIMCONNECT_UNUSED);
+	simFrameCallbacks.clear();
+	frameSamples.clear();
+	frameBarrier = false;
+	clientEventIds.clear();
+	eventRoutes.clear();
+	notificationGroupPriorities.clear();
+	inputGroupPriorities.clear();
+	inputGroupStates.clear();
+	eventBatch.clear();
+	eventBatchCallback = NULL;
+	clientDataIds.clear();
+	clientDataAreas.clear();
+	clientDataDefinitions.clear();
+	clientDataRequests.clear();
+	objectRegistries.clear();
+	detachRecorders(SIMCONNECT_UNUSED);
+
+	errorCallback = NULL;
+
+	unusedReqIds.clear();
+	unusedDefineIds = std::stack<SIMCONNECT_DATA_DEFINITION_ID>();
+	unusedEventIds = std::stack<SIMCONNECT_CLIENT_EVENT_ID>();
+}
+
 // Runs on main thread after uv_async_send() is called
 void messageReceiver(uv_async_t *handle)
 {
@@ -130,723 +638,5463 @@ void messageReceiver(uv_async_t *handle)
 	Nan::HandleScope scope;
 	v8::Isolate *isolate = v8::Isolate::GetCurrent();
 
+	if (!dispatchRunning)
+	{
+		return; // The worker has been stopped since
+	}
+	if (drainLanes(isolate))
+	{
+		uv_async_send(&async); // More after the event loop had its turn
+	}
+	if (!slotPending.exchange(false))
+	{
+		return;
+	}
+
 	CallbackData *data = (CallbackData *)handle->data;
+	if (!dispatchRunning || data->generation != dispatchGeneration)
+	{
+		return; // Sent by a worker that has been stopped since
+	}
+	if (!ghSimConnect && !data->hReconnected && !data->definitionsRegistered)
+	{
+		uv_sem_post(&workerSem); // From a connection that was lost in the meantime
+		return;
+	}
+	dispatching = true;
+	currentDispatchTime = data->dispatchTime;
 
-	if (NT_SUCCESS(data->ntstatus))
+	if (data->hReconnected)
 	{
-		switch (data->pData->dwID)
-		{
-		case SIMCONNECT_RECV_ID_EVENT:
-			handleReceived_Event(isolate, data->pData, data->cbData);
-			break;
-		case SIMCONNECT_RECV_ID_SIMOBJECT_DATA:
-			handleReceived_Data(isolate, data->pData, data->cbData);
-			break;
-		case SIMCONNECT_RECV_ID_QUIT:
-			handleReceived_Quit(isolate);
-			break;
-		case SIMCONNECT_RECV_ID_EXCEPTION:
-			handleReceived_Exception(isolate, data->pData, data->cbData);
-			break;
-		case SIMCONNECT_RECV_ID_EVENT_FILENAME:
-			handleReceived_Filename(isolate, data->pData, data->cbData);
-			break;
-		case SIMCONNECT_RECV_ID_OPEN:
-			handleReceived_Open(isolate, data->pData, data->cbData);
-			break;
-		case SIMCONNECT_RECV_ID_SYSTEM_STATE:
-			handleReceived_SystemState(isolate, data->pData, data->cbData);
-			break;
-		case SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE:
-			handleReceived_DataByType(isolate, data->pData, data->cbData);
-			break;
-		case SIMCONNECT_RECV_ID_EVENT_FRAME:
-			handleReceived_Frame(isolate, data->pData, data->cbData);
-			break;
-		default:
-			printf("Unexpected message received (dwId: %i)\n", data->pData->dwID);
-			break;
-		}
+		rehydrateConnection(isolate, data->hReconnected);
+	}
+	else if (data->definitionsRegistered)
+	{
+		deliverRegisteredDefinitions(isolate);
 	}
 	else
 	{
 		handle_Error(isolate, data->ntstatus);
 	}
 
+	dispatching = false;
+	freeRetiredCallbacks();
 	uv_sem_post(&workerSem); // The dispatch-worker can now continue
 }
 
-// Handles data requested with requestDataOnSimObject or requestDataOnSimObjectType
-void handleReceived_Data(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+void dispatchMessage(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData, uint64_t dispatchTime)
 {
-	SIMCONNECT_RECV_SIMOBJECT_DATA *pObjData = (SIMCONNECT_RECV_SIMOBJECT_DATA *)pData;
-	int numVars = dataDefinitions[pObjData->dwDefineID].num_values;
-	std::vector<SIMCONNECT_DATATYPE> valTypes = dataDefinitions[pObjData->dwDefineID].datum_types;
-	std::vector<std::string> valIds = dataDefinitions[pObjData->dwDefineID].datum_names;
+	dispatching = true;
+	currentDispatchTime = dispatchTime;
 
-	v8::Local<v8::Context> ctx =  isolate->GetCurrentContext();
-
-	Local<Object> result_list = Object::New(isolate);
-	int dataValueOffset = 0;
-
-	for (int i = 0; i < numVars; i++)
+	DWORD id = pData->dwID;
+	if (traceEnabled.load(std::memory_order_relaxed))
 	{
-		int varSize = 0;
-
-		if (valTypes[i] == SIMCONNECT_DATATYPE_STRINGV)
+		traceSpan("handoff", dispatchTime, uv_hrtime(), "recvId", id); // Worker to main thread
+	}
+	{
+		TraceScope trace("dispatch", "recvId", id);
+		if (id < messageIdCount && messageHandlers[id])
 		{
-			dataValueOffset += 8; // Not really sure why this is needed, but it fixes problems like this: "F-22 RapF-22 Raptor - 525th Fighter Squadron"
-			char *pOutString;
-			DWORD cbString;
-			char *pStringv = ((char *)(&pObjData->dwData));
-			HRESULT hr = SimConnect_RetrieveString(pData, cbData, dataValueOffset + pStringv, &pOutString, &cbString);
-			if (NT_ERROR(hr))
-			{
-				handle_Error(isolate, hr);
-				return;
-			}
-
-			//New to local convertion
-			v8::Local<v8::String> key;
-			v8::MaybeLocal<v8::String> keyTemp = String::NewFromUtf8(isolate, valIds.at(i).c_str());
-			keyTemp.ToLocal(&key);
-
-			try
-			{
-				v8::Local<v8::String> value;
-				v8::MaybeLocal<v8::String> valueTemp = String::NewFromOneByte(isolate, (const uint8_t *)pOutString, v8::NewStringType::kNormal);
-				valueTemp.ToLocal(&value);
-				result_list->Set(ctx, key, value);
-			}
-			catch (...)
-			{
-				v8::Local<v8::String> value;
-				v8::MaybeLocal<v8::String> valueTemp = String::NewFromUtf8(isolate, "ERROR");
-				valueTemp.ToLocal(&value);
-				result_list->Set(ctx, key, value);
-			}
-
-			varSize = cbString;
+			messageHandlers[id](isolate, pData, cbData);
 		}
 		else
 		{
-			//printf("------ %s -----\n", valIds.at(i).c_str());
-			varSize = sizeMap[valTypes[i]];
-			char *p = ((char *)(&pObjData->dwData) + dataValueOffset);
-			double *var = (double *)p;
-			v8::Local<v8::String> key;
-			v8::MaybeLocal<v8::String> keytemp = String::NewFromUtf8(isolate, valIds.at(i).c_str());
-			keytemp.ToLocal(&key);
-			result_list->Set(ctx,key, Number::New(isolate, *var));
+			unknownMessages++;
 		}
-		dataValueOffset += varSize;
 	}
 
-	const int argc = 1;
-	Local<Value> argv[argc] = {
-		result_list};
-	dataRequestCallbacks[pObjData->dwRequestID]->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+	dispatching = false;
+	freeRetiredCallbacks();
 }
 
-void handleReceived_DataByType(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+// Called by the worker with laneMutex held
+int messageLane(const SIMCONNECT_RECV *pData, DWORD cbData)
 {
-	SIMCONNECT_RECV_SIMOBJECT_DATA *pObjData = (SIMCONNECT_RECV_SIMOBJECT_DATA *)pData;
-	handleReceived_Data(isolate, pData, cbData);
-	unusedReqIds.push(pObjData->dwRequestID); // The id can be re-used in next request
+	DWORD id = pData->dwID;
+	if (!requestLanes.empty() && cbData >= sizeof(SIMCONNECT_RECV_SIMOBJECT_DATA) &&
+		(id == SIMCONNECT_RECV_ID_SIMOBJECT_DATA || id == SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE || id == SIMCONNECT_RECV_ID_CLIENT_DATA))
+	{
+		auto lane = requestLanes.find(((const SIMCONNECT_RECV_SIMOBJECT_DATA *)pData)->dwRequestID);
+		if (lane != requestLanes.end())
+			return lane->second;
+	}
+	else if (!eventLanes.empty() && cbData >= sizeof(SIMCONNECT_RECV_EVENT) && isEventMessage(id))
+	{
+		auto lane = eventLanes.find(((const SIMCONNECT_RECV_EVENT *)pData)->uEventID);
+		if (lane != eventLanes.end())
+			return lane->second;
+	}
+	return id < messageIdCount ? messageLanes[id] : LANE_NORMAL;
 }
 
-void handleReceived_Frame(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+// Runs on the worker, which goes on fetching while the main thread handles the copy
+void queueMessage(const SIMCONNECT_RECV *pData, DWORD cbData, uint64_t dispatchTime)
 {
-	SIMCONNECT_RECV_EVENT_FRAME *pFrame = (SIMCONNECT_RECV_EVENT_FRAME *)pData;
-	// printf("frame data recived: %f FPS\n",pFrame->fFrameRate);
-
-	const int argc = 2;
+	QueuedMessage message;
+	uv_mutex_lock(&laneMutex);
+	if (!spareMessageBuffers.empty())
+	{
+		message.bytes.swap(spareMessageBuffers.back());
+		spareMessageBuffers.pop_back();
+	}
+	uv_mutex_unlock(&laneMutex);
 
-	Local<Value> argv[argc] = {
-		Number::New(isolate, pFrame->fFrameRate),
-		Number::New(isolate, pFrame->fSimSpeed)};
+	message.bytes.assign((const char *)pData, (const char *)pData + cbData);
+	message.dispatchTime = dispatchTime;
 
-	systemEventCallbacks[pFrame->uEventID]->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+	uv_mutex_lock(&laneMutex);
+	dispatchLanes[messageLane(pData, cbData)].messages.push_back(std::move(message));
+	queuedMessages++;
+	uv_mutex_unlock(&laneMutex);
+	uv_async_send(&async);
+}
 
-	// Local<Object> obj = Object::New(isolate);
+// Handles queued messages, always from the highest lane that has any. Returns true if
+// the budget ran out before the lanes were empty.
+bool drainLanes(Isolate *isolate)
+{
+	for (int handled = 0; handled < laneDrainBudget; handled++)
+	{
+		QueuedMessage message;
+		int lane = 0;
+		uv_mutex_lock(&laneMutex);
+		while (lane < dispatchLaneCount && dispatchLanes[lane].messages.empty())
+			lane++;
+		if (lane < dispatchLaneCount)
+		{
+			message = std::move(dispatchLanes[lane].messages.front());
+			dispatchLanes[lane].messages.pop_front();
+			queuedMessages--;
+		}
+		uv_mutex_unlock(&laneMutex);
+		if (lane == dispatchLaneCount)
+		{
+			return false;
+		}
 
-	// float   fFrameRate;
-	// float   fSimSpeed;
-	// DWORD   dwFlags;
+		DispatchLane &stats = dispatchLanes[lane];
+		uint64_t latency = uv_hrtime() - message.dispatchTime;
+		int bucket = 0;
+		for (uint64_t microseconds = latency / 1000; microseconds > 0 && bucket < laneLatencyBuckets - 1; microseconds >>= 1)
+			bucket++;
+		stats.latency[bucket]++;
+		stats.delivered++;
+		stats.maxLatency = latency > stats.maxLatency ? latency : stats.maxLatency;
+
+		// Messages of a connection that was lost in the meantime are dropped
+		if (ghSimConnect)
+		{
+			dispatchMessage(isolate, (SIMCONNECT_RECV *)message.bytes.data(), (DWORD)message.bytes.size(), message.dispatchTime);
+		}
 
-	// obj->Set(String::NewFromUtf8(isolate, "float"), Number::New(isolate, pFrame->fFrameRate));
-	// obj->Set(String::NewFromUtf8(isolate, "float"), Number::New(isolate, pFrame->fSimSpeed));
+		uv_mutex_lock(&laneMutex);
+		if (spareMessageBuffers.size() < laneDrainBudget)
+			spareMessageBuffers.push_back(std::move(message.bytes));
+		uv_mutex_unlock(&laneMutex);
 
-	// Local<Value> argv[1] = { obj };
-	// unusedReqIds.push(pFrame->dwRequestID);	// The id can be re-used in next request
+		if (!dispatchRunning)
+		{
+			return false; // Closed by a callback
+		}
+	}
+	return queuedMessages > 0;
 }
 
-void handle_Error(Isolate *isolate, NTSTATUS code)
+void clearLanes()
 {
-	// Codes found so far: 0xC000014B, 0xC000020D, 0xC000013C
-	ghSimConnect = NULL;
-	char errorCode[32];
-	sprintf(errorCode, "0x%08X", code);
+	uv_mutex_lock(&laneMutex);
+	for (auto &lane : dispatchLanes)
+		lane.messages.clear();
+	queuedMessages = 0;
+	uv_mutex_unlock(&laneMutex);
+}
 
-	const int argc = 1;
+void registerMessageHandler(SIMCONNECT_RECV_ID id, MessageHandler handler)
+{
+	messageHandlers[id] = handler;
+}
 
-	//converting from maybeLocal to local
-	v8::Local<v8::String> eleErrorCodeArgc;
-	v8::MaybeLocal<v8::String> tempErrorCode = String::NewFromUtf8(isolate, errorCode);
-	tempErrorCode.ToLocal(&eleErrorCodeArgc);
-	Local<Value> argv[argc] = {eleErrorCodeArgc};
+// Messages without a dedicated handler are decoded and passed on as objects
+void registerMessageHandlers()
+{
+	for (DWORD id = 0; id < messageIdCount; id++)
+		messageHandlers[id] = handleReceived_Message;
+
+	registerMessageHandler(SIMCONNECT_RECV_ID_EVENT, handleReceived_Event);
+	registerMessageHandler(SIMCONNECT_RECV_ID_SIMOBJECT_DATA, handleReceived_Data);
+	registerMessageHandler(SIMCONNECT_RECV_ID_QUIT, handleReceived_Quit);
+	registerMessageHandler(SIMCONNECT_RECV_ID_EXCEPTION, handleReceived_Exception);
+	registerMessageHandler(SIMCONNECT_RECV_ID_EVENT_FILENAME, handleReceived_Filename);
+	registerMessageHandler(SIMCONNECT_RECV_ID_EVENT_OBJECT_ADDREMOVE, handleReceived_ObjectAddRemove);
+	registerMessageHandler(SIMCONNECT_RECV_ID_OPEN, handleReceived_Open);
+	registerMessageHandler(SIMCONNECT_RECV_ID_SYSTEM_STATE, handleReceived_SystemState);
+	registerMessageHandler(SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE, handleReceived_DataByType);
+	registerMessageHandler(SIMCONNECT_RECV_ID_EVENT_FRAME, handleReceived_Frame);
+	registerMessageHandler(SIMCONNECT_RECV_ID_CLIENT_DATA, handleReceived_ClientData);
+	registerMessageHandler(SIMCONNECT_RECV_ID_ASSIGNED_OBJECT_ID, handleReceived_AssignedObjectId);
+	registerMessageHandler(SIMCONNECT_RECV_ID_AIRPORT_LIST, handleReceived_FacilitiesList);
+	registerMessageHandler(SIMCONNECT_RECV_ID_WAYPOINT_LIST, handleReceived_FacilitiesList);
+	registerMessageHandler(SIMCONNECT_RECV_ID_NDB_LIST, handleReceived_FacilitiesList);
+	registerMessageHandler(SIMCONNECT_RECV_ID_VOR_LIST, handleReceived_FacilitiesList);
+}
 
-	errorCallback->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+Local<Value> decodedFieldToValue(Isolate *isolate, const DecodedField &field)
+{
+	switch (field.kind)
+	{
+	case FIELD_STRING:
+		return String::NewFromUtf8(isolate, field.data, v8::NewStringType::kNormal, (int)field.length).ToLocalChecked();
+	case FIELD_BYTES:
+		return Nan::CopyBuffer(field.data, (uint32_t)field.length).ToLocalChecked();
+	default:
+		return Number::New(isolate, field.number);
+	}
 }
 
-void handleReceived_Event(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+// Fields of list entries go to an `entries` array
+Local<Object> decodedMessageToObject(Isolate *isolate, DWORD id, const DecodedMessage &message)
+{
+	Local<Context> ctx = isolate->GetCurrentContext();
+	Local<Object> object = Object::New(isolate);
+	object->Set(ctx, Nan::New("id").ToLocalChecked(), Number::New(isolate, id));
+
+	Local<Array> entries = Array::New(isolate, message.entryCount);
+	Local<Object> entry;
+	int entryIndex = -1;
+	for (auto &field : message.fields)
+	{
+		if (field.entry < 0)
+		{
+			object->Set(ctx, Nan::New(field.name).ToLocalChecked(), decodedFieldToValue(isolate, field));
+			continue;
+		}
+		if (field.entry != entryIndex)
+		{
+			entryIndex = field.entry;
+			entry = Object::New(isolate);
+			entries->Set(ctx, entryIndex, entry);
+		}
+		entry->Set(ctx, Nan::New(field.name).ToLocalChecked(), decodedFieldToValue(isolate, field));
+	}
+	if (message.entryCount > 0)
+	{
+		object->Set(ctx, Nan::New("entries").ToLocalChecked(), entries);
+	}
+	return object;
+}
+
+// Events go to the callback of their subscription with the event data and the decoded message,
+// other messages to the callback set with setMessageCallback
+void handleReceived_Message(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	if (!decodeMessage(pData, cbData, decodedMessage))
+	{
+		malformedMessages++;
+		return;
+	}
+
+	Nan::Callback *callback = messageCallbacks[pData->dwID];
+	if (isEventMessage(pData->dwID))
+	{
+		SIMCONNECT_RECV_EVENT *pEvent = (SIMCONNECT_RECV_EVENT *)pData;
+		auto subscription = systemEventCallbacks.find(pEvent->uEventID);
+		if (subscription != systemEventCallbacks.end())
+		{
+			Local<Value> argv[2] = {
+				Number::New(isolate, pEvent->dwData),
+				decodedMessageToObject(isolate, pData->dwID, decodedMessage)};
+			subscription->second->Call(isolate->GetCurrentContext()->Global(), 2, argv);
+			return;
+		}
+	}
+
+	if (callback)
+	{
+		Local<Value> argv[1] = {decodedMessageToObject(isolate, pData->dwID, decodedMessage)};
+		callback->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+	}
+}
+
+void SetMessageCallback(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	DWORD id = args[0]->Uint32Value(Nan::GetCurrentContext()).FromJust();
+	if (id >= messageIdCount)
+	{
+		Nan::ThrowRangeError("Unknown message id");
+		return;
+	}
+
+	if (messageCallbacks[id])
+	{
+		retireCallback(messageCallbacks[id]);
+		if (!dispatching)
+			freeRetiredCallbacks();
+	}
+	messageCallbacks[id] = args[1]->IsFunction() ? new Nan::Callback(args[1].As<Function>()) : NULL;
+}
+
+// Splits a received SIMOBJECT_DATA payload into one slice per datum of the definition
+HRESULT sliceSample(const DataDefinition &definition, SIMCONNECT_RECV *pData, DWORD cbData, std::vector<DatumSlice> &slices)
+{
+	SIMCONNECT_RECV_SIMOBJECT_DATA *pObjData = (SIMCONNECT_RECV_SIMOBJECT_DATA *)pData;
+	char *pPayload = (char *)(&pObjData->dwData);
+	char *pEnd = (char *)pData + cbData;
+	DWORD dataValueOffset = 0;
+
+	slices.resize(definition.datum_types.size());
+	for (unsigned int i = 0; i < definition.datum_types.size(); i++)
+	{
+		if (definition.datum_types[i] == SIMCONNECT_DATATYPE_STRINGV)
+		{
+			char *pOutString;
+			DWORD cbString;
+			HRESULT hr = SimConnect_RetrieveString(pData, cbData, pPayload + dataValueOffset, &pOutString, &cbString);
+			if (NT_ERROR(hr))
+			{
+				return hr;
+			}
+			slices[i].data = pOutString;
+			slices[i].size = cbString;
+		}
+		else
+		{
+			slices[i].data = pPayload + dataValueOffset;
+			slices[i].size = datumSize(definition.datum_types[i]);
+			if (pPayload + dataValueOffset > pEnd || slices[i].size > (DWORD)(pEnd - (pPayload + dataValueOffset)))
+			{
+				return E_FAIL; // Shorter than the definition
+			}
+		}
+		dataValueOffset += slices[i].size;
+	}
+	return S_OK;
+}
+
+Local<String> newOneByteString(Isolate *isolate, const char *data, size_t length)
+{
+	static const size_t externalStringLength = 1024;
+	v8::Local<v8::String> value;
+	bool created = length >= externalStringLength
+		? String::NewExternalOneByte(isolate, new ExternalOneByteString(data, length)).ToLocal(&value)
+		: String::NewFromOneByte(isolate, (const uint8_t *)data, v8::NewStringType::kNormal, (int)length).ToLocal(&value);
+	return created ? value : Nan::New("ERROR").ToLocalChecked();
+}
+
+// Strings are compared with the previous value of the datum, so values that rarely change
+// (eg. TITLE or ATC MODEL) are only allocated once
+Local<Value> internedDatumToValue(Isolate *isolate, InternedString &interned, const DatumSlice &datum)
+{
+	size_t length = strnlen(datum.data, datum.size);
+	if (interned.value && interned.bytes.size() == length && memcmp(interned.bytes.data(), datum.data, length) == 0)
+	{
+		return Nan::New(*interned.value);
+	}
+
+	Local<String> value = newOneByteString(isolate, datum.data, length);
+	interned.bytes.assign(datum.data, length);
+	if (!interned.value)
+	{
+		interned.value = new Nan::Persistent<String>();
+	}
+	interned.value->Reset(value);
+	return value;
+}
+
+// Frees the strings kept for a definition, or for every definition with SIMCONNECT_UNUSED
+void releaseSampleStrings(SIMCONNECT_DATA_DEFINITION_ID defineId)
+{
+	for (auto entry = sampleStrings.begin(); entry != sampleStrings.end();)
+	{
+		if (defineId != SIMCONNECT_UNUSED && entry->first != defineId)
+		{
+			++entry;
+			continue;
+		}
+		for (auto key : entry->second.keys)
+		{
+			key->Reset();
+			delete key;
+		}
+		for (auto &interned : entry->second.values)
+		{
+			if (interned.value)
+			{
+				interned.value->Reset();
+				delete interned.value;
+			}
+		}
+		if (entry->second.shape)
+		{
+			entry->second.shape->Reset();
+			delete entry->second.shape;
+		}
+		entry = sampleStrings.erase(entry);
+	}
+}
+
+// Converts a received datum to a JS value according to its declared type
+Local<Value> datumToValue(Isolate *isolate, SIMCONNECT_DATATYPE type, const DatumSlice &datum)
+{
+	switch (type)
+	{
+	case SIMCONNECT_DATATYPE_INT32:
+	{
+		int32_t value;
+		memcpy(&value, datum.data, sizeof(value));
+		return Number::New(isolate, value);
+	}
+	case SIMCONNECT_DATATYPE_INT64:
+	{
+		int64_t value;
+		memcpy(&value, datum.data, sizeof(value));
+		return Number::New(isolate, (double)value);
+	}
+	case SIMCONNECT_DATATYPE_FLOAT32:
+	{
+		float value;
+		memcpy(&value, datum.data, sizeof(value));
+		return Number::New(isolate, value);
+	}
+	case SIMCONNECT_DATATYPE_FLOAT64:
+	{
+		double value;
+		memcpy(&value, datum.data, sizeof(value));
+		return Number::New(isolate, value);
+	}
+	default:
+		return newOneByteString(isolate, datum.data, strnlen(datum.data, datum.size));
+	}
+}
+
+// Feeds a decoded sample to the telemetry encoders, buses and Arrow exports attached to its definition
+void recordSample(SIMCONNECT_DATA_DEFINITION_ID defineId, const std::vector<DatumSlice> &slices)
+{
+	if (telemetryEncoders.empty() && telemetryBuses.empty() && arrowExports.empty())
+	{
+		return;
+	}
+
+	int64_t timestamp = telemetryTimestamp(currentDispatchTime);
+	for (auto &entry : telemetryEncoders)
+	{
+		TelemetryEncoder *encoder = entry.second;
+		if (encoder->defineId == defineId)
+		{
+			encoder->beginSample(timestamp);
+			for (auto &slice : slices)
+			{
+				encoder->putDatum(slice.data, slice.size);
+			}
+			encoder->endSample();
+		}
+	}
+	for (auto &entry : telemetryBuses)
+	{
+		if (entry.second->defineId == defineId)
+		{
+			entry.second->publish(timestamp, slices.data());
+		}
+	}
+	for (auto &entry : arrowExports)
+	{
+		ArrowWriter *writer = entry.second.writer;
+		if (writer->defineId == defineId)
+		{
+			writer->beginRow(timestamp);
+			for (auto &slice : slices)
+			{
+				writer->putDatum(slice.data, slice.size);
+			}
+			writer->endRow();
+			if (entry.second.file && writer->pendingRows() >= entry.second.batchSize)
+			{
+				writeArrowExport(entry.second, false);
+			}
+		}
+	}
+}
+
+// Keys of the datums followed by the computed fields, and a template with all of them so every
+// sample of a definition is created with the same shape in one step
+SampleStrings &sampleStringsOf(Isolate *isolate, const DataDefinition &definition)
+{
+	SampleStrings &cached = sampleStrings[definition.id];
+	if (cached.shape)
+	{
+		return cached;
+	}
+
+	Local<ObjectTemplate> shape = ObjectTemplate::New(isolate);
+	std::vector<std::string> names(definition.datum_names);
+	for (auto &field : definition.computed)
+		names.push_back(field.name);
+	for (unsigned int i = 0; i < names.size(); i++)
+	{
+		Local<String> name = Nan::New(names[i]).ToLocalChecked();
+		Nan::Persistent<String> *key = new Nan::Persistent<String>();
+		key->Reset(name);
+		cached.keys.push_back(key);
+		if (i >= definition.datum_names.size() || definition.hidden.empty() || !definition.hidden[i])
+		{
+			shape->Set(name, v8::Undefined(isolate));
+		}
+	}
+	cached.values.resize(definition.datum_names.size(), {std::string(), NULL});
+	cached.shape = new Nan::Persistent<ObjectTemplate>();
+	cached.shape->Reset(shape);
+	return cached;
+}
+
+// Handles data requested with requestDataOnSimObject or requestDataOnSimObjectType.
+// The sample is written into target when given, see setSampleReuse.
+Local<Object> sampleToObject(Isolate *isolate, const DataDefinition &definition, const std::vector<DatumSlice> &slices, const double *computed, Local<Object> target)
+{
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	SampleStrings &cached = sampleStringsOf(isolate, definition);
+	Local<Object> result_list = target.IsEmpty() ? Nan::New(*cached.shape)->NewInstance(ctx).ToLocalChecked() : target;
+
+	for (unsigned int i = 0; i < slices.size(); i++)
+	{
+		if (!definition.hidden.empty() && definition.hidden[i])
+		{
+			continue;
+		}
+
+		Local<Value> value = isStringType(definition.datum_types[i])
+			? internedDatumToValue(isolate, cached.values[i], slices[i])
+			: datumToValue(isolate, definition.datum_types[i], slices[i]);
+		result_list->Set(ctx, Nan::New(*cached.keys[i]), value);
+	}
+
+	for (unsigned int i = 0; computed && i < definition.computed.size(); i++)
+	{
+		result_list->Set(ctx, Nan::New(*cached.keys[slices.size() + i]), Number::New(isolate, computed[i]));
+	}
+
+	return result_list;
+}
+
+// Fills definition.values for the computed fields and rules of a sample.
+// Returns the computed fields, or NULL if there are none.
+const double *evaluateSample(DataDefinition &definition, const std::vector<DatumSlice> &slices)
+{
+	if (definition.computed.empty() && definition.rules.empty())
+	{
+		return NULL;
+	}
+
+	double *values = definition.values.data();
+	for (unsigned int i = 0; i < slices.size(); i++)
+	{
+		values[i] = datumToNumber(definition.datum_types[i], slices[i]);
+	}
+	for (unsigned int i = 0; i < definition.computed.size(); i++)
+	{
+		values[slices.size() + i] = definition.computed[i].expression.evaluate(values);
+	}
+	return definition.computed.empty() ? NULL : values + slices.size();
+}
+
+// Calls back only the rules whose state changed with this sample
+void updateRules(Isolate *isolate, DataDefinition &definition)
+{
+	for (unsigned int i = 0; i < definition.rules.size(); i++)
+	{
+		DataRule &rule = definition.rules[i];
+		if (rule.rule.update(definition.values.data(), currentDispatchTime))
+		{
+			const int argc = 3;
+			Local<Value> argv[argc] = {
+				v8::Boolean::New(isolate, rule.rule.active),
+				Number::New(isolate, rule.rule.value),
+				v8::Integer::New(isolate, rule.id)};
+
+			// The callback may add or remove rules, or clear the whole definition
+			SIMCONNECT_DATA_DEFINITION_ID defineId = definition.id;
+			size_t ruleCount = definition.rules.size();
+			rule.jsCallback->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+
+			auto entry = dataDefinitions.find(defineId);
+			if (entry == dataDefinitions.end() || &entry->second != &definition || definition.rules.size() != ruleCount)
+			{
+				return;
+			}
+		}
+	}
+}
+
+// Keeps a copy of the sample, replacing an earlier sample of the same request in this frame
+void holdFrameSample(SIMCONNECT_DATA_REQUEST_ID reqId, const DataDefinition &definition, const std::vector<DatumSlice> &slices)
+{
+	FrameSample &sample = frameSamples[reqId];
+	sample.defineId = definition.id;
+	sample.computed.assign(definition.values.begin() + (definition.computed.empty() ? definition.values.size() : slices.size()), definition.values.end());
+
+	size_t size = 0;
+	for (auto &slice : slices)
+		size += slice.size;
+	sample.bytes.resize(size);
+	sample.slices.resize(slices.size());
+
+	size_t offset = 0;
+	for (unsigned int i = 0; i < slices.size(); i++)
+	{
+		if (slices[i].size > 0)
+			memcpy(sample.bytes.data() + offset, slices[i].data, slices[i].size);
+		sample.slices[i].data = sample.bytes.data() + offset;
+		sample.slices[i].size = slices[i].size;
+		offset += slices[i].size;
+	}
+}
+
+// Calls every requestSimFrame() callback with the samples held during the frame
+void deliverSimFrame(Isolate *isolate, SIMCONNECT_RECV_EVENT_FRAME *pFrame)
+{
+	if (simFrameCallbacks.empty())
+	{
+		frameSamples.clear();
+		return;
+	}
+
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	Local<Object> data = Object::New(isolate);
+	for (auto &entry : frameSamples)
+	{
+		auto definition = dataDefinitions.find(entry.second.defineId);
+		if (definition != dataDefinitions.end())
+		{
+			data->Set(ctx, entry.first, sampleToObject(isolate, definition->second, entry.second.slices, entry.second.computed.empty() ? NULL : entry.second.computed.data()));
+		}
+	}
+	frameSamples.clear();
+
+	Local<Object> snapshot = Object::New(isolate);
+	snapshot->Set(ctx, Nan::New("frameRate").ToLocalChecked(), Number::New(isolate, pFrame->fFrameRate));
+	snapshot->Set(ctx, Nan::New("simSpeed").ToLocalChecked(), Number::New(isolate, pFrame->fSimSpeed));
+	snapshot->Set(ctx, Nan::New("data").ToLocalChecked(), data);
+
+	// Callbacks are one-shot, those requested during the calls get the next frame
+	std::map<DWORD, Nan::Callback *> callbacks;
+	callbacks.swap(simFrameCallbacks);
+
+	const int argc = 1;
+	Local<Value> argv[argc] = {snapshot};
+	for (auto &entry : callbacks)
+	{
+		entry.second->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+		retireCallback(entry.second);
+	}
+}
+
+void handleReceived_Data(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	SIMCONNECT_RECV_SIMOBJECT_DATA *pObjData = (SIMCONNECT_RECV_SIMOBJECT_DATA *)pData;
+
+	// Data may still arrive for a request or definition that has just been cancelled, or for
+	// an earlier request under the same id
+	auto request = dataRequests.find(pObjData->dwRequestID);
+	auto definitionEntry = dataDefinitions.find(pObjData->dwDefineID);
+	if (request == dataRequests.end() || definitionEntry == dataDefinitions.end() || request->second.defineId != pObjData->dwDefineID)
+	{
+		return;
+	}
+	DataDefinition &definition = definitionEntry->second;
+
+	const double *computed;
+	{
+		TraceScope trace("decode", "requestId", pObjData->dwRequestID);
+		HRESULT hr = sliceSample(definition, pData, cbData, sampleSlices);
+		if (NT_ERROR(hr))
+		{
+			malformedMessages++; // The connection itself is fine
+			return;
+		}
+
+		recordSample(pObjData->dwDefineID, sampleSlices);
+		computed = evaluateSample(definition, sampleSlices);
+	}
+	if (!definition.rules.empty())
+	{
+		updateRules(isolate, definition);
+
+		// A rule callback may have cancelled the request or cleared the definition
+		request = dataRequests.find(pObjData->dwRequestID);
+		definitionEntry = dataDefinitions.find(pObjData->dwDefineID);
+		if (request == dataRequests.end() || definitionEntry == dataDefinitions.end() || &definitionEntry->second != &definition ||
+			request->second.defineId != pObjData->dwDefineID)
+		{
+			return;
+		}
+	}
+
+	if (request->second.registry)
+	{
+		handleRegistryData(isolate, pObjData->dwRequestID, pObjData->dwObjectID, pObjData->dwentrynumber, pObjData->dwoutof, definition, sampleSlices, computed);
+		return;
+	}
+
+	// Requests without a callback only feed rules, encoders and buses
+	if (!request->second.jsCallback)
+	{
+		if (!request->second.byType && request->second.period == SIMCONNECT_PERIOD_ONCE)
+		{
+			releaseDataRequest(pObjData->dwRequestID);
+		}
+		return;
+	}
+
+	if (request->second.batch)
+	{
+		bool oneShot = !request->second.byType && request->second.period == SIMCONNECT_PERIOD_ONCE;
+		appendSampleBatch(isolate, pObjData->dwRequestID, definition, sampleSlices, computed);
+		if (oneShot)
+		{
+			releaseDataRequest(pObjData->dwRequestID); // Delivers the sample
+		}
+		return;
+	}
+
+	// Periodic requests are held back and delivered together at the end of the frame
+	if (frameBarrier && !request->second.byType && request->second.period != SIMCONNECT_PERIOD_ONCE)
+	{
+		holdFrameSample(pObjData->dwRequestID, definition, sampleSlices);
+		return;
+	}
+
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	Local<Object> result_list;
+	if (request->second.reusedSample)
+	{
+		// The same object is updated in place for every sample
+		Nan::Persistent<Object> *reused = request->second.reusedSample;
+		result_list = sampleToObject(isolate, definition, sampleSlices, computed, reused->IsEmpty() ? Local<Object>() : Nan::New(*reused));
+		reused->Reset(result_list);
+	}
+	else
+	{
+		result_list = sampleToObject(isolate, definition, sampleSlices, computed);
+	}
+
+	int argc = 1;
+	Local<Value> argv[2] = {
+		result_list};
+
+	if (sampleTiming)
+	{
+		// Milliseconds on the clock of process.hrtime()
+		Local<Object> timing = Object::New(isolate);
+		uint64_t callbackTime = uv_hrtime();
+		timing->Set(ctx, Nan::New("dispatchTime").ToLocalChecked(), Number::New(isolate, currentDispatchTime / 1e6));
+		timing->Set(ctx, Nan::New("callbackTime").ToLocalChecked(), Number::New(isolate, callbackTime / 1e6));
+		timing->Set(ctx, Nan::New("latency").ToLocalChecked(), Number::New(isolate, (callbackTime - currentDispatchTime) / 1e6));
+		timing->Set(ctx, Nan::New("timestamp").ToLocalChecked(), Number::New(isolate, telemetryTimestamp(currentDispatchTime) / 1e3));
+		if (definition.simTimeIndex >= 0)
+		{
+			timing->Set(ctx, Nan::New("simTime").ToLocalChecked(), datumToValue(isolate, definition.datum_types[definition.simTimeIndex], sampleSlices[definition.simTimeIndex]));
+		}
+		argv[argc++] = timing;
+	}
+
+	bool oneShot = !request->second.byType && request->second.period == SIMCONNECT_PERIOD_ONCE;
+	{
+		TraceScope trace("callback", "requestId", pObjData->dwRequestID);
+		request->second.jsCallback->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+	}
+
+	if (oneShot)
+	{
+		releaseDataRequest(pObjData->dwRequestID); // The id can be re-used in next request
+	}
+}
+
+void handleReceived_DataByType(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	SIMCONNECT_RECV_SIMOBJECT_DATA *pObjData = (SIMCONNECT_RECV_SIMOBJECT_DATA *)pData;
+	auto request = dataRequests.find(pObjData->dwRequestID);
+	bool current = request != dataRequests.end() && request->second.defineId == pObjData->dwDefineID;
+	handleReceived_Data(isolate, pData, cbData);
+	if (current && pObjData->dwentrynumber >= pObjData->dwoutof)
+	{
+		releaseDataRequest(pObjData->dwRequestID); // Last object of the result, the id can be re-used in next request
+	}
+}
+
+void handleReceived_Frame(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	SIMCONNECT_RECV_EVENT_FRAME *pFrame = (SIMCONNECT_RECV_EVENT_FRAME *)pData;
+	// printf("frame data recived: %f FPS\n",pFrame->fFrameRate);
+
+	if (frameBarrier && pFrame->uEventID == frameBarrierEventId)
+	{
+		deliverSimFrame(isolate, pFrame);
+		return;
+	}
+	if (eventBatchCallback && pFrame->uEventID == eventBatchEventId)
+	{
+		flushEventBatch(isolate);
+		return;
+	}
+	if (pFrame->uEventID == trajectoryEventId && !trajectoryPlayers.empty())
+	{
+		deliverTrajectoryEnds(isolate);
+		return;
+	}
+
+	const int argc = 2;
+
+	Local<Value> argv[argc] = {
+		Number::New(isolate, pFrame->fFrameRate),
+		Number::New(isolate, pFrame->fSimSpeed)};
+
+	auto callback = systemEventCallbacks.find(pFrame->uEventID);
+	if (callback != systemEventCallbacks.end())
+	{
+		callback->second->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+	}
+
+	// Local<Object> obj = Object::New(isolate);
+
+	// float   fFrameRate;
+	// float   fSimSpeed;
+	// DWORD   dwFlags;
+
+	// obj->Set(String::NewFromUtf8(isolate, "float"), Number::New(isolate, pFrame->fFrameRate));
+	// obj->Set(String::NewFromUtf8(isolate, "float"), Number::New(isolate, pFrame->fSimSpeed));
+
+	// Local<Value> argv[1] = { obj };
+	// unusedReqIds.push(pFrame->dwRequestID);	// The id can be re-used in next request
+}
+
+// Drops the connection, and with auto-reconnect enabled lets the worker start re-opening it
+void connectionLost()
+{
+	if (!ghSimConnect)
+	{
+		return;
+	}
+
+	lostSimConnect = ghSimConnect.load(); // Closed by the worker, it may still be dispatching on it
+	ghSimConnect = NULL;
+	rejectAIBatches(v8::Isolate::GetCurrent(), "The connection was lost"); // The objects are gone with it
+	dropRegistryObjects();
+	if (autoReconnect)
+	{
+		connectionLostTime = uv_hrtime();
+		reconnectDelay = reconnectDelayMin.load();
+		nextReconnectAttempt = connectionLostTime;
+		reconnecting = true;
+	}
+}
+
+// Replays every definition, event mapping, subscription and request on a re-opened
+// connection with the same ids, so the ids and callbacks held by JS stay valid
+void rehydrateConnection(Isolate *isolate, HANDLE hSimConnect)
+{
+	if (!reconnecting)
+	{
+		// Closed or re-opened from JS while the worker was connecting
+		SimConnect_Close(hSimConnect);
+		return;
+	}
+
+	HRESULT hr = S_OK;
+
+	for (auto &entry : dataDefinitions)
+	{
+		hr = registerDatums(hSimConnect, entry.first, entry.second.datums);
+		if (NT_ERROR(hr))
+			break;
+	}
+	for (auto &entry : clientEventIds)
+	{
+		if (NT_ERROR(hr))
+			break;
+		hr = sendAndRecord(hSimConnect, [&] { return SimConnect_MapClientEventToSimEvent(hSimConnect, entry.second, entry.first.c_str()); }, "mapClientEventToSimEvent", entry.second, SIMCONNECT_UNUSED, entry.first.c_str());
+	}
+	for (auto &entry : systemEventNames)
+	{
+		if (NT_ERROR(hr))
+			break;
+		hr = sendAndRecord(hSimConnect, [&] { return SimConnect_SubscribeToSystemEvent(hSimConnect, entry.first, entry.second.c_str()); }, "subscribeToSystemEvent", entry.first, SIMCONNECT_UNUSED, entry.second.c_str());
+	}
+	if (!NT_ERROR(hr))
+	{
+		hr = replayClientData(hSimConnect);
+	}
+	if (!NT_ERROR(hr))
+	{
+		hr = replayEventRoutes(hSimConnect);
+	}
+	if (!NT_ERROR(hr))
+	{
+		hr = requestFacilitiesLists(hSimConnect);
+	}
+	for (auto &entry : dataRequests)
+	{
+		if (NT_ERROR(hr))
+			break;
+		hr = sendDataRequest(hSimConnect, entry.first, entry.second);
+	}
+	if (!NT_ERROR(hr))
+	{
+		hr = replayObjectRegistries(hSimConnect); // After the requests, it adds requests of its own
+	}
+
+	if (NT_ERROR(hr))
+	{
+		// Try again with a fresh connection
+		lostSimConnect = hSimConnect;
+		scheduleReconnect();
+		return;
+	}
+
+	ghSimConnect = hSimConnect;
+	reconnecting = false;
+	reconnectCount++;
+	lastRecoveryTime = (uv_hrtime() - connectionLostTime) / 1e6;
+	deliverLostObjects(isolate);
+}
+
+void handle_Error(Isolate *isolate, NTSTATUS code)
+{
+	// Codes found so far: 0xC000014B, 0xC000020D, 0xC000013C
+	connectionLost();
+	char errorCode[32];
+	sprintf(errorCode, "0x%08X", code);
+
+	const int argc = 1;
+
+	//converting from maybeLocal to local
+	v8::Local<v8::String> eleErrorCodeArgc;
+	v8::MaybeLocal<v8::String> tempErrorCode = String::NewFromUtf8(isolate, errorCode);
+	tempErrorCode.ToLocal(&eleErrorCodeArgc);
+	Local<Value> argv[argc] = {eleErrorCodeArgc};
+
+	if (errorCallback)
+		errorCallback->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+}
+
+void handleReceived_Event(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
 {
 	SIMCONNECT_RECV_EVENT *myEvent = (SIMCONNECT_RECV_EVENT *)pData;
 
-	const int argc = 1;
-	Local<Value> argv[argc] = {
-		Number::New(isolate, myEvent->dwData)};
+	// Client and input events go straight through the routing table, they are never held back
+	if (myEvent->uEventID < eventRoutes.size() && eventRoutes[myEvent->uEventID].active)
+	{
+		const EventRoute &route = eventRoutes[myEvent->uEventID];
+		if (route.jsCallback)
+		{
+			Local<Value> argv[1] = {Number::New(isolate, myEvent->dwData)};
+			route.jsCallback->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+		}
+		else if (eventBatchCallback)
+		{
+			eventBatch.push_back(myEvent->uEventID);
+			eventBatch.push_back(myEvent->dwData);
+		}
+		return;
+	}
+
+	const int argc = 1;
+	Local<Value> argv[argc] = {
+		Number::New(isolate, myEvent->dwData)};
+
+	auto callback = systemEventCallbacks.find(myEvent->uEventID);
+	if (callback != systemEventCallbacks.end())
+	{
+		callback->second->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+	}
+}
+
+void handleReceived_Exception(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	SIMCONNECT_RECV_EXCEPTION *except = (SIMCONNECT_RECV_EXCEPTION *)pData;
+	if (settleAIException(isolate, except->dwSendID))
+	{
+		return; // Reported through the promise of the AI call
+	}
+
+	v8::Local<v8::Context> ctx =  isolate->GetCurrentContext();
+
+	v8::Local<v8::String> dwException;
+	v8::Local<v8::String> dwSendID;
+	v8::Local<v8::String> dwIndex;
+	v8::Local<v8::String> cpData;
+	v8::Local<v8::String> cpVersion;
+	v8::Local<v8::String> name;
+	v8::Local<v8::String> simConnExeption;
+
+	v8::MaybeLocal<v8::String> dwExceptionTemp = String::NewFromUtf8(isolate, "dwException");
+	v8::MaybeLocal<v8::String> dwSendIDTemp = String::NewFromUtf8(isolate, "dwSendID");
+	v8::MaybeLocal<v8::String> dwIndexTemp = String::NewFromUtf8(isolate, "dwIndex");
+	v8::MaybeLocal<v8::String> cpDataTemp = String::NewFromUtf8(isolate, "cbData");
+	v8::MaybeLocal<v8::String> cpVersionTemp = String::NewFromUtf8(isolate, "cbVersion");
+	v8::MaybeLocal<v8::String> nameTemp = String::NewFromUtf8(isolate, "name");
+	v8::MaybeLocal<v8::String> simConnExeptionTemp = String::NewFromUtf8(isolate, exceptionNames[SIMCONNECT_EXCEPTION(except->dwException)]);
+
+	dwExceptionTemp.ToLocal(&dwException);
+	dwSendIDTemp.ToLocal(&dwSendID);
+	dwIndexTemp.ToLocal(&dwIndex);
+	cpDataTemp.ToLocal(&cpData);
+	cpVersionTemp.ToLocal(&cpVersion);
+	nameTemp.ToLocal(&name);
+	simConnExeptionTemp.ToLocal(&simConnExeption);
+
+
+
+	Local<Object> obj = Object::New(isolate);
+	obj->Set(ctx ,dwException, Number::New(isolate, except->dwException));
+	obj->Set(ctx ,dwSendID, Number::New(isolate, except->dwSendID));
+	obj->Set(ctx ,dwIndex, Number::New(isolate, except->dwIndex));
+	obj->Set(ctx ,cpData, Number::New(isolate, cbData));
+	obj->Set(ctx ,cpVersion, Number::New(isolate, except->dwException));
+	obj->Set(ctx ,name, simConnExeption);
+
+	// The call that caused it, if it is still in the ring
+	Nan::Callback *callback = systemEventCallbacks[exceptionEventId];
+	SentCall &sent = sentCalls[except->dwSendID % sentCallCount];
+	if (sent.call && sent.sendId == except->dwSendID)
+	{
+		obj->Set(ctx, Nan::New("call").ToLocalChecked(), Nan::New(sent.call).ToLocalChecked());
+		obj->Set(ctx, Nan::New("id").ToLocalChecked(), Number::New(isolate, sent.id));
+		if (sent.index != SIMCONNECT_UNUSED)
+		{
+			obj->Set(ctx, Nan::New("datumIndex").ToLocalChecked(), Number::New(isolate, sent.index));
+		}
+		if (!sent.detail.empty())
+		{
+			obj->Set(ctx, Nan::New("detail").ToLocalChecked(), Nan::New(sent.detail).ToLocalChecked());
+		}
+		if (sent.jsCallback)
+		{
+			retireCallback(sent.jsCallback);
+			callback = sent.jsCallback; // Retired callbacks are freed after the dispatch
+		}
+		sent.call = NULL;
+		sent.jsCallback = NULL;
+	}
+
+	Local<Value> argv[1] = {obj};
+
+	callback->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+}
+
+void handleReceived_Filename(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	SIMCONNECT_RECV_EVENT_FILENAME *fileName = (SIMCONNECT_RECV_EVENT_FILENAME *)pData;
+	const int argc = 1;
+	v8::Local<v8::String> eleArgc;
+	v8::MaybeLocal<v8::String> TempEleArgc = String::NewFromUtf8(isolate, (const char *)fileName->szFileName);
+	TempEleArgc.ToLocal(&eleArgc);
+	Local<Value> argv[argc] = {eleArgc};
+
+	auto callback = systemEventCallbacks.find(fileName->uEventID);
+	if (callback != systemEventCallbacks.end())
+	{
+		callback->second->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+	}
+}
+
+void handleReceived_Open(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	SIMCONNECT_RECV_OPEN *pOpen = (SIMCONNECT_RECV_OPEN *)pData;
+
+	char applicationVersion[64];
+	sprintf(applicationVersion, " %d.%d.%d.%d", pOpen->dwApplicationVersionMajor, pOpen->dwApplicationVersionMinor, pOpen->dwApplicationBuildMajor, pOpen->dwApplicationBuildMinor);
+	simVersion = std::string(pOpen->szApplicationName) + applicationVersion;
+
+	char simconnVersion[32];
+	sprintf(simconnVersion, "%d.%d.%d.%d", pOpen->dwSimConnectVersionMajor, pOpen->dwSimConnectVersionMinor, pOpen->dwSimConnectBuildMajor, pOpen->dwSimConnectBuildMinor);
+
+	const int argc = 2;
+	//Convert  to MaybeLocal to local
+	v8::Local<v8::String> simconnVersionArg;
+	v8::MaybeLocal<v8::String> tempSimConn = String::NewFromUtf8(isolate, simconnVersion);
+	tempSimConn.ToLocal(&simconnVersionArg);
+
+
+	Local<Value> argv[argc] = {
+		String::NewFromOneByte(isolate, (const uint8_t *)pOpen->szApplicationName, v8::NewStringType::kNormal).ToLocalChecked(),
+		simconnVersionArg
+		};
+
+	systemEventCallbacks[openEventId]->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+}
+
+void handleReceived_SystemState(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	SIMCONNECT_RECV_SYSTEM_STATE *pState = (SIMCONNECT_RECV_SYSTEM_STATE *)pData;
+	if (settleAIMarker(isolate, pState->dwRequestID))
+	{
+		return;
+	}
+	v8::Local<v8::Context> ctx =  isolate->GetCurrentContext();
+
+	v8::Local<v8::String> integer;
+	v8::Local<v8::String> floatt;
+	v8::Local<v8::String> stringg;
+
+	v8::MaybeLocal<v8::String> integerTemp = String::NewFromUtf8(isolate, "integer");
+	v8::MaybeLocal<v8::String> floattemp = String::NewFromUtf8(isolate, "float");
+	v8::MaybeLocal<v8::String> stringgTemp = String::NewFromUtf8(isolate, "string");
+
+	integerTemp.ToLocal(&integer);
+	floattemp.ToLocal(&floatt);
+	stringgTemp.ToLocal(&stringg);
+	
+
+	Local<Object> obj = Object::New(isolate);
+	obj->Set(ctx ,integer, Number::New(isolate, pState->dwInteger));
+	obj->Set(ctx ,floatt, Number::New(isolate, pState->fFloat));
+	obj->Set(ctx ,stringg, String::NewFromOneByte(isolate, (const uint8_t *)pState->szString, v8::NewStringType::kNormal, (int)strnlen(pState->szString, sizeof(pState->szString))).ToLocalChecked());
+
+	auto callback = systemStateCallbacks.find(pState->dwRequestID);
+	if (callback == systemStateCallbacks.end())
+	{
+		return;
+	}
+
+	Local<Value> argv[1] = {obj};
+	callback->second->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+
+	// System state requests are one-shot
+	retireCallback(callback->second);
+	systemStateCallbacks.erase(callback);
+	releaseRequestId(pState->dwRequestID);
+}
+
+void handleReceived_Quit(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	connectionLost();
+	systemEventCallbacks[quitEventId]->Call(isolate->GetCurrentContext()->Global(), 0, NULL);
+}
+
+void handleSimDisconnect(Isolate *isolate)
+{
+}
+
+// Wrapped SimConnect-functions //////////////////////////////////////////////////////
+void Open(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	stopDispatchThread();
+	uv_sem_init(&defineIdSem, 1);
+	uv_sem_init(&eventIdSem, 1);
+	uv_sem_init(&reqIdSem, 1);
+
+	reconnecting = false;
+	closeLostConnection();
+	releaseAll();
+	defineIdCounter = 0;
+	eventIdCounter = 0;
+	requestIdCounter = 0;
+	clientDataIdCounter = 0;
+	clientDataDefineIdCounter = 0;
+	aiBatchIdCounter = 0;
+	registryIdCounter = 0;
+	trajectoryIdCounter = 0;
+
+	Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+	// Get arguments
+	Nan::Utf8String appName(args[0].As<String>());// Maybe wanted to Maybe<Local>
+	connectionAppName = *appName;
+	//AppName = appName.ToLocalChecked();
+	///char appName = *str
+
+	openEventId = getUniqueEventId();
+	systemEventCallbacks[openEventId] = {new Nan::Callback(args[1].As<Function>())};
+	quitEventId = getUniqueEventId();
+	systemEventCallbacks[quitEventId] = {new Nan::Callback(args[2].As<Function>())};
+	exceptionEventId = getUniqueEventId();
+	systemEventCallbacks[exceptionEventId] = {new Nan::Callback(args[3].As<Function>())};
+	errorCallback = {new Nan::Callback(args[4].As<Function>())};
+
+	// Create dispatch looper thread
+	loop = uv_default_loop();
+	startDispatchThread();
+
+	// Open connection
+	HANDLE hSimConnect = NULL;
+	HRESULT hr = SimConnect_Open(&hSimConnect, *appName, NULL, 0, 0, 0);
+	ghSimConnect = SUCCEEDED(hr) ? hSimConnect : NULL; // Published to the worker once open
+	if (FAILED(hr))
+	{
+		stopDispatchThread();
+	}
+
+	// With a manifest, return the ids of everything it registered
+	if (SUCCEEDED(hr) && args.Length() > 5 && args[5]->IsObject())
+	{
+		Local<Object> handles = registerManifest(isolate, args[5].As<Object>());
+		if (!handles.IsEmpty())
+		{
+			args.GetReturnValue().Set(handles);
+		}
+		return;
+	}
+
+	// Return true if success
+	Local<Boolean> retval = v8::Boolean::New(isolate, SUCCEEDED(hr));
+
+	args.GetReturnValue().Set(retval);
+}
+
+void Close(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	stopDispatchThread();
+
+	if (reconnecting.exchange(false))
+	{
+		closeLostConnection();
+		releaseAll();
+	}
+
+	if (ghSimConnect)
+	{
+		Isolate *isolate = args.GetIsolate();
+		printf("Trying to close..\n");
+		HRESULT hr = SimConnect_Close(ghSimConnect);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		printf("Closed: %i\n", hr);
+		ghSimConnect = NULL;
+		releaseAll();
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
+	}
+}
+
+void isConnected(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	Isolate *isolate = args.GetIsolate();
+	args.GetReturnValue().Set(v8::Boolean::New(isolate, ghSimConnect));
+}
+
+void RequestSystemState(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+		Nan::Utf8String stateName(args[0].As<String>());
+
+		SIMCONNECT_DATA_REQUEST_ID reqId = getUniqueRequestId();
+		systemStateCallbacks[reqId] = new Nan::Callback(args[1].As<Function>());
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_RequestSystemState(ghSimConnect, reqId, *stateName); }, "requestSystemState", reqId, SIMCONNECT_UNUSED, *stateName);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+		args.GetReturnValue().Set(v8::Number::New(isolate, reqId));
+	}
+}
+
+void FlightLoad(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+		Nan::Utf8String szFileName(args[0].As<String>()); //Maybe wanted to Maybe<Local>
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_FlightLoad(ghSimConnect, *szFileName); }, "flightLoad", SIMCONNECT_UNUSED, SIMCONNECT_UNUSED, *szFileName);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
+	}
+}
+
+// Each sim event is mapped once per connection, later calls re-use the id
+HRESULT mapClientEvent(const std::string &eventName, SIMCONNECT_CLIENT_EVENT_ID &eventId)
+{
+	auto mapped = clientEventIds.find(eventName);
+	if (mapped != clientEventIds.end())
+	{
+		eventId = mapped->second;
+		return S_OK;
+	}
+
+	eventId = getUniqueEventId();
+	HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_MapClientEventToSimEvent(ghSimConnect, eventId, eventName.c_str()); }, "mapClientEventToSimEvent", eventId, SIMCONNECT_UNUSED, eventName.c_str());
+	if (NT_ERROR(hr))
+	{
+		releaseEventId(eventId);
+		return hr;
+	}
+	clientEventIds[eventName] = eventId;
+	return hr;
+}
+
+void TransmitClientEvent(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		Isolate *isolate = args.GetIsolate();
+		//v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+		Nan::Utf8String eventName(args[0].As<String>()); // Maybe wanted to Maybe<Local>
+		DWORD data = args.Length() > 1 ? args[1]->Int32Value(Nan::GetCurrentContext()).FromJust() : 0;
+
+		SIMCONNECT_CLIENT_EVENT_ID id;
+		HRESULT hr = mapClientEvent(*eventName, id);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_TransmitClientEvent(ghSimConnect, SIMCONNECT_OBJECT_ID_USER, id, data, SIMCONNECT_GROUP_PRIORITY_HIGHEST, SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY); },
+						   "transmitClientEvent", id, SIMCONNECT_UNUSED, *eventName, args.Length() > 2 && args[2]->IsFunction() ? new Nan::Callback(args[2].As<Function>()) : NULL);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
+	}
+}
+
+void SubscribeToSystemEvent(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		//v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+		SIMCONNECT_CLIENT_EVENT_ID eventId = getUniqueEventId();
+
+		Nan::Utf8String systemEventName(args[0].As<String>());//Maybe wanted to local checked
+		systemEventCallbacks[eventId] = {new Nan::Callback(args[1].As<Function>())};
+		systemEventNames[eventId] = *systemEventName;
+
+		HANDLE hSimConnect = ghSimConnect;
+		HRESULT hr = sendAndRecord(hSimConnect, [&] { return SimConnect_SubscribeToSystemEvent(hSimConnect, eventId, *systemEventName); }, "subscribeToSystemEvent", eventId, SIMCONNECT_UNUSED, *systemEventName);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		args.GetReturnValue().Set(v8::Integer::New(isolate, eventId));
+	}
+}
+
+void RequestDataOnSimObject(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+		DataRequest request = {};
+		request.objectId = args.Length() > 2 ? args[2]->Int32Value(ctx).FromJust() : SIMCONNECT_OBJECT_ID_USER;
+		request.period = SIMCONNECT_PERIOD(args.Length() > 3 ? args[3]->Int32Value(ctx).FromJust() : SIMCONNECT_PERIOD_SIM_FRAME);
+		request.flags = args.Length() > 4 ? args[4]->Int32Value(ctx).FromJust() : 0;
+		request.origin = args.Length() > 5 ? args[5]->Int32Value(ctx).FromJust() : 0;
+		request.interval = args.Length() > 6 ? args[6]->Int32Value(ctx).FromJust() : 0;
+		request.limit = args.Length() > 7 ? args[7]->NumberValue(ctx).FromJust() : 0;
+
+		DataDefinition definition;
+
+		if (args[0]->IsArray())
+		{
+			Local<Array> reqValues = v8::Local<v8::Array>::Cast(args[0]);
+			definition = generateDataDefinition(isolate, ghSimConnect, reqValues);
+			if (definition.id == SIMCONNECT_UNUSED)
+			{
+				return;
+			}
+			dataDefinitions[definition.id] = definition;
+			request.ownsDefinition = true;
+		}
+		else if (args[0]->IsNumber())
+		{
+			SIMCONNECT_DATA_DEFINITION_ID defineId = args[0]->Int32Value(ctx).FromJust();
+			auto found = dataDefinitions.find(defineId);
+			if (found == dataDefinitions.end())
+			{
+				if (!queuePendingRequest(args, defineId, request))
+				{
+					Nan::ThrowError("Unknown data definition");
+				}
+				return;
+			}
+			definition = found->second;
+		}
+
+		SIMCONNECT_DATA_REQUEST_ID reqId = getUniqueRequestId();
+		request.defineId = definition.id;
+		request.jsCallback = args[1]->IsFunction() ? new Nan::Callback(args[1].As<Function>()) : NULL;
+		dataRequests[reqId] = request;
+
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_RequestDataOnSimObject(ghSimConnect, reqId, definition.id, request.objectId, request.period, request.flags, request.origin, request.interval, request.limit); }, "requestDataOnSimObject", reqId);
+		if (NT_ERROR(hr))
+		{
+			releaseDataRequest(reqId);
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		args.GetReturnValue().Set(v8::Integer::New(isolate, reqId));
+	}
+}
+
+void RequestDataOnSimObjectType(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+		DataRequest request = {};
+		request.byType = true;
+		request.radius = args.Length() > 2 ? args[2]->Int32Value(ctx).FromJust() : 0;
+		request.objectType = SIMCONNECT_SIMOBJECT_TYPE(args.Length() > 3 ? args[3]->Int32Value(ctx).FromJust() : SIMCONNECT_SIMOBJECT_TYPE_USER);
+
+		DataDefinition definition;
+
+		if (args[0]->IsArray())
+		{
+			Local<Array> reqValues = v8::Local<v8::Array>::Cast(args[0]);
+			definition = generateDataDefinition(isolate, ghSimConnect, reqValues);
+			if (definition.id == SIMCONNECT_UNUSED)
+			{
+				return;
+			}
+			dataDefinitions[definition.id] = definition;
+			request.ownsDefinition = true;
+		}
+		else if (args[0]->IsNumber())
+		{
+			SIMCONNECT_DATA_DEFINITION_ID defineId = args[0]->Int32Value(ctx).FromJust();
+			auto found = dataDefinitions.find(defineId);
+			if (found == dataDefinitions.end())
+			{
+				if (!queuePendingRequest(args, defineId, request))
+				{
+					Nan::ThrowError("Unknown data definition");
+				}
+				return;
+			}
+			definition = found->second;
+		}
+
+		SIMCONNECT_DATA_REQUEST_ID reqId = getUniqueRequestId();
+		request.defineId = definition.id;
+		request.jsCallback = args[1]->IsFunction() ? new Nan::Callback(args[1].As<Function>()) : NULL;
+		dataRequests[reqId] = request;
+
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_RequestDataOnSimObjectType(ghSimConnect, reqId, definition.id, request.radius, request.objectType); }, "requestDataOnSimObjectType", reqId);
+		if (NT_ERROR(hr))
+		{
+			releaseDataRequest(reqId);
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		args.GetReturnValue().Set(v8::Integer::New(isolate, reqId));
+	}
+}
+
+void CreateDataDefinition(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		Local<Array> reqValues = v8::Local<v8::Array>::Cast(args[0]);
+		DataDefinition definition = generateDataDefinition(isolate, ghSimConnect, reqValues);
+		if (definition.id == SIMCONNECT_UNUSED)
+		{
+			return;
+		}
+		args.GetReturnValue().Set(v8::Number::New(isolate, definition.id));
+		dataDefinitions[definition.id] = definition;
+	}
+}
+
+void SetDataOnSimObject(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+		Nan::Utf8String name(args[0].As<String>());
+		Nan::Utf8String unit(args[1].As<String>());
+
+		double value = args[2]->NumberValue(Nan::GetCurrentContext()).FromJust();
+
+		int objectId = args.Length() > 3 ? args[3]->Int32Value(Nan::GetCurrentContext()).FromMaybe(SIMCONNECT_OBJECT_ID_USER) : SIMCONNECT_OBJECT_ID_USER;
+		int flags = args.Length() > 4 ? args[4]->Int32Value(Nan::GetCurrentContext()).FromJust() : 0;
+
+		SIMCONNECT_DATA_DEFINITION_ID defId = getUniqueDefineId();
+
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_AddToDataDefinition(ghSimConnect, defId, *name, *unit); },
+								   "addToDataDefinition", defId, 0, *name);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		// The set fails as well when the datum could not be added, so its exception reaches the callback either way
+		Nan::Callback *onException = args.Length() > 5 && args[5]->IsFunction() ? new Nan::Callback(args[5].As<Function>()) : NULL;
+		hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_SetDataOnSimObject(ghSimConnect, defId, SIMCONNECT_OBJECT_ID_USER, 0, 0, sizeof(value), &value); },
+						   "setDataOnSimObject", defId, 0, *name, onException);
+		sendAndRecord(ghSimConnect, [&] { return SimConnect_ClearDataDefinition(ghSimConnect, defId); }, "clearDataDefinition", defId);
+		releaseDefineId(defId);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
+	}
+}
+
+// Reads the collection of requested values, eg. [["Plane Latitude", "degrees"], ["ATC MODEL", null, STRINGV]]
+std::vector<DatumDescriptor> parseDatums(Isolate *isolate, Local<Array> requestedValues)
+{
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+	std::vector<DatumDescriptor> datums;
+
+	for (unsigned int i = 0; i < requestedValues->Length(); i++)
+	{
+		Local<Value> entry = requestedValues->Get(ctx, i).ToLocalChecked();
+		if (!entry->IsArray())
+		{
+			continue;
+		}
+
+		Local<Array> value = entry.As<Array>();
+		int len = value->Length();
+		if (len < 2)
+		{
+			continue;
+		}
+
+		DatumDescriptor datum;
+		datum.name = *Nan::Utf8String(value->Get(ctx, 0).ToLocalChecked());
+		Local<Value> units = value->Get(ctx, 1).ToLocalChecked();
+		datum.hasUnits = !units->IsNull() && !units->IsUndefined(); // Should be NULL for string
+		if (datum.hasUnits)
+		{
+			datum.units = *Nan::Utf8String(units);
+		}
+		datum.type = len > 2 ? SIMCONNECT_DATATYPE(value->Get(ctx, 2).ToLocalChecked()->Int32Value(ctx).FromJust()) : SIMCONNECT_DATATYPE_FLOAT64; // Default type (double)
+		datum.epsilon = len > 3 ? (float)value->Get(ctx, 3).ToLocalChecked()->NumberValue(ctx).FromJust() : 0;
+		datum.datumId = len > 4 ? value->Get(ctx, 4).ToLocalChecked()->Uint32Value(ctx).FromJust() : SIMCONNECT_UNUSED;
+		datums.push_back(datum);
+	}
+
+	return datums;
+}
+
+// Adds each datum to the definition exactly once, so the received payload matches the datum list
+HRESULT registerDatums(HANDLE hSimConnect, SIMCONNECT_DATA_DEFINITION_ID definitionId, const std::vector<DatumDescriptor> &datums)
+{
+	for (auto &datum : datums)
+	{
+		HRESULT hr = sendAndRecord(hSimConnect, [&] { return SimConnect_AddToDataDefinition(hSimConnect, definitionId, datum.name.c_str(), datum.hasUnits ? datum.units.c_str() : NULL, datum.type, datum.epsilon, datum.datumId); },
+								   "addToDataDefinition", definitionId, (DWORD)(&datum - datums.data()), datum.name.c_str());
+		if (NT_ERROR(hr))
+		{
+			return hr;
+		}
+	}
+	return S_OK;
+}
+
+DataDefinition describeDataDefinition(SIMCONNECT_DATA_DEFINITION_ID definitionId, const std::vector<DatumDescriptor> &datums)
+{
+	DataDefinition definition = {definitionId, (unsigned int)datums.size()};
+	definition.simTimeIndex = -1;
+	for (auto &datum : datums)
+	{
+		std::string name = datum.name;
+		for (auto &c : name)
+			c = toupper(c);
+		if (definition.simTimeIndex < 0 && (name == "SIMULATION TIME" || name == "ABSOLUTE TIME") && !isStringType(datum.type))
+		{
+			definition.simTimeIndex = (int)definition.datum_names.size();
+		}
+
+		definition.datum_names.push_back(datum.name);
+		definition.datum_types.push_back(datum.type);
+	}
+	definition.datums = datums;
+	return definition;
+}
+
+// Reads the computed fields of the requested values, eg. { name: "groundSpeed", expression: "hypot([VELOCITY WORLD X], [VELOCITY WORLD Z])" }
+std::vector<ComputedField> parseComputedFields(Isolate *isolate, Local<Array> requestedValues)
+{
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+	std::vector<ComputedField> fields;
+
+	for (unsigned int i = 0; i < requestedValues->Length(); i++)
+	{
+		Local<Value> entry = requestedValues->Get(ctx, i).ToLocalChecked();
+		if (!entry->IsObject() || entry->IsArray())
+		{
+			continue;
+		}
+
+		Local<Object> value = entry.As<Object>();
+		Local<Value> expression = value->Get(ctx, Nan::New("expression").ToLocalChecked()).ToLocalChecked();
+		if (!expression->IsString())
+		{
+			continue;
+		}
+
+		ComputedField field;
+		field.name = *Nan::Utf8String(value->Get(ctx, Nan::New("name").ToLocalChecked()).ToLocalChecked());
+		field.source = *Nan::Utf8String(expression);
+		field.replace = value->Get(ctx, Nan::New("replace").ToLocalChecked()).ToLocalChecked()->BooleanValue(isolate);
+		fields.push_back(field);
+	}
+
+	return fields;
+}
+
+// Compiles the computed fields against the datums and the computed fields before them
+bool compileComputedFields(DataDefinition &definition, std::string &error)
+{
+	std::vector<std::string> variables = definition.datum_names;
+	definition.hidden.assign(definition.datum_names.size(), false);
+
+	for (auto &field : definition.computed)
+	{
+		if (!field.expression.compile(field.source, variables, error))
+		{
+			error = "Invalid expression for " + field.name + ": " + error;
+			return false;
+		}
+		if (field.replace)
+		{
+			for (int input : field.expression.inputs())
+				if (input < (int)definition.hidden.size())
+					definition.hidden[input] = true;
+		}
+		variables.push_back(field.name);
+	}
+
+	definition.values.resize(variables.size());
+	return true;
+}
+
+// Parses the requested values into a definition without an id. Throws if a computed field does not compile.
+bool parseDataDefinition(Isolate *isolate, Local<Array> requestedValues, DataDefinition &definition)
+{
+	definition = describeDataDefinition(SIMCONNECT_UNUSED, parseDatums(isolate, requestedValues));
+	definition.computed = parseComputedFields(isolate, requestedValues);
+
+	std::string error;
+	if (!compileComputedFields(definition, error))
+	{
+		Nan::ThrowError(error.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Generates a SimConnect data definition for the collection of requests.
+// The id is SIMCONNECT_UNUSED if the requests are invalid.
+DataDefinition generateDataDefinition(Isolate *isolate, HANDLE hSimConnect, Local<Array> requestedValues)
+{
+	DataDefinition definition;
+	if (!parseDataDefinition(isolate, requestedValues, definition))
+	{
+		return definition;
+	}
+
+	definition.id = getUniqueDefineId();
+	HRESULT hr = registerDatums(hSimConnect, definition.id, definition.datums);
+	if (NT_ERROR(hr))
+	{
+		handle_Error(isolate, hr);
+	}
+
+	return definition;
+}
+
+HRESULT sendDataRequest(HANDLE hSimConnect, SIMCONNECT_DATA_REQUEST_ID reqId, const DataRequest &request)
+{
+	if (request.byType)
+		return SimConnect_RequestDataOnSimObjectType(hSimConnect, reqId, request.defineId, request.radius, request.objectType);
+	return SimConnect_RequestDataOnSimObject(hSimConnect, reqId, request.defineId, request.objectId, request.period, request.flags, request.origin, request.interval, request.limit);
+}
+
+// Runs on the worker. Every datum is added exactly once, each with sendWithId so a call of the
+// JS thread cannot come between it and the read of its packet id.
+bool registerQueuedDefinitions()
+{
+	HANDLE hSimConnect = ghSimConnect;
+	if (!hSimConnect || !registrationsQueued.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	std::vector<DefinitionRegistration *> queued;
+	uv_mutex_lock(&registrationMutex);
+	queued.swap(registrationQueue);
+	registrationsQueued = false;
+	uv_mutex_unlock(&registrationMutex);
+
+	for (auto registration : queued)
+	{
+		DataDefinition &definition = registration->definition;
+		TraceScope trace("register", "defineId", definition.id);
+		registration->hSimConnect = hSimConnect;
+		registration->hr = S_OK;
+		registration->sendIds.clear();
+		for (auto &datum : definition.datums)
+		{
+			DWORD sendId;
+			registration->hr = sendWithId(hSimConnect, [&] { return SimConnect_AddToDataDefinition(hSimConnect, definition.id, datum.name.c_str(), datum.hasUnits ? datum.units.c_str() : NULL, datum.type, datum.epsilon, datum.datumId); }, sendId);
+			if (NT_ERROR(registration->hr))
+			{
+				break;
+			}
+			registration->sendIds.push_back(sendId);
+		}
+	}
+
+	uv_mutex_lock(&registrationMutex);
+	registeredDefinitions.insert(registeredDefinitions.end(), queued.begin(), queued.end());
+	uv_mutex_unlock(&registrationMutex);
+	return !queued.empty();
+}
+
+// Records the packet ids of the definitions registered by the worker, then settles their promises
+// and sends the requests made against them
+void deliverRegisteredDefinitions(Isolate *isolate)
+{
+	std::vector<DefinitionRegistration *> registered;
+	uv_mutex_lock(&registrationMutex);
+	registered.swap(registeredDefinitions);
+	uv_mutex_unlock(&registrationMutex);
+
+	HRESULT requestError = S_OK;
+	std::vector<DefinitionRegistration *> requeued;
+	for (auto registration : registered)
+	{
+		DataDefinition &definition = registration->definition;
+		if (registration->hSimConnect != ghSimConnect)
+		{
+			requeued.push_back(registration); // Registered again once the connection is back
+			continue;
+		}
+
+		for (size_t i = 0; i < registration->sendIds.size(); i++)
+		{
+			if (registration->sendIds[i])
+				recordSentCallId(registration->sendIds[i], "addToDataDefinition", definition.id, (DWORD)i, definition.datums[i].name.c_str(), NULL);
+		}
+		definitionRegistrations.erase(definition.id);
+		settleDefinitionRegistration(isolate, registration, registration->hr, requestError);
+	}
+
+	if (!requeued.empty())
+	{
+		uv_mutex_lock(&registrationMutex);
+		registrationQueue.insert(registrationQueue.begin(), requeued.begin(), requeued.end());
+		registrationsQueued.store(true, std::memory_order_release);
+		uv_mutex_unlock(&registrationMutex);
+	}
+	if (NT_ERROR(requestError))
+	{
+		handle_Error(isolate, requestError);
+	}
+}
+
+// Settles the promise of a registered definition and sends the requests made against it
+void settleDefinitionRegistration(Isolate *isolate, DefinitionRegistration *registration, HRESULT hr, HRESULT &requestError)
+{
+	Local<Context> ctx = isolate->GetCurrentContext();
+	DataDefinition &definition = registration->definition;
+
+	Local<v8::Promise::Resolver> resolver = Nan::New(*registration->resolver);
+	registration->resolver->Reset();
+	delete registration->resolver;
+
+	if (NT_ERROR(hr))
+	{
+		for (auto &queued : registration->queuedRequests)
+		{
+			retireCallback(queued.second.jsCallback);
+			releaseRequestId(queued.first);
+		}
+		releaseDefineId(definition.id);
+		char message[64];
+		sprintf(message, "Could not register the definition: 0x%08X", (unsigned int)hr);
+		resolver->Reject(ctx, Nan::Error(message));
+		delete registration;
+		return;
+	}
+
+	dataDefinitions[definition.id] = definition;
+	for (auto &queued : registration->queuedRequests)
+	{
+		dataRequests[queued.first] = queued.second;
+		if (NT_ERROR(requestError))
+		{
+			continue; // Sent again on reconnect
+		}
+		HRESULT sent = sendAndRecord(ghSimConnect, [&] { return sendDataRequest(ghSimConnect, queued.first, queued.second); },
+									 queued.second.byType ? "requestDataOnSimObjectType" : "requestDataOnSimObject", queued.first);
+		if (NT_ERROR(sent))
+		{
+			releaseDataRequest(queued.first);
+			requestError = sent;
+		}
+	}
+
+	resolver->Resolve(ctx, v8::Integer::New(isolate, definition.id));
+	delete registration;
+}
+
+// The worker is stopped when the connection is closed, so every registration is back on the JS thread
+void rejectDefinitionRegistrations(Isolate *isolate, const char *reason)
+{
+	uv_mutex_lock(&registrationMutex);
+	registrationQueue.clear();
+	registeredDefinitions.clear();
+	registrationsQueued = false;
+	uv_mutex_unlock(&registrationMutex);
+
+	std::map<SIMCONNECT_DATA_DEFINITION_ID, DefinitionRegistration *> registrations;
+	registrations.swap(definitionRegistrations);
+
+	Local<Context> ctx = isolate->GetCurrentContext();
+	for (auto &entry : registrations)
+	{
+		DefinitionRegistration *registration = entry.second;
+		for (auto &queued : registration->queuedRequests)
+		{
+			retireCallback(queued.second.jsCallback);
+			releaseRequestId(queued.first);
+		}
+		releaseDefineId(entry.first);
+
+		Local<v8::Promise::Resolver> resolver = Nan::New(*registration->resolver);
+		registration->resolver->Reset();
+		delete registration->resolver;
+		delete registration;
+		resolver->Reject(ctx, Nan::Error(reason));
+	}
+}
+
+// Requests against a definition that is still being registered wait for it natively
+bool queuePendingRequest(const v8::FunctionCallbackInfo<v8::Value> &args, SIMCONNECT_DATA_DEFINITION_ID defineId, DataRequest &request)
+{
+	auto registration = definitionRegistrations.find(defineId);
+	if (registration == definitionRegistrations.end())
+	{
+		return false;
+	}
+
+	SIMCONNECT_DATA_REQUEST_ID reqId = getUniqueRequestId();
+	request.defineId = defineId;
+	request.jsCallback = args[1]->IsFunction() ? new Nan::Callback(args[1].As<Function>()) : NULL;
+	registration->second->queuedRequests.push_back(std::make_pair(reqId, request));
+	args.GetReturnValue().Set(v8::Integer::New(args.GetIsolate(), reqId));
+	return true;
+}
+
+bool cancelQueuedRequest(SIMCONNECT_DATA_REQUEST_ID reqId)
+{
+	for (auto &entry : definitionRegistrations)
+	{
+		auto &queued = entry.second->queuedRequests;
+		for (auto request = queued.begin(); request != queued.end(); ++request)
+		{
+			if (request->first == reqId)
+			{
+				retireCallback(request->second.jsCallback);
+				releaseRequestId(reqId);
+				queued.erase(request);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void RegisterDataDefinition(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+		if (!args[0]->IsArray())
+		{
+			Nan::ThrowTypeError("Expected an array of simulation variables");
+			return;
+		}
+
+		DefinitionRegistration *registration = new DefinitionRegistration();
+		if (!parseDataDefinition(isolate, args[0].As<Array>(), registration->definition))
+		{
+			delete registration;
+			return;
+		}
+		registration->definition.id = getUniqueDefineId();
+		registration->hSimConnect = NULL;
+		registration->hr = S_OK;
+
+		Local<v8::Promise::Resolver> resolver = v8::Promise::Resolver::New(ctx).ToLocalChecked();
+		registration->resolver = new Nan::Persistent<v8::Promise::Resolver>();
+		registration->resolver->Reset(resolver);
+		definitionRegistrations[registration->definition.id] = registration;
+
+		uv_mutex_lock(&registrationMutex);
+		registrationQueue.push_back(registration);
+		registrationsQueued.store(true, std::memory_order_release);
+		uv_mutex_unlock(&registrationMutex);
+
+		Local<Object> handle = Object::New(isolate);
+		handle->Set(ctx, Nan::New("id").ToLocalChecked(), v8::Integer::New(isolate, registration->definition.id));
+		handle->Set(ctx, Nan::New("ready").ToLocalChecked(), resolver->GetPromise());
+		args.GetReturnValue().Set(handle);
+	}
+}
+
+// Custom useful functions ////////////////////////////////////////////////////////////////////
+SIMCONNECT_DATA_INITPOSITION parseInitPosition(Local<Object> json)
+{
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+	SIMCONNECT_DATA_INITPOSITION init;
+
+	v8::Local<v8::String> altProp = Nan::New("altitude").ToLocalChecked();
+	v8::Local<v8::String> latProp = Nan::New("latitude").ToLocalChecked();
+	v8::Local<v8::String> lngProp = Nan::New("longitude").ToLocalChecked();
+	v8::Local<v8::String> pitchProp = Nan::New("pitch").ToLocalChecked();
+	v8::Local<v8::String> bankProp = Nan::New("bank").ToLocalChecked();
+	v8::Local<v8::String> hdgProp = Nan::New("heading").ToLocalChecked();
+	v8::Local<v8::String> gndProp = Nan::New("onGround").ToLocalChecked();
+	v8::Local<v8::String> iasProp = Nan::New("airspeed").ToLocalChecked();
+
+	init.Altitude = json->HasRealNamedProperty(Nan::GetCurrentContext(), altProp).FromJust()? json->Get(ctx , altProp).ToLocalChecked()->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
+	init.Latitude = json->HasRealNamedProperty(Nan::GetCurrentContext(), latProp).FromJust() ? json->Get(ctx, latProp).ToLocalChecked()->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
+	init.Longitude = json->HasRealNamedProperty(Nan::GetCurrentContext(), lngProp).FromJust() ? json->Get(ctx, lngProp).ToLocalChecked()->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
+	init.Pitch = json->HasRealNamedProperty(Nan::GetCurrentContext(), pitchProp).FromJust() ? json->Get(ctx, pitchProp).ToLocalChecked()->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
+	init.Bank = json->HasRealNamedProperty(Nan::GetCurrentContext(), bankProp).FromJust() ? json->Get(ctx, bankProp).ToLocalChecked()->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
+	init.Heading = json->HasRealNamedProperty(Nan::GetCurrentContext(), hdgProp).FromJust() ? json->Get(ctx, hdgProp).ToLocalChecked()->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
+	init.OnGround = json->HasRealNamedProperty(Nan::GetCurrentContext(), gndProp).FromJust() ? json->Get(ctx, gndProp).ToLocalChecked()->IntegerValue(Nan::GetCurrentContext()).FromJust() : 0;
+	init.Airspeed = json->HasRealNamedProperty(Nan::GetCurrentContext(), iasProp).FromJust() ? json->Get(ctx, iasProp).ToLocalChecked()->IntegerValue(Nan::GetCurrentContext()).FromJust() : 0;
+	return init;
+}
+
+void SetAircraftInitialPosition(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+
+		SIMCONNECT_DATA_INITPOSITION init = parseInitPosition(args[0]->ToObject(ctx).ToLocalChecked());
+
+		SIMCONNECT_DATA_DEFINITION_ID id = getUniqueDefineId();
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_AddToDataDefinition(ghSimConnect, id, "Initial Position", NULL, SIMCONNECT_DATATYPE_INITPOSITION); }, "addToDataDefinition", id);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_SetDataOnSimObject(ghSimConnect, id, SIMCONNECT_OBJECT_ID_USER, 0, 0, sizeof(init), &init); }, "setDataOnSimObject", id);
+		sendAndRecord(ghSimConnect, [&] { return SimConnect_ClearDataDefinition(ghSimConnect, id); }, "clearDataDefinition", id);
+		releaseDefineId(id);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
+	}
+}
+
+void CancelDataRequest(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		SIMCONNECT_DATA_REQUEST_ID reqId = args[0]->Int32Value(Nan::GetCurrentContext()).FromJust();
+
+		auto clientDataRequest = clientDataRequests.find(reqId);
+		if (clientDataRequest != clientDataRequests.end())
+		{
+			HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_RequestClientData(ghSimConnect, clientDataRequest->second.clientDataId, reqId, clientDataRequest->second.defineId, SIMCONNECT_CLIENT_DATA_PERIOD_NEVER); }, "requestClientData", reqId);
+			if (NT_ERROR(hr))
+			{
+				handle_Error(isolate, hr);
+				return;
+			}
+			releaseClientDataRequest(reqId);
+			args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+			return;
+		}
+
+		if (cancelQueuedRequest(reqId))
+		{
+			args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+			return;
+		}
+
+		auto request = dataRequests.find(reqId);
+		if (request == dataRequests.end())
+		{
+			args.GetReturnValue().Set(v8::Boolean::New(isolate, false));
+			return;
+		}
+
+		// Requests by type end by themselves, periodic requests are stopped with PERIOD_NEVER
+		if (!request->second.byType)
+		{
+			HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_RequestDataOnSimObject(ghSimConnect, reqId, request->second.defineId, request->second.objectId, SIMCONNECT_PERIOD_NEVER); }, "requestDataOnSimObject", reqId);
+			if (NT_ERROR(hr))
+			{
+				handle_Error(isolate, hr);
+				return;
+			}
+		}
+
+		releaseDataRequest(reqId);
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+	}
+}
+
+void ClearDataDefinition(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		SIMCONNECT_DATA_DEFINITION_ID defineId = args[0]->Int32Value(Nan::GetCurrentContext()).FromJust();
+
+		bool inUse = false;
+		for (auto &entry : dataRequests)
+			inUse = inUse || entry.second.defineId == defineId;
+
+		if (inUse || dataDefinitions.find(defineId) == dataDefinitions.end())
+		{
+			args.GetReturnValue().Set(v8::Boolean::New(isolate, false));
+			return;
+		}
+
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_ClearDataDefinition(ghSimConnect, defineId); }, "clearDataDefinition", defineId);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		releaseDataDefinition(defineId);
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+	}
+}
+
+void UnsubscribeFromSystemEvent(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		SIMCONNECT_CLIENT_EVENT_ID eventId = args[0]->Int32Value(Nan::GetCurrentContext()).FromJust();
+
+		// The callbacks given to open() live as long as the connection
+		if (eventId == openEventId || eventId == quitEventId || eventId == exceptionEventId || systemEventCallbacks.find(eventId) == systemEventCallbacks.end())
+		{
+			args.GetReturnValue().Set(v8::Boolean::New(isolate, false));
+			return;
+		}
+
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_UnsubscribeFromSystemEvent(ghSimConnect, eventId); }, "unsubscribeFromSystemEvent", eventId);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		releaseSystemEvent(eventId);
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+	}
+}
+
+void SetAutoReconnect(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+	autoReconnect = args[0]->BooleanValue(args.GetIsolate());
+	reconnectDelayMin = args.Length() > 1 && args[1]->IsNumber() ? args[1]->Uint32Value(ctx).FromJust() : 500;
+	reconnectDelayMax = args.Length() > 2 && args[2]->IsNumber() ? args[2]->Uint32Value(ctx).FromJust() : 30000;
+	if (reconnectDelayMax < reconnectDelayMin)
+	{
+		reconnectDelayMax = reconnectDelayMin.load();
+	}
+	if (!autoReconnect)
+	{
+		reconnecting = false;
+	}
+}
+
+// Applied by the dispatch thread before its next dispatch
+void SetDispatchPriority(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+	dispatchPriority = args.Length() > 0 && args[0]->IsNumber() ? args[0]->Int32Value(ctx).FromJust() : THREAD_PRIORITY_NORMAL;
+	dispatchAffinity = args.Length() > 1 && args[1]->IsNumber() ? (uint64_t)args[1]->IntegerValue(ctx).FromJust() : 0;
+	dispatchPriorityChanged = true;
+}
+
+// Puts the messages of a recvId, a request or a client event into a lane, for messages fetched from then on
+void SetDispatchLane(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+	int target = args[0]->Int32Value(ctx).FromJust();
+	DWORD id = args[1]->Uint32Value(ctx).FromJust();
+	int lane = args[2]->Int32Value(ctx).FromJust();
+	if (lane < 0 || lane >= dispatchLaneCount || target < 0 || target > 2 || (target == 0 && id >= messageIdCount))
+	{
+		Nan::ThrowRangeError("Unknown lane or message id");
+		return;
+	}
+
+	uv_mutex_lock(&laneMutex);
+	if (target == 0)
+		messageLanes[id] = lane;
+	else if (target == 1)
+		requestLanes[id] = lane;
+	else
+		eventLanes[id] = lane;
+	uv_mutex_unlock(&laneMutex);
+}
+
+void SetFrameBarrier(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		bool enabled = args[0]->BooleanValue(isolate);
+		if (enabled == frameBarrier)
+		{
+			return;
+		}
+
+		HRESULT hr;
+		if (enabled)
+		{
+			// The frame event marks the end of the samples belonging to a frame
+			frameBarrierEventId = getUniqueEventId();
+			systemEventNames[frameBarrierEventId] = "Frame";
+			hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_SubscribeToSystemEvent(ghSimConnect, frameBarrierEventId, "Frame"); }, "subscribeToSystemEvent", frameBarrierEventId, SIMCONNECT_UNUSED, "Frame");
+		}
+		else
+		{
+			hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_UnsubscribeFromSystemEvent(ghSimConnect, frameBarrierEventId); }, "unsubscribeFromSystemEvent", frameBarrierEventId, SIMCONNECT_UNUSED, "Frame");
+			systemEventNames.erase(frameBarrierEventId);
+			releaseEventId(frameBarrierEventId);
+			frameSamples.clear();
+		}
+		frameBarrier = enabled;
+
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+	}
+}
+
+void RequestSimFrame(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	if (!args[0]->IsFunction())
+	{
+		Nan::ThrowTypeError("requestSimFrame needs a callback");
+		return;
+	}
+
+	DWORD id = ++simFrameIdCounter;
+	simFrameCallbacks[id] = new Nan::Callback(args[0].As<Function>());
+	args.GetReturnValue().Set(v8::Integer::New(isolate, id));
+}
+
+void CancelSimFrame(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	auto callback = simFrameCallbacks.find(args[0]->Uint32Value(Nan::GetCurrentContext()).FromJust());
+	if (callback == simFrameCallbacks.end())
+	{
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, false));
+		return;
+	}
+
+	retireCallback(callback->second);
+	simFrameCallbacks.erase(callback);
+	args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+}
+
+void AddRule(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+	auto definition = dataDefinitions.find(args[0]->Uint32Value(ctx).FromJust());
+	if (definition == dataDefinitions.end())
+	{
+		Nan::ThrowError("Unknown data definition");
+		return;
+	}
+	if (!args[1]->IsObject() || !args[2]->IsFunction())
+	{
+		Nan::ThrowTypeError("addRule needs a definition id, a rule and a callback");
+		return;
+	}
+
+	Local<Object> options = args[1].As<Object>();
+	Local<Value> above = options->Get(ctx, Nan::New("above").ToLocalChecked()).ToLocalChecked();
+	Local<Value> below = options->Get(ctx, Nan::New("below").ToLocalChecked()).ToLocalChecked();
+	Local<Value> hysteresis = options->Get(ctx, Nan::New("hysteresis").ToLocalChecked()).ToLocalChecked();
+	Local<Value> minDuration = options->Get(ctx, Nan::New("minDuration").ToLocalChecked()).ToLocalChecked();
+	Local<Value> clearDuration = options->Get(ctx, Nan::New("clearDuration").ToLocalChecked()).ToLocalChecked();
+
+	DataRule rule;
+	rule.id = ++ruleIdCounter;
+	if (above->IsNumber())
+	{
+		rule.rule.mode = RULE_ABOVE;
+		rule.rule.threshold = above->NumberValue(ctx).FromJust();
+	}
+	else if (below->IsNumber())
+	{
+		rule.rule.mode = RULE_BELOW;
+		rule.rule.threshold = below->NumberValue(ctx).FromJust();
+	}
+	rule.rule.hysteresis = hysteresis->IsNumber() ? hysteresis->NumberValue(ctx).FromJust() : 0;
+	rule.rule.minDuration = minDuration->IsNumber() ? (uint64_t)(minDuration->NumberValue(ctx).FromJust() * 1e6) : 0;
+	rule.rule.clearDuration = clearDuration->IsNumber() ? (uint64_t)(clearDuration->NumberValue(ctx).FromJust() * 1e6) : 0;
+
+	// Rules see the datums and the computed fields of the definition
+	std::vector<std::string> variables = definition->second.datum_names;
+	for (auto &field : definition->second.computed)
+		variables.push_back(field.name);
+
+	std::string error;
+	Nan::Utf8String expression(options->Get(ctx, Nan::New("expression").ToLocalChecked()).ToLocalChecked());
+	if (!rule.rule.compile(*expression, variables, error))
+	{
+		Nan::ThrowError(("Invalid rule expression: " + error).c_str());
+		return;
+	}
+
+	rule.jsCallback = new Nan::Callback(args[2].As<Function>());
+	definition->second.rules.push_back(rule);
+	args.GetReturnValue().Set(v8::Integer::New(isolate, rule.id));
+}
+
+void RemoveRule(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	DWORD ruleId = args[0]->Uint32Value(Nan::GetCurrentContext()).FromJust();
+
+	for (auto &entry : dataDefinitions)
+	{
+		std::vector<DataRule> &rules = entry.second.rules;
+		for (auto rule = rules.begin(); rule != rules.end(); ++rule)
+		{
+			if (rule->id == ruleId)
+			{
+				retireCallback(rule->jsCallback);
+				rules.erase(rule);
+				args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+				return;
+			}
+		}
+	}
+	args.GetReturnValue().Set(v8::Boolean::New(isolate, false));
+}
+
+void SetSampleTiming(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	sampleTiming = args[0]->BooleanValue(args.GetIsolate());
+}
+
+// Numeric columns are widened to Float64Array, strings become arrays
+Local<Value> batchColumn(Isolate *isolate, SIMCONNECT_DATATYPE type, const SampleBatch &batch, unsigned int index)
+{
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	if (isStringType(type))
+	{
+		const std::vector<std::string> &values = batch.strings[index];
+		Local<Array> column = Array::New(isolate, (int)values.size());
+		Local<String> value;
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			if (i == 0 || values[i] != values[i - 1])
+				value = newOneByteString(isolate, values[i].data(), values[i].size());
+			column->Set(ctx, (uint32_t)i, value);
+		}
+		return column;
+	}
+
+	Local<Float64Array> column = Float64Array::New(ArrayBuffer::New(isolate, batch.count * sizeof(double)), 0, batch.count);
+	Nan::TypedArrayContents<double> out(column);
+	widenDatums(type, batch.columns[index].data(), batch.count, *out);
+	return column;
+}
+
+Local<Float64Array> newFloat64Column(Isolate *isolate, const std::vector<double> &values)
+{
+	Local<Float64Array> column = Float64Array::New(ArrayBuffer::New(isolate, values.size() * sizeof(double)), 0, values.size());
+	Nan::TypedArrayContents<double> out(column);
+	if (!values.empty())
+		memcpy(*out, values.data(), values.size() * sizeof(double));
+	return column;
+}
+
+// Calls the callback of the request with the samples collected so far
+void deliverSampleBatch(Isolate *isolate, SIMCONNECT_DATA_REQUEST_ID reqId)
+{
+	auto request = dataRequests.find(reqId);
+	auto definitionEntry = request != dataRequests.end() ? dataDefinitions.find(request->second.defineId) : dataDefinitions.end();
+	if (definitionEntry == dataDefinitions.end() || !request->second.batch || request->second.batch->count == 0)
+	{
+		return;
+	}
+	const DataDefinition &definition = definitionEntry->second;
+	SampleBatch &batch = *request->second.batch;
+	SampleStrings &cached = sampleStringsOf(isolate, definition);
+
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	Local<Object> block = Object::New(isolate);
+	block->Set(ctx, Nan::New("timestamps").ToLocalChecked(), newFloat64Column(isolate, batch.timestamps));
+	for (unsigned int i = 0; i < definition.datum_types.size(); i++)
+	{
+		if (definition.hidden.empty() || !definition.hidden[i])
+			block->Set(ctx, Nan::New(*cached.keys[i]), batchColumn(isolate, definition.datum_types[i], batch, i));
+	}
+	for (unsigned int i = 0; i < batch.computed.size(); i++)
+	{
+		block->Set(ctx, Nan::New(*cached.keys[definition.datum_types.size() + i]), newFloat64Column(isolate, batch.computed[i]));
+	}
+
+	Local<Value> argv[2] = {block, Number::New(isolate, batch.count)};
+	batch.count = 0;
+	batch.timestamps.clear();
+	for (auto &column : batch.columns)
+		column.clear();
+	for (auto &column : batch.strings)
+		column.clear();
+	for (auto &column : batch.computed)
+		column.clear();
+	request->second.jsCallback->Call(isolate->GetCurrentContext()->Global(), 2, argv);
+}
+
+void appendSampleBatch(Isolate *isolate, SIMCONNECT_DATA_REQUEST_ID reqId, const DataDefinition &definition, const std::vector<DatumSlice> &slices, const double *computed)
+{
+	SampleBatch &batch = *dataRequests[reqId].batch;
+	if (batch.count == 0)
+	{
+		batch.started = currentDispatchTime;
+	}
+
+	batch.timestamps.push_back(telemetryTimestamp(currentDispatchTime) / 1e3);
+	for (unsigned int i = 0; i < slices.size(); i++)
+	{
+		if (!definition.hidden.empty() && definition.hidden[i])
+			continue;
+		if (isStringType(definition.datum_types[i]))
+			batch.strings[i].push_back(std::string(slices[i].data, strnlen(slices[i].data, slices[i].size)));
+		else
+			batch.columns[i].insert(batch.columns[i].end(), slices[i].data, slices[i].data + slices[i].size);
+	}
+	for (unsigned int i = 0; computed && i < batch.computed.size(); i++)
+	{
+		batch.computed[i].push_back(computed[i]);
+	}
+	batch.count++;
+
+	if (batch.count >= batch.size || (batch.interval && currentDispatchTime - batch.started >= batch.interval))
+	{
+		deliverSampleBatch(isolate, reqId);
+	}
+	else if (batch.count == 1 && batch.interval)
+	{
+		scheduleSampleBatches(batch.started + batch.interval);
+	}
+}
+
+// Wakes up at the earliest deadline of the partial blocks, so they are delivered after
+// intervalMs even when no further sample arrives
+void scheduleSampleBatches(uint64_t deadline)
+{
+	if (!sampleBatchTimerInitialized)
+	{
+		uv_timer_init(loop, &sampleBatchTimer);
+		uv_unref((uv_handle_t *)&sampleBatchTimer);
+		sampleBatchTimerInitialized = true;
+	}
+	if (sampleBatchDeadline && sampleBatchDeadline <= deadline)
+	{
+		return; // Rescheduled when it fires
+	}
+	sampleBatchDeadline = deadline;
+	uint64_t now = uv_hrtime();
+	uv_timer_start(&sampleBatchTimer, deliverDueSampleBatches, deadline > now ? (deadline - now + 999999) / 1000000 : 0, 0);
+}
+
+void deliverDueSampleBatches(uv_timer_t *handle)
+{
+	Nan::HandleScope scope;
+	Isolate *isolate = Isolate::GetCurrent();
+
+	uint64_t now = uv_hrtime();
+	uint64_t next = 0;
+	std::vector<SIMCONNECT_DATA_REQUEST_ID> due;
+	for (auto &entry : dataRequests)
+	{
+		SampleBatch *batch = entry.second.batch;
+		if (!batch || !batch->interval || batch->count == 0)
+			continue;
+		uint64_t deadline = batch->started + batch->interval;
+		if (deadline <= now)
+			due.push_back(entry.first);
+		else if (!next || deadline < next)
+			next = deadline;
+	}
+
+	dispatching = true;
+	for (auto reqId : due)
+	{
+		deliverSampleBatch(isolate, reqId); // Skips requests a callback has released meanwhile
+	}
+	dispatching = false;
+	freeRetiredCallbacks();
+
+	sampleBatchDeadline = 0;
+	if (next)
+	{
+		scheduleSampleBatches(next);
+	}
+}
+
+// Samples of the request are delivered in blocks of size samples, or after intervalMs with
+// fewer. A size of 0 delivers what has been collected and goes back to one call per sample.
+void SetSampleBatch(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+	SIMCONNECT_DATA_REQUEST_ID reqId = args[0]->Uint32Value(ctx).FromJust();
+	auto request = dataRequests.find(reqId);
+	auto definition = request != dataRequests.end() ? dataDefinitions.find(request->second.defineId) : dataDefinitions.end();
+	if (definition == dataDefinitions.end() || !request->second.jsCallback)
+	{
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, false));
+		return;
+	}
+
+	DWORD size = args[1]->Uint32Value(ctx).FromJust();
+	double interval = args.Length() > 2 && args[2]->IsNumber() ? args[2]->NumberValue(ctx).FromJust() : 0;
+	if (size == 0)
+	{
+		deliverSampleBatch(isolate, reqId);
+		request = dataRequests.find(reqId); // The callback may have cancelled the request
+		if (request != dataRequests.end())
+		{
+			delete request->second.batch;
+			request->second.batch = NULL;
+		}
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+		return;
+	}
+
+	if (!request->second.batch)
+	{
+		SampleBatch *batch = new SampleBatch();
+		batch->count = 0;
+		batch->columns.resize(definition->second.datum_types.size());
+		batch->strings.resize(definition->second.datum_types.size());
+		batch->computed.resize(definition->second.computed.size());
+		request->second.batch = batch;
+	}
+	SampleBatch &batch = *request->second.batch;
+	batch.size = size;
+	batch.interval = interval > 0 ? (uint64_t)(interval * 1e6) : 0;
+	batch.timestamps.reserve(size);
+	for (unsigned int i = 0; i < batch.columns.size(); i++)
+	{
+		if (!isStringType(definition->second.datum_types[i]))
+			batch.columns[i].reserve(size * datumSize(definition->second.datum_types[i]));
+	}
+	args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+}
+
+// With reuse on, a request delivers the same object every time, updated in place
+void SetSampleReuse(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	auto request = dataRequests.find(args[0]->Uint32Value(Nan::GetCurrentContext()).FromJust());
+	if (request == dataRequests.end())
+	{
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, false));
+		return;
+	}
+
+	bool enabled = args[1]->BooleanValue(isolate);
+	if (enabled && !request->second.reusedSample)
+	{
+		request->second.reusedSample = new Nan::Persistent<Object>();
+	}
+	else if (!enabled)
+	{
+		releaseReusedSample(request->second);
+	}
+	args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+}
+
+void SetTracing(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	traceEnabled = args[0]->BooleanValue(args.GetIsolate());
+}
+
+// Spans of the last `seconds` (all that are still in the rings by default) as Chrome trace-event JSON
+void DumpTrace(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	double seconds = args.Length() > 0 && args[0]->IsNumber() ? args[0]->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
+	uint64_t now = uv_hrtime();
+	uint64_t window = (uint64_t)(seconds * 1e9);
+	std::string trace = dumpTrace(seconds > 0 && window < now ? now - window : 0);
+	args.GetReturnValue().Set(Nan::New(trace).ToLocalChecked());
+}
+
+void GetMetrics(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+	Local<Object> metrics = Object::New(isolate);
+	metrics->Set(ctx, Nan::New("connected").ToLocalChecked(), v8::Boolean::New(isolate, ghSimConnect != NULL));
+	metrics->Set(ctx, Nan::New("reconnecting").ToLocalChecked(), v8::Boolean::New(isolate, reconnecting));
+	metrics->Set(ctx, Nan::New("reconnects").ToLocalChecked(), v8::Number::New(isolate, reconnectCount));
+	metrics->Set(ctx, Nan::New("reconnectAttempts").ToLocalChecked(), v8::Number::New(isolate, reconnectAttempts));
+	metrics->Set(ctx, Nan::New("lastRecoveryTime").ToLocalChecked(), lastRecoveryTime < 0 ? (Local<Value>)Nan::Null() : (Local<Value>)v8::Number::New(isolate, lastRecoveryTime));
+	metrics->Set(ctx, Nan::New("dataRequests").ToLocalChecked(), v8::Number::New(isolate, dataRequests.size()));
+	metrics->Set(ctx, Nan::New("dataDefinitions").ToLocalChecked(), v8::Number::New(isolate, dataDefinitions.size()));
+	metrics->Set(ctx, Nan::New("unknownMessages").ToLocalChecked(), v8::Number::New(isolate, (double)unknownMessages));
+	metrics->Set(ctx, Nan::New("malformedMessages").ToLocalChecked(), v8::Number::New(isolate, (double)malformedMessages));
+
+	Local<Array> lanes = Array::New(isolate, dispatchLaneCount);
+	uv_mutex_lock(&laneMutex);
+	for (int i = 0; i < dispatchLaneCount; i++)
+	{
+		DispatchLane &lane = dispatchLanes[i];
+		Local<Array> latency = Array::New(isolate, laneLatencyBuckets);
+		for (int bucket = 0; bucket < laneLatencyBuckets; bucket++)
+			latency->Set(ctx, bucket, v8::Number::New(isolate, (double)lane.latency[bucket]));
+
+		Local<Object> entry = Object::New(isolate);
+		entry->Set(ctx, Nan::New("queued").ToLocalChecked(), v8::Number::New(isolate, (double)lane.messages.size()));
+		entry->Set(ctx, Nan::New("delivered").ToLocalChecked(), v8::Number::New(isolate, (double)lane.delivered));
+		entry->Set(ctx, Nan::New("maxLatency").ToLocalChecked(), v8::Number::New(isolate, lane.maxLatency / 1e6));
+		entry->Set(ctx, Nan::New("latency").ToLocalChecked(), latency);
+		lanes->Set(ctx, i, entry);
+	}
+	uv_mutex_unlock(&laneMutex);
+	metrics->Set(ctx, Nan::New("lanes").ToLocalChecked(), lanes);
+	args.GetReturnValue().Set(metrics);
+}
+
+// Client data ///////////////////////////////////////////////////////////////////////////
+
+DWORD clientDataTypeSize(DWORD sizeOrType)
+{
+	switch (sizeOrType)
+	{
+	case SIMCONNECT_CLIENTDATATYPE_INT8:
+		return 1;
+	case SIMCONNECT_CLIENTDATATYPE_INT16:
+		return 2;
+	case SIMCONNECT_CLIENTDATATYPE_INT32:
+	case SIMCONNECT_CLIENTDATATYPE_FLOAT32:
+		return 4;
+	case SIMCONNECT_CLIENTDATATYPE_INT64:
+	case SIMCONNECT_CLIENTDATATYPE_FLOAT64:
+		return 8;
+	default:
+		return sizeOrType;
+	}
+}
+
+void releaseClientDataRequest(SIMCONNECT_DATA_REQUEST_ID reqId)
+{
+	auto request = clientDataRequests.find(reqId);
+	if (request == clientDataRequests.end())
+	{
+		return;
+	}
+
+	retireCallback(request->second.jsCallback);
+	clientDataRequests.erase(request);
+	releaseRequestId(reqId);
+}
+
+// Maps, creates and defines the client data again on a re-opened connection
+HRESULT replayClientData(HANDLE hSimConnect)
+{
+	HRESULT hr = S_OK;
+	for (auto &entry : clientDataAreas)
+	{
+		hr = sendAndRecord(hSimConnect, [&] { return SimConnect_MapClientDataNameToID(hSimConnect, entry.second.name.c_str(), entry.first); }, "mapClientDataNameToID", entry.first, SIMCONNECT_UNUSED, entry.second.name.c_str());
+		if (!NT_ERROR(hr) && entry.second.size > 0)
+			hr = sendAndRecord(hSimConnect, [&] { return SimConnect_CreateClientData(hSimConnect, entry.first, entry.second.size, entry.second.flags); }, "createClientData", entry.first);
+		if (NT_ERROR(hr))
+			return hr;
+	}
+	for (auto &entry : clientDataDefinitions)
+	{
+		for (auto &datum : entry.second.datums)
+		{
+			hr = sendAndRecord(hSimConnect, [&] { return SimConnect_AddToClientDataDefinition(hSimConnect, entry.first, datum.offset, datum.sizeOrType, datum.epsilon); }, "addToClientDataDefinition", entry.first);
+			if (NT_ERROR(hr))
+				return hr;
+		}
+	}
+	for (auto &entry : clientDataRequests)
+	{
+		const ClientDataRequest &request = entry.second;
+		hr = sendAndRecord(hSimConnect, [&] { return SimConnect_RequestClientData(hSimConnect, request.clientDataId, entry.first, request.defineId, request.period, request.flags, request.origin, request.interval, request.limit); }, "requestClientData", entry.first);
+		if (NT_ERROR(hr))
+			return hr;
+	}
+	return hr;
+}
+
+// The receive buffer belongs to SimConnect and is re-used on the next dispatch, so the
+// data is copied once into the request's buffer, which is handed to the callback every time
+void handleReceived_ClientData(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	SIMCONNECT_RECV_CLIENT_DATA *pClientData = (SIMCONNECT_RECV_CLIENT_DATA *)pData;
+
+	auto request = clientDataRequests.find(pClientData->dwRequestID);
+	if (request == clientDataRequests.end() || request->second.defineId != pClientData->dwDefineID)
+	{
+		return;
+	}
+
+	DWORD offset = (DWORD)((char *)&pClientData->dwData - (char *)pData);
+	DWORD size = cbData > offset ? cbData - offset : 0;
+	if (size > request->second.size)
+	{
+		size = request->second.size;
+	}
+
+	// A Buffer of its own per update, JS may keep it past the callback
+	Local<Object> buffer = Nan::NewBuffer(request->second.size).ToLocalChecked();
+	memcpy(node::Buffer::Data(buffer), &pClientData->dwData, size);
+	memset(node::Buffer::Data(buffer) + size, 0, request->second.size - size);
+
+	const int argc = 2;
+	Local<Value> argv[argc] = {
+		buffer,
+		Number::New(isolate, size)};
+
+	bool oneShot = request->second.period == SIMCONNECT_CLIENT_DATA_PERIOD_ONCE;
+	request->second.jsCallback->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+
+	if (oneShot)
+	{
+		releaseClientDataRequest(pClientData->dwRequestID);
+	}
+}
+
+void MapClientDataName(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		Nan::Utf8String name(args[0]);
+
+		auto mapped = clientDataIds.find(*name);
+		if (mapped != clientDataIds.end())
+		{
+			args.GetReturnValue().Set(v8::Integer::New(isolate, mapped->second));
+			return;
+		}
+
+		SIMCONNECT_CLIENT_DATA_ID clientDataId = clientDataIdCounter++;
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_MapClientDataNameToID(ghSimConnect, *name, clientDataId); }, "mapClientDataNameToID", clientDataId, SIMCONNECT_UNUSED, *name);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		clientDataIds[*name] = clientDataId;
+		clientDataAreas[clientDataId] = {*name, 0, 0};
+		args.GetReturnValue().Set(v8::Integer::New(isolate, clientDataId));
+	}
+}
+
+void CreateClientData(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+		auto area = clientDataAreas.find(args[0]->Uint32Value(ctx).FromJust());
+		if (area == clientDataAreas.end())
+		{
+			Nan::ThrowError("Unknown client data id, use mapClientDataName first");
+			return;
+		}
+
+		DWORD size = args[1]->Uint32Value(ctx).FromJust();
+		if (size == 0 || size > SIMCONNECT_CLIENTDATA_MAX_SIZE)
+		{
+			Nan::ThrowRangeError("Client data size must be between 1 and 8192 bytes");
+			return;
+		}
+		DWORD flags = args.Length() > 2 && args[2]->BooleanValue(isolate) ? SIMCONNECT_CREATE_CLIENT_DATA_FLAG_READ_ONLY : SIMCONNECT_CREATE_CLIENT_DATA_FLAG_DEFAULT;
+
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_CreateClientData(ghSimConnect, area->first, size, flags); }, "createClientData", area->first);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		area->second.size = size;
+		area->second.flags = flags;
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
+	}
+}
+
+void CreateClientDataDefinition(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+		// Either a size in bytes, or an array of [offset, sizeOrType, epsilon]
+		ClientDataDefinition definition = {};
+		if (args[0]->IsNumber())
+		{
+			definition.datums.push_back({0, args[0]->Uint32Value(ctx).FromJust(), 0});
+		}
+		else if (args[0]->IsArray())
+		{
+			Local<Array> datums = args[0].As<Array>();
+			for (unsigned int i = 0; i < datums->Length(); i++)
+			{
+				Local<Value> entry = datums->Get(ctx, i).ToLocalChecked();
+				if (!entry->IsArray() || entry.As<Array>()->Length() < 2)
+				{
+					Nan::ThrowTypeError("Client data datums are [offset, sizeOrType, epsilon]");
+					return;
+				}
+				Local<Array> datum = entry.As<Array>();
+				float epsilon = datum->Length() > 2 ? (float)datum->Get(ctx, 2).ToLocalChecked()->NumberValue(ctx).FromJust() : 0;
+				definition.datums.push_back({(DWORD)datum->Get(ctx, 0).ToLocalChecked()->Int32Value(ctx).FromJust(), (DWORD)datum->Get(ctx, 1).ToLocalChecked()->Int32Value(ctx).FromJust(), epsilon});
+			}
+		}
+
+		DWORD offset = 0;
+		for (auto &datum : definition.datums)
+		{
+			offset = (datum.offset == SIMCONNECT_CLIENTDATAOFFSET_AUTO ? offset : datum.offset) + clientDataTypeSize(datum.sizeOrType);
+			if (offset > definition.size)
+				definition.size = offset;
+		}
+		if (definition.size == 0 || definition.size > SIMCONNECT_CLIENTDATA_MAX_SIZE)
+		{
+			Nan::ThrowRangeError("Client data definitions must cover between 1 and 8192 bytes");
+			return;
+		}
+
+		SIMCONNECT_CLIENT_DATA_DEFINITION_ID defineId = clientDataDefineIdCounter++;
+		for (auto &datum : definition.datums)
+		{
+			HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_AddToClientDataDefinition(ghSimConnect, defineId, datum.offset, datum.sizeOrType, datum.epsilon); }, "addToClientDataDefinition", defineId);
+			if (NT_ERROR(hr))
+			{
+				handle_Error(isolate, hr);
+				return;
+			}
+		}
+
+		clientDataDefinitions[defineId] = definition;
+		args.GetReturnValue().Set(v8::Integer::New(isolate, defineId));
+	}
+}
+
+void RequestClientData(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+		ClientDataRequest request = {};
+		request.clientDataId = args[0]->Uint32Value(ctx).FromJust();
+		request.defineId = args[1]->Uint32Value(ctx).FromJust();
+		auto definition = clientDataDefinitions.find(request.defineId);
+		if (clientDataAreas.find(request.clientDataId) == clientDataAreas.end() || definition == clientDataDefinitions.end())
+		{
+			Nan::ThrowError("Unknown client data id or client data definition");
+			return;
+		}
+		if (!args[2]->IsFunction())
+		{
+			Nan::ThrowTypeError("requestClientData needs a callback");
+			return;
+		}
+
+		request.period = SIMCONNECT_CLIENT_DATA_PERIOD(args.Length() > 3 ? args[3]->Int32Value(ctx).FromJust() : SIMCONNECT_CLIENT_DATA_PERIOD_ON_SET);
+		request.flags = args.Length() > 4 ? args[4]->Int32Value(ctx).FromJust() : 0;
+		request.origin = args.Length() > 5 ? args[5]->Int32Value(ctx).FromJust() : 0;
+		request.interval = args.Length() > 6 ? args[6]->Int32Value(ctx).FromJust() : 0;
+		request.limit = args.Length() > 7 ? args[7]->Int32Value(ctx).FromJust() : 0;
+
+		// Tagged data carries a datum id in front of every datum
+		request.size = definition->second.size;
+		if (request.flags & SIMCONNECT_CLIENT_DATA_REQUEST_FLAG_TAGGED)
+		{
+			request.size += (DWORD)definition->second.datums.size() * sizeof(DWORD);
+		}
+
+		SIMCONNECT_DATA_REQUEST_ID reqId = getUniqueRequestId();
+		request.jsCallback = new Nan::Callback(args[2].As<Function>());
+		clientDataRequests[reqId] = request;
+
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_RequestClientData(ghSimConnect, request.clientDataId, reqId, request.defineId, request.period, request.flags, request.origin, request.interval, request.limit); }, "requestClientData", reqId);
+		if (NT_ERROR(hr))
+		{
+			releaseClientDataRequest(reqId);
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		args.GetReturnValue().Set(v8::Integer::New(isolate, reqId));
+	}
+}
+
+// The data is passed to SimConnect straight from the memory of the given Buffer or typed array
+void SetClientData(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+		SIMCONNECT_CLIENT_DATA_ID clientDataId = args[0]->Uint32Value(ctx).FromJust();
+		SIMCONNECT_CLIENT_DATA_DEFINITION_ID defineId = args[1]->Uint32Value(ctx).FromJust();
+		DWORD flags = args.Length() > 3 ? args[3]->Int32Value(ctx).FromJust() : 0;
+
+		auto definition = clientDataDefinitions.find(defineId);
+		if (definition == clientDataDefinitions.end())
+		{
+			Nan::ThrowError("Unknown client data definition");
+			return;
+		}
+		if (!args[2]->IsArrayBufferView())
+		{
+			Nan::ThrowTypeError("setClientData needs a Buffer or typed array");
+			return;
+		}
+
+		Nan::TypedArrayContents<uint8_t> data(args[2]);
+		if (!(flags & SIMCONNECT_CLIENT_DATA_SET_FLAG_TAGGED) && data.length() < definition->second.size)
+		{
+			Nan::ThrowRangeError("The data is smaller than the client data definition");
+			return;
+		}
+
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_SetClientData(ghSimConnect, clientDataId, defineId, flags, 0, (DWORD)data.length(), *data); }, "setClientData", clientDataId);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
+	}
+}
+
+// Facilities //////////////////////////////////////////////////////////////////////////
+
+// (Re)starts the download of every list not received yet
+HRESULT requestFacilitiesLists(HANDLE hSimConnect)
+{
+	HRESULT hr = S_OK;
+	uv_mutex_lock(&facilityMutex);
+	if (facilityDownload && !facilityDownload->finished)
+	{
+		// Pages of a list cut off by a lost connection are dropped and the list is fetched again
+		facilityDownload->records.erase(std::remove_if(facilityDownload->records.begin(), facilityDownload->records.end(), [](const FacilityRecord &record) {
+			return !facilityDownload->listComplete[record.type];
+		}), facilityDownload->records.end());
+		if (!facilityDownload->listComplete[SIMCONNECT_FACILITY_LIST_TYPE_VOR])
+			facilityDownload->vors.clear();
+
+		for (int type = 0; type < SIMCONNECT_FACILITY_LIST_TYPE_COUNT && !NT_ERROR(hr); type++)
+		{
+			if (!facilityDownload->listComplete[type])
+			{
+				facilityDownload->pagesReceived[type] = 0;
+				hr = sendAndRecord(hSimConnect, [&] { return SimConnect_RequestFacilitiesList(hSimConnect, SIMCONNECT_FACILITY_LIST_TYPE(type), facilityDownload->requestIds[type]); }, "requestFacilitiesList", facilityDownload->requestIds[type]);
+			}
+		}
+	}
+	uv_mutex_unlock(&facilityMutex);
+	return hr;
+}
+
+template <typename T>
+static const T *facilitiesListEntries(SIMCONNECT_RECV_FACILITIES_LIST *pList, DWORD cbData, DWORD &count)
+{
+	DWORD available = cbData > sizeof(SIMCONNECT_RECV_FACILITIES_LIST) ? (cbData - sizeof(SIMCONNECT_RECV_FACILITIES_LIST)) / sizeof(T) : 0;
+	count = pList->dwArraySize < available ? pList->dwArraySize : available;
+	return (const T *)(pList + 1);
+}
+
+static void copyFacility(const SIMCONNECT_DATA_FACILITY_AIRPORT &facility, SIMCONNECT_FACILITY_LIST_TYPE type, FacilityRecord &record)
+{
+	memset(&record, 0, sizeof(record));
+	strncpy(record.icao, facility.Icao, sizeof(record.icao) - 1);
+	record.type = (uint8_t)type;
+	record.latitude = facility.Latitude;
+	record.longitude = facility.Longitude;
+	record.altitude = facility.Altitude;
+	record.vorIndex = facilityNoVor;
+}
+
+// Runs on the dispatch worker. Keeps the pages of the facility lists being downloaded and builds
+// the cache once every list is in. Returns false if the message must go to the main thread.
+bool collectFacilitiesList(SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	SIMCONNECT_FACILITY_LIST_TYPE type;
+	switch (pData->dwID)
+	{
+	case SIMCONNECT_RECV_ID_AIRPORT_LIST:
+		type = SIMCONNECT_FACILITY_LIST_TYPE_AIRPORT;
+		break;
+	case SIMCONNECT_RECV_ID_WAYPOINT_LIST:
+		type = SIMCONNECT_FACILITY_LIST_TYPE_WAYPOINT;
+		break;
+	case SIMCONNECT_RECV_ID_NDB_LIST:
+		type = SIMCONNECT_FACILITY_LIST_TYPE_NDB;
+		break;
+	case SIMCONNECT_RECV_ID_VOR_LIST:
+		type = SIMCONNECT_FACILITY_LIST_TYPE_VOR;
+		break;
+	default:
+		return false;
+	}
+
+	SIMCONNECT_RECV_FACILITIES_LIST *pList = (SIMCONNECT_RECV_FACILITIES_LIST *)pData;
+	uv_mutex_lock(&facilityMutex);
+	FacilityDownload *download = facilityDownload;
+	if (!download || download->finished || download->listComplete[type] || download->requestIds[type] != pList->dwRequestID)
+	{
+		uv_mutex_unlock(&facilityMutex);
+		return true; // Left over from a cancelled download
+	}
+
+	DWORD count;
+	FacilityRecord record;
+	if (type == SIMCONNECT_FACILITY_LIST_TYPE_AIRPORT)
+	{
+		const SIMCONNECT_DATA_FACILITY_AIRPORT *entries = facilitiesListEntries<SIMCONNECT_DATA_FACILITY_AIRPORT>(pList, cbData, count);
+		for (DWORD i = 0; i < count; i++)
+		{
+			copyFacility(entries[i], type, record);
+			download->records.push_back(record);
+		}
+	}
+	else if (type == SIMCONNECT_FACILITY_LIST_TYPE_WAYPOINT)
+	{
+		const SIMCONNECT_DATA_FACILITY_WAYPOINT *entries = facilitiesListEntries<SIMCONNECT_DATA_FACILITY_WAYPOINT>(pList, cbData, count);
+		for (DWORD i = 0; i < count; i++)
+		{
+			copyFacility(entries[i], type, record);
+			record.magVar = entries[i].fMagVar;
+			download->records.push_back(record);
+		}
+	}
+	else if (type == SIMCONNECT_FACILITY_LIST_TYPE_NDB)
+	{
+		const SIMCONNECT_DATA_FACILITY_NDB *entries = facilitiesListEntries<SIMCONNECT_DATA_FACILITY_NDB>(pList, cbData, count);
+		for (DWORD i = 0; i < count; i++)
+		{
+			copyFacility(entries[i], type, record);
+			record.magVar = entries[i].fMagVar;
+			record.frequency = entries[i].fFrequency;
+			download->records.push_back(record);
+		}
+	}
+	else
+	{
+		const SIMCONNECT_DATA_FACILITY_VOR *entries = facilitiesListEntries<SIMCONNECT_DATA_FACILITY_VOR>(pList, cbData, count);
+		for (DWORD i = 0; i < count; i++)
+		{
+			copyFacility(entries[i], type, record);
+			record.magVar = entries[i].fMagVar;
+			record.frequency = entries[i].fFrequency;
+			record.vorIndex = (uint32_t)download->vors.size();
+			download->records.push_back(record);
+
+			FacilityVorRecord vor = {};
+			vor.flags = entries[i].Flags;
+			vor.localizer = entries[i].fLocalizer;
+			vor.glideLatitude = entries[i].GlideLat;
+			vor.glideLongitude = entries[i].GlideLon;
+			vor.glideAltitude = entries[i].GlideAlt;
+			vor.glideSlopeAngle = entries[i].fGlideSlopeAngle;
+			download->vors.push_back(vor);
+		}
+	}
+
+	download->pagesReceived[type]++;
+	download->listComplete[type] = download->pagesReceived[type] >= pList->dwOutOf;
+
+	bool complete = true;
+	for (int i = 0; i < SIMCONNECT_FACILITY_LIST_TYPE_COUNT; i++)
+		complete = complete && download->listComplete[i];
+	if (complete)
+	{
+		download->cache = FacilityCache::build(download->path, download->simVersion, download->records, download->vors, download->error);
+		download->records = std::vector<FacilityRecord>();
+		download->vors = std::vector<FacilityVorRecord>();
+		download->finished = true;
+	}
+	uv_mutex_unlock(&facilityMutex);
+	return !complete;
+}
+
+Local<Object> facilitiesSummary(Isolate *isolate, const FacilityCache *cache, bool cached)
+{
+	Local<Context> ctx = isolate->GetCurrentContext();
+	Local<Object> summary = Object::New(isolate);
+	const FacilityCacheHeader *header = cache->header();
+	summary->Set(ctx, String::NewFromUtf8(isolate, "cached").ToLocalChecked(), v8::Boolean::New(isolate, cached));
+	summary->Set(ctx, String::NewFromUtf8(isolate, "airports").ToLocalChecked(), Number::New(isolate, header->typeCounts[SIMCONNECT_FACILITY_LIST_TYPE_AIRPORT]));
+	summary->Set(ctx, String::NewFromUtf8(isolate, "waypoints").ToLocalChecked(), Number::New(isolate, header->typeCounts[SIMCONNECT_FACILITY_LIST_TYPE_WAYPOINT]));
+	summary->Set(ctx, String::NewFromUtf8(isolate, "ndbs").ToLocalChecked(), Number::New(isolate, header->typeCounts[SIMCONNECT_FACILITY_LIST_TYPE_NDB]));
+	summary->Set(ctx, String::NewFromUtf8(isolate, "vors").ToLocalChecked(), Number::New(isolate, header->typeCounts[SIMCONNECT_FACILITY_LIST_TYPE_VOR]));
+	return summary;
+}
+
+// The last page of the last list, the worker has built the cache by now
+void handleReceived_FacilitiesList(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	uv_mutex_lock(&facilityMutex);
+	FacilityDownload *download = facilityDownload;
+	if (!download || !download->finished)
+	{
+		uv_mutex_unlock(&facilityMutex);
+		return;
+	}
+	facilityDownload = NULL;
+	uv_mutex_unlock(&facilityMutex);
+
+	for (int type = 0; type < SIMCONNECT_FACILITY_LIST_TYPE_COUNT; type++)
+		releaseRequestId(download->requestIds[type]);
+
+	Local<Value> argv[1];
+	if (download->cache)
+	{
+		delete facilityCache;
+		facilityCache = download->cache;
+		argv[0] = facilitiesSummary(isolate, facilityCache, false);
+	}
+	else
+	{
+		Local<Object> summary = Object::New(isolate);
+		summary->Set(isolate->GetCurrentContext(), String::NewFromUtf8(isolate, "error").ToLocalChecked(), String::NewFromUtf8(isolate, download->error.c_str()).ToLocalChecked());
+		argv[0] = summary;
+	}
+
+	download->jsCallback->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+	retireCallback(download->jsCallback);
+	delete download;
+}
+
+void LoadFacilities(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+
+		Nan::Utf8String path(args[0]);
+		if (!args[1]->IsFunction())
+		{
+			Nan::ThrowTypeError("loadFacilities needs a callback");
+			return;
+		}
+		if (simVersion.empty())
+		{
+			Nan::ThrowError("The sim version is not known yet, load the facilities from the open callback");
+			return;
+		}
+
+		// A cache built for this sim version is mapped straight away
+		std::string error;
+		FacilityCache *cache = FacilityCache::open(*path, simVersion, error);
+		if (cache)
+		{
+			delete facilityCache;
+			facilityCache = cache;
+			Nan::Callback callback(args[1].As<Function>());
+			Local<Value> argv[1] = {facilitiesSummary(isolate, facilityCache, true)};
+			callback.Call(isolate->GetCurrentContext()->Global(), 1, argv);
+			args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+			return;
+		}
+
+		uv_mutex_lock(&facilityMutex);
+		bool downloading = facilityDownload != NULL;
+		uv_mutex_unlock(&facilityMutex);
+		if (downloading)
+		{
+			Nan::ThrowError("The facilities are already being downloaded");
+			return;
+		}
+
+		FacilityDownload *download = new FacilityDownload();
+		download->path = *path;
+		download->simVersion = simVersion;
+		for (int type = 0; type < SIMCONNECT_FACILITY_LIST_TYPE_COUNT; type++)
+		{
+			download->requestIds[type] = getUniqueRequestId();
+			download->pagesReceived[type] = 0;
+			download->listComplete[type] = false;
+		}
+		download->finished = false;
+		download->cache = NULL;
+		download->jsCallback = new Nan::Callback(args[1].As<Function>());
+
+		uv_mutex_lock(&facilityMutex);
+		facilityDownload = download;
+		uv_mutex_unlock(&facilityMutex);
+
+		HRESULT hr = requestFacilitiesLists(ghSimConnect);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, false));
+	}
+}
+
+void GetNearbyFacilities(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+	if (!facilityCache)
+	{
+		Nan::ThrowError("No facilities loaded, use loadFacilities first");
+		return;
+	}
+
+	double latitude = args[0]->NumberValue(ctx).FromJust();
+	double longitude = args[1]->NumberValue(ctx).FromJust();
+	double radius = args[2]->NumberValue(ctx).FromJust();
+
+	// A single facility type or an array of them, all types by default
+	bool typesValid = true;
+	auto typeBit = [&typesValid](uint32_t type) {
+		typesValid = typesValid && type < SIMCONNECT_FACILITY_LIST_TYPE_COUNT;
+		return type < SIMCONNECT_FACILITY_LIST_TYPE_COUNT ? 1u << type : 0u;
+	};
+	uint32_t typeMask = (1u << SIMCONNECT_FACILITY_LIST_TYPE_COUNT) - 1;
+	if (args.Length() > 3 && args[3]->IsNumber())
+	{
+		typeMask = typeBit(args[3]->Uint32Value(ctx).FromJust());
+	}
+	else if (args.Length() > 3 && args[3]->IsArray())
+	{
+		Local<Array> types = args[3].As<Array>();
+		typeMask = 0;
+		for (unsigned int i = 0; i < types->Length(); i++)
+			typeMask |= typeBit(types->Get(ctx, i).ToLocalChecked()->Uint32Value(ctx).FromJust());
+	}
+	if (!typesValid)
+	{
+		Nan::ThrowRangeError("Unknown facility type");
+		return;
+	}
+	size_t limit = args.Length() > 4 && args[4]->IsNumber() ? args[4]->Uint32Value(ctx).FromJust() : 0;
+
+	std::vector<std::pair<double, const FacilityRecord *>> found;
+	facilityCache->nearby(latitude, longitude, radius, typeMask, limit, found);
+
+	Local<Array> result = Array::New(isolate, (int)found.size());
+	for (unsigned int i = 0; i < found.size(); i++)
+	{
+		const FacilityRecord *record = found[i].second;
+		Local<Object> facility = Object::New(isolate);
+		facility->Set(ctx, String::NewFromUtf8(isolate, "icao").ToLocalChecked(), String::NewFromUtf8(isolate, record->icao).ToLocalChecked());
+		facility->Set(ctx, String::NewFromUtf8(isolate, "type").ToLocalChecked(), Number::New(isolate, record->type));
+		facility->Set(ctx, String::NewFromUtf8(isolate, "latitude").ToLocalChecked(), Number::New(isolate, record->latitude));
+		facility->Set(ctx, String::NewFromUtf8(isolate, "longitude").ToLocalChecked(), Number::New(isolate, record->longitude));
+		facility->Set(ctx, String::NewFromUtf8(isolate, "altitude").ToLocalChecked(), Number::New(isolate, record->altitude));
+		facility->Set(ctx, String::NewFromUtf8(isolate, "distance").ToLocalChecked(), Number::New(isolate, found[i].first));
+		if (record->type != SIMCONNECT_FACILITY_LIST_TYPE_AIRPORT)
+		{
+			facility->Set(ctx, String::NewFromUtf8(isolate, "magVar").ToLocalChecked(), Number::New(isolate, record->magVar));
+		}
+		if (record->type == SIMCONNECT_FACILITY_LIST_TYPE_NDB || record->type == SIMCONNECT_FACILITY_LIST_TYPE_VOR)
+		{
+			facility->Set(ctx, String::NewFromUtf8(isolate, "frequency").ToLocalChecked(), Number::New(isolate, record->frequency));
+		}
+		const FacilityVorRecord *vor = facilityCache->vor(record);
+		if (vor)
+		{
+			facility->Set(ctx, String::NewFromUtf8(isolate, "flags").ToLocalChecked(), Number::New(isolate, vor->flags));
+			facility->Set(ctx, String::NewFromUtf8(isolate, "localizer").ToLocalChecked(), Number::New(isolate, vor->localizer));
+			facility->Set(ctx, String::NewFromUtf8(isolate, "glideLatitude").ToLocalChecked(), Number::New(isolate, vor->glideLatitude));
+			facility->Set(ctx, String::NewFromUtf8(isolate, "glideLongitude").ToLocalChecked(), Number::New(isolate, vor->glideLongitude));
+			facility->Set(ctx, String::NewFromUtf8(isolate, "glideAltitude").ToLocalChecked(), Number::New(isolate, vor->glideAltitude));
+			facility->Set(ctx, String::NewFromUtf8(isolate, "glideSlopeAngle").ToLocalChecked(), Number::New(isolate, vor->glideSlopeAngle));
+		}
+		result->Set(ctx, i, facility);
+	}
+	args.GetReturnValue().Set(result);
+}
+
+// AI objects ////////////////////////////////////////////////////////////////////////////
+
+// Resolves the promise of a batch with the object ids, null where an object failed
+void settleAIBatch(Isolate *isolate, DWORD batchId)
+{
+	auto batch = aiBatches.find(batchId);
+	if (batch == aiBatches.end())
+	{
+		return;
+	}
+
+	Local<Context> ctx = isolate->GetCurrentContext();
+	Local<Array> objectIds = Array::New(isolate, (int)batch->second.objectIds.size());
+	for (unsigned int i = 0; i < batch->second.objectIds.size(); i++)
+	{
+		double objectId = batch->second.objectIds[i];
+		objectIds->Set(ctx, i, isnan(objectId) ? (Local<Value>)Nan::Null() : (Local<Value>)Number::New(isolate, objectId));
+	}
+
+	for (auto &request : batch->second.requests)
+	{
+		if (request.sent)
+		{
+			aiRequestBatches.erase(request.requestId);
+			aiSendRequests.erase(request.sendId);
+			releaseRequestId(request.requestId);
+		}
+	}
+	if (batch->second.remove)
+	{
+		aiMarkerBatches.erase(batch->second.markerId);
+		releaseRequestId(batch->second.markerId);
+	}
+
+	Local<v8::Promise::Resolver> resolver = Nan::New(*batch->second.resolver);
+	batch->second.resolver->Reset();
+	delete batch->second.resolver;
+	aiBatches.erase(batch);
+	resolver->Resolve(ctx, objectIds);
+}
+
+void rejectAIBatches(Isolate *isolate, const char *reason)
+{
+	if (aiBatches.empty())
+	{
+		return;
+	}
+
+	std::map<DWORD, AIBatch> batches;
+	batches.swap(aiBatches);
+	aiRequestBatches.clear();
+	aiSendRequests.clear();
+	aiMarkerBatches.clear();
+
+	Local<Context> ctx = isolate->GetCurrentContext();
+	for (auto &entry : batches)
+	{
+		for (auto &request : entry.second.requests)
+			if (request.sent)
+				releaseRequestId(request.requestId);
+		if (entry.second.markerId != SIMCONNECT_UNUSED)
+			releaseRequestId(entry.second.markerId);
+
+		Local<v8::Promise::Resolver> resolver = Nan::New(*entry.second.resolver);
+		entry.second.resolver->Reset();
+		delete entry.second.resolver;
+		resolver->Reject(ctx, Nan::Error(reason));
+	}
+}
+
+void handleReceived_AssignedObjectId(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	SIMCONNECT_RECV_ASSIGNED_OBJECT_ID *pAssigned = (SIMCONNECT_RECV_ASSIGNED_OBJECT_ID *)pData;
+
+	auto batchId = aiRequestBatches.find(pAssigned->dwRequestID);
+	if (batchId == aiRequestBatches.end())
+	{
+		return;
+	}
+	AIBatch &batch = aiBatches[batchId->second];
+	for (auto &request : batch.requests)
+	{
+		if (request.sent && request.requestId == pAssigned->dwRequestID)
+		{
+			batch.objectIds[request.index] = pAssigned->dwObjectID;
+			break;
+		}
+	}
+
+	if (--batch.pending == 0)
+	{
+		settleAIBatch(isolate, batchId->second);
+		isolate->PerformMicrotaskCheckpoint();
+	}
+}
+
+// A create or remove call failed. Returns false if the exception is not for an AI call.
+bool settleAIException(Isolate *isolate, DWORD sendId)
+{
+	auto requestId = aiSendRequests.find(sendId);
+	if (requestId == aiSendRequests.end())
+	{
+		return false;
+	}
+	DWORD batchId = aiRequestBatches[requestId->second];
+	AIBatch &batch = aiBatches[batchId];
+	for (auto &request : batch.requests)
+	{
+		if (request.sent && request.sendId == sendId)
+		{
+			batch.objectIds[request.index] = NAN;
+			break;
+		}
+	}
+
+	// Removals are settled by their marker
+	if (!batch.remove && --batch.pending == 0)
+	{
+		settleAIBatch(isolate, batchId);
+		isolate->PerformMicrotaskCheckpoint();
+	}
+	return true;
+}
+
+// SimConnect handles requests in order, so once the marker sent after the removals is
+// answered, the exceptions of any failed removal have been received
+bool settleAIMarker(Isolate *isolate, SIMCONNECT_DATA_REQUEST_ID requestId)
+{
+	auto batchId = aiMarkerBatches.find(requestId);
+	if (batchId == aiMarkerBatches.end())
+	{
+		return false;
+	}
+	settleAIBatch(isolate, batchId->second);
+	isolate->PerformMicrotaskCheckpoint();
+	return true;
+}
+
+std::string getObjectString(Local<Object> object, const char *key)
+{
+	Local<Value> value = object->Get(Nan::GetCurrentContext(), Nan::New(key).ToLocalChecked()).ToLocalChecked();
+	return value->IsString() ? std::string(*Nan::Utf8String(value)) : std::string();
+}
+
+// Sends every create call at once and resolves with the assigned object ids, in the order of
+// the given objects. The kind of object follows from the fields given: an airport creates a
+// parked ATC aircraft, a flight plan an en route ATC aircraft, a tail number a non-ATC
+// aircraft and anything else a simulated object.
+void CreateAIObjects(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+	if (!ghSimConnect)
+	{
+		Nan::ThrowError("Not connected");
+		return;
+	}
+	if (!args[0]->IsArray())
+	{
+		Nan::ThrowTypeError("createAIObjects needs an array of objects");
+		return;
+	}
+
+	Local<Array> objects = args[0].As<Array>();
+	DWORD batchId = aiBatchIdCounter++;
+	AIBatch &batch = aiBatches[batchId];
+	Local<v8::Promise::Resolver> resolver = v8::Promise::Resolver::New(ctx).ToLocalChecked();
+	batch.resolver = new Nan::Persistent<v8::Promise::Resolver>();
+	batch.resolver->Reset(resolver);
+	batch.remove = false;
+	batch.pending = 0;
+	batch.markerId = SIMCONNECT_UNUSED;
+	batch.objectIds.assign(objects->Length(), NAN);
+	batch.requests.resize(objects->Length());
+
+	for (unsigned int i = 0; i < objects->Length(); i++)
+	{
+		AIRequest &request = batch.requests[i];
+		request.index = i;
+		request.sent = false;
+
+		Local<Value> value = objects->Get(ctx, i).ToLocalChecked();
+		if (!value->IsObject())
+		{
+			continue;
+		}
+		Local<Object> object = value.As<Object>();
+		std::string title = getObjectString(object, "title");
+		std::string tailNumber = getObjectString(object, "tailNumber");
+		std::string airport = getObjectString(object, "airport");
+		std::string flightPlan = getObjectString(object, "flightPlan");
+
+		request.requestId = getUniqueRequestId();
+		HRESULT hr;
+		if (!airport.empty())
+		{
+			hr = sendWithId(ghSimConnect, [&] { return SimConnect_AICreateParkedATCAircraft(ghSimConnect, title.c_str(), tailNumber.c_str(), airport.c_str(), request.requestId); }, request.sendId);
+		}
+		else if (!flightPlan.empty())
+		{
+			Local<Value> position = object->Get(ctx, Nan::New("flightPlanPosition").ToLocalChecked()).ToLocalChecked();
+			Local<Value> touchAndGo = object->Get(ctx, Nan::New("touchAndGo").ToLocalChecked()).ToLocalChecked();
+			Local<Value> flightNumber = object->Get(ctx, Nan::New("flightNumber").ToLocalChecked()).ToLocalChecked();
+			int number = flightNumber->IsNumber() ? flightNumber->Int32Value(ctx).FromJust() : 0;
+			double planPosition = position->IsNumber() ? position->NumberValue(ctx).FromJust() : 0;
+			BOOL touch = touchAndGo->BooleanValue(isolate);
+			hr = sendWithId(ghSimConnect, [&] { return SimConnect_AICreateEnrouteATCAircraft(ghSimConnect, title.c_str(), tailNumber.c_str(), number, flightPlan.c_str(), planPosition, touch, request.requestId); }, request.sendId);
+		}
+		else
+		{
+			Local<Value> position = object->Get(ctx, Nan::New("position").ToLocalChecked()).ToLocalChecked();
+			SIMCONNECT_DATA_INITPOSITION init = parseInitPosition(position->IsObject() ? position.As<Object>() : Object::New(isolate));
+			if (!tailNumber.empty())
+				hr = sendWithId(ghSimConnect, [&] { return SimConnect_AICreateNonATCAircraft(ghSimConnect, title.c_str(), tailNumber.c_str(), init, request.requestId); }, request.sendId);
+			else
+				hr = sendWithId(ghSimConnect, [&] { return SimConnect_AICreateSimulatedObject(ghSimConnect, title.c_str(), init, request.requestId); }, request.sendId);
+		}
+
+		if (NT_ERROR(hr))
+		{
+			releaseRequestId(request.requestId);
+			args.GetReturnValue().Set(resolver->GetPromise());
+			handle_Error(isolate, hr); // Rejects the promise
+			return;
+		}
+		request.sent = true;
+		aiRequestBatches[request.requestId] = batchId;
+		aiSendRequests[request.sendId] = request.requestId;
+		batch.pending++;
+	}
+
+	args.GetReturnValue().Set(resolver->GetPromise());
+	if (batch.pending == 0)
+	{
+		settleAIBatch(isolate, batchId);
+	}
+}
+
+// Sends every remove call at once and resolves with the object ids, null for objects that
+// could not be removed
+void RemoveAIObjects(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+	if (!ghSimConnect)
+	{
+		Nan::ThrowError("Not connected");
+		return;
+	}
+	if (!args[0]->IsArray())
+	{
+		Nan::ThrowTypeError("removeAIObjects needs an array of object ids");
+		return;
+	}
+
+	Local<Array> objectIds = args[0].As<Array>();
+	DWORD batchId = aiBatchIdCounter++;
+	AIBatch &batch = aiBatches[batchId];
+	Local<v8::Promise::Resolver> resolver = v8::Promise::Resolver::New(ctx).ToLocalChecked();
+	batch.resolver = new Nan::Persistent<v8::Promise::Resolver>();
+	batch.resolver->Reset(resolver);
+	batch.remove = true;
+	batch.pending = 0;
+	batch.markerId = SIMCONNECT_UNUSED;
+	batch.objectIds.assign(objectIds->Length(), NAN);
+	batch.requests.resize(objectIds->Length());
+
+	for (unsigned int i = 0; i < objectIds->Length(); i++)
+	{
+		AIRequest &request = batch.requests[i];
+		request.index = i;
+		request.sent = false;
+
+		SIMCONNECT_OBJECT_ID objectId = objectIds->Get(ctx, i).ToLocalChecked()->Uint32Value(ctx).FromJust();
+		request.requestId = getUniqueRequestId();
+		HRESULT hr = sendWithId(ghSimConnect, [&] { return SimConnect_AIRemoveObject(ghSimConnect, objectId, request.requestId); }, request.sendId);
+		if (NT_ERROR(hr))
+		{
+			releaseRequestId(request.requestId);
+			args.GetReturnValue().Set(resolver->GetPromise());
+			handle_Error(isolate, hr);
+			return;
+		}
+		request.sent = true;
+		aiRequestBatches[request.requestId] = batchId;
+		aiSendRequests[request.sendId] = request.requestId;
+		batch.objectIds[i] = objectId;
+	}
+
+	batch.markerId = getUniqueRequestId();
+	aiMarkerBatches[batch.markerId] = batchId;
+	HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_RequestSystemState(ghSimConnect, batch.markerId, "Sim"); }, "requestSystemState", batch.markerId, SIMCONNECT_UNUSED, "Sim");
+	args.GetReturnValue().Set(resolver->GetPromise());
+	if (NT_ERROR(hr))
+	{
+		handle_Error(isolate, hr); // Rejects the promise
+	}
+}
+
+// Connection manifest ///////////////////////////////////////////////////////////////////
+
+struct ManifestSubscription
+{
+	std::string name;
+	std::string eventName;
+	Local<Function> callback;
+};
+
+struct ManifestRequest
+{
+	std::string name;
+	std::string definitionName; // Definition declared in the same manifest
+	DataDefinition definition; // Or a definition of its own
+	SIMCONNECT_DATA_DEFINITION_ID defineId; // Or an existing definition
+	DataRequest request;
+	Local<Function> callback;
+};
+
+DWORD getManifestNumber(Local<Object> object, const char *key, DWORD defaultValue)
+{
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+	Local<Value> value = object->Get(ctx, Nan::New(key).ToLocalChecked()).ToLocalChecked();
+	return value->IsNumber() ? value->Uint32Value(ctx).FromJust() : defaultValue;
+}
+
+// Registers everything declared in the manifest in one burst. The SimConnect calls only queue
+// packets, so nothing waits for the simulator until the whole manifest has been sent; failures
+// are reported afterwards through the exception callback. Returns the id of every entry by name,
+// or an empty handle when a call failed and the manifest was rolled back.
+Local<Object> registerManifest(Isolate *isolate, Local<Object> manifest)
+{
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+	std::vector<std::pair<std::string, DataDefinition>> definitions;
+	std::vector<std::pair<std::string, std::string>> events;
+	std::vector<ManifestSubscription> subscriptions;
+	std::vector<ManifestRequest> requests;
+
+	// Everything is parsed before the first call, so a malformed manifest registers nothing
+	Local<Value> section = manifest->Get(ctx, Nan::New("definitions").ToLocalChecked()).ToLocalChecked();
+	if (section->IsObject())
+	{
+		Local<Object> entries = section.As<Object>();
+		Local<Array> names = entries->GetOwnPropertyNames(ctx).ToLocalChecked();
+		for (unsigned int i = 0; i < names->Length(); i++)
+		{
+			Local<Value> name = names->Get(ctx, i).ToLocalChecked();
+			Local<Value> datums = entries->Get(ctx, name).ToLocalChecked();
+			if (!datums->IsArray())
+			{
+				Nan::ThrowTypeError("Manifest definitions must be arrays of simulation variables");
+				return Local<Object>();
+			}
+			DataDefinition definition;
+			if (!parseDataDefinition(isolate, datums.As<Array>(), definition))
+			{
+				return Local<Object>();
+			}
+			definitions.push_back({*Nan::Utf8String(name), definition});
+		}
+	}
+
+	section = manifest->Get(ctx, Nan::New("events").ToLocalChecked()).ToLocalChecked();
+	if (section->IsObject())
+	{
+		Local<Object> entries = section.As<Object>();
+		Local<Array> names = entries->GetOwnPropertyNames(ctx).ToLocalChecked();
+		for (unsigned int i = 0; i < names->Length(); i++)
+		{
+			Local<Value> name = names->Get(ctx, i).ToLocalChecked();
+			events.push_back({*Nan::Utf8String(name), *Nan::Utf8String(entries->Get(ctx, name).ToLocalChecked())});
+		}
+	}
+
+	section = manifest->Get(ctx, Nan::New("subscriptions").ToLocalChecked()).ToLocalChecked();
+	if (section->IsObject())
+	{
+		Local<Object> entries = section.As<Object>();
+		Local<Array> names = entries->GetOwnPropertyNames(ctx).ToLocalChecked();
+		for (unsigned int i = 0; i < names->Length(); i++)
+		{
+			Local<Value> name = names->Get(ctx, i).ToLocalChecked();
+			Local<Value> entry = entries->Get(ctx, name).ToLocalChecked();
+			Local<Value> event = entry->IsObject() ? entry.As<Object>()->Get(ctx, Nan::New("event").ToLocalChecked()).ToLocalChecked() : Local<Value>();
+			Local<Value> callback = entry->IsObject() ? entry.As<Object>()->Get(ctx, Nan::New("callback").ToLocalChecked()).ToLocalChecked() : Local<Value>();
+			if (event.IsEmpty() || !event->IsString() || !callback->IsFunction())
+			{
+				Nan::ThrowTypeError("Manifest subscriptions need an event name and a callback");
+				return Local<Object>();
+			}
+
+			ManifestSubscription subscription;
+			subscription.name = *Nan::Utf8String(name);
+			subscription.eventName = *Nan::Utf8String(event);
+			subscription.callback = callback.As<Function>();
+			subscriptions.push_back(subscription);
+		}
+	}
+
+	section = manifest->Get(ctx, Nan::New("requests").ToLocalChecked()).ToLocalChecked();
+	if (section->IsObject())
+	{
+		Local<Object> entries = section.As<Object>();
+		Local<Array> names = entries->GetOwnPropertyNames(ctx).ToLocalChecked();
+		for (unsigned int i = 0; i < names->Length(); i++)
+		{
+			Local<Value> name = names->Get(ctx, i).ToLocalChecked();
+			Local<Value> entry = entries->Get(ctx, name).ToLocalChecked();
+			if (!entry->IsObject())
+			{
+				Nan::ThrowTypeError("Manifest requests need a definition");
+				return Local<Object>();
+			}
+
+			Local<Object> options = entry.As<Object>();
+			Local<Value> callback = options->Get(ctx, Nan::New("callback").ToLocalChecked()).ToLocalChecked();
+			ManifestRequest request = {};
+			request.name = *Nan::Utf8String(name);
+			request.defineId = SIMCONNECT_UNUSED;
+			if (callback->IsFunction())
+			{
+				request.callback = callback.As<Function>();
+			}
+
+			Local<Value> definition = options->Get(ctx, Nan::New("definition").ToLocalChecked()).ToLocalChecked();
+			if (definition->IsArray())
+			{
+				if (!parseDataDefinition(isolate, definition.As<Array>(), request.definition))
+				{
+					return Local<Object>();
+				}
+				request.request.ownsDefinition = true;
+			}
+			else if (definition->IsNumber())
+			{
+				request.defineId = definition->Uint32Value(ctx).FromJust();
+				if (dataDefinitions.find(request.defineId) == dataDefinitions.end())
+				{
+					Nan::ThrowError("Unknown data definition");
+					return Local<Object>();
+				}
+			}
+			else
+			{
+				request.definitionName = *Nan::Utf8String(definition);
+				bool declared = false;
+				for (auto &declaredDefinition : definitions)
+					declared = declared || declaredDefinition.first == request.definitionName;
+				if (!declared)
+				{
+					Nan::ThrowError("Manifest request refers to an undeclared definition");
+					return Local<Object>();
+				}
+			}
+
+			// Requests with an object type are made with RequestDataOnSimObjectType
+			request.request.byType = options->Has(ctx, Nan::New("simobjectType").ToLocalChecked()).FromJust();
+			request.request.objectId = getManifestNumber(options, "objectId", SIMCONNECT_OBJECT_ID_USER);
+			request.request.period = SIMCONNECT_PERIOD(getManifestNumber(options, "period", SIMCONNECT_PERIOD_SIM_FRAME));
+			request.request.flags = getManifestNumber(options, "flags", 0);
+			request.request.origin = getManifestNumber(options, "origin", 0);
+			request.request.interval = getManifestNumber(options, "interval", 0);
+			request.request.limit = getManifestNumber(options, "limit", 0);
+			request.request.radius = getManifestNumber(options, "radius", 0);
+			request.request.objectType = SIMCONNECT_SIMOBJECT_TYPE(getManifestNumber(options, "simobjectType", SIMCONNECT_SIMOBJECT_TYPE_USER));
+			requests.push_back(request);
+		}
+	}
+
+	Local<Object> definitionIds = Object::New(isolate);
+	Local<Object> eventIds = Object::New(isolate);
+	Local<Object> subscriptionIds = Object::New(isolate);
+	Local<Object> requestIds = Object::New(isolate);
+	std::map<std::string, SIMCONNECT_DATA_DEFINITION_ID> definitionsByName;
+	std::vector<SIMCONNECT_DATA_DEFINITION_ID> definedIds;
+	std::vector<SIMCONNECT_CLIENT_EVENT_ID> subscribedIds;
+	std::vector<SIMCONNECT_DATA_REQUEST_ID> requestedIds;
+	HRESULT hr = S_OK;
+
+	for (unsigned int i = 0; i < definitions.size() && !NT_ERROR(hr); i++)
+	{
+		SIMCONNECT_DATA_DEFINITION_ID defineId = getUniqueDefineId();
+		definitions[i].second.id = defineId;
+		dataDefinitions[defineId] = definitions[i].second;
+		definedIds.push_back(defineId); // Cleared on failure too, some datums may have been added
+		definitionsByName[definitions[i].first] = defineId;
+		definitionIds->Set(ctx, Nan::New(definitions[i].first).ToLocalChecked(), v8::Integer::New(isolate, defineId));
+		hr = registerDatums(ghSimConnect, defineId, definitions[i].second.datums);
+	}
+
+	// Mapped events are kept on failure, the mapping is shared with transmitClientEvent
+	for (unsigned int i = 0; i < events.size() && !NT_ERROR(hr); i++)
+	{
+		SIMCONNECT_CLIENT_EVENT_ID eventId;
+		hr = mapClientEvent(events[i].second, eventId);
+		if (!NT_ERROR(hr))
+			eventIds->Set(ctx, Nan::New(events[i].first).ToLocalChecked(), v8::Integer::New(isolate, eventId));
+	}
+
+	for (unsigned int i = 0; i < subscriptions.size() && !NT_ERROR(hr); i++)
+	{
+		SIMCONNECT_CLIENT_EVENT_ID eventId = getUniqueEventId();
+		systemEventCallbacks[eventId] = new Nan::Callback(subscriptions[i].callback);
+		systemEventNames[eventId] = subscriptions[i].eventName;
+		hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_SubscribeToSystemEvent(ghSimConnect, eventId, subscriptions[i].eventName.c_str()); }, "subscribeToSystemEvent", eventId, SIMCONNECT_UNUSED, subscriptions[i].eventName.c_str());
+		if (NT_ERROR(hr))
+		{
+			releaseSystemEvent(eventId);
+			break;
+		}
+		subscribedIds.push_back(eventId);
+		subscriptionIds->Set(ctx, Nan::New(subscriptions[i].name).ToLocalChecked(), v8::Integer::New(isolate, eventId));
+	}
+
+	for (unsigned int i = 0; i < requests.size() && !NT_ERROR(hr); i++)
+	{
+		DataRequest request = requests[i].request;
+		if (request.ownsDefinition)
+		{
+			request.defineId = getUniqueDefineId();
+			requests[i].definition.id = request.defineId;
+			dataDefinitions[request.defineId] = requests[i].definition;
+			hr = registerDatums(ghSimConnect, request.defineId, requests[i].definition.datums);
+			if (NT_ERROR(hr))
+			{
+				sendAndRecord(ghSimConnect, [&] { return SimConnect_ClearDataDefinition(ghSimConnect, request.defineId); }, "clearDataDefinition", request.defineId);
+				releaseDataDefinition(request.defineId);
+				break;
+			}
+		}
+		else
+		{
+			request.defineId = requests[i].definitionName.empty() ? requests[i].defineId : definitionsByName[requests[i].definitionName];
+		}
+
+		SIMCONNECT_DATA_REQUEST_ID reqId = getUniqueRequestId();
+		request.jsCallback = requests[i].callback.IsEmpty() ? NULL : new Nan::Callback(requests[i].callback);
+		dataRequests[reqId] = request;
+		if (request.byType)
+			hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_RequestDataOnSimObjectType(ghSimConnect, reqId, request.defineId, request.radius, request.objectType); }, "requestDataOnSimObjectType", reqId);
+		else
+			hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_RequestDataOnSimObject(ghSimConnect, reqId, request.defineId, request.objectId, request.period, request.flags, request.origin, request.interval, request.limit); }, "requestDataOnSimObject", reqId);
+		if (NT_ERROR(hr))
+		{
+			releaseDataRequest(reqId); // Clears the definition of its own
+			break;
+		}
+		requestedIds.push_back(reqId);
+		requestIds->Set(ctx, Nan::New(requests[i].name).ToLocalChecked(), v8::Integer::New(isolate, reqId));
+	}
+
+	// A manifest registers whole or not at all. What was sent before the failure is undone, so
+	// no half registered entry is left behind to be replayed after a reconnect.
+	if (NT_ERROR(hr))
+	{
+		for (SIMCONNECT_DATA_REQUEST_ID reqId : requestedIds)
+		{
+			auto request = dataRequests.find(reqId);
+			if (request != dataRequests.end() && !request->second.byType)
+			{
+				sendAndRecord(ghSimConnect, [&] { return SimConnect_RequestDataOnSimObject(ghSimConnect, reqId, request->second.defineId, request->second.objectId, SIMCONNECT_PERIOD_NEVER); }, "requestDataOnSimObject", reqId);
+			}
+			releaseDataRequest(reqId);
+		}
+		for (SIMCONNECT_CLIENT_EVENT_ID eventId : subscribedIds)
+		{
+			sendAndRecord(ghSimConnect, [&] { return SimConnect_UnsubscribeFromSystemEvent(ghSimConnect, eventId); }, "unsubscribeFromSystemEvent", eventId);
+			releaseSystemEvent(eventId);
+		}
+		for (SIMCONNECT_DATA_DEFINITION_ID defineId : definedIds)
+		{
+			sendAndRecord(ghSimConnect, [&] { return SimConnect_ClearDataDefinition(ghSimConnect, defineId); }, "clearDataDefinition", defineId);
+			releaseDataDefinition(defineId);
+		}
+		handle_Error(isolate, hr);
+		return Local<Object>();
+	}
+
+	Local<Object> handles = Object::New(isolate);
+	handles->Set(ctx, Nan::New("definitions").ToLocalChecked(), definitionIds);
+	handles->Set(ctx, Nan::New("events").ToLocalChecked(), eventIds);
+	handles->Set(ctx, Nan::New("subscriptions").ToLocalChecked(), subscriptionIds);
+	handles->Set(ctx, Nan::New("requests").ToLocalChecked(), requestIds);
+	return handles;
+}
+
+void RegisterManifest(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		if (!args[0]->IsObject())
+		{
+			Nan::ThrowTypeError("The manifest must be an object");
+			return;
+		}
+
+		Local<Object> handles = registerManifest(isolate, args[0].As<Object>());
+		if (!handles.IsEmpty())
+		{
+			args.GetReturnValue().Set(handles);
+		}
+	}
+}
+
+// Object registries /////////////////////////////////////////////////////////////////////
+
+bool registryTracks(const ObjectRegistry &registry, SIMCONNECT_SIMOBJECT_TYPE objectType)
+{
+	return registry.objectType == SIMCONNECT_SIMOBJECT_TYPE_ALL || registry.objectType == objectType;
+}
+
+void deliverObjectDelta(Isolate *isolate, ObjectRegistry &registry, const char *type, SIMCONNECT_OBJECT_ID objectId, Local<Value> data)
+{
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	Local<Object> delta = Object::New(isolate);
+	delta->Set(ctx, Nan::New("type").ToLocalChecked(), Nan::New(type).ToLocalChecked());
+	delta->Set(ctx, Nan::New("objectId").ToLocalChecked(), Number::New(isolate, objectId));
+	if (!data.IsEmpty())
+	{
+		delta->Set(ctx, Nan::New("data").ToLocalChecked(), data);
+	}
+	Local<Value> argv[1] = {delta};
+	registry.jsCallback->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+}
+
+// Finds the objects that existed before the registry, new ones are reported by ObjectAdded
+HRESULT seedObjectRegistry(HANDLE hSimConnect, ObjectRegistry &registry)
+{
+	DataRequest request = {};
+	request.byType = true;
+	request.defineId = registry.defineId;
+	request.radius = registry.radius;
+	request.objectType = registry.objectType;
+	request.registry = &registry;
+	SIMCONNECT_DATA_REQUEST_ID reqId = getUniqueRequestId();
+	dataRequests[reqId] = request;
+	return sendAndRecord(hSimConnect, [&] { return SimConnect_RequestDataOnSimObjectType(hSimConnect, reqId, registry.defineId, registry.radius, registry.objectType); }, "requestDataOnSimObjectType", reqId);
+}
+
+HRESULT subscribeObjectRegistry(HANDLE hSimConnect, ObjectRegistry &registry)
+{
+	HRESULT hr = sendAndRecord(hSimConnect, [&] { return SimConnect_SubscribeToSystemEvent(hSimConnect, registry.addedEventId, "ObjectAdded"); }, "subscribeToSystemEvent", registry.addedEventId, SIMCONNECT_UNUSED, "ObjectAdded");
+	if (!NT_ERROR(hr))
+	{
+		hr = sendAndRecord(hSimConnect, [&] { return SimConnect_SubscribeToSystemEvent(hSimConnect, registry.removedEventId, "ObjectRemoved"); }, "subscribeToSystemEvent", registry.removedEventId, SIMCONNECT_UNUSED, "ObjectRemoved");
+	}
+	if (!NT_ERROR(hr))
+	{
+		hr = seedObjectRegistry(hSimConnect, registry);
+	}
+	return hr;
+}
+
+// Starts the periodic request of a newly seen object. Its first sample is reported as the add delta.
+HRESULT attachRegistryObject(ObjectRegistry &registry, SIMCONNECT_OBJECT_ID objectId)
+{
+	if (registry.objects.find(objectId) != registry.objects.end())
+	{
+		return S_OK;
+	}
+
+	DataRequest request = {};
+	request.defineId = registry.defineId;
+	request.objectId = objectId;
+	request.period = registry.period;
+	request.flags = registry.flags;
+	request.registry = &registry;
+	SIMCONNECT_DATA_REQUEST_ID reqId = getUniqueRequestId();
+	dataRequests[reqId] = request;
+	registry.objects[objectId] = {reqId, false};
+	return sendAndRecord(ghSimConnect, [&] { return SimConnect_RequestDataOnSimObject(ghSimConnect, reqId, registry.defineId, objectId, registry.period, registry.flags, 0, 0, 0); }, "requestDataOnSimObject", reqId);
+}
+
+void handleRegistryData(Isolate *isolate, SIMCONNECT_DATA_REQUEST_ID reqId, SIMCONNECT_OBJECT_ID objectId, DWORD entryNumber, DWORD outOf, const DataDefinition &definition, const std::vector<DatumSlice> &slices, const double *computed)
+{
+	ObjectRegistry &registry = *dataRequests[reqId].registry;
+	if (dataRequests[reqId].byType)
+	{
+		// An empty result comes as a single entry without an object. The seed is done with its
+		// last entry, its id is released here rather than left to the caller.
+		HRESULT hr = outOf > 0 ? attachRegistryObject(registry, objectId) : S_OK;
+		if (entryNumber >= outOf)
+		{
+			releaseDataRequest(reqId);
+		}
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+		}
+		return;
+	}
+
+	auto object = registry.objects.find(objectId);
+	if (object == registry.objects.end() || object->second.requestId != reqId)
+	{
+		return;
+	}
+	const char *type = object->second.reported ? "update" : "add";
+	object->second.reported = true;
+	deliverObjectDelta(isolate, registry, type, objectId, sampleToObject(isolate, definition, slices, computed));
+}
+
+void handleReceived_ObjectAddRemove(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+{
+	SIMCONNECT_RECV_EVENT_OBJECT_ADDREMOVE *pEvent = (SIMCONNECT_RECV_EVENT_OBJECT_ADDREMOVE *)pData;
+	SIMCONNECT_OBJECT_ID objectId = pEvent->dwData;
+
+	for (auto &entry : objectRegistries)
+	{
+		ObjectRegistry &registry = entry.second;
+		if (pEvent->uEventID == registry.addedEventId)
+		{
+			if (registryTracks(registry, pEvent->eObjType))
+			{
+				HRESULT hr = attachRegistryObject(registry, objectId);
+				if (NT_ERROR(hr))
+				{
+					handle_Error(isolate, hr);
+				}
+			}
+			return;
+		}
+		if (pEvent->uEventID == registry.removedEventId)
+		{
+			auto object = registry.objects.find(objectId);
+			if (object == registry.objects.end())
+			{
+				return;
+			}
+			// The sim ends the requests on removed objects itself
+			bool reported = object->second.reported;
+			releaseDataRequest(object->second.requestId);
+			registry.objects.erase(object);
+			if (reported)
+			{
+				deliverObjectDelta(isolate, registry, "remove", objectId, Local<Value>());
+			}
+			return;
+		}
+	}
+
+	handleReceived_Message(isolate, pData, cbData);
+}
+
+// Releases every request of the registries, on a lost connection or when a registry is destroyed
+void releaseRegistryRequests(const ObjectRegistry *registry)
+{
+	std::vector<SIMCONNECT_DATA_REQUEST_ID> requestIds;
+	for (auto &entry : dataRequests)
+	{
+		if (entry.second.registry && (!registry || entry.second.registry == registry))
+			requestIds.push_back(entry.first);
+	}
+	for (auto reqId : requestIds)
+	{
+		releaseDataRequest(reqId);
+	}
+}
+
+// The objects are gone with the connection. The remove deltas are delivered once it is back.
+void dropRegistryObjects()
+{
+	for (auto &entry : objectRegistries)
+	{
+		for (auto &object : entry.second.objects)
+		{
+			if (object.second.reported)
+				entry.second.lostObjects.push_back(object.first);
+		}
+		entry.second.objects.clear();
+	}
+	releaseRegistryRequests(NULL);
+}
+
+HRESULT replayObjectRegistries(HANDLE hSimConnect)
+{
+	HRESULT hr = S_OK;
+	for (auto &entry : objectRegistries)
+	{
+		hr = subscribeObjectRegistry(hSimConnect, entry.second);
+		if (NT_ERROR(hr))
+			break;
+	}
+	return hr;
+}
+
+void deliverLostObjects(Isolate *isolate)
+{
+	std::vector<std::pair<DWORD, SIMCONNECT_OBJECT_ID>> lost;
+	for (auto &entry : objectRegistries)
+	{
+		for (auto objectId : entry.second.lostObjects)
+			lost.push_back(std::make_pair(entry.first, objectId));
+		entry.second.lostObjects.clear();
+	}
+	for (auto &object : lost)
+	{
+		// A callback may have destroyed the registry
+		auto registry = objectRegistries.find(object.first);
+		if (registry != objectRegistries.end())
+		{
+			deliverObjectDelta(isolate, registry->second, "remove", object.second, Local<Value>());
+		}
+	}
+}
+
+void CreateObjectRegistry(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+		if (!args[1]->IsFunction())
+		{
+			Nan::ThrowTypeError("The callback must be a function");
+			return;
+		}
+		Local<Object> options = args.Length() > 2 && args[2]->IsObject() ? args[2].As<Object>() : Object::New(isolate);
+
+		ObjectRegistry registry = {};
+		registry.objectType = SIMCONNECT_SIMOBJECT_TYPE(getManifestNumber(options, "objectType", SIMCONNECT_SIMOBJECT_TYPE_AIRCRAFT));
+		registry.period = SIMCONNECT_PERIOD(getManifestNumber(options, "period", SIMCONNECT_PERIOD_SECOND));
+		registry.flags = getManifestNumber(options, "flags", SIMCONNECT_DATA_REQUEST_FLAG_CHANGED);
+		registry.radius = getManifestNumber(options, "radius", 200000);
+
+		if (args[0]->IsArray())
+		{
+			DataDefinition definition = generateDataDefinition(isolate, ghSimConnect, args[0].As<Array>());
+			if (definition.id == SIMCONNECT_UNUSED)
+			{
+				return;
+			}
+			dataDefinitions[definition.id] = definition;
+			registry.defineId = definition.id;
+			registry.ownsDefinition = true;
+		}
+		else
+		{
+			auto found = dataDefinitions.find(args[0]->Int32Value(ctx).FromJust());
+			if (found == dataDefinitions.end())
+			{
+				Nan::ThrowError("Unknown data definition");
+				return;
+			}
+			registry.defineId = found->first;
+		}
+
+		DWORD registryId = registryIdCounter++;
+		registry.jsCallback = new Nan::Callback(args[1].As<Function>());
+		registry.addedEventId = getUniqueEventId();
+		registry.removedEventId = getUniqueEventId();
+		ObjectRegistry &stored = objectRegistries[registryId] = registry;
+
+		HRESULT hr = subscribeObjectRegistry(ghSimConnect, stored);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		args.GetReturnValue().Set(v8::Integer::New(isolate, registryId));
+	}
+}
+
+void DestroyObjectRegistry(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	auto registry = objectRegistries.find(args[0]->Uint32Value(Nan::GetCurrentContext()).FromJust());
+	if (registry == objectRegistries.end())
+	{
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, false));
+		return;
+	}
+
+	if (ghSimConnect)
+	{
+		// Ending the periodic requests, the sim would keep sending them otherwise
+		for (auto &object : registry->second.objects)
+		{
+			sendAndRecord(ghSimConnect, [&] { return SimConnect_RequestDataOnSimObject(ghSimConnect, object.second.requestId, registry->second.defineId, object.first, SIMCONNECT_PERIOD_NEVER); }, "requestDataOnSimObject", object.second.requestId);
+		}
+		sendAndRecord(ghSimConnect, [&] { return SimConnect_UnsubscribeFromSystemEvent(ghSimConnect, registry->second.addedEventId); }, "unsubscribeFromSystemEvent", registry->second.addedEventId, SIMCONNECT_UNUSED, "ObjectAdded");
+		sendAndRecord(ghSimConnect, [&] { return SimConnect_UnsubscribeFromSystemEvent(ghSimConnect, registry->second.removedEventId); }, "unsubscribeFromSystemEvent", registry->second.removedEventId, SIMCONNECT_UNUSED, "ObjectRemoved");
+		if (registry->second.ownsDefinition)
+		{
+			sendAndRecord(ghSimConnect, [&] { return SimConnect_ClearDataDefinition(ghSimConnect, registry->second.defineId); }, "clearDataDefinition", registry->second.defineId);
+		}
+	}
+
+	releaseRegistryRequests(&registry->second);
+	if (registry->second.ownsDefinition)
+	{
+		releaseDataDefinition(registry->second.defineId);
+	}
+	releaseEventId(registry->second.addedEventId);
+	releaseEventId(registry->second.removedEventId);
+	retireCallback(registry->second.jsCallback);
+	if (!dispatching)
+		freeRetiredCallbacks();
+	objectRegistries.erase(registry);
+	args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+}
+
+// Trajectory playback ///////////////////////////////////////////////////////////////////
+
+// Difference of two angles in degrees, the short way around
+double angleDifference(double from, double to)
+{
+	double difference = fmod(to - from, 360);
+	if (difference > 180)
+		difference -= 360;
+	else if (difference < -180)
+		difference += 360;
+	return difference;
+}
+
+// Places the cursor on the sample at or before the position and interpolates between it and the next
+void interpolateTrajectory(TrajectoryPlayer &player, TrajectoryPosition &out)
+{
+	const double *samples = player.samples.data();
+	size_t count = player.samples.size() / trajectorySampleSize;
+	if (player.cursor >= count || samples[player.cursor * trajectorySampleSize] > player.position)
+	{
+		// Seeked or playing backwards, binary search for the last sample at or before the position
+		size_t low = 0, high = count;
+		while (high - low > 1)
+		{
+			size_t middle = (low + high) / 2;
+			if (samples[middle * trajectorySampleSize] <= player.position)
+				low = middle;
+			else
+				high = middle;
+		}
+		player.cursor = low;
+	}
+	while (player.cursor + 1 < count && samples[(player.cursor + 1) * trajectorySampleSize] <= player.position)
+	{
+		player.cursor++;
+	}
+
+	const double *a = samples + player.cursor * trajectorySampleSize;
+	const double *b = player.cursor + 1 < count ? a + trajectorySampleSize : a;
+	double span = b[0] - a[0];
+	double t = span > 0 ? (player.position - a[0]) / span : 0;
+	t = t < 0 ? 0 : t > 1 ? 1 : t;
+
+	out.latitude = a[1] + (b[1] - a[1]) * t;
+	out.longitude = a[2] + angleDifference(a[2], b[2]) * t;
+	out.longitude = out.longitude > 180 ? out.longitude - 360 : out.longitude < -180 ? out.longitude + 360 : out.longitude;
+	out.altitude = a[3] + (b[3] - a[3]) * t;
+	out.pitch = a[4] + angleDifference(a[4], b[4]) * t;
+	out.bank = a[5] + angleDifference(a[5], b[5]) * t;
+	out.heading = fmod(a[6] + angleDifference(a[6], b[6]) * t + 360, 360);
+	out.speed = a[7] + (b[7] - a[7]) * t;
+}
+
+double trajectoryDuration(const TrajectoryPlayer &player)
+{
+	return player.samples[player.samples.size() - trajectorySampleSize];
+}
+
+// Runs on the dispatch worker for every message. Writes the position of every playing trajectory
+// on their frame event and returns true, unless a trajectory stopped and its callback is due.
+bool tickTrajectories(SIMCONNECT_RECV *pData, uint64_t now)
+{
+	if (pData->dwID != SIMCONNECT_RECV_ID_EVENT_FRAME)
+	{
+		return false;
+	}
+
+	uv_mutex_lock(&trajectoryMutex);
+	HANDLE hSimConnect = ghSimConnect;
+	if (trajectoryPlayers.empty() || ((SIMCONNECT_RECV_EVENT *)pData)->uEventID != trajectoryEventId || !hSimConnect)
+	{
+		uv_mutex_unlock(&trajectoryMutex);
+		return false;
+	}
+
+	bool ended = false;
+	TrajectoryPosition position;
+	for (auto &entry : trajectoryPlayers)
+	{
+		TrajectoryPlayer &player = entry.second;
+		if (!player.playing)
+		{
+			continue;
+		}
+
+		double duration = trajectoryDuration(player);
+		player.position += player.lastTick ? (now - player.lastTick) / 1e9 * player.rate : 0;
+		player.lastTick = now;
+		if (player.position > duration || player.position < 0)
+		{
+			if (player.loop && duration > 0)
+			{
+				player.position = fmod(fmod(player.position, duration) + duration, duration);
+			}
+			else
+			{
+				player.position = player.position < 0 ? 0 : duration;
+				player.playing = false;
+				player.ended = true;
+				ended = true;
+			}
+		}
+
+		interpolateTrajectory(player, position);
+		uv_mutex_lock(&sendMutex);
+		SimConnect_SetDataOnSimObject(hSimConnect, trajectoryDefineId, player.objectId, 0, 0, sizeof(position), &position);
+		uv_mutex_unlock(&sendMutex);
+	}
+	uv_mutex_unlock(&trajectoryMutex);
+	return !ended;
+}
+
+void deliverTrajectoryEnds(Isolate *isolate)
+{
+	std::vector<std::pair<DWORD, Nan::Callback *>> ended;
+	uv_mutex_lock(&trajectoryMutex);
+	for (auto &entry : trajectoryPlayers)
+	{
+		if (entry.second.ended)
+		{
+			entry.second.ended = false;
+			if (entry.second.jsCallback)
+				ended.push_back(std::make_pair(entry.first, entry.second.jsCallback));
+		}
+	}
+	uv_mutex_unlock(&trajectoryMutex);
+
+	// A callback destroying a player only retires the callbacks, they live until the end of the dispatch
+	for (auto &player : ended)
+	{
+		Local<Value> argv[1] = {Number::New(isolate, player.first)};
+		player.second->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+	}
+}
+
+void releaseTrajectoryPlayers()
+{
+	uv_mutex_lock(&trajectoryMutex);
+	for (auto &entry : trajectoryPlayers)
+	{
+		if (entry.second.jsCallback)
+			retireCallback(entry.second.jsCallback);
+	}
+	trajectoryPlayers.clear();
+	trajectoryDefineId = SIMCONNECT_UNUSED; // Released with the other definitions
+	uv_mutex_unlock(&trajectoryMutex);
+}
+
+// Reads a Float64Array of samples, or the { timestamps, values } of decodeTelemetry with the
+// columns of the position in options.columns
+bool parseTrajectory(Isolate *isolate, Local<Value> value, Local<Object> options, std::vector<double> &samples)
+{
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	if (value->IsFloat64Array())
+	{
+		Nan::TypedArrayContents<double> contents(value);
+		samples.assign(*contents, *contents + contents.length());
+	}
+	else if (value->IsObject())
+	{
+		Local<Object> log = value.As<Object>();
+		Local<Value> timestamps = log->Get(ctx, Nan::New("timestamps").ToLocalChecked()).ToLocalChecked();
+		Local<Value> values = log->Get(ctx, Nan::New("values").ToLocalChecked()).ToLocalChecked();
+		Local<Value> columns = options->Get(ctx, Nan::New("columns").ToLocalChecked()).ToLocalChecked();
+		if (!timestamps->IsFloat64Array() || !values->IsArray())
+		{
+			Nan::ThrowTypeError("The trajectory must be a Float64Array or a decoded telemetry log");
+			return false;
+		}
+
+		Nan::TypedArrayContents<double> times(timestamps);
+		std::vector<Local<Object>> sources;
+		for (unsigned int i = 1; i < trajectorySampleSize; i++)
+		{
+			uint32_t column = columns->IsArray() ? columns.As<Array>()->Get(ctx, i - 1).ToLocalChecked()->Uint32Value(ctx).FromMaybe(0) : i - 1;
+			Local<Value> source = values.As<Array>()->Get(ctx, column).ToLocalChecked();
+			if (!source->IsObject())
+			{
+				Nan::ThrowRangeError("The telemetry log has no such column");
+				return false;
+			}
+			sources.push_back(source.As<Object>());
+		}
+
+		samples.resize(times.length() * trajectorySampleSize);
+		for (size_t i = 0; i < times.length(); i++)
+		{
+			samples[i * trajectorySampleSize] = (*times)[i] / 1000; // Milliseconds
+			for (unsigned int j = 1; j < trajectorySampleSize; j++)
+			{
+				samples[i * trajectorySampleSize + j] = sources[j - 1]->Get(ctx, (uint32_t)i).ToLocalChecked()->NumberValue(ctx).FromMaybe(0);
+			}
+		}
+	}
+
+	size_t count = samples.size() / trajectorySampleSize;
+	if (count == 0 || samples.size() % trajectorySampleSize != 0)
+	{
+		Nan::ThrowRangeError("The trajectory needs whole samples of 8 values");
+		return false;
+	}
+	double start = samples[0];
+	for (size_t i = 0; i < count; i++)
+	{
+		samples[i * trajectorySampleSize] -= start;
+		if (i > 0 && samples[i * trajectorySampleSize] < samples[(i - 1) * trajectorySampleSize])
+		{
+			Nan::ThrowRangeError("The trajectory samples must be in time order");
+			return false;
+		}
+	}
+	return true;
+}
+
+Local<Object> trajectoryState(Isolate *isolate, const TrajectoryPlayer &player)
+{
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	Local<Object> state = Object::New(isolate);
+	state->Set(ctx, Nan::New("position").ToLocalChecked(), Number::New(isolate, player.position));
+	state->Set(ctx, Nan::New("duration").ToLocalChecked(), Number::New(isolate, trajectoryDuration(player)));
+	state->Set(ctx, Nan::New("rate").ToLocalChecked(), Number::New(isolate, player.rate));
+	state->Set(ctx, Nan::New("playing").ToLocalChecked(), v8::Boolean::New(isolate, player.playing));
+	state->Set(ctx, Nan::New("loop").ToLocalChecked(), v8::Boolean::New(isolate, player.loop));
+	return state;
+}
+
+void CreateTrajectoryPlayer(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+		Local<Object> options = args.Length() > 2 && args[2]->IsObject() ? args[2].As<Object>() : Object::New(isolate);
+
+		TrajectoryPlayer player = {};
+		if (!parseTrajectory(isolate, args[0], options, player.samples))
+		{
+			return;
+		}
+		player.objectId = args.Length() > 1 && args[1]->IsNumber() ? args[1]->Uint32Value(ctx).FromJust() : SIMCONNECT_OBJECT_ID_USER;
+		Local<Value> rate = options->Get(ctx, Nan::New("rate").ToLocalChecked()).ToLocalChecked();
+		player.rate = rate->IsNumber() ? rate->NumberValue(ctx).FromJust() : 1;
+		player.loop = options->Get(ctx, Nan::New("loop").ToLocalChecked()).ToLocalChecked()->BooleanValue(isolate);
+		player.playing = !options->Get(ctx, Nan::New("paused").ToLocalChecked()).ToLocalChecked()->BooleanValue(isolate);
+		player.position = player.rate < 0 ? trajectoryDuration(player) : 0;
+		player.jsCallback = args.Length() > 3 && args[3]->IsFunction() ? new Nan::Callback(args[3].As<Function>()) : NULL;
+
+		HRESULT hr = S_OK;
+		if (trajectoryDefineId == SIMCONNECT_UNUSED)
+		{
+			static const char *names[] = {"PLANE LATITUDE", "PLANE LONGITUDE", "PLANE ALTITUDE", "PLANE PITCH DEGREES", "PLANE BANK DEGREES", "PLANE HEADING DEGREES TRUE", "VELOCITY BODY Z"};
+			static const char *units[] = {"degrees", "degrees", "feet", "degrees", "degrees", "degrees", "knots"};
+			std::vector<DatumDescriptor> datums;
+			for (unsigned int i = 0; i < trajectorySampleSize - 1; i++)
+			{
+				datums.push_back({names[i], units[i], true, SIMCONNECT_DATATYPE_FLOAT64, 0, SIMCONNECT_UNUSED});
+			}
+			SIMCONNECT_DATA_DEFINITION_ID defineId = getUniqueDefineId();
+			hr = registerDatums(ghSimConnect, defineId, datums);
+			if (NT_ERROR(hr))
+			{
+				sendAndRecord(ghSimConnect, [&] { return SimConnect_ClearDataDefinition(ghSimConnect, defineId); }, "clearDataDefinition", defineId);
+				releaseDefineId(defineId);
+			}
+			else
+			{
+				dataDefinitions[defineId] = describeDataDefinition(defineId, datums); // Registered again after a reconnect
+				uv_mutex_lock(&trajectoryMutex);
+				trajectoryDefineId = defineId;
+				uv_mutex_unlock(&trajectoryMutex);
+			}
+		}
+		if (!NT_ERROR(hr) && trajectoryPlayers.empty())
+		{
+			// Played on the frame event by the dispatch worker
+			SIMCONNECT_CLIENT_EVENT_ID eventId = getUniqueEventId();
+			hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_SubscribeToSystemEvent(ghSimConnect, eventId, "Frame"); }, "subscribeToSystemEvent", eventId, SIMCONNECT_UNUSED, "Frame");
+			if (NT_ERROR(hr))
+			{
+				releaseEventId(eventId);
+			}
+			else
+			{
+				uv_mutex_lock(&trajectoryMutex);
+				trajectoryEventId = eventId;
+				uv_mutex_unlock(&trajectoryMutex);
+				systemEventNames[trajectoryEventId] = "Frame";
+			}
+		}
+
+		// Only added once it can be played, JS gets no id to destroy it otherwise
+		if (NT_ERROR(hr))
+		{
+			delete player.jsCallback;
+			handle_Error(isolate, hr);
+			return;
+		}
+
+		DWORD playerId = trajectoryIdCounter++;
+		uv_mutex_lock(&trajectoryMutex);
+		trajectoryPlayers[playerId] = player;
+		uv_mutex_unlock(&trajectoryMutex);
+		args.GetReturnValue().Set(v8::Integer::New(isolate, playerId));
+	}
+}
+
+// Changes any of { playing, position, rate, loop } and returns the state of the player
+void ControlTrajectoryPlayer(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+	Local<Object> control = args.Length() > 1 && args[1]->IsObject() ? args[1].As<Object>() : Object::New(isolate);
+	Local<Value> playing = control->Get(ctx, Nan::New("playing").ToLocalChecked()).ToLocalChecked();
+	Local<Value> position = control->Get(ctx, Nan::New("position").ToLocalChecked()).ToLocalChecked();
+	Local<Value> rate = control->Get(ctx, Nan::New("rate").ToLocalChecked()).ToLocalChecked();
+	Local<Value> loop = control->Get(ctx, Nan::New("loop").ToLocalChecked()).ToLocalChecked();
+
+	uv_mutex_lock(&trajectoryMutex);
+	auto entry = trajectoryPlayers.find(args[0]->Uint32Value(ctx).FromJust());
+	if (entry == trajectoryPlayers.end())
+	{
+		uv_mutex_unlock(&trajectoryMutex);
+		args.GetReturnValue().SetNull();
+		return;
+	}
+
+	TrajectoryPlayer &player = entry->second;
+	if (position->IsNumber())
+	{
+		double duration = trajectoryDuration(player);
+		double seconds = position->NumberValue(ctx).FromJust();
+		player.position = seconds < 0 ? 0 : seconds > duration ? duration : seconds;
+	}
+	if (rate->IsNumber())
+		player.rate = rate->NumberValue(ctx).FromJust();
+	if (loop->IsBoolean())
+		player.loop = loop->BooleanValue(isolate);
+	if (playing->IsBoolean())
+	{
+		player.playing = playing->BooleanValue(isolate);
+		player.lastTick = 0; // Time paused does not count
+		if (player.playing && !player.loop && (player.rate >= 0 ? player.position >= trajectoryDuration(player) : player.position <= 0))
+		{
+			player.position = player.rate >= 0 ? 0 : trajectoryDuration(player); // Played again from the start
+		}
+	}
+	Local<Object> state = trajectoryState(isolate, player);
+	uv_mutex_unlock(&trajectoryMutex);
+	args.GetReturnValue().Set(state);
+}
+
+void DestroyTrajectoryPlayer(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	uv_mutex_lock(&trajectoryMutex);
+	auto entry = trajectoryPlayers.find(args[0]->Uint32Value(Nan::GetCurrentContext()).FromJust());
+	bool found = entry != trajectoryPlayers.end();
+	if (found)
+	{
+		if (entry->second.jsCallback)
+			retireCallback(entry->second.jsCallback);
+		trajectoryPlayers.erase(entry);
+	}
+	bool last = found && trajectoryPlayers.empty();
+	uv_mutex_unlock(&trajectoryMutex);
+
+	if (last)
+	{
+		HRESULT hr = ghSimConnect ? sendAndRecord(ghSimConnect, [&] { return SimConnect_UnsubscribeFromSystemEvent(ghSimConnect, trajectoryEventId); }, "unsubscribeFromSystemEvent", trajectoryEventId, SIMCONNECT_UNUSED, "Frame") : S_OK;
+		systemEventNames.erase(trajectoryEventId);
+		releaseEventId(trajectoryEventId);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+	}
+	if (!dispatching)
+		freeRetiredCallbacks();
+	args.GetReturnValue().Set(v8::Boolean::New(isolate, found));
+}
+
+// Telemetry encoding ////////////////////////////////////////////////////////////////////
+
+// Wall-clock microseconds advanced by the monotonic clock, so deltas never jump backwards
+int64_t telemetryTimestamp(uint64_t hrtime)
+{
+	static uint64_t hrtimeBase = 0;
+	static int64_t wallBase = 0;
+	if (hrtimeBase == 0)
+	{
+		uv_timeval64_t now;
+		uv_gettimeofday(&now);
+		wallBase = now.tv_sec * 1000000 + now.tv_usec;
+		hrtimeBase = uv_hrtime();
+	}
+	return wallBase + ((int64_t)hrtime - (int64_t)hrtimeBase) / 1000;
+}
+
+template <typename TArray, typename T>
+Local<TArray> newTypedArray(Isolate *isolate, const std::vector<T> &values)
+{
+	Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, values.size() * sizeof(T));
+	Local<TArray> array = TArray::New(buffer, 0, values.size());
+	Nan::TypedArrayContents<T> contents(array);
+	if (!values.empty())
+	{
+		memcpy(*contents, values.data(), values.size() * sizeof(T));
+	}
+	return array;
+}
+
+void CreateTelemetryEncoder(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+	std::vector<SIMCONNECT_DATATYPE> types;
+	SIMCONNECT_DATA_DEFINITION_ID defineId = SIMCONNECT_UNUSED;
+
+	if (args[0]->IsNumber())
+	{
+		// Live stream: every sample received for this definition is recorded
+		defineId = args[0]->Int32Value(ctx).FromJust();
+		auto definition = dataDefinitions.find(defineId);
+		if (definition == dataDefinitions.end())
+		{
+			Nan::ThrowRangeError("Unknown data definition");
+			return;
+		}
+		types = definition->second.datum_types;
+	}
+	else if (args[0]->IsArray())
+	{
+		Local<Array> typeList = v8::Local<v8::Array>::Cast(args[0]);
+		for (unsigned int i = 0; i < typeList->Length(); i++)
+		{
+			types.push_back(SIMCONNECT_DATATYPE(typeList->Get(ctx, i).ToLocalChecked()->Int32Value(ctx).FromJust()));
+		}
+	}
+
+	for (auto type : types)
+	{
+		if (!isTelemetryType(type))
+		{
+			Nan::ThrowTypeError("Unsupported datatype for telemetry encoding");
+			return;
+		}
+	}
 
-	systemEventCallbacks[myEvent->uEventID]->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+	DWORD encoderId = encoderIdCounter++;
+	telemetryEncoders[encoderId] = new TelemetryEncoder(types, defineId);
+	args.GetReturnValue().Set(v8::Number::New(isolate, encoderId));
 }
 
-void handleReceived_Exception(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+void AppendTelemetry(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
-	SIMCONNECT_RECV_EXCEPTION *except = (SIMCONNECT_RECV_EXCEPTION *)pData;
+	Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
 
-	v8::Local<v8::Context> ctx =  isolate->GetCurrentContext();
+	auto entry = telemetryEncoders.find(args[0]->Int32Value(ctx).FromJust());
+	if (entry == telemetryEncoders.end() || !args[2]->IsArray())
+	{
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, false));
+		return;
+	}
 
-	v8::Local<v8::String> dwException;
-	v8::Local<v8::String> dwSendID;
-	v8::Local<v8::String> dwIndex;
-	v8::Local<v8::String> cpData;
-	v8::Local<v8::String> cpVersion;
-	v8::Local<v8::String> name;
-	v8::Local<v8::String> simConnExeption;
+	TelemetryEncoder *encoder = entry->second;
+	const std::vector<SIMCONNECT_DATATYPE> &types = encoder->columnTypes();
+	Local<Array> values = v8::Local<v8::Array>::Cast(args[2]);
 
-	v8::MaybeLocal<v8::String> dwExceptionTemp = String::NewFromUtf8(isolate, "dwException");
-	v8::MaybeLocal<v8::String> dwSendIDTemp = String::NewFromUtf8(isolate, "dwSendID");
-	v8::MaybeLocal<v8::String> dwIndexTemp = String::NewFromUtf8(isolate, "dwIndex");
-	v8::MaybeLocal<v8::String> cpDataTemp = String::NewFromUtf8(isolate, "cbData");
-	v8::MaybeLocal<v8::String> cpVersionTemp = String::NewFromUtf8(isolate, "cbVersion");
-	v8::MaybeLocal<v8::String> nameTemp = String::NewFromUtf8(isolate, "name");
-	v8::MaybeLocal<v8::String> simConnExeptionTemp = String::NewFromUtf8(isolate, exceptionNames[SIMCONNECT_EXCEPTION(except->dwException)]);
+	// Timestamps are given in milliseconds, like Date.now()
+	encoder->beginSample((int64_t)(args[1]->NumberValue(ctx).FromJust() * 1000.0));
+	for (unsigned int i = 0; i < types.size() && i < values->Length(); i++)
+	{
+		Local<Value> value = values->Get(ctx, i).ToLocalChecked();
+		if (types[i] >= SIMCONNECT_DATATYPE_STRING8)
+		{
+			Nan::Utf8String str(value);
+			encoder->putString(*str, str.length());
+		}
+		else
+		{
+			encoder->putNumber(value->NumberValue(ctx).FromMaybe(0));
+		}
+	}
+	encoder->endSample();
 
-	dwExceptionTemp.ToLocal(&dwException);
-	dwSendIDTemp.ToLocal(&dwSendID);
-	dwIndexTemp.ToLocal(&dwIndex);
-	cpDataTemp.ToLocal(&cpData);
-	cpVersionTemp.ToLocal(&cpVersion);
-	nameTemp.ToLocal(&name);
-	simConnExeptionTemp.ToLocal(&simConnExeption);
+	args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+}
 
+void FlushTelemetry(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	auto entry = telemetryEncoders.find(args[0]->Int32Value(Nan::GetCurrentContext()).FromJust());
+	if (entry == telemetryEncoders.end())
+	{
+		return;
+	}
 
+	std::vector<uint8_t> chunk = entry->second->flush();
+	args.GetReturnValue().Set(Nan::CopyBuffer((const char *)chunk.data(), (uint32_t)chunk.size()).ToLocalChecked());
+}
 
-	Local<Object> obj = Object::New(isolate);
-	obj->Set(ctx ,dwException, Number::New(isolate, except->dwException));
-	obj->Set(ctx ,dwSendID, Number::New(isolate, except->dwSendID));
-	obj->Set(ctx ,dwIndex, Number::New(isolate, except->dwIndex));
-	obj->Set(ctx ,cpData, Number::New(isolate, cbData));
-	obj->Set(ctx ,cpVersion, Number::New(isolate, except->dwException));
-	obj->Set(ctx ,name, simConnExeption);
+void DestroyTelemetryEncoder(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	Isolate *isolate = args.GetIsolate();
 
-	Local<Value> argv[1] = {obj};
+	auto entry = telemetryEncoders.find(args[0]->Int32Value(Nan::GetCurrentContext()).FromJust());
+	bool found = entry != telemetryEncoders.end();
+	if (found)
+	{
+		delete entry->second;
+		telemetryEncoders.erase(entry);
+	}
+	args.GetReturnValue().Set(v8::Boolean::New(isolate, found));
+}
+
+void DecodeTelemetry(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+	if (!node::Buffer::HasInstance(args[0]))
+	{
+		Nan::ThrowTypeError("Expected a Buffer");
+		return;
+	}
+
+	TelemetryDecoded decoded;
+	std::string error;
+	if (!decodeTelemetry((const uint8_t *)node::Buffer::Data(args[0]), node::Buffer::Length(args[0]), decoded, error))
+	{
+		Nan::ThrowError(error.c_str());
+		return;
+	}
+
+	// Timestamps are returned in milliseconds, like Date.now()
+	std::vector<double> timestamps(decoded.timestamps.size());
+	for (size_t i = 0; i < timestamps.size(); i++)
+	{
+		timestamps[i] = decoded.timestamps[i] / 1000.0;
+	}
+
+	Local<Array> columns = Array::New(isolate, (int)decoded.columns.size());
+	for (size_t c = 0; c < decoded.columns.size(); c++)
+	{
+		TelemetryDecodedColumn &column = decoded.columns[c];
+		Local<Value> values;
+		switch (column.type)
+		{
+		case SIMCONNECT_DATATYPE_INT32:
+			values = newTypedArray<Int32Array>(isolate, column.int32);
+			break;
+		case SIMCONNECT_DATATYPE_FLOAT32:
+			values = newTypedArray<Float32Array>(isolate, column.float32);
+			break;
+		case SIMCONNECT_DATATYPE_INT64:
+		case SIMCONNECT_DATATYPE_FLOAT64:
+			values = newTypedArray<Float64Array>(isolate, column.float64);
+			break;
+		default:
+		{
+			Local<Array> strings = Array::New(isolate, (int)column.strings.size());
+			for (size_t i = 0; i < column.strings.size(); i++)
+			{
+				strings->Set(ctx, (uint32_t)i, String::NewFromUtf8(isolate, column.strings[i].data(), v8::NewStringType::kNormal, (int)column.strings[i].size()).ToLocalChecked());
+			}
+			values = strings;
+			break;
+		}
+		}
+		columns->Set(ctx, (uint32_t)c, values);
+	}
 
-	systemEventCallbacks[exceptionEventId]->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+	Local<Object> result = Object::New(isolate);
+	result->Set(ctx, Nan::New("timestamps").ToLocalChecked(), newTypedArray<Float64Array>(isolate, timestamps));
+	result->Set(ctx, Nan::New("values").ToLocalChecked(), columns);
+	args.GetReturnValue().Set(result);
 }
 
-void handleReceived_Filename(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+// Arrow export //////////////////////////////////////////////////////////////////////////
+
+static const uint32_t arrowBatchSize = 4096; // Rows per record batch written to a file
+
+// Writes the pending rows to the export's file
+void writeArrowExport(ArrowExport &entry, bool finish)
 {
-	SIMCONNECT_RECV_EVENT_FILENAME *fileName = (SIMCONNECT_RECV_EVENT_FILENAME *)pData;
-	const int argc = 1;
-	v8::Local<v8::String> eleArgc;
-	v8::MaybeLocal<v8::String> TempEleArgc = String::NewFromUtf8(isolate, (const char *)fileName->szFileName);
-	TempEleArgc.ToLocal(&eleArgc);
-	Local<Value> argv[argc] = {eleArgc};
+	std::vector<uint8_t> bytes;
+	if (finish)
+		entry.writer->finish(bytes);
+	else
+		entry.writer->flush(bytes);
+	if (!bytes.empty() && fwrite(bytes.data(), 1, bytes.size(), entry.file) != bytes.size())
+	{
+		entry.writeFailed = true;
+	}
+}
+
+void CreateArrowWriter(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+	std::vector<std::string> names;
+	std::vector<SIMCONNECT_DATATYPE> types;
+	SIMCONNECT_DATA_DEFINITION_ID defineId = SIMCONNECT_UNUSED;
+
+	if (args[0]->IsNumber())
+	{
+		// Live capture: every sample received for this definition is added as a row
+		defineId = args[0]->Int32Value(ctx).FromJust();
+		auto definition = dataDefinitions.find(defineId);
+		if (definition == dataDefinitions.end())
+		{
+			Nan::ThrowRangeError("Unknown data definition");
+			return;
+		}
+		names = definition->second.datum_names;
+		types = definition->second.datum_types;
+	}
+	else if (args[0]->IsArray())
+	{
+		// Columns as [name, datatype] pairs, rows are added with appendArrow
+		Local<Array> columnList = v8::Local<v8::Array>::Cast(args[0]);
+		for (unsigned int i = 0; i < columnList->Length(); i++)
+		{
+			Local<Value> entry = columnList->Get(ctx, i).ToLocalChecked();
+			if (!entry->IsArray())
+			{
+				Nan::ThrowTypeError("Columns are given as [name, datatype]");
+				return;
+			}
+			Local<Array> column = entry.As<Array>();
+			Nan::Utf8String name(column->Get(ctx, 0).ToLocalChecked());
+			names.push_back(*name);
+			types.push_back(SIMCONNECT_DATATYPE(column->Get(ctx, 1).ToLocalChecked()->Int32Value(ctx).FromMaybe(SIMCONNECT_DATATYPE_FLOAT64)));
+		}
+	}
+
+	for (auto type : types)
+	{
+		if (!isTelemetryType(type))
+		{
+			Nan::ThrowTypeError("Unsupported datatype for Arrow export");
+			return;
+		}
+	}
+
+	ArrowExport entry = {};
+	entry.batchSize = arrowBatchSize;
+	if (args.Length() > 1 && args[1]->IsObject())
+	{
+		Local<Object> options = args[1].As<Object>();
+		Local<Value> path = options->Get(ctx, Nan::New("path").ToLocalChecked()).ToLocalChecked();
+		entry.batchSize = getManifestNumber(options, "batchSize", arrowBatchSize);
+		entry.batchSize = entry.batchSize > 0 ? entry.batchSize : 1;
+		if (path->IsString())
+		{
+			Nan::Utf8String pathString(path);
+			entry.file = fopen(*pathString, "wb");
+			if (!entry.file)
+			{
+				Nan::ThrowError((std::string("Could not open ") + *pathString).c_str());
+				return;
+			}
+		}
+	}
+
+	entry.writer = new ArrowWriter(names, types, defineId);
+	if (entry.file)
+	{
+		writeArrowExport(entry, false); // The schema, so the file is readable from the start
+	}
 
-	systemEventCallbacks[fileName->uEventID]->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+	DWORD writerId = arrowIdCounter++;
+	arrowExports[writerId] = entry;
+	args.GetReturnValue().Set(v8::Number::New(isolate, writerId));
 }
 
-void handleReceived_Open(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+void AppendArrow(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
-	SIMCONNECT_RECV_OPEN *pOpen = (SIMCONNECT_RECV_OPEN *)pData;
+	Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
 
-	char simconnVersion[32];
-	sprintf(simconnVersion, "%d.%d.%d.%d", pOpen->dwSimConnectVersionMajor, pOpen->dwSimConnectVersionMinor, pOpen->dwSimConnectBuildMajor, pOpen->dwSimConnectBuildMinor);
+	auto entry = arrowExports.find(args[0]->Int32Value(ctx).FromJust());
+	if (entry == arrowExports.end() || !args[2]->IsArray())
+	{
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, false));
+		return;
+	}
 
-	const int argc = 2;
-	//Convert  to MaybeLocal to local
-	v8::Local<v8::String> simconnVersionArg;
-	v8::MaybeLocal<v8::String> tempSimConn = String::NewFromUtf8(isolate, simconnVersion);
-	tempSimConn.ToLocal(&simconnVersionArg);
+	ArrowWriter *writer = entry->second.writer;
+	const std::vector<ArrowColumn> &columns = writer->columnList();
+	Local<Array> values = v8::Local<v8::Array>::Cast(args[2]);
 
+	// Timestamps are given in milliseconds, like Date.now()
+	writer->beginRow((int64_t)(args[1]->NumberValue(ctx).FromJust() * 1000.0));
+	for (unsigned int i = 0; i < columns.size() && i < values->Length(); i++)
+	{
+		Local<Value> value = values->Get(ctx, i).ToLocalChecked();
+		if (columns[i].type >= SIMCONNECT_DATATYPE_STRING8)
+		{
+			Nan::Utf8String str(value);
+			writer->putString(*str, str.length());
+		}
+		else
+		{
+			writer->putNumber(value->NumberValue(ctx).FromMaybe(0));
+		}
+	}
+	writer->endRow();
+	if (entry->second.file && writer->pendingRows() >= entry->second.batchSize)
+	{
+		writeArrowExport(entry->second, false);
+	}
 
-	Local<Value> argv[argc] = {
-		String::NewFromOneByte(isolate, (const uint8_t *)pOpen->szApplicationName, v8::NewStringType::kNormal).ToLocalChecked(),
-		simconnVersionArg
-		};
+	args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+}
 
-	systemEventCallbacks[openEventId]->Call(isolate->GetCurrentContext()->Global(), argc, argv);
+// Returns the pending rows as a Buffer, or writes them to the export's file
+void FlushArrow(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	Isolate *isolate = args.GetIsolate();
+
+	auto entry = arrowExports.find(args[0]->Int32Value(Nan::GetCurrentContext()).FromJust());
+	if (entry == arrowExports.end())
+	{
+		return;
+	}
+
+	if (entry->second.file)
+	{
+		writeArrowExport(entry->second, false);
+		if (entry->second.writeFailed || fflush(entry->second.file) != 0)
+		{
+			Nan::ThrowError("Could not write the Arrow export");
+			return;
+		}
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+		return;
+	}
+
+	std::vector<uint8_t> bytes;
+	entry->second.writer->flush(bytes);
+	args.GetReturnValue().Set(Nan::CopyBuffer((const char *)bytes.data(), (uint32_t)bytes.size()).ToLocalChecked());
 }
 
-void handleReceived_SystemState(Isolate *isolate, SIMCONNECT_RECV *pData, DWORD cbData)
+// Ends the stream and frees the writer. Returns the rest of the stream, or closes the file.
+void CloseArrowWriter(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
-	SIMCONNECT_RECV_SYSTEM_STATE *pState = (SIMCONNECT_RECV_SYSTEM_STATE *)pData;
-	v8::Local<v8::Context> ctx =  isolate->GetCurrentContext();
+	Isolate *isolate = args.GetIsolate();
 
-	v8::Local<v8::String> integer;
-	v8::Local<v8::String> floatt;
-	v8::Local<v8::String> stringg;
+	auto entry = arrowExports.find(args[0]->Int32Value(Nan::GetCurrentContext()).FromJust());
+	if (entry == arrowExports.end())
+	{
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, false));
+		return;
+	}
 
-	v8::MaybeLocal<v8::String> integerTemp = String::NewFromUtf8(isolate, "integer");
-	v8::MaybeLocal<v8::String> floattemp = String::NewFromUtf8(isolate, "float");
-	v8::MaybeLocal<v8::String> stringgTemp = String::NewFromUtf8(isolate, "string");
+	ArrowExport closing = entry->second;
+	arrowExports.erase(entry);
 
-	integerTemp.ToLocal(&integer);
-	floattemp.ToLocal(&floatt);
-	stringgTemp.ToLocal(&stringg);
-	
+	std::vector<uint8_t> bytes;
+	bool written = true;
+	if (closing.file)
+	{
+		writeArrowExport(closing, true);
+		written = fclose(closing.file) == 0 && !closing.writeFailed;
+	}
+	else
+	{
+		closing.writer->finish(bytes);
+	}
+	delete closing.writer;
 
-	Local<Object> obj = Object::New(isolate);
-	obj->Set(ctx ,integer, Number::New(isolate, pState->dwInteger));
-	obj->Set(ctx ,floatt, Number::New(isolate, pState->fFloat));
-	obj->Set(ctx ,stringg, stringg);
+	if (!written)
+	{
+		Nan::ThrowError("Could not write the Arrow export");
+		return;
+	}
+	if (closing.file)
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
+	else
+		args.GetReturnValue().Set(Nan::CopyBuffer((const char *)bytes.data(), (uint32_t)bytes.size()).ToLocalChecked());
+}
 
-	Local<Value> argv[1] = {obj};
-	systemStateCallbacks[openEventId]->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+// Converts a recorded telemetry log straight to an Arrow stream, without creating JS values per sample
+void TelemetryToArrow(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+	if (!node::Buffer::HasInstance(args[0]))
+	{
+		Nan::ThrowTypeError("Expected a Buffer");
+		return;
+	}
+
+	TelemetryDecoded decoded;
+	std::string error;
+	if (!decodeTelemetry((const uint8_t *)node::Buffer::Data(args[0]), node::Buffer::Length(args[0]), decoded, error))
+	{
+		Nan::ThrowError(error.c_str());
+		return;
+	}
+
+	std::vector<std::string> names;
+	if (args.Length() > 1 && args[1]->IsArray())
+	{
+		Local<Array> nameList = args[1].As<Array>();
+		for (unsigned int i = 0; i < nameList->Length(); i++)
+		{
+			Nan::Utf8String name(nameList->Get(ctx, i).ToLocalChecked());
+			names.push_back(*name);
+		}
+	}
+	std::vector<SIMCONNECT_DATATYPE> types;
+	for (auto &column : decoded.columns)
+	{
+		types.push_back(column.type);
+	}
+
+	ArrowWriter writer(names, types, SIMCONNECT_UNUSED);
+	std::vector<uint8_t> bytes;
+	for (size_t row = 0; row < decoded.timestamps.size(); row++)
+	{
+		writer.beginRow(decoded.timestamps[row]);
+		for (auto &column : decoded.columns)
+		{
+			switch (column.type)
+			{
+			case SIMCONNECT_DATATYPE_INT32:
+				writer.putInt32(column.int32[row]);
+				break;
+			case SIMCONNECT_DATATYPE_FLOAT32:
+				writer.putFloat32(column.float32[row]);
+				break;
+			case SIMCONNECT_DATATYPE_INT64:
+			case SIMCONNECT_DATATYPE_FLOAT64:
+				writer.putNumber(column.float64[row]);
+				break;
+			default:
+				writer.putString(column.strings[row].data(), column.strings[row].size());
+				break;
+			}
+		}
+		writer.endRow();
+		if (writer.pendingRows() >= arrowBatchSize)
+		{
+			writer.flush(bytes);
+		}
+	}
+	writer.finish(bytes);
+	args.GetReturnValue().Set(Nan::CopyBuffer((const char *)bytes.data(), (uint32_t)bytes.size()).ToLocalChecked());
 }
 
-void handleReceived_Quit(Isolate *isolate)
+// Shared-memory telemetry bus ///////////////////////////////////////////////////////////
+
+// The mapping stays alive as long as a JS Buffer references it
+void releaseTelemetryBusBuffer(char *data, void *hint)
 {
-	ghSimConnect = NULL;
-	systemEventCallbacks[quitEventId]->Call(isolate->GetCurrentContext()->Global(), 0, NULL);
+	TelemetryBus *bus = (TelemetryBus *)hint;
+	bus->exposed = false;
+	if (bus->closed)
+	{
+		delete bus;
+	}
 }
 
-void handleSimDisconnect(Isolate *isolate)
-{
+void PublishTelemetryBus(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+
+	Nan::Utf8String name(args[0]);
+	SIMCONNECT_DATA_DEFINITION_ID defineId = args[1]->Int32Value(ctx).FromJust();
+	uint32_t slotCount = args.Length() > 2 ? args[2]->Uint32Value(ctx).FromJust() : 256;
+
+	auto definition = dataDefinitions.find(defineId);
+	if (definition == dataDefinitions.end())
+	{
+		Nan::ThrowRangeError("Unknown data definition");
+		return;
+	}
+
+	std::string error;
+	TelemetryBus *bus = TelemetryBus::create(*name, definition->second.datum_names, definition->second.datum_types, slotCount > 1 ? slotCount : 2, error);
+	if (bus == NULL)
+	{
+		Nan::ThrowError(error.c_str());
+		return;
+	}
+	bus->defineId = defineId;
+
+	DWORD busId = busIdCounter++;
+	telemetryBuses[busId] = bus;
+	args.GetReturnValue().Set(v8::Number::New(isolate, busId));
 }
 
-// Wrapped SimConnect-functions //////////////////////////////////////////////////////
-void Open(const v8::FunctionCallbackInfo<v8::Value> &args)
+void AttachTelemetryBus(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
-	uv_sem_init(&workerSem, 1);
-	uv_sem_init(&defineIdSem, 1);
-	uv_sem_init(&eventIdSem, 1);
-	uv_sem_init(&reqIdSem, 1);
-
-	defineIdCounter = 0;
-	eventIdCounter = 0;
-	requestIdCounter = 0;
-
 	Isolate *isolate = args.GetIsolate();
 	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
 
-	// Get arguments
-	Nan::Utf8String appName(args[0].As<String>());// Maybe wanted to Maybe<Local>
-	//AppName = appName.ToLocalChecked();
-	///char appName = *str
+	Nan::Utf8String name(args[0]);
+	std::string error;
+	TelemetryBus *bus = TelemetryBus::attach(*name, error);
+	if (bus == NULL)
+	{
+		Nan::ThrowError(error.c_str());
+		return;
+	}
 
-	openEventId = getUniqueEventId();
-	systemEventCallbacks[openEventId] = {new Nan::Callback(args[1].As<Function>())};
-	quitEventId = getUniqueEventId();
-	systemEventCallbacks[quitEventId] = {new Nan::Callback(args[2].As<Function>())};
-	exceptionEventId = getUniqueEventId();
-	systemEventCallbacks[exceptionEventId] = {new Nan::Callback(args[3].As<Function>())};
-	errorCallback = {new Nan::Callback(args[4].As<Function>())};
+	DWORD busId = busIdCounter++;
+	telemetryBuses[busId] = bus;
 
-	// Create dispatch looper thread
-	loop = uv_default_loop();
+	const TelemetryBusHeader *header = bus->header();
+	Local<Array> fields = Array::New(isolate, header->fieldCount);
+	for (uint32_t i = 0; i < header->fieldCount; i++)
+	{
+		const TelemetryBusField &field = bus->fields()[i];
+		Local<Object> obj = Object::New(isolate);
+		obj->Set(ctx, Nan::New("name").ToLocalChecked(), Nan::New(std::string(field.name, strnlen(field.name, sizeof(field.name)))).ToLocalChecked());
+		obj->Set(ctx, Nan::New("type").ToLocalChecked(), Number::New(isolate, field.type));
+		obj->Set(ctx, Nan::New("offset").ToLocalChecked(), Number::New(isolate, field.offset));
+		obj->Set(ctx, Nan::New("size").ToLocalChecked(), Number::New(isolate, field.size));
+		fields->Set(ctx, i, obj);
+	}
 
-	Nan::AsyncQueueWorker(new DispatchWorker(NULL));
+	// Zero-copy view of the whole mapping, for readers that decode slots themselves
+	bus->exposed = true;
+	Local<Object> buffer = Nan::NewBuffer(bus->data(), (uint32_t)bus->size(), releaseTelemetryBusBuffer, bus).ToLocalChecked();
+
+	Local<Object> result = Object::New(isolate);
+	result->Set(ctx, Nan::New("id").ToLocalChecked(), Number::New(isolate, busId));
+	result->Set(ctx, Nan::New("fields").ToLocalChecked(), fields);
+	result->Set(ctx, Nan::New("slotCount").ToLocalChecked(), Number::New(isolate, header->slotCount));
+	result->Set(ctx, Nan::New("slotSize").ToLocalChecked(), Number::New(isolate, header->slotSize));
+	result->Set(ctx, Nan::New("slotsOffset").ToLocalChecked(), Number::New(isolate, header->slotsOffset));
+	result->Set(ctx, Nan::New("buffer").ToLocalChecked(), buffer);
+	args.GetReturnValue().Set(result);
+}
 
-	// Open connection
-	HRESULT hr = SimConnect_Open(&ghSimConnect, *appName, NULL, 0, 0, 0);
+void ReadTelemetryBus(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	Isolate *isolate = args.GetIsolate();
+	v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
 
-	// Return true if success
-	Local<Boolean> retval = v8::Boolean::New(isolate, SUCCEEDED(hr));
+	auto entry = telemetryBuses.find(args[0]->Int32Value(ctx).FromJust());
+	if (entry == telemetryBuses.end())
+	{
+		return;
+	}
 
-	args.GetReturnValue().Set(retval);
-}
+	// Without a cursor the newest sample is returned, otherwise the one following the cursor
+	bool next = args.Length() > 1 && args[1]->IsNumber();
+	int64_t after = next ? (int64_t)args[1]->NumberValue(ctx).FromJust() : -1;
 
-void Close(const v8::FunctionCallbackInfo<v8::Value> &args)
-{
-	if (ghSimConnect)
+	static std::vector<char> sample;
+	int64_t index;
+	int64_t timestamp;
+	TelemetryBus *bus = entry->second;
+	if (!bus->read(after, next, index, timestamp, sample))
 	{
-		Isolate *isolate = args.GetIsolate();
-		printf("Trying to close..\n");
-		HRESULT hr = SimConnect_Close(&ghSimConnect);
-		if (NT_ERROR(hr))
-		{
-			handle_Error(isolate, hr);
-			return;
-		}
+		args.GetReturnValue().SetNull();
+		return;
+	}
 
-		printf("Closed: %i\n", hr);
-		ghSimConnect = NULL;
-		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
+	Local<Object> data = Object::New(isolate);
+	for (uint32_t i = 0; i < bus->header()->fieldCount; i++)
+	{
+		const TelemetryBusField &field = bus->fields()[i];
+		DatumSlice datum = {sample.data() + field.offset, field.size};
+		data->Set(ctx, Nan::New(std::string(field.name, strnlen(field.name, sizeof(field.name)))).ToLocalChecked(), datumToValue(isolate, SIMCONNECT_DATATYPE(field.type), datum));
 	}
+
+	Local<Object> result = Object::New(isolate);
+	result->Set(ctx, Nan::New("index").ToLocalChecked(), Number::New(isolate, (double)index));
+	result->Set(ctx, Nan::New("timestamp").ToLocalChecked(), Number::New(isolate, timestamp / 1000.0));
+	result->Set(ctx, Nan::New("data").ToLocalChecked(), data);
+	args.GetReturnValue().Set(result);
 }
 
-void isConnected(const v8::FunctionCallbackInfo<v8::Value> &args)
+void CloseTelemetryBus(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
 	Isolate *isolate = args.GetIsolate();
-	args.GetReturnValue().Set(v8::Boolean::New(isolate, ghSimConnect));
+
+	auto entry = telemetryBuses.find(args[0]->Int32Value(Nan::GetCurrentContext()).FromJust());
+	bool found = entry != telemetryBuses.end();
+	if (found)
+	{
+		TelemetryBus *bus = entry->second;
+		telemetryBuses.erase(entry);
+		bus->closed = true;
+		if (!bus->exposed)
+		{
+			delete bus;
+		}
+	}
+	args.GetReturnValue().Set(v8::Boolean::New(isolate, found));
 }
 
-void RequestSystemState(const v8::FunctionCallbackInfo<v8::Value> &args)
+// Client and input events //////////////////////////////////////////////////////////////
+
+void flushEventBatch(Isolate *isolate)
 {
-	if (ghSimConnect)
+	if (eventBatch.empty())
 	{
-		Isolate *isolate = args.GetIsolate();
-		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+		return;
+	}
 
-		Nan::Utf8String stateName(args[0].As<String>());
+	std::vector<uint32_t> events;
+	events.swap(eventBatch);
+	Local<Value> argv[1] = {newTypedArray<Uint32Array>(isolate, events)};
+	eventBatchCallback->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+}
 
-		SIMCONNECT_DATA_REQUEST_ID reqId = getUniqueRequestId();
-		systemStateCallbacks[reqId] = new Nan::Callback(args[1].As<Function>());
-		HRESULT hr = SimConnect_RequestSystemState(ghSimConnect, reqId, *stateName);
-		if (NT_ERROR(hr))
+// Adds the events to their groups again on a re-opened connection
+HRESULT replayEventRoutes(HANDLE hSimConnect)
+{
+	HRESULT hr = S_OK;
+	for (DWORD eventId = 0; eventId < eventRoutes.size() && !NT_ERROR(hr); eventId++)
+	{
+		const EventRoute &route = eventRoutes[eventId];
+		if (!route.active)
+			continue;
+		if (route.input)
 		{
-			handle_Error(isolate, hr);
-			return;
+			hr = sendAndRecord(hSimConnect, [&] { return SimConnect_MapClientEventToSimEvent(hSimConnect, eventId); }, "mapClientEventToSimEvent", eventId);
+			if (!NT_ERROR(hr))
+				hr = sendAndRecord(hSimConnect, [&] { return SimConnect_MapInputEventToClientEvent(hSimConnect, route.groupId, route.inputDefinition.c_str(), eventId, 1, eventId, 0, route.maskable); }, "mapInputEventToClientEvent", eventId, SIMCONNECT_UNUSED, route.inputDefinition.c_str());
 		}
-		args.GetReturnValue().Set(v8::Number::New(isolate, reqId));
+		else
+		{
+			hr = sendAndRecord(hSimConnect, [&] { return SimConnect_AddClientEventToNotificationGroup(hSimConnect, route.groupId, eventId, route.maskable); }, "addClientEventToNotificationGroup", eventId);
+		}
+	}
+	for (auto &entry : notificationGroupPriorities)
+	{
+		if (NT_ERROR(hr))
+			break;
+		hr = sendAndRecord(hSimConnect, [&] { return SimConnect_SetNotificationGroupPriority(hSimConnect, entry.first, entry.second); }, "setNotificationGroupPriority", entry.first);
+	}
+	for (auto &entry : inputGroupPriorities)
+	{
+		if (NT_ERROR(hr))
+			break;
+		hr = sendAndRecord(hSimConnect, [&] { return SimConnect_SetInputGroupPriority(hSimConnect, entry.first, entry.second); }, "setInputGroupPriority", entry.first);
+	}
+	for (auto &entry : inputGroupStates)
+	{
+		if (NT_ERROR(hr))
+			break;
+		hr = sendAndRecord(hSimConnect, [&] { return SimConnect_SetInputGroupState(hSimConnect, entry.first, entry.second); }, "setInputGroupState", entry.first);
 	}
+	return hr;
 }
 
-void FlightLoad(const v8::FunctionCallbackInfo<v8::Value> &args)
+void addEventRoute(SIMCONNECT_CLIENT_EVENT_ID eventId, Local<Value> callback, bool input, bool maskable, DWORD groupId, const std::string &inputDefinition)
 {
-	if (ghSimConnect)
+	if (eventRoutes.size() <= eventId)
 	{
-		Isolate *isolate = args.GetIsolate();
-		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
-
-		Nan::Utf8String szFileName(args[0].As<String>()); //Maybe wanted to Maybe<Local>
-		HRESULT hr = SimConnect_FlightLoad(ghSimConnect, *szFileName);
-		if (NT_ERROR(hr))
-		{
-			handle_Error(isolate, hr);
-			return;
-		}
-		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
+		eventRoutes.resize(eventId + 1);
 	}
+	EventRoute &route = eventRoutes[eventId];
+	route.active = true;
+	route.jsCallback = callback->IsFunction() ? new Nan::Callback(callback.As<Function>()) : NULL;
+	route.input = input;
+	route.maskable = maskable;
+	route.groupId = groupId;
+	route.inputDefinition = inputDefinition;
 }
 
-void TransmitClientEvent(const v8::FunctionCallbackInfo<v8::Value> &args)
+void SubscribeToClientEvent(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
 	if (ghSimConnect)
 	{
-		Isolate *isolate = args.GetIsolate();
-		//v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+		v8::Isolate *isolate = args.GetIsolate();
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
 
-		Nan::Utf8String eventName(args[0].As<String>()); // Maybe wanted to Maybe<Local>
-		DWORD data = args.Length() > 1 ? args[1]->Int32Value(Nan::GetCurrentContext()).FromJust() : 0;
+		Nan::Utf8String eventName(args[0]);
+		DWORD groupId = args.Length() > 2 ? args[2]->Uint32Value(ctx).FromJust() : 0;
+		bool maskable = args.Length() > 3 && args[3]->BooleanValue(isolate);
 
-		SIMCONNECT_CLIENT_EVENT_ID id = getUniqueEventId();
-		HRESULT hr = SimConnect_MapClientEventToSimEvent(ghSimConnect, id, *eventName);
+		SIMCONNECT_CLIENT_EVENT_ID eventId;
+		HRESULT hr = mapClientEvent(*eventName, eventId);
 		if (NT_ERROR(hr))
 		{
 			handle_Error(isolate, hr);
 			return;
 		}
-
-		hr = SimConnect_TransmitClientEvent(ghSimConnect, SIMCONNECT_OBJECT_ID_USER, id, data, SIMCONNECT_GROUP_PRIORITY_HIGHEST, SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY);
-		if (NT_ERROR(hr))
+		if (eventId < eventRoutes.size() && eventRoutes[eventId].active)
 		{
-			handle_Error(isolate, hr);
+			Nan::ThrowError("Already subscribed to this event");
 			return;
 		}
 
-		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
-	}
-}
-
-void SubscribeToSystemEvent(const v8::FunctionCallbackInfo<v8::Value> &args)
-{
-	if (ghSimConnect)
-	{
-		v8::Isolate *isolate = args.GetIsolate();
-		//v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
-
-		SIMCONNECT_CLIENT_EVENT_ID eventId = getUniqueEventId();
-
-		Nan::Utf8String systemEventName(args[0].As<String>());//Maybe wanted to local checked
-		systemEventCallbacks[eventId] = {new Nan::Callback(args[1].As<Function>())};
-
-		HANDLE hSimConnect = ghSimConnect;
-		HRESULT hr = SimConnect_SubscribeToSystemEvent(hSimConnect, eventId, *systemEventName);
+		hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_AddClientEventToNotificationGroup(ghSimConnect, groupId, eventId, maskable); }, "addClientEventToNotificationGroup", eventId);
+		if (!NT_ERROR(hr) && notificationGroupPriorities.find(groupId) == notificationGroupPriorities.end())
+		{
+			// A group without a priority gets no notifications, masking needs a maskable priority
+			DWORD priority = maskable ? SIMCONNECT_GROUP_PRIORITY_HIGHEST_MASKABLE : SIMCONNECT_GROUP_PRIORITY_HIGHEST;
+			hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_SetNotificationGroupPriority(ghSimConnect, groupId, priority); }, "setNotificationGroupPriority", groupId);
+			notificationGroupPriorities[groupId] = priority;
+		}
 		if (NT_ERROR(hr))
 		{
 			handle_Error(isolate, hr);
 			return;
 		}
 
+		addEventRoute(eventId, args[1], false, maskable, groupId, std::string());
 		args.GetReturnValue().Set(v8::Integer::New(isolate, eventId));
 	}
 }
 
-void RequestDataOnSimObject(const v8::FunctionCallbackInfo<v8::Value> &args)
+void MapInputEvent(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
 	if (ghSimConnect)
 	{
 		v8::Isolate *isolate = args.GetIsolate();
 		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
 
-		Local<Array> reqValues = v8::Local<v8::Array>::Cast(args[0]);
-		auto callback = new Nan::Callback(args[1].As<Function>());
-
-		int objectId = args.Length() > 2 ? args[2]->Int32Value(Nan::GetCurrentContext()).FromJust() : SIMCONNECT_OBJECT_ID_USER;
-		int periodId = args.Length() > 3 ? args[3]->Int32Value(Nan::GetCurrentContext()).FromJust() : SIMCONNECT_PERIOD_SIM_FRAME;
-		int flags = args.Length() > 4 ? args[4]->Int32Value(Nan::GetCurrentContext()).FromJust() : 0;
-		int origin = args.Length() > 5 ? args[5]->Int32Value(Nan::GetCurrentContext()).FromJust() : 0;
-		int interval = args.Length() > 6 ? args[6]->Int32Value(Nan::GetCurrentContext()).FromJust() : 0;
-		DWORD limit = args.Length() > 7 ? args[7]->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
-
-		SIMCONNECT_DATA_REQUEST_ID reqId = getUniqueRequestId();
-
-		DataDefinition definition = generateDataDefinition(isolate, ghSimConnect, reqValues);
+		Nan::Utf8String inputDefinition(args[0]);
+		DWORD groupId = args.Length() > 2 ? args[2]->Uint32Value(ctx).FromJust() : 0;
+		bool maskable = args.Length() > 3 && args[3]->BooleanValue(isolate);
 
-		HRESULT hr = SimConnect_RequestDataOnSimObject(ghSimConnect, reqId, definition.id, objectId, SIMCONNECT_PERIOD(periodId), flags, origin, interval, limit);
+		// A private client event, 1 when the input goes down and 0 when it goes up
+		SIMCONNECT_CLIENT_EVENT_ID eventId = getUniqueEventId();
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_MapClientEventToSimEvent(ghSimConnect, eventId); }, "mapClientEventToSimEvent", eventId);
+		if (!NT_ERROR(hr))
+		{
+			hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_MapInputEventToClientEvent(ghSimConnect, groupId, *inputDefinition, eventId, 1, eventId, 0, maskable); }, "mapInputEventToClientEvent", eventId, SIMCONNECT_UNUSED, *inputDefinition);
+		}
+		if (!NT_ERROR(hr) && inputGroupPriorities.find(groupId) == inputGroupPriorities.end())
+		{
+			DWORD priority = maskable ? SIMCONNECT_GROUP_PRIORITY_HIGHEST_MASKABLE : SIMCONNECT_GROUP_PRIORITY_HIGHEST;
+			hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_SetInputGroupPriority(ghSimConnect, groupId, priority); }, "setInputGroupPriority", groupId);
+			inputGroupPriorities[groupId] = priority;
+		}
+		if (!NT_ERROR(hr) && inputGroupStates.find(groupId) == inputGroupStates.end())
+		{
+			hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_SetInputGroupState(ghSimConnect, groupId, SIMCONNECT_STATE_ON); }, "setInputGroupState", groupId);
+			inputGroupStates[groupId] = SIMCONNECT_STATE_ON;
+		}
 		if (NT_ERROR(hr))
 		{
+			releaseEventId(eventId);
 			handle_Error(isolate, hr);
 			return;
 		}
 
-		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
-
-		dataDefinitions[definition.id] = definition;
-		dataRequestCallbacks[reqId] = callback;
+		addEventRoute(eventId, args[1], true, maskable, groupId, *inputDefinition);
+		args.GetReturnValue().Set(v8::Integer::New(isolate, eventId));
 	}
 }
 
-void RequestDataOnSimObjectType(const v8::FunctionCallbackInfo<v8::Value> &args)
+void UnsubscribeFromClientEvent(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
 	if (ghSimConnect)
 	{
 		v8::Isolate *isolate = args.GetIsolate();
-		//v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
-
-		DataDefinition definition;
+		SIMCONNECT_CLIENT_EVENT_ID eventId = args[0]->Uint32Value(Nan::GetCurrentContext()).FromJust();
+		if (eventId >= eventRoutes.size() || !eventRoutes[eventId].active)
+		{
+			args.GetReturnValue().Set(v8::Boolean::New(isolate, false));
+			return;
+		}
 
-		if (args[0]->IsArray())
+		EventRoute &route = eventRoutes[eventId];
+		HRESULT hr;
+		if (route.input)
 		{
-			Local<Array> reqValues = v8::Local<v8::Array>::Cast(args[0]);
-			definition = generateDataDefinition(isolate, ghSimConnect, reqValues);
+			hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_RemoveInputEvent(ghSimConnect, route.groupId, route.inputDefinition.c_str()); }, "removeInputEvent", eventId, SIMCONNECT_UNUSED, route.inputDefinition.c_str());
+			releaseEventId(eventId); // Private event, the name cache only holds sim events
 		}
-		else if (args[0]->IsNumber())
+		else
 		{
-			definition = dataDefinitions[args[0]->NumberValue(Nan::GetCurrentContext()).FromJust()];
+			hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_RemoveClientEvent(ghSimConnect, route.groupId, eventId); }, "removeClientEvent", eventId);
 		}
+		if (route.jsCallback)
+		{
+			retireCallback(route.jsCallback);
+		}
+		route = EventRoute();
 
-		auto callback = new Nan::Callback(args[1].As<Function>());
-
-		DWORD radius = args.Length() > 2 ? args[2]->Int32Value(Nan::GetCurrentContext()).FromJust() : 0;
-		int typeId = args.Length() > 3 ? args[3]->Int32Value(Nan::GetCurrentContext()).FromJust() : SIMCONNECT_SIMOBJECT_TYPE_USER;
-
-		SIMCONNECT_DATA_REQUEST_ID reqId = getUniqueRequestId();
-		HRESULT hr = SimConnect_RequestDataOnSimObjectType(ghSimConnect, reqId, definition.id, radius, SIMCONNECT_SIMOBJECT_TYPE(typeId));
 		if (NT_ERROR(hr))
 		{
 			handle_Error(isolate, hr);
 			return;
 		}
-
-		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
-
-		dataDefinitions[definition.id] = definition;
-		dataRequestCallbacks[reqId] = callback;
+		args.GetReturnValue().Set(v8::Boolean::New(isolate, true));
 	}
 }
 
-void CreateDataDefinition(const v8::FunctionCallbackInfo<v8::Value> &args)
+void SetNotificationGroupPriority(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
 	if (ghSimConnect)
 	{
 		v8::Isolate *isolate = args.GetIsolate();
-		Local<Array> reqValues = v8::Local<v8::Array>::Cast(args[0]);
-		DataDefinition definition = generateDataDefinition(isolate, ghSimConnect, reqValues);
-		args.GetReturnValue().Set(v8::Number::New(isolate, definition.id));
-		dataDefinitions[definition.id] = definition;
+		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+		DWORD groupId = args[0]->Uint32Value(ctx).FromJust();
+		DWORD priority = args[1]->Uint32Value(ctx).FromJust();
+
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_SetNotificationGroupPriority(ghSimConnect, groupId, priority); }, "setNotificationGroupPriority", groupId);
+		if (NT_ERROR(hr))
+		{
+			handle_Error(isolate, hr);
+			return;
+		}
+		notificationGroupPriorities[groupId] = priority;
 	}
 }
 
-void SetDataOnSimObject(const v8::FunctionCallbackInfo<v8::Value> &args)
+void SetInputGroupPriority(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
 	if (ghSimConnect)
 	{
 		v8::Isolate *isolate = args.GetIsolate();
 		v8::Local<v8::Context> ctx = Nan::GetCurrentContext();
+		DWORD groupId = args[0]->Uint32Value(ctx).FromJust();
+		DWORD priority = args[1]->Uint32Value(ctx).FromJust();
 
-		Nan::Utf8String name(args[0].As<String>());
-		Nan::Utf8String unit(args[1].As<String>());
-
-		double value = args[2]->NumberValue(Nan::GetCurrentContext()).FromJust();
-
-		int objectId = args.Length() > 3 ? args[3]->Int32Value(Nan::GetCurrentContext()).FromMaybe(SIMCONNECT_OBJECT_ID_USER) : SIMCONNECT_OBJECT_ID_USER;
-		int flags = args.Length() > 4 ? args[4]->Int32Value(Nan::GetCurrentContext()).FromJust() : 0;
-
-		SIMCONNECT_DATA_DEFINITION_ID defId = getUniqueDefineId();
-
-		HRESULT hr = SimConnect_AddToDataDefinition(ghSimConnect, defId, *name, *unit);
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_SetInputGroupPriority(ghSimConnect, groupId, priority); }, "setInputGroupPriority", groupId);
 		if (NT_ERROR(hr))
 		{
 			handle_Error(isolate, hr);
 			return;
 		}
+		inputGroupPriorities[groupId] = priority;
+	}
+}
+
+void SetInputGroupState(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (ghSimConnect)
+	{
+		v8::Isolate *isolate = args.GetIsolate();
+		DWORD groupId = args[0]->Uint32Value(Nan::GetCurrentContext()).FromJust();
+		DWORD state = args[1]->BooleanValue(isolate) ? SIMCONNECT_STATE_ON : SIMCONNECT_STATE_OFF;
 
-		hr = SimConnect_SetDataOnSimObject(ghSimConnect, defId, SIMCONNECT_OBJECT_ID_USER, 0, 0, sizeof(value), &value);
+		HRESULT hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_SetInputGroupState(ghSimConnect, groupId, state); }, "setInputGroupState", groupId);
 		if (NT_ERROR(hr))
 		{
 			handle_Error(isolate, hr);
 			return;
 		}
-
-		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
+		inputGroupStates[groupId] = state;
 	}
 }
 
-// Generates a SimConnect data definition for the collection of requests.
-DataDefinition generateDataDefinition(Isolate *isolate, HANDLE hSimConnect, Local<Array> requestedValues)
+// Events subscribed without a callback are collected and handed over once per sim frame
+void SetEventBatchCallback(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
-
-	SIMCONNECT_DATA_DEFINITION_ID definitionId = getUniqueDefineId();
-	v8::Local<v8::Context> ctx = Nan::GetCurrentContext(); // use for all
-
-	HRESULT hr = -1;
-	bool success = true;
-	unsigned int numValues = requestedValues->Length();
-
-	std::vector<std::string> datumNames;
-	std::vector<SIMCONNECT_DATATYPE> datumTypes;
-
-	for (unsigned int i = 0; i < requestedValues->Length(); i++)
+	if (ghSimConnect)
 	{
-		Local<Array> value = v8::Local<v8::Array>::Cast(requestedValues->Get(ctx,i).ToLocalChecked());
+		v8::Isolate *isolate = args.GetIsolate();
 
-		if (value->IsArray())
+		HRESULT hr = S_OK;
+		if (args[0]->IsFunction())
 		{
-			int len = value->Length();
-
-			if (len > 1)
+			if (eventBatchCallback)
 			{
-				Nan::Utf8String datumName(value->Get(ctx, 0).ToLocalChecked());
-				const char *sDatumName = *datumName;
-				const char *sUnitsName = NULL;
-
-				if (!value->Get(ctx, 1).ToLocalChecked()->IsNull())
-				{ // Should be NULL for string
-					Nan::Utf8String unitsName(value->Get(ctx, 1).ToLocalChecked().As<String>());
-					sUnitsName = *unitsName;
-				}
-
-				SIMCONNECT_DATATYPE datumType = SIMCONNECT_DATATYPE_FLOAT64; // Default type (double)
-				double epsilon;
-				float datumId;
-
-				if (len > 1)
-				{
-					hr = SimConnect_AddToDataDefinition(hSimConnect, definitionId, sDatumName, sUnitsName);
-					if (NT_ERROR(hr))
-					{
-						handle_Error(isolate, hr);
-						break;
-					}
-				}
-				if (len > 2)
-				{
-					int t = value->Get(ctx, 2).ToLocalChecked()->Int32Value(Nan::GetCurrentContext()).FromJust();
-					datumType = SIMCONNECT_DATATYPE(t);
-					hr = SimConnect_AddToDataDefinition(hSimConnect, definitionId, sDatumName, sUnitsName, datumType);
-					if (NT_ERROR(hr))
-					{
-						handle_Error(isolate, hr);
-						break;
-					}
-				}
-				if (len > 3)
-				{
-					epsilon = value->Get(ctx, 3).ToLocalChecked()->Int32Value(Nan::GetCurrentContext()).FromJust();
-					hr = SimConnect_AddToDataDefinition(hSimConnect, definitionId, sDatumName, sUnitsName, datumType, epsilon);
-					if (NT_ERROR(hr))
-					{
-						handle_Error(isolate, hr);
-						break;
-					}
-				}
-				if (len > 4)
-				{
-					datumId = value->Get(ctx, 4).ToLocalChecked()->Int32Value(Nan::GetCurrentContext()).FromJust();
-					hr = SimConnect_AddToDataDefinition(hSimConnect, definitionId, sDatumName, sUnitsName, datumType, epsilon, datumId);
-					if (NT_ERROR(hr))
-					{
-						handle_Error(isolate, hr);
-						break;
-					}
-				}
-
-				std::string datumNameStr(sDatumName);
-				datumNames.push_back(datumNameStr);
-				datumTypes.push_back(datumType);
+				retireCallback(eventBatchCallback);
+			}
+			else
+			{
+				eventBatchEventId = getUniqueEventId();
+				systemEventNames[eventBatchEventId] = "Frame";
+				hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_SubscribeToSystemEvent(ghSimConnect, eventBatchEventId, "Frame"); }, "subscribeToSystemEvent", eventBatchEventId, SIMCONNECT_UNUSED, "Frame");
 			}
+			eventBatchCallback = new Nan::Callback(args[0].As<Function>());
 		}
-	}
-
-	return {definitionId, numValues, datumNames, datumTypes};
-}
-
-// Custom useful functions ////////////////////////////////////////////////////////////////////
-void SetAircraftInitialPosition(const v8::FunctionCallbackInfo<v8::Value> &args)
-{
-	if (ghSimConnect)
-	{
-		Isolate *isolate = args.GetIsolate();
-		v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
-
-		SIMCONNECT_DATA_INITPOSITION init;
-
-		//Nan::GetCurrentContext()
-		Local<Object> json = args[0]->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
-
-		v8::Local<v8::String> altProp = Nan::New("altitude").ToLocalChecked();
-		v8::Local<v8::String> latProp = Nan::New("latitude").ToLocalChecked();
-		v8::Local<v8::String> lngProp = Nan::New("longitude").ToLocalChecked();
-		v8::Local<v8::String> pitchProp = Nan::New("pitch").ToLocalChecked();
-		v8::Local<v8::String> bankProp = Nan::New("bank").ToLocalChecked();
-		v8::Local<v8::String> hdgProp = Nan::New("heading").ToLocalChecked();
-		v8::Local<v8::String> gndProp = Nan::New("onGround").ToLocalChecked();
-		v8::Local<v8::String> iasProp = Nan::New("airspeed").ToLocalChecked();
-
-		init.Altitude = json->HasRealNamedProperty(Nan::GetCurrentContext(), altProp).FromJust()? json->Get(ctx , altProp).ToLocalChecked()->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
-		init.Latitude = json->HasRealNamedProperty(Nan::GetCurrentContext(), latProp).FromJust() ? json->Get(ctx, latProp).ToLocalChecked()->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
-		init.Longitude = json->HasRealNamedProperty(Nan::GetCurrentContext(), lngProp).FromJust() ? json->Get(ctx, lngProp).ToLocalChecked()->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
-		init.Pitch = json->HasRealNamedProperty(Nan::GetCurrentContext(), pitchProp).FromJust() ? json->Get(ctx, pitchProp).ToLocalChecked()->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
-		init.Bank = json->HasRealNamedProperty(Nan::GetCurrentContext(), bankProp).FromJust() ? json->Get(ctx, bankProp).ToLocalChecked()->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
-		init.Heading = json->HasRealNamedProperty(Nan::GetCurrentContext(), hdgProp).FromJust() ? json->Get(ctx, hdgProp).ToLocalChecked()->NumberValue(Nan::GetCurrentContext()).FromJust() : 0;
-		init.OnGround = json->HasRealNamedProperty(Nan::GetCurrentContext(), gndProp).FromJust() ? json->Get(ctx, gndProp).ToLocalChecked()->IntegerValue(Nan::GetCurrentContext()).FromJust() : 0;
-		init.Airspeed = json->HasRealNamedProperty(Nan::GetCurrentContext(), iasProp).FromJust() ? json->Get(ctx, iasProp).ToLocalChecked()->IntegerValue(Nan::GetCurrentContext()).FromJust() : 0;
-
-		SIMCONNECT_DATA_DEFINITION_ID id = getUniqueDefineId();
-		HRESULT hr = SimConnect_AddToDataDefinition(ghSimConnect, id, "Initial Position", NULL, SIMCONNECT_DATATYPE_INITPOSITION);
-		if (NT_ERROR(hr))
+		else if (eventBatchCallback)
 		{
-			handle_Error(isolate, hr);
-			return;
+			hr = sendAndRecord(ghSimConnect, [&] { return SimConnect_UnsubscribeFromSystemEvent(ghSimConnect, eventBatchEventId); }, "unsubscribeFromSystemEvent", eventBatchEventId, SIMCONNECT_UNUSED, "Frame");
+			systemEventNames.erase(eventBatchEventId);
+			releaseEventId(eventBatchEventId);
+			retireCallback(eventBatchCallback);
+			eventBatchCallback = NULL;
+			eventBatch.clear();
 		}
 
-		hr = SimConnect_SetDataOnSimObject(ghSimConnect, id, SIMCONNECT_OBJECT_ID_USER, 0, 0, sizeof(init), &init);
 		if (NT_ERROR(hr))
 		{
 			handle_Error(isolate, hr);
 			return;
 		}
-
-		args.GetReturnValue().Set(v8::Boolean::New(isolate, SUCCEEDED(hr)));
 	}
 }
 
 void Initialize(v8::Local<v8::Object> exports)
 {
+	uv_mutex_init(&facilityMutex);
+	uv_mutex_init(&trajectoryMutex);
+	uv_mutex_init(&sendMutex);
+	uv_mutex_init(&registrationMutex);
+	uv_mutex_init(&laneMutex);
+	for (DWORD id = 0; id < messageIdCount; id++)
+		messageLanes[id] = LANE_NORMAL;
+	messageLanes[SIMCONNECT_RECV_ID_EXCEPTION] = LANE_HIGH;
+	messageLanes[SIMCONNECT_RECV_ID_QUIT] = LANE_HIGH;
+	messageLanes[SIMCONNECT_RECV_ID_EVENT] = LANE_HIGH;
+	// EVENT_FRAME stays in the lane of the data samples: the frame barrier delivers the samples
+	// held so far when the frame event is handled, so it must not overtake the samples of its frame
+	nameTraceThread("main");
+	registerMessageHandlers();
+
 	NODE_SET_METHOD(exports, "open", Open);
 	NODE_SET_METHOD(exports, "close", Close);
 	NODE_SET_METHOD(exports, "subscribeToSystemEvent", SubscribeToSystemEvent);
@@ -854,11 +6102,66 @@ void Initialize(v8::Local<v8::Object> exports)
 	NODE_SET_METHOD(exports, "setDataOnSimObject", SetDataOnSimObject);
 	NODE_SET_METHOD(exports, "requestDataOnSimObjectType", RequestDataOnSimObjectType);
 	NODE_SET_METHOD(exports, "setAircraftInitialPosition", SetAircraftInitialPosition);
+	NODE_SET_METHOD(exports, "registerManifest", RegisterManifest);
+	NODE_SET_METHOD(exports, "mapClientDataName", MapClientDataName);
+	NODE_SET_METHOD(exports, "createClientData", CreateClientData);
+	NODE_SET_METHOD(exports, "createClientDataDefinition", CreateClientDataDefinition);
+	NODE_SET_METHOD(exports, "requestClientData", RequestClientData);
+	NODE_SET_METHOD(exports, "setClientData", SetClientData);
+	NODE_SET_METHOD(exports, "subscribeToClientEvent", SubscribeToClientEvent);
+	NODE_SET_METHOD(exports, "mapInputEvent", MapInputEvent);
+	NODE_SET_METHOD(exports, "unsubscribeFromClientEvent", UnsubscribeFromClientEvent);
+	NODE_SET_METHOD(exports, "setNotificationGroupPriority", SetNotificationGroupPriority);
+	NODE_SET_METHOD(exports, "setInputGroupPriority", SetInputGroupPriority);
+	NODE_SET_METHOD(exports, "setInputGroupState", SetInputGroupState);
+	NODE_SET_METHOD(exports, "setEventBatchCallback", SetEventBatchCallback);
+	NODE_SET_METHOD(exports, "setMessageCallback", SetMessageCallback);
+	NODE_SET_METHOD(exports, "createObjectRegistry", CreateObjectRegistry);
+	NODE_SET_METHOD(exports, "destroyObjectRegistry", DestroyObjectRegistry);
+	NODE_SET_METHOD(exports, "createTrajectoryPlayer", CreateTrajectoryPlayer);
+	NODE_SET_METHOD(exports, "controlTrajectoryPlayer", ControlTrajectoryPlayer);
+	NODE_SET_METHOD(exports, "destroyTrajectoryPlayer", DestroyTrajectoryPlayer);
+	NODE_SET_METHOD(exports, "setSampleReuse", SetSampleReuse);
+	NODE_SET_METHOD(exports, "setSampleBatch", SetSampleBatch);
+	NODE_SET_METHOD(exports, "setTracing", SetTracing);
+	NODE_SET_METHOD(exports, "dumpTrace", DumpTrace);
+	NODE_SET_METHOD(exports, "createAIObjects", CreateAIObjects);
+	NODE_SET_METHOD(exports, "removeAIObjects", RemoveAIObjects);
+	NODE_SET_METHOD(exports, "loadFacilities", LoadFacilities);
+	NODE_SET_METHOD(exports, "getNearbyFacilities", GetNearbyFacilities);
+	NODE_SET_METHOD(exports, "setAutoReconnect", SetAutoReconnect);
+	NODE_SET_METHOD(exports, "setDispatchPriority", SetDispatchPriority);
+	NODE_SET_METHOD(exports, "setDispatchLane", SetDispatchLane);
+	NODE_SET_METHOD(exports, "getMetrics", GetMetrics);
+	NODE_SET_METHOD(exports, "setSampleTiming", SetSampleTiming);
+	NODE_SET_METHOD(exports, "addRule", AddRule);
+	NODE_SET_METHOD(exports, "removeRule", RemoveRule);
+	NODE_SET_METHOD(exports, "setFrameBarrier", SetFrameBarrier);
+	NODE_SET_METHOD(exports, "requestSimFrame", RequestSimFrame);
+	NODE_SET_METHOD(exports, "cancelSimFrame", CancelSimFrame);
+	NODE_SET_METHOD(exports, "cancelDataRequest", CancelDataRequest);
+	NODE_SET_METHOD(exports, "clearDataDefinition", ClearDataDefinition);
+	NODE_SET_METHOD(exports, "unsubscribeFromSystemEvent", UnsubscribeFromSystemEvent);
 	NODE_SET_METHOD(exports, "transmitClientEvent", TransmitClientEvent);
 	NODE_SET_METHOD(exports, "requestSystemState", RequestSystemState);
 	NODE_SET_METHOD(exports, "createDataDefinition", CreateDataDefinition);
+	NODE_SET_METHOD(exports, "registerDataDefinition", RegisterDataDefinition);
 	NODE_SET_METHOD(exports, "flightLoad", FlightLoad);
 	NODE_SET_METHOD(exports, "isConnected", isConnected);
+	NODE_SET_METHOD(exports, "createTelemetryEncoder", CreateTelemetryEncoder);
+	NODE_SET_METHOD(exports, "appendTelemetry", AppendTelemetry);
+	NODE_SET_METHOD(exports, "flushTelemetry", FlushTelemetry);
+	NODE_SET_METHOD(exports, "destroyTelemetryEncoder", DestroyTelemetryEncoder);
+	NODE_SET_METHOD(exports, "decodeTelemetry", DecodeTelemetry);
+	NODE_SET_METHOD(exports, "createArrowWriter", CreateArrowWriter);
+	NODE_SET_METHOD(exports, "appendArrow", AppendArrow);
+	NODE_SET_METHOD(exports, "flushArrow", FlushArrow);
+	NODE_SET_METHOD(exports, "closeArrowWriter", CloseArrowWriter);
+	NODE_SET_METHOD(exports, "telemetryToArrow", TelemetryToArrow);
+	NODE_SET_METHOD(exports, "publishTelemetryBus", PublishTelemetryBus);
+	NODE_SET_METHOD(exports, "attachTelemetryBus", AttachTelemetryBus);
+	NODE_SET_METHOD(exports, "readTelemetryBus", ReadTelemetryBus);
+	NODE_SET_METHOD(exports, "closeTelemetryBus", CloseTelemetryBus);
 }
 
 NODE_MODULE(addon, Initialize);
@@ -1,8 +1,18 @@
+#include <deque>
 #include <map>
 #include <string>
 #include <nan.h>
 
 #include "SimConnect.h"
+#include "arrow_writer.h"
+#include "datum.h"
+#include "expression.h"
+#include "facility_cache.h"
+#include "message_decoder.h"
+#include "rule.h"
+#include "telemetry_bus.h"
+#include "telemetry_codec.h"
+#include "trace.h"
 
 using namespace v8;
 
@@ -10,17 +20,286 @@ struct CallbackData {
 	DWORD cbData;
 	SIMCONNECT_RECV* pData;
 	NTSTATUS ntstatus;
+	HANDLE hReconnected;	// Set instead of pData when the worker has re-opened the connection
+	bool definitionsRegistered;	// Set instead of pData when the worker has registered queued definitions
+	uint64_t dispatchTime;	// uv_hrtime() when SimConnect_GetNextDispatch returned
+	uint32_t generation;	// Of the dispatch thread that sent it
+};
+
+// Messages are handed to the main thread through lanes, higher lanes (lower numbers) are handled first
+enum DispatchLaneId
+{
+	LANE_HIGH,
+	LANE_NORMAL,
+	LANE_LOW
+};
+static const int dispatchLaneCount = LANE_LOW + 1;
+static const int laneLatencyBuckets = 24;	// Powers of two microseconds, the last one takes the rest
+
+struct QueuedMessage {
+	std::vector<char> bytes;	// Copy of the message, the SimConnect buffer is re-used by the next fetch
+	uint64_t dispatchTime;
+};
+
+struct DispatchLane {
+	std::deque<QueuedMessage> messages;	// Guarded by laneMutex
+	uint64_t delivered;	// Statistics are kept by the main thread
+	uint64_t maxLatency;
+	uint64_t latency[laneLatencyBuckets];	// Time from fetch to handling
+};
+
+// Arrow export, written to a file every batchSize rows or returned by flushArrow
+struct ArrowExport {
+	ArrowWriter* writer;
+	FILE* file;	// NULL when the output is returned to JS
+	uint32_t batchSize;
+	bool writeFailed;
 };
 
 struct SystemEventRequest {
 	Nan::Callback* jsCallback;
 };
 
+struct ObjectRegistry;
+
+// Samples of a request collected natively and delivered as one block, one column per field
+struct SampleBatch {
+	DWORD size;	// Samples per block
+	uint64_t interval;	// Nanoseconds after which a partial block is delivered, 0 to always wait for size
+	uint64_t started;	// currentDispatchTime of the first sample of the block
+	DWORD count;
+	std::vector<double> timestamps;
+	std::vector<std::vector<char>> columns;	// Received bytes of the numeric datums
+	std::vector<std::vector<std::string>> strings;	// Values of the string datums
+	std::vector<std::vector<double>> computed;
+};
+
+struct DataRequest {
+	Nan::Callback* jsCallback;
+	SIMCONNECT_DATA_DEFINITION_ID defineId;
+	bool ownsDefinition;	// The definition was generated for this request only
+	bool byType;
+	SIMCONNECT_OBJECT_ID objectId;
+	SIMCONNECT_PERIOD period;
+	DWORD flags;
+	DWORD origin;
+	DWORD interval;
+	DWORD limit;
+	DWORD radius;
+	SIMCONNECT_SIMOBJECT_TYPE objectType;
+	ObjectRegistry* registry;	// Set for requests made by an object registry
+	Nan::Persistent<Object>* reusedSample;	// Set while the request re-uses its sample object
+	SampleBatch* batch;	// Set while samples are delivered in blocks
+};
+
+// Latest sample of a data request within the current sim frame, copied out of the SimConnect buffer
+struct FrameSample {
+	SIMCONNECT_DATA_DEFINITION_ID defineId;
+	std::vector<char> bytes;
+	std::vector<DatumSlice> slices;
+	std::vector<double> computed;
+};
+
+struct ClientDataArea {
+	std::string name;
+	DWORD size;	// 0 if the area is created by another client
+	DWORD flags;
+};
+
+struct ClientDataDatum {
+	DWORD offset;
+	DWORD sizeOrType;	// Size in bytes or one of SIMCONNECT_CLIENTDATATYPE_*
+	float epsilon;
+};
+
+struct ClientDataDefinition {
+	std::vector<ClientDataDatum> datums;
+	DWORD size;	// Bytes covered by the datums
+};
+
+struct ClientDataRequest {
+	Nan::Callback* jsCallback;
+	DWORD size;
+	SIMCONNECT_CLIENT_DATA_ID clientDataId;
+	SIMCONNECT_CLIENT_DATA_DEFINITION_ID defineId;
+	SIMCONNECT_CLIENT_DATA_PERIOD period;
+	DWORD flags;
+	DWORD origin;
+	DWORD interval;
+	DWORD limit;
+};
+
+// One object of a createAIObjects or removeAIObjects call
+struct AIRequest {
+	DWORD index;
+	SIMCONNECT_DATA_REQUEST_ID requestId;
+	DWORD sendId;
+	bool sent;
+};
+
+// A createAIObjects or removeAIObjects call, its promise settles once every object is accounted for
+struct AIBatch {
+	Nan::Persistent<v8::Promise::Resolver>* resolver;
+	bool remove;
+	std::vector<AIRequest> requests;
+	std::vector<double> objectIds;	// NaN for objects that were not created or removed
+	DWORD pending;
+	SIMCONNECT_DATA_REQUEST_ID markerId;	// Removals are confirmed by a system state request sent after them
+};
+
+// Entry of the event routing table, for client events in a notification group and input events
+struct EventRoute {
+	bool active;
+	Nan::Callback* jsCallback;	// NULL for events delivered in the per-frame batch
+	bool input;
+	bool maskable;
+	DWORD groupId;	// Notification group, or input group for input events
+	std::string inputDefinition;
+};
+
+struct RegistryObject {
+	SIMCONNECT_DATA_REQUEST_ID requestId;
+	bool reported;	// The add delta has been delivered
+};
+
+// Live SimObjects of a type, kept up to date from the ObjectAdded and ObjectRemoved events
+struct ObjectRegistry {
+	Nan::Callback* jsCallback;
+	SIMCONNECT_DATA_DEFINITION_ID defineId;
+	bool ownsDefinition;
+	SIMCONNECT_SIMOBJECT_TYPE objectType;
+	SIMCONNECT_PERIOD period;
+	DWORD flags;
+	DWORD radius;	// Of the request finding the objects that already exist
+	SIMCONNECT_CLIENT_EVENT_ID addedEventId;
+	SIMCONNECT_CLIENT_EVENT_ID removedEventId;
+	std::map<SIMCONNECT_OBJECT_ID, RegistryObject> objects;
+	std::vector<SIMCONNECT_OBJECT_ID> lostObjects;	// Reported objects gone with the connection
+};
+
+// Values of a trajectory sample: time (seconds), latitude, longitude (degrees), altitude (feet),
+// pitch, bank, heading (degrees) and speed (knots)
+static const unsigned int trajectorySampleSize = 8;
+
+// Written to the sim for every frame, in the order of the trajectory data definition
+struct TrajectoryPosition {
+	double latitude;
+	double longitude;
+	double altitude;
+	double pitch;
+	double bank;
+	double heading;
+	double speed;
+};
+
+// A trajectory streamed into the sim by the dispatch worker on every frame, guarded by trajectoryMutex
+struct TrajectoryPlayer {
+	std::vector<double> samples;	// trajectorySampleSize values per sample, times start at 0
+	SIMCONNECT_OBJECT_ID objectId;
+	double position;	// Seconds into the trajectory
+	double rate;	// Negative to play backwards
+	bool playing;
+	bool loop;
+	bool ended;	// Stopped at an end, the callback is still due
+	size_t cursor;	// Sample at or before position
+	uint64_t lastTick;	// uv_hrtime() of the last frame written, 0 after a pause
+	Nan::Callback* jsCallback;	// Called when playback stops at an end
+};
+
+// Facility lists being downloaded. Filled by the dispatch worker, guarded by facilityMutex.
+struct FacilityDownload {
+	std::string path;
+	std::string simVersion;
+	SIMCONNECT_DATA_REQUEST_ID requestIds[SIMCONNECT_FACILITY_LIST_TYPE_COUNT];
+	DWORD pagesReceived[SIMCONNECT_FACILITY_LIST_TYPE_COUNT];
+	bool listComplete[SIMCONNECT_FACILITY_LIST_TYPE_COUNT];
+	std::vector<FacilityRecord> records;
+	std::vector<FacilityVorRecord> vors;
+	bool finished;	// Every list is in and the cache is built
+	FacilityCache* cache;
+	std::string error;
+	Nan::Callback* jsCallback;
+};
+
+struct DatumDescriptor {
+	std::string name;
+	std::string units;
+	bool hasUnits;	// Strings are registered with NULL units
+	SIMCONNECT_DATATYPE type;
+	float epsilon;
+	DWORD datumId;
+};
+
+// Field computed natively from the datums of every sample, eg. { name: "groundSpeed", expression: "hypot([VELOCITY WORLD X], [VELOCITY WORLD Z])" }
+struct ComputedField {
+	std::string name;
+	std::string source;
+	bool replace;	// Leave the datums read by the expression out of the sample
+	Expression expression;
+};
+
+struct DataRule {
+	DWORD id;
+	Rule rule;
+	Nan::Callback* jsCallback;	// Called when the rule changes state
+};
+
+// An outbound call, kept by packet id so an exception arriving later can be traced back to it
+struct SentCall {
+	DWORD sendId;
+	const char* call;	// NULL for unused entries
+	DWORD id;	// Definition, event or request the call was about
+	DWORD index;	// Datum of the definition, or SIMCONNECT_UNUSED
+	std::string detail;	// eg. the name of the datum or event
+	Nan::Callback* jsCallback;	// Called with the exception instead of the exception callback
+};
+
+// Last value of a string datum, returned again while the received bytes stay the same
+struct InternedString {
+	std::string bytes;
+	Nan::Persistent<String>* value;
+};
+
+// V8 strings kept for the samples of a definition
+struct SampleStrings {
+	std::vector<Nan::Persistent<String>*> keys;	// Datums followed by the computed fields
+	std::vector<InternedString> values;
+	Nan::Persistent<ObjectTemplate>* shape;	// Sample objects are instances of it
+};
+
+// Large string values are handed to V8 as external strings instead of being copied onto its heap
+class ExternalOneByteString : public String::ExternalOneByteStringResource {
+public:
+	ExternalOneByteString(const char* data, size_t length) : bytes(data, length) {}
+	const char* data() const override { return bytes.data(); }
+	size_t length() const override { return bytes.size(); }
+
+private:
+	std::string bytes;
+};
+
 struct DataDefinition {
 	SIMCONNECT_DATA_DEFINITION_ID id;
 	unsigned int num_values;
 	std::vector<std::string> datum_names;
 	std::vector<SIMCONNECT_DATATYPE> datum_types;
+	std::vector<DatumDescriptor> datums;
+	int simTimeIndex;	// Datum holding the sim time of the sample, or -1
+	std::vector<ComputedField> computed;
+	std::vector<bool> hidden;	// Datums left out of the sample object
+	std::vector<double> values;	// Datums as numbers followed by the computed fields, reused for every sample
+	std::vector<DataRule> rules;
+};
+
+// A definition passed to registerDataDefinition, registered by the dispatch worker so a large
+// definition does not hold up the event loop
+struct DefinitionRegistration {
+	DataDefinition definition;
+	HANDLE hSimConnect;	// Connection the datums were added on, set by the worker
+	HRESULT hr;
+	std::vector<DWORD> sendIds;	// Packet id of every added datum, 0 if it could not be read
+	Nan::Persistent<v8::Promise::Resolver>* resolver;
+	std::vector<std::pair<SIMCONNECT_DATA_REQUEST_ID, DataRequest>> queuedRequests;	// Sent once registered
 };
 
 
@@ -64,21 +343,6 @@ std::map<SIMCONNECT_EXCEPTION, const char*> exceptionNames = {
 	{ SIMCONNECT_EXCEPTION_OBJECT_SCHEDULE, "SIMCONNECT_EXCEPTION_OBJECT_SCHEDULE" }
 };
 
-std::map<SIMCONNECT_DATATYPE, int> sizeMap =
-{
-	{ SIMCONNECT_DATATYPE_INT32, 4 },
-	{ SIMCONNECT_DATATYPE_INT64, 8 },
-	{ SIMCONNECT_DATATYPE_FLOAT32, 4 },
-	{ SIMCONNECT_DATATYPE_FLOAT64, 8 },
-	{ SIMCONNECT_DATATYPE_STRING8, 8 },
-	{ SIMCONNECT_DATATYPE_STRING32, 32 },
-	{ SIMCONNECT_DATATYPE_STRING64, 64 },
-	{ SIMCONNECT_DATATYPE_STRING128, 128 },
-	{ SIMCONNECT_DATATYPE_STRING256, 256 },
-	{ SIMCONNECT_DATATYPE_STRING260, 260 }
-};
-
-
 void handleReceived_Data(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cbData);
 void handleReceived_DataByType(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cbData);
 void handleReceived_Frame(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cbData);
@@ -87,8 +351,70 @@ void handleReceived_Exception(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cb
 void handleReceived_Filename(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cbData);
 void handleReceived_Open(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cbData);
 void handleReceived_SystemState(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cbData);
-void handleReceived_Quit(Isolate* isolate);
+void handleReceived_Quit(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cbData);
+void handleReceived_Message(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cbData);
+void registerMessageHandlers();
+void handleReceived_ClientData(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cbData);
+void handleReceived_FacilitiesList(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cbData);
+bool collectFacilitiesList(SIMCONNECT_RECV* pData, DWORD cbData);
+HRESULT requestFacilitiesLists(HANDLE hSimConnect);
+void releaseClientDataRequest(SIMCONNECT_DATA_REQUEST_ID reqId);
+HRESULT replayClientData(HANDLE hSimConnect);
+HRESULT replayEventRoutes(HANDLE hSimConnect);
+void flushEventBatch(Isolate* isolate);
+void handleReceived_AssignedObjectId(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cbData);
+bool settleAIException(Isolate* isolate, DWORD sendId);
+bool settleAIMarker(Isolate* isolate, SIMCONNECT_DATA_REQUEST_ID requestId);
+void rejectAIBatches(Isolate* isolate, const char* reason);
+SIMCONNECT_DATA_INITPOSITION parseInitPosition(Local<Object> json);
+void handleReceived_ObjectAddRemove(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cbData);
+void handleRegistryData(Isolate* isolate, SIMCONNECT_DATA_REQUEST_ID reqId, SIMCONNECT_OBJECT_ID objectId, DWORD entryNumber, DWORD outOf, const DataDefinition& definition, const std::vector<DatumSlice>& slices, const double* computed);
+void dropRegistryObjects();
+HRESULT replayObjectRegistries(HANDLE hSimConnect);
+void deliverLostObjects(Isolate* isolate);
+Local<Object> sampleToObject(Isolate* isolate, const DataDefinition& definition, const std::vector<DatumSlice>& slices, const double* computed, Local<Object> target = Local<Object>());
+void releaseReusedSample(DataRequest& request);
+void appendSampleBatch(Isolate* isolate, SIMCONNECT_DATA_REQUEST_ID reqId, const DataDefinition& definition, const std::vector<DatumSlice>& slices, const double* computed);
+void deliverSampleBatch(Isolate* isolate, SIMCONNECT_DATA_REQUEST_ID reqId);
+void scheduleSampleBatches(uint64_t deadline);
+void deliverDueSampleBatches(uv_timer_t* handle);
+void holdFrameSample(SIMCONNECT_DATA_REQUEST_ID reqId, const DataDefinition& definition, const std::vector<DatumSlice>& slices);
+const double* evaluateSample(DataDefinition& definition, const std::vector<DatumSlice>& slices);
+void updateRules(Isolate* isolate, DataDefinition& definition);
+void deliverSimFrame(Isolate* isolate, SIMCONNECT_RECV_EVENT_FRAME* pFrame);
+void releaseSampleStrings(SIMCONNECT_DATA_DEFINITION_ID defineId);
+bool tickTrajectories(SIMCONNECT_RECV* pData, uint64_t now);
+void deliverTrajectoryEnds(Isolate* isolate);
+void releaseTrajectoryPlayers();
+void recordSentCallId(DWORD sendId, const char* call, DWORD id, DWORD index, const char* detail, Nan::Callback* jsCallback);
+bool registerQueuedDefinitions();
+void deliverRegisteredDefinitions(Isolate* isolate);
+void settleDefinitionRegistration(Isolate* isolate, DefinitionRegistration* registration, HRESULT hr, HRESULT& requestError);
+void rejectDefinitionRegistrations(Isolate* isolate, const char* reason);
+bool queuePendingRequest(const v8::FunctionCallbackInfo<v8::Value>& args, SIMCONNECT_DATA_DEFINITION_ID defineId, DataRequest& request);
+bool cancelQueuedRequest(SIMCONNECT_DATA_REQUEST_ID reqId);
+HRESULT sendDataRequest(HANDLE hSimConnect, SIMCONNECT_DATA_REQUEST_ID reqId, const DataRequest& request);
+void writeArrowExport(ArrowExport& entry, bool finish);
 void handle_Error(Isolate* isolate, NTSTATUS code);
+void connectionLost();
+void scheduleReconnect();
+void rehydrateConnection(Isolate* isolate, HANDLE hSimConnect);
 
 void messageReceiver(uv_async_t* handle);
-DataDefinition generateDataDefinition(Isolate* isolate, HANDLE hSimConnect, Local<Array> requestedValues);
\ No newline at end of file
+void dispatchMessage(Isolate* isolate, SIMCONNECT_RECV* pData, DWORD cbData, uint64_t dispatchTime);
+int messageLane(const SIMCONNECT_RECV* pData, DWORD cbData);
+void queueMessage(const SIMCONNECT_RECV* pData, DWORD cbData, uint64_t dispatchTime);
+bool drainLanes(Isolate* isolate);
+void clearLanes();
+void releaseDataRequest(SIMCONNECT_DATA_REQUEST_ID reqId);
+void releaseDataDefinition(SIMCONNECT_DATA_DEFINITION_ID defineId);
+void releaseSystemEvent(SIMCONNECT_CLIENT_EVENT_ID eventId);
+std::vector<DatumDescriptor> parseDatums(Isolate* isolate, Local<Array> requestedValues);
+std::vector<ComputedField> parseComputedFields(Isolate* isolate, Local<Array> requestedValues);
+bool compileComputedFields(DataDefinition& definition, std::string& error);
+bool parseDataDefinition(Isolate* isolate, Local<Array> requestedValues, DataDefinition& definition);
+HRESULT registerDatums(HANDLE hSimConnect, SIMCONNECT_DATA_DEFINITION_ID definitionId, const std::vector<DatumDescriptor>& datums);
+DataDefinition generateDataDefinition(Isolate* isolate, HANDLE hSimConnect, Local<Array> requestedValues);
+HRESULT mapClientEvent(const std::string& eventName, SIMCONNECT_CLIENT_EVENT_ID& eventId);
+Local<Object> registerManifest(Isolate* isolate, Local<Object> manifest);
+int64_t telemetryTimestamp(uint64_t hrtime);
\ No newline at end of file
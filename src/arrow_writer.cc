@@ -0,0 +1,383 @@
+#include "arrow_writer.h"
+
+#include <string.h>
+
+// Values of the Arrow format's flatbuffers schema (Message.fbs and Schema.fbs)
+static const uint16_t metadataVersionV5 = 4;
+static const uint8_t headerSchema = 1;
+static const uint8_t headerRecordBatch = 3;
+static const uint8_t typeInt = 2;
+static const uint8_t typeFloatingPoint = 3;
+static const uint8_t typeUtf8 = 5;
+static const uint8_t typeTimestamp = 10;
+static const uint16_t precisionSingle = 1;
+static const uint16_t precisionDouble = 2;
+static const uint16_t timeUnitMicrosecond = 2;
+
+static size_t alignTo8(size_t value)
+{
+	return (value + 7) & ~(size_t)7;
+}
+
+// Minimal flatbuffers writer. Unlike the flatbuffers library it writes front to back:
+// a table is written before the strings, vectors and tables it refers to, and their
+// offsets are patched in once they are written, so all offsets point forward.
+class FlatBuilder
+{
+public:
+	FlatBuilder() : bytes(4, 0) {} // Offset of the root table
+
+	// Fields are { size, value } by field id, size 0 for absent fields. Offsets are given
+	// as 4-byte fields and patched later, slots receives the position of every field.
+	size_t table(const std::vector<std::pair<int, uint64_t>> &fields, std::vector<size_t> *slots = NULL)
+	{
+		std::vector<uint16_t> positions(fields.size(), 0);
+		size_t size = 4; // Offset of the vtable
+		for (size_t i = 0; i < fields.size(); i++)
+		{
+			if (fields[i].first)
+			{
+				size = (size + fields[i].first - 1) / fields[i].first * fields[i].first;
+				positions[i] = (uint16_t)size;
+				size += fields[i].first;
+			}
+		}
+
+		pad(2);
+		size_t vtable = bytes.size();
+		write(vtable, 4 + 2 * fields.size(), 2);
+		write(vtable + 2, size, 2);
+		for (size_t i = 0; i < fields.size(); i++)
+			write(vtable + 4 + 2 * i, positions[i], 2);
+
+		pad(8); // Tables start 8-aligned, so their fields are aligned to their size
+		size_t table = bytes.size();
+		bytes.resize(table + size, 0);
+		write(table, table - vtable, 4);
+		for (size_t i = 0; i < fields.size(); i++)
+		{
+			if (fields[i].first)
+			{
+				write(table + positions[i], fields[i].second, fields[i].first);
+				if (slots)
+					(*slots)[i] = table + positions[i];
+			}
+		}
+		return table;
+	}
+
+	size_t string(const std::string &value)
+	{
+		pad(4);
+		size_t position = bytes.size();
+		write(position, value.size(), 4);
+		bytes.insert(bytes.end(), value.begin(), value.end());
+		bytes.push_back(0);
+		return position;
+	}
+
+	// Vector of scalars or structs, the elements are 8-aligned
+	size_t vector(const void *data, size_t count, size_t elementSize)
+	{
+		pad(8);
+		bytes.resize(bytes.size() + 4, 0); // So the elements after the length are 8-aligned
+		size_t position = bytes.size();
+		write(position, count, 4);
+		if (count)
+			bytes.insert(bytes.end(), (const uint8_t *)data, (const uint8_t *)data + count * elementSize);
+		return position;
+	}
+
+	// Vector of offsets to tables, element i is patched at the returned position + 4 + 4 * i
+	size_t offsetVector(size_t count)
+	{
+		pad(4);
+		size_t position = bytes.size();
+		write(position, count, 4);
+		bytes.resize(position + 4 + 4 * count, 0);
+		return position;
+	}
+
+	void patch(size_t slot, size_t target)
+	{
+		write(slot, target - slot, 4);
+	}
+
+	void finish(size_t root)
+	{
+		patch(0, root);
+		pad(8);
+	}
+
+	std::vector<uint8_t> bytes;
+
+private:
+	void pad(size_t alignment)
+	{
+		bytes.resize((bytes.size() + alignment - 1) / alignment * alignment, 0);
+	}
+
+	// Little-endian, growing the buffer when writing past its end
+	void write(size_t position, uint64_t value, int size)
+	{
+		if (bytes.size() < position + size)
+			bytes.resize(position + size, 0);
+		for (int i = 0; i < size; i++)
+			bytes[position + i] = (uint8_t)(value >> (8 * i));
+	}
+};
+
+// Message table with the header still to be patched in
+static size_t messageTable(FlatBuilder &builder, uint8_t headerType, int64_t bodyLength, size_t &headerSlot)
+{
+	std::vector<size_t> slots(4);
+	size_t message = builder.table({{2, metadataVersionV5}, {1, headerType}, {4, 0}, {8, (uint64_t)bodyLength}}, &slots);
+	headerSlot = slots[2];
+	return message;
+}
+
+// Encapsulated message: continuation marker, metadata size, metadata, body
+static void writeMessage(std::vector<uint8_t> &out, const FlatBuilder &metadata, const std::vector<uint8_t> &body)
+{
+	static const uint8_t continuation[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+	uint32_t size = (uint32_t)metadata.bytes.size(); // Padded to 8 bytes by finish
+	out.insert(out.end(), continuation, continuation + 4);
+	for (int i = 0; i < 4; i++)
+		out.push_back((uint8_t)(size >> (8 * i)));
+	out.insert(out.end(), metadata.bytes.begin(), metadata.bytes.end());
+	out.insert(out.end(), body.begin(), body.end());
+}
+
+static size_t fixedWidth(SIMCONNECT_DATATYPE type)
+{
+	switch (type)
+	{
+	case SIMCONNECT_DATATYPE_INT32:
+	case SIMCONNECT_DATATYPE_FLOAT32:
+		return 4;
+	case SIMCONNECT_DATATYPE_INT64:
+	case SIMCONNECT_DATATYPE_FLOAT64:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+ArrowWriter::ArrowWriter(const std::vector<std::string> &names, const std::vector<SIMCONNECT_DATATYPE> &types, SIMCONNECT_DATA_DEFINITION_ID defineId)
+	: defineId(defineId), column(0), rowCount(0), schemaWritten(false)
+{
+	columns.resize(types.size());
+	for (size_t i = 0; i < types.size(); i++)
+	{
+		columns[i].name = i < names.size() ? names[i] : "column" + std::to_string(i);
+		columns[i].type = types[i];
+		if (!fixedWidth(types[i]))
+			columns[i].offsets.push_back(0);
+	}
+}
+
+void ArrowWriter::beginRow(int64_t timestampUs)
+{
+	timestamps.push_back(timestampUs);
+	column = 0;
+}
+
+void ArrowWriter::putFixed(const void *value, size_t size)
+{
+	std::vector<uint8_t> &values = columns[column++].values;
+	values.insert(values.end(), (const uint8_t *)value, (const uint8_t *)value + size);
+}
+
+void ArrowWriter::putInt32(int32_t value)
+{
+	putFixed(&value, sizeof(value));
+}
+
+void ArrowWriter::putInt64(int64_t value)
+{
+	putFixed(&value, sizeof(value));
+}
+
+void ArrowWriter::putFloat32(float value)
+{
+	putFixed(&value, sizeof(value));
+}
+
+void ArrowWriter::putFloat64(double value)
+{
+	putFixed(&value, sizeof(value));
+}
+
+void ArrowWriter::putString(const char *value, size_t length)
+{
+	ArrowColumn &target = columns[column++];
+	target.values.insert(target.values.end(), (const uint8_t *)value, (const uint8_t *)value + length);
+	target.offsets.push_back((int32_t)target.values.size());
+}
+
+void ArrowWriter::putNumber(double value)
+{
+	switch (columns[column].type)
+	{
+	case SIMCONNECT_DATATYPE_INT32:
+		putInt32((int32_t)value);
+		break;
+	case SIMCONNECT_DATATYPE_INT64:
+		putInt64((int64_t)value);
+		break;
+	case SIMCONNECT_DATATYPE_FLOAT32:
+		putFloat32((float)value);
+		break;
+	case SIMCONNECT_DATATYPE_FLOAT64:
+		putFloat64(value);
+		break;
+	default:
+		putString("", 0);
+		break;
+	}
+}
+
+void ArrowWriter::putDatum(const char *pDatum, size_t maxLength)
+{
+	SIMCONNECT_DATATYPE type = columns[column].type;
+	size_t width = fixedWidth(type);
+	if (width)
+	{
+		putFixed(pDatum, width); // Same layout as Arrow, little-endian
+		return;
+	}
+
+	size_t limit = type == SIMCONNECT_DATATYPE_STRINGV ? maxLength : datumSize(type);
+	if (limit > maxLength)
+	{
+		limit = maxLength;
+	}
+	const char *end = (const char *)memchr(pDatum, 0, limit);
+	putString(pDatum, end ? end - pDatum : limit);
+}
+
+void ArrowWriter::endRow()
+{
+	while (column < columns.size())
+	{
+		putNumber(0);
+	}
+	rowCount++;
+}
+
+void ArrowWriter::writeSchema(std::vector<uint8_t> &out)
+{
+	FlatBuilder builder;
+	size_t headerSlot;
+	size_t message = messageTable(builder, headerSchema, 0, headerSlot);
+
+	std::vector<size_t> schemaSlots(2);
+	size_t schema = builder.table({{0, 0}, {4, 0}}, &schemaSlots); // Endianness left at its default, little
+	builder.patch(headerSlot, schema);
+	size_t fields = builder.offsetVector(columns.size() + 1);
+	builder.patch(schemaSlots[1], fields);
+
+	for (size_t i = 0; i <= columns.size(); i++)
+	{
+		SIMCONNECT_DATATYPE type = i ? columns[i - 1].type : SIMCONNECT_DATATYPE_INT64;
+		uint8_t typeType = i == 0 ? typeTimestamp : type == SIMCONNECT_DATATYPE_INT32 || type == SIMCONNECT_DATATYPE_INT64 ? typeInt
+			: type == SIMCONNECT_DATATYPE_FLOAT32 || type == SIMCONNECT_DATATYPE_FLOAT64 ? typeFloatingPoint : typeUtf8;
+
+		// name, nullable, type_type, type, dictionary, children
+		std::vector<size_t> fieldSlots(6);
+		size_t field = builder.table({{4, 0}, {1, 0}, {1, typeType}, {4, 0}, {0, 0}, {4, 0}}, &fieldSlots);
+		builder.patch(fields + 4 + 4 * i, field);
+		builder.patch(fieldSlots[0], builder.string(i ? columns[i - 1].name : "timestamp"));
+
+		size_t typeTable;
+		std::vector<size_t> typeSlots(2);
+		if (typeType == typeTimestamp)
+		{
+			typeTable = builder.table({{2, timeUnitMicrosecond}, {4, 0}}, &typeSlots);
+			builder.patch(typeSlots[1], builder.string("UTC"));
+		}
+		else if (typeType == typeInt)
+			typeTable = builder.table({{4, type == SIMCONNECT_DATATYPE_INT32 ? 32u : 64u}, {1, 1}});
+		else if (typeType == typeFloatingPoint)
+			typeTable = builder.table({{2, type == SIMCONNECT_DATATYPE_FLOAT32 ? precisionSingle : precisionDouble}});
+		else
+			typeTable = builder.table({});
+		builder.patch(fieldSlots[3], typeTable);
+		builder.patch(fieldSlots[5], builder.vector(NULL, 0, 4));
+	}
+
+	builder.finish(message);
+	writeMessage(out, builder, std::vector<uint8_t>());
+}
+
+void ArrowWriter::writeRecordBatch(std::vector<uint8_t> &out)
+{
+	// Every column has a validity buffer, empty as there are no nulls, and its values;
+	// strings have their offsets in between. Buffers are 8-aligned in the body.
+	std::vector<uint8_t> body;
+	std::vector<int64_t> buffers; // Offset and length of every buffer
+	auto append = [&](const void *data, size_t length) {
+		buffers.push_back((int64_t)body.size());
+		buffers.push_back((int64_t)length);
+		if (length)
+			body.insert(body.end(), (const uint8_t *)data, (const uint8_t *)data + length);
+		body.resize(alignTo8(body.size()), 0);
+	};
+
+	append(NULL, 0);
+	append(timestamps.data(), timestamps.size() * sizeof(int64_t));
+	for (auto &entry : columns)
+	{
+		append(NULL, 0);
+		if (!fixedWidth(entry.type))
+			append(entry.offsets.data(), entry.offsets.size() * sizeof(int32_t));
+		append(entry.values.data(), entry.values.size());
+	}
+
+	std::vector<int64_t> nodes; // Length and null count of every column
+	for (size_t i = 0; i <= columns.size(); i++)
+	{
+		nodes.push_back(rowCount);
+		nodes.push_back(0);
+	}
+
+	FlatBuilder builder;
+	size_t headerSlot;
+	size_t message = messageTable(builder, headerRecordBatch, (int64_t)body.size(), headerSlot);
+	std::vector<size_t> batchSlots(3);
+	size_t batch = builder.table({{8, rowCount}, {4, 0}, {4, 0}}, &batchSlots);
+	builder.patch(headerSlot, batch);
+	builder.patch(batchSlots[1], builder.vector(nodes.data(), nodes.size() / 2, 16));
+	builder.patch(batchSlots[2], builder.vector(buffers.data(), buffers.size() / 2, 16));
+	builder.finish(message);
+	writeMessage(out, builder, body);
+
+	timestamps.clear();
+	for (auto &entry : columns)
+	{
+		entry.values.clear();
+		if (!fixedWidth(entry.type))
+			entry.offsets.assign(1, 0);
+	}
+	rowCount = 0;
+}
+
+void ArrowWriter::flush(std::vector<uint8_t> &out)
+{
+	if (!schemaWritten)
+	{
+		writeSchema(out);
+		schemaWritten = true;
+	}
+	if (rowCount > 0)
+	{
+		writeRecordBatch(out);
+	}
+}
+
+void ArrowWriter::finish(std::vector<uint8_t> &out)
+{
+	static const uint8_t endOfStream[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0};
+	flush(out);
+	out.insert(out.end(), endOfStream, endOfStream + 8);
+}
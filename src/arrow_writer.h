@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "datum.h"
+
+// Writer of the Arrow IPC streaming format, so telemetry can be opened directly with
+// pandas, Polars or DuckDB. The first flush writes the schema, every flush a record batch
+// of the rows added since, and finish the end-of-stream marker, so the output of all
+// flushes can simply be appended to a file.
+//
+// Column 0 is the sample timestamp (microseconds, UTC), followed by one column per datum:
+// INT32/INT64 as signed integers, FLOAT32/FLOAT64 as floating point and strings as UTF-8.
+// No value is ever null. The few flatbuffers tables of the metadata are written by hand.
+
+struct ArrowColumn
+{
+	std::string name;
+	SIMCONNECT_DATATYPE type;
+	std::vector<uint8_t> values;  // Fixed-width values, or the bytes of all strings
+	std::vector<int32_t> offsets; // Strings only, one more than there are rows
+};
+
+class ArrowWriter
+{
+public:
+	ArrowWriter(const std::vector<std::string> &names, const std::vector<SIMCONNECT_DATATYPE> &types, SIMCONNECT_DATA_DEFINITION_ID defineId);
+
+	// A row is written as beginRow() followed by one put per column, in column order.
+	// Columns left out are written as 0 or an empty string.
+	void beginRow(int64_t timestampUs);
+	void putInt32(int32_t value);
+	void putInt64(int64_t value);
+	void putFloat32(float value);
+	void putFloat64(double value);
+	void putString(const char *value, size_t length);
+	void putNumber(double value);				 // Converts to the column's type
+	void putDatum(const char *pDatum, size_t maxLength); // Raw SimConnect payload of the column's type
+	void endRow();
+
+	// Appends the schema (on the first flush) and a record batch of the pending rows
+	void flush(std::vector<uint8_t> &out);
+	// Flushes and appends the end-of-stream marker
+	void finish(std::vector<uint8_t> &out);
+
+	SIMCONNECT_DATA_DEFINITION_ID defineId;
+	const std::vector<ArrowColumn> &columnList() const { return columns; }
+	uint32_t pendingRows() const { return rowCount; }
+
+private:
+	void putFixed(const void *value, size_t size);
+	void writeSchema(std::vector<uint8_t> &out);
+	void writeRecordBatch(std::vector<uint8_t> &out);
+
+	std::vector<ArrowColumn> columns;
+	std::vector<int64_t> timestamps;
+	size_t column;
+	uint32_t rowCount;
+	bool schemaWritten;
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <windows.h>
+
+#include "SimConnect.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DATUM_SSE2 1
+#endif
+
+// One datum of a received sample, pointing into the SimConnect receive buffer
+struct DatumSlice
+{
+	const char *data;
+	DWORD size;
+};
+
+// Payload size of the fixed-size datatypes, 0 for STRINGV and structured types
+inline DWORD datumSize(SIMCONNECT_DATATYPE type)
+{
+	switch (type)
+	{
+	case SIMCONNECT_DATATYPE_INT32:
+	case SIMCONNECT_DATATYPE_FLOAT32:
+		return 4;
+	case SIMCONNECT_DATATYPE_INT64:
+	case SIMCONNECT_DATATYPE_FLOAT64:
+	case SIMCONNECT_DATATYPE_STRING8:
+		return 8;
+	case SIMCONNECT_DATATYPE_STRING32:
+		return 32;
+	case SIMCONNECT_DATATYPE_STRING64:
+		return 64;
+	case SIMCONNECT_DATATYPE_STRING128:
+		return 128;
+	case SIMCONNECT_DATATYPE_STRING256:
+		return 256;
+	case SIMCONNECT_DATATYPE_STRING260:
+		return 260;
+	default:
+		return 0;
+	}
+}
+
+inline bool isStringType(SIMCONNECT_DATATYPE type)
+{
+	return type >= SIMCONNECT_DATATYPE_STRING8 && type <= SIMCONNECT_DATATYPE_STRINGV;
+}
+
+// Numeric value of a datum, NaN for strings
+inline double datumToNumber(SIMCONNECT_DATATYPE type, const DatumSlice &datum)
+{
+	switch (type)
+	{
+	case SIMCONNECT_DATATYPE_INT32:
+	{
+		int32_t value;
+		memcpy(&value, datum.data, sizeof(value));
+		return value;
+	}
+	case SIMCONNECT_DATATYPE_INT64:
+	{
+		int64_t value;
+		memcpy(&value, datum.data, sizeof(value));
+		return (double)value;
+	}
+	case SIMCONNECT_DATATYPE_FLOAT32:
+	{
+		float value;
+		memcpy(&value, datum.data, sizeof(value));
+		return value;
+	}
+	case SIMCONNECT_DATATYPE_FLOAT64:
+	{
+		double value;
+		memcpy(&value, datum.data, sizeof(value));
+		return value;
+	}
+	default:
+		return NAN;
+	}
+}
+
+// Converts count consecutive datums of a numeric type to doubles, FLOAT32 and INT32 four at a time
+inline void widenDatums(SIMCONNECT_DATATYPE type, const char *in, size_t count, double *out)
+{
+	size_t i = 0;
+	switch (type)
+	{
+	case SIMCONNECT_DATATYPE_FLOAT32:
+#ifdef DATUM_SSE2
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 values = _mm_loadu_ps((const float *)(in + i * 4));
+			_mm_storeu_pd(out + i, _mm_cvtps_pd(values));
+			_mm_storeu_pd(out + i + 2, _mm_cvtps_pd(_mm_movehl_ps(values, values)));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			float value;
+			memcpy(&value, in + i * 4, sizeof(value));
+			out[i] = value;
+		}
+		break;
+	case SIMCONNECT_DATATYPE_INT32:
+#ifdef DATUM_SSE2
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i values = _mm_loadu_si128((const __m128i *)(in + i * 4));
+			_mm_storeu_pd(out + i, _mm_cvtepi32_pd(values));
+			_mm_storeu_pd(out + i + 2, _mm_cvtepi32_pd(_mm_shuffle_epi32(values, _MM_SHUFFLE(1, 0, 3, 2))));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			int32_t value;
+			memcpy(&value, in + i * 4, sizeof(value));
+			out[i] = value;
+		}
+		break;
+	case SIMCONNECT_DATATYPE_INT64:
+		for (; i < count; i++)
+		{
+			int64_t value;
+			memcpy(&value, in + i * 8, sizeof(value));
+			out[i] = (double)value;
+		}
+		break;
+	case SIMCONNECT_DATATYPE_FLOAT64:
+		memcpy(out, in, count * sizeof(double));
+		break;
+	default:
+		for (; i < count; i++)
+			out[i] = NAN;
+		break;
+	}
+}
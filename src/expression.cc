@@ -0,0 +1,508 @@
+#include "expression.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const double expressionPi = 3.14159265358979323846;
+
+enum ExpressionOp : uint8_t
+{
+	OP_CONST,
+	OP_VAR,
+	OP_NEG,
+	OP_NOT,
+	OP_ADD,
+	OP_SUB,
+	OP_MUL,
+	OP_DIV,
+	OP_MOD,
+	OP_POW,
+	OP_SQUARE,
+	OP_LT,
+	OP_LE,
+	OP_GT,
+	OP_GE,
+	OP_EQ,
+	OP_NE,
+	OP_AND,
+	OP_OR,
+	OP_SELECT,
+	OP_ABS,
+	OP_SQRT,
+	OP_EXP,
+	OP_LOG,
+	OP_LOG10,
+	OP_SIN,
+	OP_COS,
+	OP_TAN,
+	OP_ASIN,
+	OP_ACOS,
+	OP_ATAN,
+	OP_ATAN2,
+	OP_FLOOR,
+	OP_CEIL,
+	OP_ROUND,
+	OP_MIN,
+	OP_MAX,
+	OP_HYPOT,
+	OP_CLAMP,
+	OP_EMA,
+	OP_PREV
+};
+
+struct ExpressionFunction
+{
+	const char *name;
+	int arity;
+	ExpressionOp op;
+	bool stateful;
+};
+
+static const ExpressionFunction expressionFunctions[] = {
+	{"abs", 1, OP_ABS, false},
+	{"sqrt", 1, OP_SQRT, false},
+	{"exp", 1, OP_EXP, false},
+	{"log", 1, OP_LOG, false},
+	{"log10", 1, OP_LOG10, false},
+	{"sin", 1, OP_SIN, false},
+	{"cos", 1, OP_COS, false},
+	{"tan", 1, OP_TAN, false},
+	{"asin", 1, OP_ASIN, false},
+	{"acos", 1, OP_ACOS, false},
+	{"atan", 1, OP_ATAN, false},
+	{"atan2", 2, OP_ATAN2, false},
+	{"floor", 1, OP_FLOOR, false},
+	{"ceil", 1, OP_CEIL, false},
+	{"round", 1, OP_ROUND, false},
+	{"min", 2, OP_MIN, false},
+	{"max", 2, OP_MAX, false},
+	{"pow", 2, OP_POW, false},
+	{"hypot", 2, OP_HYPOT, false},
+	{"clamp", 3, OP_CLAMP, false},
+	{"ema", 2, OP_EMA, true},
+	{"prev", 1, OP_PREV, true},
+};
+
+static bool equalsIgnoreCase(const std::string &a, const std::string &b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++)
+		if (toupper((unsigned char)a[i]) != toupper((unsigned char)b[i]))
+			return false;
+	return true;
+}
+
+// Recursive descent parser emitting postfix code
+class ExpressionParser
+{
+public:
+	ExpressionParser(Expression &expression, const std::string &source, const std::vector<std::string> &variables)
+		: expression(expression), source(source), variables(variables), pos(0), depth(0) {}
+
+	bool parse(std::string &error)
+	{
+		if (!parseTernary())
+		{
+			error = message;
+			return false;
+		}
+		skipSpace();
+		if (pos < source.size())
+		{
+			error = "Unexpected '" + source.substr(pos, 1) + "' at position " + std::to_string(pos);
+			return false;
+		}
+		return true;
+	}
+
+private:
+	Expression &expression;
+	const std::string &source;
+	const std::vector<std::string> &variables;
+	size_t pos;
+	int depth;
+	std::string message;
+
+	bool fail(const std::string &text)
+	{
+		if (message.empty())
+			message = text + " at position " + std::to_string(pos);
+		return false;
+	}
+
+	void skipSpace()
+	{
+		while (pos < source.size() && isspace((unsigned char)source[pos]))
+			pos++;
+	}
+
+	bool accept(const char *token)
+	{
+		skipSpace();
+		size_t length = strlen(token);
+		if (source.compare(pos, length, token) == 0)
+		{
+			// "<" must not match the start of "<=", "=" is never an operator on its own
+			if (length == 1 && pos + 1 < source.size() && source[pos + 1] == '=' && (token[0] == '<' || token[0] == '>' || token[0] == '!'))
+				return false;
+			pos += length;
+			return true;
+		}
+		return false;
+	}
+
+	void emit(ExpressionOp op, int32_t arg = 0, double value = 0, int stackEffect = 0)
+	{
+		expression.code.push_back({op, arg, value});
+		depth += stackEffect;
+		if (depth > expression.maxDepth)
+			expression.maxDepth = depth;
+	}
+
+	bool parseTernary()
+	{
+		if (!parseBinary(0))
+			return false;
+		if (accept("?"))
+		{
+			if (!parseTernary())
+				return false;
+			if (!accept(":"))
+				return fail("Expected ':'");
+			if (!parseTernary())
+				return false;
+			emit(OP_SELECT, 0, 0, -2);
+		}
+		return true;
+	}
+
+	// Binary operators by precedence level, lowest first
+	bool parseBinary(int level)
+	{
+		static const struct
+		{
+			const char *token;
+			ExpressionOp op;
+			int level;
+		} operators[] = {
+			{"||", OP_OR, 0},
+			{"&&", OP_AND, 1},
+			{"==", OP_EQ, 2},
+			{"!=", OP_NE, 2},
+			{"<=", OP_LE, 3},
+			{">=", OP_GE, 3},
+			{"<", OP_LT, 3},
+			{">", OP_GT, 3},
+			{"+", OP_ADD, 4},
+			{"-", OP_SUB, 4},
+			{"*", OP_MUL, 5},
+			{"/", OP_DIV, 5},
+			{"%", OP_MOD, 5},
+		};
+		const int levels = 6;
+
+		if (level == levels)
+			return parseUnary();
+
+		if (!parseBinary(level + 1))
+			return false;
+		while (true)
+		{
+			bool matched = false;
+			for (auto &op : operators)
+			{
+				if (op.level == level && accept(op.token))
+				{
+					if (!parseBinary(level + 1))
+						return false;
+					emit(op.op, 0, 0, -1);
+					matched = true;
+					break;
+				}
+			}
+			if (!matched)
+				return true;
+		}
+	}
+
+	bool parseUnary()
+	{
+		if (accept("-"))
+		{
+			if (!parseUnary())
+				return false;
+			emit(OP_NEG);
+			return true;
+		}
+		if (accept("!"))
+		{
+			if (!parseUnary())
+				return false;
+			emit(OP_NOT);
+			return true;
+		}
+		if (accept("+"))
+			return parseUnary();
+		return parsePower();
+	}
+
+	bool parsePower()
+	{
+		if (!parsePrimary())
+			return false;
+		if (accept("^"))
+		{
+			if (!parseUnary()) // Right associative, 2^-1 is allowed
+				return false;
+			if (expression.code.back().op == OP_CONST && expression.code.back().value == 2)
+			{
+				// x^2 is by far the most common power, and much cheaper than pow()
+				expression.code.pop_back();
+				depth--;
+				emit(OP_SQUARE);
+			}
+			else
+			{
+				emit(OP_POW, 0, 0, -1);
+			}
+		}
+		return true;
+	}
+
+	bool parseVariable(const std::string &name)
+	{
+		for (size_t i = 0; i < variables.size(); i++)
+		{
+			if (equalsIgnoreCase(variables[i], name))
+			{
+				emit(OP_VAR, (int32_t)i, 0, 1);
+				expression.referenced.push_back((int)i);
+				return true;
+			}
+		}
+		if (equalsIgnoreCase(name, "pi"))
+		{
+			emit(OP_CONST, 0, expressionPi, 1);
+			return true;
+		}
+		return fail("Unknown variable '" + name + "'");
+	}
+
+	bool parsePrimary()
+	{
+		skipSpace();
+		if (pos >= source.size())
+			return fail("Unexpected end of expression");
+
+		char c = source[pos];
+		if (isdigit((unsigned char)c) || c == '.')
+		{
+			const char *start = source.c_str() + pos;
+			char *end;
+			double value = strtod(start, &end);
+			if (end == start)
+				return fail("Invalid number");
+			pos += end - start;
+			emit(OP_CONST, 0, value, 1);
+			return true;
+		}
+		if (c == '(')
+		{
+			pos++;
+			if (!parseTernary())
+				return false;
+			if (!accept(")"))
+				return fail("Expected ')'");
+			return true;
+		}
+		if (c == '[')
+		{
+			size_t end = source.find(']', pos);
+			if (end == std::string::npos)
+				return fail("Expected ']'");
+			std::string name = source.substr(pos + 1, end - pos - 1);
+			pos = end + 1;
+			return parseVariable(name);
+		}
+		if (isalpha((unsigned char)c) || c == '_')
+		{
+			size_t start = pos;
+			while (pos < source.size() && (isalnum((unsigned char)source[pos]) || source[pos] == '_'))
+				pos++;
+			std::string name = source.substr(start, pos - start);
+
+			if (!accept("("))
+				return parseVariable(name);
+
+			for (auto &function : expressionFunctions)
+			{
+				if (name == function.name)
+				{
+					for (int i = 0; i < function.arity; i++)
+					{
+						if (i > 0 && !accept(","))
+							return fail("Expected ',' in " + name + "()");
+						if (!parseTernary())
+							return false;
+					}
+					if (!accept(")"))
+						return fail("Expected ')' after the arguments of " + name + "()");
+
+					int32_t slot = 0;
+					if (function.stateful)
+					{
+						slot = (int32_t)expression.state.size();
+						expression.state.push_back(NAN); // No previous sample yet
+					}
+					emit(function.op, slot, 0, 1 - function.arity);
+					return true;
+				}
+			}
+			return fail("Unknown function '" + name + "'");
+		}
+		return fail(std::string("Unexpected '") + c + "'");
+	}
+};
+
+bool Expression::compile(const std::string &source, const std::vector<std::string> &variables, std::string &error)
+{
+	code.clear();
+	state.clear();
+	referenced.clear();
+	maxDepth = 0;
+
+	ExpressionParser parser(*this, source, variables);
+	if (!parser.parse(error))
+	{
+		code.clear();
+		return false;
+	}
+	stack.resize(maxDepth > 0 ? maxDepth : 1);
+	return true;
+}
+
+double Expression::evaluate(const double *variables)
+{
+	double *sp = stack.data(); // Points past the top of the stack
+
+	for (const Instruction &in : code)
+	{
+		switch (in.op)
+		{
+		case OP_CONST:
+			*sp++ = in.value;
+			break;
+		case OP_VAR:
+			*sp++ = variables[in.arg];
+			break;
+		case OP_NEG:
+			sp[-1] = -sp[-1];
+			break;
+		case OP_NOT:
+			sp[-1] = sp[-1] == 0;
+			break;
+		case OP_SELECT:
+			sp -= 2;
+			sp[-1] = sp[-1] != 0 ? sp[0] : sp[1];
+			break;
+		case OP_CLAMP:
+			sp -= 2;
+			sp[-1] = sp[-1] < sp[0] ? sp[0] : (sp[-1] > sp[1] ? sp[1] : sp[-1]);
+			break;
+		case OP_EMA:
+		{
+			sp--;
+			double &average = state[in.arg];
+			average = isnan(average) ? sp[-1] : average + sp[0] * (sp[-1] - average);
+			sp[-1] = average;
+			break;
+		}
+		case OP_PREV:
+		{
+			double previous = state[in.arg];
+			state[in.arg] = sp[-1];
+			sp[-1] = isnan(previous) ? sp[-1] : previous;
+			break;
+		}
+		case OP_SQUARE:
+			sp[-1] = sp[-1] * sp[-1];
+			break;
+		case OP_ABS:
+			sp[-1] = fabs(sp[-1]);
+			break;
+		case OP_SQRT:
+			sp[-1] = sqrt(sp[-1]);
+			break;
+		case OP_EXP:
+			sp[-1] = exp(sp[-1]);
+			break;
+		case OP_LOG:
+			sp[-1] = log(sp[-1]);
+			break;
+		case OP_LOG10:
+			sp[-1] = log10(sp[-1]);
+			break;
+		case OP_SIN:
+			sp[-1] = sin(sp[-1]);
+			break;
+		case OP_COS:
+			sp[-1] = cos(sp[-1]);
+			break;
+		case OP_TAN:
+			sp[-1] = tan(sp[-1]);
+			break;
+		case OP_ASIN:
+			sp[-1] = asin(sp[-1]);
+			break;
+		case OP_ACOS:
+			sp[-1] = acos(sp[-1]);
+			break;
+		case OP_ATAN:
+			sp[-1] = atan(sp[-1]);
+			break;
+		case OP_FLOOR:
+			sp[-1] = floor(sp[-1]);
+			break;
+		case OP_CEIL:
+			sp[-1] = ceil(sp[-1]);
+			break;
+		case OP_ROUND:
+			sp[-1] = round(sp[-1]);
+			break;
+		default:
+		{
+			// Binary operators
+			sp--;
+			double a = sp[-1], b = sp[0];
+			switch (in.op)
+			{
+			case OP_ADD: a = a + b; break;
+			case OP_SUB: a = a - b; break;
+			case OP_MUL: a = a * b; break;
+			case OP_DIV: a = a / b; break;
+			case OP_MOD: a = fmod(a, b); break;
+			case OP_POW: a = pow(a, b); break;
+			case OP_LT: a = a < b; break;
+			case OP_LE: a = a <= b; break;
+			case OP_GT: a = a > b; break;
+			case OP_GE: a = a >= b; break;
+			case OP_EQ: a = a == b; break;
+			case OP_NE: a = a != b; break;
+			case OP_AND: a = a != 0 && b != 0; break;
+			case OP_OR: a = a != 0 || b != 0; break;
+			case OP_ATAN2: a = atan2(a, b); break;
+			case OP_MIN: a = a < b ? a : b; break;
+			case OP_MAX: a = a > b ? a : b; break;
+			case OP_HYPOT: a = hypot(a, b); break;
+			}
+			sp[-1] = a;
+			break;
+		}
+		}
+	}
+
+	return code.empty() ? NAN : stack[0];
+}
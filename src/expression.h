@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Small arithmetic expression language for computed fields, compiled once into
+// stack bytecode and evaluated natively for every sample.
+//
+//   sqrt([VELOCITY WORLD X]^2 + [VELOCITY WORLD Z]^2) * 1.94384
+//   ema([VERTICAL SPEED], 0.2)
+//   onGround ? 0 : altitude - groundAltitude
+//
+// Variables are datum names, bare or in square brackets when they contain spaces or
+// colons, matched case-insensitively. Operators, from lowest to highest precedence:
+// ?:  ||  &&  == !=  < <= > >=  + -  * / %  unary - !  ^ (right associative).
+// Functions: abs, sqrt, exp, log, log10, sin, cos, tan, asin, acos, atan, atan2,
+// floor, ceil, round, min, max, pow, hypot, clamp(x, lo, hi), and the stateful
+// ema(x, alpha) and prev(x), which keep their state between samples. Constants: pi.
+
+class Expression
+{
+public:
+	Expression() : maxDepth(0) {}
+
+	// Compiles the source, resolving names against the variables that will be passed to evaluate()
+	bool compile(const std::string &source, const std::vector<std::string> &variables, std::string &error);
+
+	double evaluate(const double *variables);
+
+	// Indices of the variables the expression reads
+	const std::vector<int> &inputs() const { return referenced; }
+
+private:
+	struct Instruction
+	{
+		uint8_t op;
+		int32_t arg;  // Variable index, state slot or argument count
+		double value; // Constant
+	};
+
+	std::vector<Instruction> code;
+	std::vector<double> state;
+	std::vector<double> stack;
+	std::vector<int> referenced;
+	int maxDepth;
+
+	friend class ExpressionParser;
+};
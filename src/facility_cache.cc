@@ -0,0 +1,264 @@
+#include "facility_cache.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char cacheMagic[8] = { 'S', 'C', 'F', 'A', 'C', '\0', '\0', '\0' };
+static const double earthRadius = 6371008.8; // Mean radius, meters
+static const double degreesToRadians = 3.14159265358979323846 / 180;
+
+static uint32_t alignTo(uint32_t value, uint32_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+uint32_t facilityCell(double latitude, double longitude)
+{
+	int row = (int)floor(latitude + 90);
+	int column = (int)floor(longitude + 180);
+	row = row < 0 ? 0 : row > 179 ? 179 : row;
+	column = column < 0 ? 0 : column > 359 ? 359 : column;
+	return (uint32_t)(row * 360 + column);
+}
+
+double facilityDistance(double latitude1, double longitude1, double latitude2, double longitude2)
+{
+	double sinLatitude = sin((latitude2 - latitude1) * degreesToRadians / 2);
+	double sinLongitude = sin((longitude2 - longitude1) * degreesToRadians / 2);
+	double a = sinLatitude * sinLatitude + cos(latitude1 * degreesToRadians) * cos(latitude2 * degreesToRadians) * sinLongitude * sinLongitude;
+	return 2 * earthRadius * asin(sqrt(a < 1 ? a : 1));
+}
+
+FacilityCache *FacilityCache::build(const std::string &path, const std::string &simVersion, std::vector<FacilityRecord> &records, const std::vector<FacilityVorRecord> &vors, std::string &error)
+{
+	// Counting sort by grid cell, the VOR indexes travel with their records
+	std::vector<uint32_t> cellStart(facilityCacheCells + 1, 0);
+	for (auto &record : records)
+	{
+		cellStart[facilityCell(record.latitude, record.longitude) + 1]++;
+	}
+	for (uint32_t i = 0; i < facilityCacheCells; i++)
+	{
+		cellStart[i + 1] += cellStart[i];
+	}
+
+	std::vector<FacilityRecord> sorted(records.size());
+	std::vector<uint32_t> next(cellStart.begin(), cellStart.end() - 1);
+	FacilityCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	for (auto &record : records)
+	{
+		sorted[next[facilityCell(record.latitude, record.longitude)]++] = record;
+		if (record.type < SIMCONNECT_FACILITY_LIST_TYPE_COUNT)
+		{
+			header.typeCounts[record.type]++;
+		}
+	}
+	records.swap(sorted);
+
+	memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+	header.version = facilityCacheVersion;
+	header.recordCount = (uint32_t)records.size();
+	header.vorCount = (uint32_t)vors.size();
+	header.cellsOffset = alignTo(sizeof(FacilityCacheHeader), 8);
+	header.recordsOffset = alignTo(header.cellsOffset + (uint32_t)(cellStart.size() * sizeof(uint32_t)), 8);
+	header.vorsOffset = alignTo(header.recordsOffset + (uint32_t)(records.size() * sizeof(FacilityRecord)), 8);
+	strncpy(header.simVersion, simVersion.c_str(), sizeof(header.simVersion) - 1);
+
+	// Written next to the cache and moved over it, so readers never see a partial file
+	std::string temporaryPath = path + ".tmp";
+	FILE *file = fopen(temporaryPath.c_str(), "wb");
+	if (!file)
+	{
+		error = "Could not write the facility cache " + temporaryPath;
+		return NULL;
+	}
+
+	static const char padding[8] = {};
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+	written = written && fwrite(padding, 1, header.cellsOffset - sizeof(header), file) == header.cellsOffset - sizeof(header);
+	written = written && fwrite(cellStart.data(), sizeof(uint32_t), cellStart.size(), file) == cellStart.size();
+	uint32_t position = header.cellsOffset + (uint32_t)(cellStart.size() * sizeof(uint32_t));
+	written = written && fwrite(padding, 1, header.recordsOffset - position, file) == header.recordsOffset - position;
+	written = written && fwrite(records.data(), sizeof(FacilityRecord), records.size(), file) == records.size();
+	position = header.recordsOffset + (uint32_t)(records.size() * sizeof(FacilityRecord));
+	written = written && fwrite(padding, 1, header.vorsOffset - position, file) == header.vorsOffset - position;
+	written = written && fwrite(vors.data(), sizeof(FacilityVorRecord), vors.size(), file) == vors.size();
+	written = fclose(file) == 0 && written;
+
+#ifdef _WIN32
+	written = written && MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+	written = written && rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+	if (!written)
+	{
+		remove(temporaryPath.c_str());
+		error = "Could not write the facility cache " + path;
+		return NULL;
+	}
+
+	return open(path, simVersion, error);
+}
+
+FacilityCache *FacilityCache::open(const std::string &path, const std::string &simVersion, std::string &error)
+{
+	FacilityCache *cache = new FacilityCache();
+#ifdef _WIN32
+	cache->fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER size;
+	if (cache->fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(cache->fileHandle, &size) || size.QuadPart < (long long)sizeof(FacilityCacheHeader))
+	{
+		error = "Could not open the facility cache " + path;
+		delete cache;
+		return NULL;
+	}
+	cache->handle = CreateFileMappingA(cache->fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	cache->mapping = cache->handle ? (char *)MapViewOfFile(cache->handle, FILE_MAP_READ, 0, 0, 0) : NULL;
+	cache->mappingSize = (size_t)size.QuadPart;
+#else
+	cache->fd = ::open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (cache->fd < 0 || fstat(cache->fd, &st) != 0 || st.st_size < (off_t)sizeof(FacilityCacheHeader))
+	{
+		error = "Could not open the facility cache " + path;
+		delete cache;
+		return NULL;
+	}
+	void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, cache->fd, 0);
+	cache->mapping = p == MAP_FAILED ? NULL : (char *)p;
+	cache->mappingSize = (size_t)st.st_size;
+#endif
+	if (cache->mapping == NULL)
+	{
+		error = "Could not map the facility cache " + path;
+		delete cache;
+		return NULL;
+	}
+
+	const FacilityCacheHeader *h = cache->header();
+	if (memcmp(h->magic, cacheMagic, sizeof(cacheMagic)) != 0 || h->version != facilityCacheVersion ||
+		h->cellsOffset + (facilityCacheCells + 1) * sizeof(uint32_t) > cache->mappingSize ||
+		h->recordsOffset + (size_t)h->recordCount * sizeof(FacilityRecord) > cache->mappingSize ||
+		h->vorsOffset + (size_t)h->vorCount * sizeof(FacilityVorRecord) > cache->mappingSize)
+	{
+		error = "The facility cache " + path + " is damaged or from another version";
+		delete cache;
+		return NULL;
+	}
+
+	// nearby() reads the records between the starts of neighbouring cells without further checks
+	const uint32_t *cellStart = cache->cells();
+	bool cellsValid = cellStart[facilityCacheCells] == h->recordCount;
+	for (uint32_t cell = 0; cellsValid && cell < facilityCacheCells; cell++)
+	{
+		cellsValid = cellStart[cell] <= cellStart[cell + 1];
+	}
+	if (!cellsValid)
+	{
+		error = "The facility cache " + path + " is damaged or from another version";
+		delete cache;
+		return NULL;
+	}
+	if (strncmp(h->simVersion, simVersion.c_str(), sizeof(h->simVersion)) != 0)
+	{
+		error = "The facility cache " + path + " was built for another sim version";
+		delete cache;
+		return NULL;
+	}
+	return cache;
+}
+
+FacilityCache::~FacilityCache()
+{
+#ifdef _WIN32
+	if (mapping)
+		UnmapViewOfFile(mapping);
+	if (handle)
+		CloseHandle(handle);
+	if (fileHandle && fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+#else
+	if (mapping)
+		munmap(mapping, mappingSize);
+	if (fd >= 0)
+		close(fd);
+#endif
+}
+
+const FacilityVorRecord *FacilityCache::vor(const FacilityRecord *record) const
+{
+	if (record->vorIndex >= header()->vorCount)
+	{
+		return NULL;
+	}
+	return (const FacilityVorRecord *)(mapping + header()->vorsOffset) + record->vorIndex;
+}
+
+void FacilityCache::nearby(double latitude, double longitude, double radius, uint32_t typeMask, size_t limit, std::vector<std::pair<double, const FacilityRecord *>> &out) const
+{
+	out.clear();
+
+	// Cells of the bounding box around the circle, all longitudes close to the poles
+	double latitudeSpan = radius / (earthRadius * degreesToRadians);
+	double sinSpan = sin(radius / earthRadius);
+	double cosLatitude = cos(latitude * degreesToRadians);
+	double longitudeSpan = radius / earthRadius < 1.5 && sinSpan < cosLatitude ? asin(sinSpan / cosLatitude) / degreesToRadians : 360;
+	int firstRow = (int)floor(latitude - latitudeSpan + 90);
+	int lastRow = (int)floor(latitude + latitudeSpan + 90);
+	firstRow = firstRow < 0 ? 0 : firstRow;
+	lastRow = lastRow > 179 ? 179 : lastRow;
+	int firstColumn = 0;
+	int lastColumn = 359;
+	if (longitudeSpan < 180 && latitude - latitudeSpan > -90 && latitude + latitudeSpan < 90)
+	{
+		firstColumn = (int)floor(longitude - longitudeSpan + 180);
+		lastColumn = (int)floor(longitude + longitudeSpan + 180);
+		if (lastColumn - firstColumn >= 359)
+		{
+			firstColumn = 0;
+			lastColumn = 359;
+		}
+	}
+
+	const uint32_t *cellStart = cells();
+	const FacilityRecord *all = records();
+	for (int row = firstRow; row <= lastRow; row++)
+	{
+		for (int column = firstColumn; column <= lastColumn; column++)
+		{
+			uint32_t cell = (uint32_t)(row * 360 + ((column % 360) + 360) % 360); // Wraps around the antimeridian
+			for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; i++)
+			{
+				if (!(typeMask & (1u << all[i].type)))
+				{
+					continue;
+				}
+				double distance = facilityDistance(latitude, longitude, all[i].latitude, all[i].longitude);
+				if (distance <= radius)
+				{
+					out.push_back(std::make_pair(distance, &all[i]));
+				}
+			}
+		}
+	}
+
+	auto nearer = [](const std::pair<double, const FacilityRecord *> &a, const std::pair<double, const FacilityRecord *> &b) { return a.first < b.first; };
+	if (limit > 0 && out.size() > limit)
+	{
+		std::partial_sort(out.begin(), out.begin() + limit, out.end(), nearer);
+		out.resize(limit);
+	}
+	else
+	{
+		std::sort(out.begin(), out.end(), nearer);
+	}
+}
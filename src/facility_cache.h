@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "datum.h"
+
+// On-disk cache of the sim's facility lists (airports, waypoints, NDBs and VORs).
+// The file is memory-mapped read-only, so loading it costs no parsing, and the
+// records are sorted into a 1x1 degree grid for proximity queries.
+//
+// Layout of the file:
+//   FacilityCacheHeader
+//   uint32_t cellStart[facilityCacheCells + 1]   first record of every grid cell
+//   FacilityRecord records[recordCount]          sorted by grid cell
+//   FacilityVorRecord vors[vorCount]             extra VOR data, by FacilityRecord::vorIndex
+//
+// The cache is only valid for the sim version it was built with.
+
+static const uint32_t facilityCacheVersion = 1;
+static const uint32_t facilityCacheCells = 180 * 360;
+static const uint32_t facilityNoVor = 0xFFFFFFFF;
+
+#pragma pack(push, 8)
+struct FacilityCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t recordCount;
+	uint32_t vorCount;
+	uint32_t typeCounts[SIMCONNECT_FACILITY_LIST_TYPE_COUNT];
+	uint32_t cellsOffset;
+	uint32_t recordsOffset;
+	uint32_t vorsOffset;
+	char simVersion[64];
+};
+
+struct FacilityRecord
+{
+	char icao[9];
+	uint8_t type; // SIMCONNECT_FACILITY_LIST_TYPE
+	uint8_t reserved[2];
+	uint32_t frequency; // Hz, NDBs and VORs
+	double latitude;
+	double longitude;
+	double altitude;
+	float magVar;
+	uint32_t vorIndex;
+};
+
+struct FacilityVorRecord
+{
+	uint32_t flags; // SIMCONNECT_VOR_FLAGS
+	float localizer;
+	double glideLatitude;
+	double glideLongitude;
+	double glideAltitude;
+	float glideSlopeAngle;
+	uint32_t reserved;
+};
+#pragma pack(pop)
+
+class FacilityCache
+{
+public:
+	// Sorts the records into the grid, writes the file and maps it
+	static FacilityCache *build(const std::string &path, const std::string &simVersion, std::vector<FacilityRecord> &records, const std::vector<FacilityVorRecord> &vors, std::string &error);
+	// Returns NULL if the file is missing, damaged or was built for another sim version
+	static FacilityCache *open(const std::string &path, const std::string &simVersion, std::string &error);
+	~FacilityCache();
+
+	// Facilities of the types in typeMask (1 << SIMCONNECT_FACILITY_LIST_TYPE) within radius
+	// meters, nearest first. Pairs are the distance in meters and the record.
+	void nearby(double latitude, double longitude, double radius, uint32_t typeMask, size_t limit, std::vector<std::pair<double, const FacilityRecord *>> &out) const;
+
+	const FacilityCacheHeader *header() const { return (const FacilityCacheHeader *)mapping; }
+	const FacilityRecord *records() const { return (const FacilityRecord *)(mapping + header()->recordsOffset); }
+	const FacilityVorRecord *vor(const FacilityRecord *record) const;
+
+private:
+	FacilityCache() : mapping(NULL), mappingSize(0), handle(NULL), fileHandle(NULL), fd(-1) {}
+	const uint32_t *cells() const { return (const uint32_t *)(mapping + header()->cellsOffset); }
+
+	char *mapping;
+	size_t mappingSize;
+	HANDLE handle;
+	HANDLE fileHandle;
+	int fd;
+};
+
+// Grid cell of a position, also used to sort the records
+uint32_t facilityCell(double latitude, double longitude);
+
+// Great-circle distance in meters
+double facilityDistance(double latitude1, double longitude1, double latitude2, double longitude2);
@@ -0,0 +1,385 @@
+#include "message_decoder.h"
+
+#include <string.h>
+
+void DecodedMessage::clear()
+{
+	fields.clear();
+	entryCount = 0;
+	currentEntry = -1;
+}
+
+void DecodedMessage::number(const char *name, double value)
+{
+	DecodedField field = { name, FIELD_NUMBER, currentEntry, value, NULL, 0 };
+	fields.push_back(field);
+}
+
+void DecodedMessage::string(const char *name, const char *value, size_t capacity)
+{
+	const char *end = (const char *)memchr(value, 0, capacity);
+	DecodedField field = { name, FIELD_STRING, currentEntry, 0, value, end ? (size_t)(end - value) : capacity };
+	fields.push_back(field);
+}
+
+void DecodedMessage::bytes(const char *name, const void *data, size_t length)
+{
+	DecodedField field = { name, FIELD_BYTES, currentEntry, 0, (const char *)data, length };
+	fields.push_back(field);
+}
+
+void DecodedMessage::beginEntry()
+{
+	currentEntry = entryCount++;
+}
+
+typedef bool (*MessageDecoder)(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out);
+
+// Bytes from the start of the message to a member, for structs ending in a variable-length member
+#define MESSAGE_OFFSET(p, member) ((DWORD)((const char *)&(p)->member - (const char *)(p)))
+
+static bool decodeException(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_EXCEPTION))
+		return false;
+	const SIMCONNECT_RECV_EXCEPTION *p = (const SIMCONNECT_RECV_EXCEPTION *)pData;
+	out.number("exception", p->dwException);
+	out.number("sendId", p->dwSendID);
+	out.number("index", p->dwIndex);
+	return true;
+}
+
+static bool decodeOpen(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_OPEN))
+		return false;
+	const SIMCONNECT_RECV_OPEN *p = (const SIMCONNECT_RECV_OPEN *)pData;
+	out.string("applicationName", p->szApplicationName, sizeof(p->szApplicationName));
+	out.number("applicationVersionMajor", p->dwApplicationVersionMajor);
+	out.number("applicationVersionMinor", p->dwApplicationVersionMinor);
+	out.number("applicationBuildMajor", p->dwApplicationBuildMajor);
+	out.number("applicationBuildMinor", p->dwApplicationBuildMinor);
+	out.number("simConnectVersionMajor", p->dwSimConnectVersionMajor);
+	out.number("simConnectVersionMinor", p->dwSimConnectVersionMinor);
+	out.number("simConnectBuildMajor", p->dwSimConnectBuildMajor);
+	out.number("simConnectBuildMinor", p->dwSimConnectBuildMinor);
+	return true;
+}
+
+static bool decodeEmpty(const SIMCONNECT_RECV *, DWORD cbData, DecodedMessage &)
+{
+	return cbData >= sizeof(SIMCONNECT_RECV);
+}
+
+static void decodeEventHeader(const SIMCONNECT_RECV_EVENT *p, DecodedMessage &out)
+{
+	out.number("groupId", p->uGroupID);
+	out.number("eventId", p->uEventID);
+	out.number("data", p->dwData);
+}
+
+static bool decodeEvent(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_EVENT))
+		return false;
+	decodeEventHeader((const SIMCONNECT_RECV_EVENT *)pData, out);
+	return true;
+}
+
+static bool decodeObjectAddRemove(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_EVENT_OBJECT_ADDREMOVE))
+		return false;
+	const SIMCONNECT_RECV_EVENT_OBJECT_ADDREMOVE *p = (const SIMCONNECT_RECV_EVENT_OBJECT_ADDREMOVE *)pData;
+	decodeEventHeader(p, out);
+	out.number("objectType", p->eObjType);
+	return true;
+}
+
+static bool decodeFilename(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_EVENT_FILENAME))
+		return false;
+	const SIMCONNECT_RECV_EVENT_FILENAME *p = (const SIMCONNECT_RECV_EVENT_FILENAME *)pData;
+	decodeEventHeader(p, out);
+	out.string("fileName", p->szFileName, sizeof(p->szFileName));
+	out.number("flags", p->dwFlags);
+	return true;
+}
+
+static bool decodeFrame(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_EVENT_FRAME))
+		return false;
+	const SIMCONNECT_RECV_EVENT_FRAME *p = (const SIMCONNECT_RECV_EVENT_FRAME *)pData;
+	decodeEventHeader(p, out);
+	out.number("frameRate", p->fFrameRate);
+	out.number("simSpeed", p->fSimSpeed);
+	return true;
+}
+
+static bool decodeObjectData(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	const SIMCONNECT_RECV_SIMOBJECT_DATA *p = (const SIMCONNECT_RECV_SIMOBJECT_DATA *)pData;
+	DWORD offset = MESSAGE_OFFSET(p, dwData);
+	if (cbData < offset)
+		return false;
+	out.number("requestId", p->dwRequestID);
+	out.number("objectId", p->dwObjectID);
+	out.number("defineId", p->dwDefineID);
+	out.number("flags", p->dwFlags);
+	out.number("entryNumber", p->dwentrynumber);
+	out.number("outOf", p->dwoutof);
+	out.number("defineCount", p->dwDefineCount);
+	out.bytes("data", (const char *)pData + offset, cbData - offset);
+	return true;
+}
+
+static bool decodeWeatherObservation(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	const SIMCONNECT_RECV_WEATHER_OBSERVATION *p = (const SIMCONNECT_RECV_WEATHER_OBSERVATION *)pData;
+	DWORD offset = MESSAGE_OFFSET(p, szMetar);
+	if (cbData < offset)
+		return false;
+	out.number("requestId", p->dwRequestID);
+	out.string("metar", p->szMetar, cbData - offset);
+	return true;
+}
+
+static bool decodeCloudState(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	const SIMCONNECT_RECV_CLOUD_STATE *p = (const SIMCONNECT_RECV_CLOUD_STATE *)pData;
+	DWORD offset = MESSAGE_OFFSET(p, rgbData);
+	if (cbData < offset)
+		return false;
+	out.number("requestId", p->dwRequestID);
+	out.bytes("data", p->rgbData, p->dwArraySize < cbData - offset ? p->dwArraySize : cbData - offset);
+	return true;
+}
+
+static bool decodeAssignedObjectId(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_ASSIGNED_OBJECT_ID))
+		return false;
+	const SIMCONNECT_RECV_ASSIGNED_OBJECT_ID *p = (const SIMCONNECT_RECV_ASSIGNED_OBJECT_ID *)pData;
+	out.number("requestId", p->dwRequestID);
+	out.number("objectId", p->dwObjectID);
+	return true;
+}
+
+static bool decodeReservedKey(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_RESERVED_KEY))
+		return false;
+	const SIMCONNECT_RECV_RESERVED_KEY *p = (const SIMCONNECT_RECV_RESERVED_KEY *)pData;
+	out.string("choiceReserved", p->szChoiceReserved, sizeof(p->szChoiceReserved));
+	out.string("reservedKey", p->szReservedKey, sizeof(p->szReservedKey));
+	return true;
+}
+
+static bool decodeCustomAction(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	const SIMCONNECT_RECV_CUSTOM_ACTION *p = (const SIMCONNECT_RECV_CUSTOM_ACTION *)pData;
+	DWORD offset = MESSAGE_OFFSET(p, szPayLoad);
+	if (cbData < offset)
+		return false;
+	decodeEventHeader(p, out);
+	out.bytes("instanceId", &p->guidInstanceId, sizeof(p->guidInstanceId));
+	out.number("waitForCompletion", p->dwWaitForCompletion);
+	out.string("payload", p->szPayLoad, cbData - offset);
+	return true;
+}
+
+static bool decodeSystemState(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_SYSTEM_STATE))
+		return false;
+	const SIMCONNECT_RECV_SYSTEM_STATE *p = (const SIMCONNECT_RECV_SYSTEM_STATE *)pData;
+	out.number("requestId", p->dwRequestID);
+	out.number("integer", p->dwInteger);
+	out.number("float", p->fFloat);
+	out.string("string", p->szString, sizeof(p->szString));
+	return true;
+}
+
+// The entries of a facilities list that fit in the received size
+template <typename T>
+static const T *facilitiesEntries(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out, DWORD &count)
+{
+	const SIMCONNECT_RECV_FACILITIES_LIST *p = (const SIMCONNECT_RECV_FACILITIES_LIST *)pData;
+	out.number("requestId", p->dwRequestID);
+	out.number("entryNumber", p->dwEntryNumber);
+	out.number("outOf", p->dwOutOf);
+	DWORD available = (cbData - sizeof(SIMCONNECT_RECV_FACILITIES_LIST)) / sizeof(T);
+	count = p->dwArraySize < available ? p->dwArraySize : available;
+	return (const T *)(p + 1);
+}
+
+static void decodeFacility(const SIMCONNECT_DATA_FACILITY_AIRPORT &facility, DecodedMessage &out)
+{
+	out.beginEntry();
+	out.string("icao", facility.Icao, sizeof(facility.Icao));
+	out.number("latitude", facility.Latitude);
+	out.number("longitude", facility.Longitude);
+	out.number("altitude", facility.Altitude);
+}
+
+static bool decodeAirportList(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_FACILITIES_LIST))
+		return false;
+	DWORD count;
+	const SIMCONNECT_DATA_FACILITY_AIRPORT *entries = facilitiesEntries<SIMCONNECT_DATA_FACILITY_AIRPORT>(pData, cbData, out, count);
+	for (DWORD i = 0; i < count; i++)
+	{
+		decodeFacility(entries[i], out);
+	}
+	return true;
+}
+
+static bool decodeWaypointList(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_FACILITIES_LIST))
+		return false;
+	DWORD count;
+	const SIMCONNECT_DATA_FACILITY_WAYPOINT *entries = facilitiesEntries<SIMCONNECT_DATA_FACILITY_WAYPOINT>(pData, cbData, out, count);
+	for (DWORD i = 0; i < count; i++)
+	{
+		decodeFacility(entries[i], out);
+		out.number("magVar", entries[i].fMagVar);
+	}
+	return true;
+}
+
+static bool decodeNdbList(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_FACILITIES_LIST))
+		return false;
+	DWORD count;
+	const SIMCONNECT_DATA_FACILITY_NDB *entries = facilitiesEntries<SIMCONNECT_DATA_FACILITY_NDB>(pData, cbData, out, count);
+	for (DWORD i = 0; i < count; i++)
+	{
+		decodeFacility(entries[i], out);
+		out.number("magVar", entries[i].fMagVar);
+		out.number("frequency", entries[i].fFrequency);
+	}
+	return true;
+}
+
+static bool decodeVorList(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_FACILITIES_LIST))
+		return false;
+	DWORD count;
+	const SIMCONNECT_DATA_FACILITY_VOR *entries = facilitiesEntries<SIMCONNECT_DATA_FACILITY_VOR>(pData, cbData, out, count);
+	for (DWORD i = 0; i < count; i++)
+	{
+		decodeFacility(entries[i], out);
+		out.number("magVar", entries[i].fMagVar);
+		out.number("frequency", entries[i].fFrequency);
+		out.number("flags", entries[i].Flags);
+		out.number("localizer", entries[i].fLocalizer);
+		out.number("glideLatitude", entries[i].GlideLat);
+		out.number("glideLongitude", entries[i].GlideLon);
+		out.number("glideAltitude", entries[i].GlideAlt);
+		out.number("glideSlopeAngle", entries[i].fGlideSlopeAngle);
+	}
+	return true;
+}
+
+static void decodeRaceResult(const SIMCONNECT_DATA_RACE_RESULT &result, DecodedMessage &out)
+{
+	out.number("numberOfRacers", result.dwNumberOfRacers);
+	out.bytes("missionGuid", &result.MissionGUID, sizeof(result.MissionGUID));
+	out.string("playerName", result.szPlayerName, sizeof(result.szPlayerName));
+	out.string("sessionType", result.szSessionType, sizeof(result.szSessionType));
+	out.string("aircraft", result.szAircraft, sizeof(result.szAircraft));
+	out.string("playerRole", result.szPlayerRole, sizeof(result.szPlayerRole));
+	out.number("totalTime", result.fTotalTime);
+	out.number("penaltyTime", result.fPenaltyTime);
+	out.number("isDisqualified", result.dwIsDisqualified);
+}
+
+static bool decodeRaceEnd(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_EVENT_RACE_END))
+		return false;
+	const SIMCONNECT_RECV_EVENT_RACE_END *p = (const SIMCONNECT_RECV_EVENT_RACE_END *)pData;
+	decodeEventHeader(p, out);
+	out.number("racerNumber", p->dwRacerNumber);
+	decodeRaceResult(p->RacerData, out);
+	return true;
+}
+
+static bool decodeRaceLap(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	if (cbData < sizeof(SIMCONNECT_RECV_EVENT_RACE_LAP))
+		return false;
+	const SIMCONNECT_RECV_EVENT_RACE_LAP *p = (const SIMCONNECT_RECV_EVENT_RACE_LAP *)pData;
+	decodeEventHeader(p, out);
+	out.number("lapIndex", p->dwLapIndex);
+	decodeRaceResult(p->RacerData, out);
+	return true;
+}
+
+// Indexed by SIMCONNECT_RECV_ID
+static const MessageDecoder messageDecoders[messageIdCount] = {
+	decodeEmpty,			  // NULL
+	decodeException,		  // EXCEPTION
+	decodeOpen,				  // OPEN
+	decodeEmpty,			  // QUIT
+	decodeEvent,			  // EVENT
+	decodeObjectAddRemove,	  // EVENT_OBJECT_ADDREMOVE
+	decodeFilename,			  // EVENT_FILENAME
+	decodeFrame,			  // EVENT_FRAME
+	decodeObjectData,		  // SIMOBJECT_DATA
+	decodeObjectData,		  // SIMOBJECT_DATA_BYTYPE
+	decodeWeatherObservation, // WEATHER_OBSERVATION
+	decodeCloudState,		  // CLOUD_STATE
+	decodeAssignedObjectId,	  // ASSIGNED_OBJECT_ID
+	decodeReservedKey,		  // RESERVED_KEY
+	decodeCustomAction,		  // CUSTOM_ACTION
+	decodeSystemState,		  // SYSTEM_STATE
+	decodeObjectData,		  // CLIENT_DATA
+	decodeEvent,			  // EVENT_WEATHER_MODE
+	decodeAirportList,		  // AIRPORT_LIST
+	decodeVorList,			  // VOR_LIST
+	decodeNdbList,			  // NDB_LIST
+	decodeWaypointList,		  // WAYPOINT_LIST
+	decodeEvent,			  // EVENT_MULTIPLAYER_SERVER_STARTED
+	decodeEvent,			  // EVENT_MULTIPLAYER_CLIENT_STARTED
+	decodeEvent,			  // EVENT_MULTIPLAYER_SESSION_ENDED
+	decodeRaceEnd,			  // EVENT_RACE_END
+	decodeRaceLap,			  // EVENT_RACE_LAP
+};
+
+bool decodeMessage(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out)
+{
+	out.clear();
+	if (cbData < sizeof(SIMCONNECT_RECV) || pData->dwID >= messageIdCount)
+	{
+		return false;
+	}
+	return messageDecoders[pData->dwID](pData, cbData, out);
+}
+
+bool isEventMessage(DWORD id)
+{
+	switch (id)
+	{
+	case SIMCONNECT_RECV_ID_EVENT:
+	case SIMCONNECT_RECV_ID_EVENT_OBJECT_ADDREMOVE:
+	case SIMCONNECT_RECV_ID_EVENT_FILENAME:
+	case SIMCONNECT_RECV_ID_EVENT_FRAME:
+	case SIMCONNECT_RECV_ID_CUSTOM_ACTION:
+	case SIMCONNECT_RECV_ID_EVENT_WEATHER_MODE:
+	case SIMCONNECT_RECV_ID_EVENT_MULTIPLAYER_SERVER_STARTED:
+	case SIMCONNECT_RECV_ID_EVENT_MULTIPLAYER_CLIENT_STARTED:
+	case SIMCONNECT_RECV_ID_EVENT_MULTIPLAYER_SESSION_ENDED:
+	case SIMCONNECT_RECV_ID_EVENT_RACE_END:
+	case SIMCONNECT_RECV_ID_EVENT_RACE_LAP:
+		return true;
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "datum.h"
+
+// Decoders for every SIMCONNECT_RECV struct. A message is decoded into a flat list of
+// named fields, checked against the received size, so messages the addon has no
+// dedicated handling for can still be passed on. Entries of a list message (eg. the
+// airports of an AIRPORT_LIST) carry the index of their entry.
+
+enum DecodedFieldKind
+{
+	FIELD_NUMBER,
+	FIELD_STRING,
+	FIELD_BYTES
+};
+
+struct DecodedField
+{
+	const char *name;
+	DecodedFieldKind kind;
+	int entry; // -1 for fields of the message itself
+	double number;
+	const char *data; // Points into the message for strings and bytes
+	size_t length;
+};
+
+class DecodedMessage
+{
+public:
+	DecodedMessage() : entryCount(0), currentEntry(-1) {}
+
+	void clear();
+	void number(const char *name, double value);
+	void string(const char *name, const char *value, size_t capacity); // Stops at the first zero
+	void bytes(const char *name, const void *data, size_t length);
+	void beginEntry();
+
+	std::vector<DecodedField> fields;
+	int entryCount;
+
+private:
+	int currentEntry;
+};
+
+static const DWORD messageIdCount = SIMCONNECT_RECV_ID_EVENT_RACE_LAP + 1;
+
+// Returns false for unknown ids and messages too short for their struct
+bool decodeMessage(const SIMCONNECT_RECV *pData, DWORD cbData, DecodedMessage &out);
+
+// Messages derived from SIMCONNECT_RECV_EVENT, which belong to a subscribed event id
+bool isEventMessage(DWORD id);
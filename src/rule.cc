@@ -0,0 +1,41 @@
+#include "rule.h"
+
+#include <math.h>
+
+bool Rule::update(const double *values, uint64_t timeNs)
+{
+	value = expression.evaluate(values);
+
+	bool condition;
+	switch (mode)
+	{
+	case RULE_ABOVE:
+		condition = active ? value > threshold - hysteresis : value > threshold;
+		break;
+	case RULE_BELOW:
+		condition = active ? value < threshold + hysteresis : value < threshold;
+		break;
+	default:
+		condition = value != 0 && !isnan(value);
+		break;
+	}
+
+	if (condition == active)
+	{
+		pending = false;
+		return false;
+	}
+
+	if (!pending)
+	{
+		pending = true;
+		pendingSince = timeNs;
+	}
+	if (timeNs - pendingSince >= (condition ? minDuration : clearDuration))
+	{
+		active = condition;
+		pending = false;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "expression.h"
+
+// Edge-triggered condition on the values of a sample, eg. an overspeed warning:
+// the expression is compared against a threshold with hysteresis, and the
+// rule only changes state once the new state has held for a minimum duration.
+
+enum RuleMode
+{
+	RULE_CONDITION, // Active while the expression is non-zero
+	RULE_ABOVE,		// Active above the threshold, inactive again below threshold - hysteresis
+	RULE_BELOW		// Active below the threshold, inactive again above threshold + hysteresis
+};
+
+class Rule
+{
+public:
+	Rule() : mode(RULE_CONDITION), threshold(0), hysteresis(0), minDuration(0), clearDuration(0), active(false), value(0), pending(false), pendingSince(0) {}
+
+	bool compile(const std::string &source, const std::vector<std::string> &variables, std::string &error)
+	{
+		return expression.compile(source, variables, error);
+	}
+
+	// Evaluates the rule for a sample taken at timeNs. Returns true when the rule changes state.
+	bool update(const double *values, uint64_t timeNs);
+
+	RuleMode mode;
+	double threshold;
+	double hysteresis;
+	uint64_t minDuration;	// Nanoseconds the condition must hold before the rule becomes active
+	uint64_t clearDuration; // Nanoseconds the condition must be gone before the rule becomes inactive
+
+	bool active;
+	double value; // Value of the expression in the last sample
+
+private:
+	Expression expression;
+	bool pending; // The condition differs from the state since pendingSince
+	uint64_t pendingSince;
+};
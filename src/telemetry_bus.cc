@@ -0,0 +1,302 @@
+#include "telemetry_bus.h"
+
+#include <atomic>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char busMagic[8] = { 'S', 'C', 'B', 'U', 'S', '\0', '\0', '\0' };
+
+static uint32_t alignTo(uint32_t value, uint32_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+bool TelemetryBus::map(bool create, size_t size, std::string &error)
+{
+#ifdef _WIN32
+	std::string objectName = "Local\\SimConnectBus_" + shmName;
+	if (create)
+	{
+		handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, objectName.c_str());
+		if (handle != NULL && GetLastError() == ERROR_ALREADY_EXISTS)
+		{
+			error = "Shared memory " + objectName + " is already published";
+			return false;
+		}
+	}
+	else
+	{
+		handle = OpenFileMappingA(FILE_MAP_READ, FALSE, objectName.c_str());
+	}
+	if (handle == NULL)
+	{
+		error = "Could not open shared memory " + objectName;
+		return false;
+	}
+	owner = create;
+
+	mapping = (char *)MapViewOfFile(handle, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size);
+	if (mapping == NULL)
+	{
+		error = "Could not map shared memory " + objectName;
+		return false;
+	}
+	if (size == 0)
+	{
+		// Consumers take the size of the view, the header is checked against it
+		MEMORY_BASIC_INFORMATION info;
+		if (VirtualQuery(mapping, &info, sizeof(info)) == 0)
+		{
+			error = "Could not size shared memory " + objectName;
+			return false;
+		}
+		size = info.RegionSize;
+	}
+#else
+	std::string objectName = "/simconnect-bus-" + shmName;
+	fd = create ? shm_open(objectName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644) : shm_open(objectName.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+	{
+		error = create && errno == EEXIST ? "Shared memory " + objectName + " is already published" : "Could not open shared memory " + objectName;
+		return false;
+	}
+	owner = create; // Unlinked again by the destructor, also when the rest fails
+	if (create && ftruncate(fd, (off_t)size) != 0)
+	{
+		error = "Could not size shared memory " + objectName;
+		return false;
+	}
+	if (!create)
+	{
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size <= 0)
+		{
+			error = "Could not size shared memory " + objectName;
+			return false;
+		}
+		size = (size_t)st.st_size;
+	}
+
+	void *p = mmap(NULL, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+	{
+		error = "Could not map shared memory " + objectName;
+		return false;
+	}
+	mapping = (char *)p;
+#endif
+	mappingSize = size;
+	return true;
+}
+
+TelemetryBus *TelemetryBus::create(const std::string &name, const std::vector<std::string> &names, const std::vector<SIMCONNECT_DATATYPE> &types, uint32_t slotCount, std::string &error)
+{
+	std::vector<TelemetryBusField> fields(types.size());
+	uint32_t sampleSize = 0;
+
+	for (size_t i = 0; i < types.size(); i++)
+	{
+		uint32_t size = types[i] == SIMCONNECT_DATATYPE_STRINGV ? telemetryBusStringCapacity : datumSize(types[i]);
+		if (size == 0)
+		{
+			error = "Unsupported datatype for the telemetry bus";
+			return NULL;
+		}
+
+		// Numbers are naturally aligned so readers can use typed views
+		if (!isStringType(types[i]))
+		{
+			sampleSize = alignTo(sampleSize, size);
+		}
+
+		memset(&fields[i], 0, sizeof(TelemetryBusField));
+		strncpy(fields[i].name, names[i].c_str(), sizeof(fields[i].name) - 1);
+		fields[i].type = types[i];
+		fields[i].offset = sampleSize;
+		fields[i].size = size;
+		sampleSize += size;
+	}
+
+	sampleSize = alignTo(sampleSize, 8);
+	uint32_t slotSize = (uint32_t)sizeof(TelemetryBusSlot) + sampleSize;
+	uint32_t slotsOffset = alignTo((uint32_t)(sizeof(TelemetryBusHeader) + fields.size() * sizeof(TelemetryBusField)), 64);
+
+	TelemetryBus *bus = new TelemetryBus();
+	bus->shmName = name;
+	if (!bus->map(true, slotsOffset + (size_t)slotCount * slotSize, error))
+	{
+		delete bus;
+		return NULL;
+	}
+
+	memset(bus->mapping, 0, bus->mappingSize);
+	TelemetryBusHeader *h = (TelemetryBusHeader *)bus->mapping;
+	h->version = telemetryBusVersion;
+	h->fieldCount = (uint32_t)fields.size();
+	h->slotCount = slotCount;
+	h->slotSize = slotSize;
+	h->sampleSize = sampleSize;
+	h->slotsOffset = slotsOffset;
+	h->published.store(0, std::memory_order_relaxed);
+	if (!fields.empty())
+	{
+		memcpy(bus->mapping + sizeof(TelemetryBusHeader), fields.data(), fields.size() * sizeof(TelemetryBusField));
+	}
+
+	// The magic goes in last, attaching readers treat the bus as ready once it is there
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(h->magic, busMagic, sizeof(busMagic));
+	return bus;
+}
+
+TelemetryBus *TelemetryBus::attach(const std::string &name, std::string &error)
+{
+	TelemetryBus *bus = new TelemetryBus();
+	bus->shmName = name;
+	if (!bus->map(false, 0, error))
+	{
+		delete bus;
+		return NULL;
+	}
+
+	const TelemetryBusHeader *h = bus->header();
+	if (bus->mappingSize < sizeof(TelemetryBusHeader) || memcmp(h->magic, busMagic, sizeof(busMagic)) != 0 || h->version != telemetryBusVersion)
+	{
+		error = "Shared memory " + name + " is not a telemetry bus";
+		delete bus;
+		return NULL;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire); // Pairs with the fence before the magic
+
+	// The layout comes from another process, every slot and field has to lie within the mapping
+	uint64_t fieldsEnd = sizeof(TelemetryBusHeader) + (uint64_t)h->fieldCount * sizeof(TelemetryBusField);
+	bool valid = h->slotCount > 0 && h->slotsOffset >= fieldsEnd && h->slotsOffset % 8 == 0 && h->slotSize % 8 == 0 &&
+				 (uint64_t)h->slotSize >= sizeof(TelemetryBusSlot) + (uint64_t)h->sampleSize &&
+				 h->slotsOffset + (uint64_t)h->slotCount * h->slotSize <= bus->mappingSize;
+	for (uint32_t i = 0; valid && i < h->fieldCount; i++)
+	{
+		const TelemetryBusField &field = bus->fields()[i];
+		valid = (uint64_t)field.offset + field.size <= h->sampleSize;
+	}
+	if (!valid)
+	{
+		error = "Shared memory " + name + " has a damaged telemetry bus layout";
+		delete bus;
+		return NULL;
+	}
+	return bus;
+}
+
+TelemetryBus::~TelemetryBus()
+{
+#ifdef _WIN32
+	if (mapping)
+		UnmapViewOfFile(mapping);
+	if (handle)
+		CloseHandle(handle);
+#else
+	if (mapping)
+		munmap(mapping, mappingSize);
+	if (fd >= 0)
+		close(fd);
+	if (owner)
+		shm_unlink(("/simconnect-bus-" + shmName).c_str());
+#endif
+}
+
+TelemetryBusSlot *TelemetryBus::slot(int64_t index) const
+{
+	const TelemetryBusHeader *h = header();
+	return (TelemetryBusSlot *)(mapping + h->slotsOffset + (size_t)(index % h->slotCount) * h->slotSize);
+}
+
+void TelemetryBus::publish(int64_t timestampUs, const DatumSlice *datums)
+{
+	TelemetryBusHeader *h = (TelemetryBusHeader *)mapping;
+	const TelemetryBusField *f = fields();
+	int64_t index = h->published.load(std::memory_order_relaxed); // Only written here
+	TelemetryBusSlot *s = slot(index);
+	char *sample = (char *)s + sizeof(TelemetryBusSlot);
+
+	// Odd while the slot is written. The fence keeps the writes below from moving ahead of it.
+	uint32_t sequence = s->sequence.load(std::memory_order_relaxed);
+	s->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	s->index = index;
+	s->timestampUs = timestampUs;
+	for (uint32_t i = 0; i < h->fieldCount; i++)
+	{
+		DWORD size = datums[i].size < f[i].size ? datums[i].size : f[i].size;
+		if (isStringType(SIMCONNECT_DATATYPE(f[i].type)))
+		{
+			// Strings are always zero-terminated and zero-padded
+			const char *end = (const char *)memchr(datums[i].data, 0, size);
+			size_t length = end ? end - datums[i].data : size;
+			if (length >= f[i].size)
+			{
+				length = f[i].size - 1;
+			}
+			memcpy(sample + f[i].offset, datums[i].data, length);
+			memset(sample + f[i].offset + length, 0, f[i].size - length);
+		}
+		else
+		{
+			memcpy(sample + f[i].offset, datums[i].data, size);
+		}
+	}
+
+	s->sequence.store(sequence + 2, std::memory_order_release);
+	h->published.store(index + 1, std::memory_order_release);
+}
+
+bool TelemetryBus::read(int64_t after, bool next, int64_t &index, int64_t &timestampUs, std::vector<char> &sample) const
+{
+	const TelemetryBusHeader *h = header();
+	sample.resize(h->sampleSize);
+
+	for (int attempt = 0; attempt < 16; attempt++)
+	{
+		int64_t published = h->published.load(std::memory_order_acquire);
+		if (published == 0 || published - 1 <= after)
+		{
+			return false;
+		}
+
+		int64_t wanted = published - 1;
+		if (next)
+		{
+			int64_t oldest = published - h->slotCount + 1; // The oldest slot may be being overwritten
+			wanted = after + 1 > oldest ? after + 1 : oldest;
+			if (wanted < 0)
+			{
+				wanted = 0;
+			}
+		}
+
+		// The copy is only kept if the sequence was even and unchanged around it. The fence keeps
+		// the reads of the copy from moving past the second load.
+		const TelemetryBusSlot *s = slot(wanted);
+		uint32_t before = s->sequence.load(std::memory_order_acquire);
+		int64_t slotIndex = s->index;
+		int64_t slotTimestamp = s->timestampUs;
+		memcpy(sample.data(), (const char *)s + sizeof(TelemetryBusSlot), h->sampleSize);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint32_t after = s->sequence.load(std::memory_order_relaxed);
+
+		if ((before & 1) == 0 && before == after && slotIndex == wanted)
+		{
+			index = slotIndex;
+			timestampUs = slotTimestamp;
+			return true;
+		}
+	}
+	return false;
+}
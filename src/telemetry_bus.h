@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "datum.h"
+
+// Shared-memory telemetry bus. One process (the one connected to SimConnect)
+// publishes the samples of a data definition into a named ring; any number of
+// processes attach read-only and read the samples without a SimConnect connection.
+//
+// Layout of the mapping:
+//   TelemetryBusHeader
+//   TelemetryBusField[fieldCount]       schema, one entry per datum
+//   slots[slotCount], each slotSize bytes: TelemetryBusSlot followed by the sample
+//
+// Each slot is guarded by a seqlock: the sequence is odd while the producer writes it.
+
+static const uint32_t telemetryBusVersion = 1;
+static const uint32_t telemetryBusStringCapacity = 256; // Bytes reserved for STRINGV data
+
+#pragma pack(push, 8)
+struct TelemetryBusHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t fieldCount;
+	uint32_t slotCount;
+	uint32_t slotSize;
+	uint32_t sampleSize;
+	uint32_t slotsOffset;
+	std::atomic<int64_t> published; // Number of samples published so far
+};
+
+struct TelemetryBusField
+{
+	char name[64];
+	uint32_t type; // SIMCONNECT_DATATYPE
+	uint32_t offset;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+struct TelemetryBusSlot
+{
+	std::atomic<uint32_t> sequence;
+	uint32_t reserved;
+	int64_t index;
+	int64_t timestampUs;
+};
+#pragma pack(pop)
+
+// The atomics are shared with other processes, so they have to be plain lock-free words
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && sizeof(std::atomic<int64_t>) == sizeof(int64_t), "Atomics of the telemetry bus must not add state");
+
+class TelemetryBus
+{
+public:
+	static TelemetryBus *create(const std::string &name, const std::vector<std::string> &names, const std::vector<SIMCONNECT_DATATYPE> &types, uint32_t slotCount, std::string &error);
+	static TelemetryBus *attach(const std::string &name, std::string &error);
+	~TelemetryBus();
+
+	// Producer side
+	void publish(int64_t timestampUs, const DatumSlice *datums);
+
+	// Consumer side. Reads the newest sample, or with next=true the oldest
+	// sample after `after` still in the ring. Returns false if there is none.
+	bool read(int64_t after, bool next, int64_t &index, int64_t &timestampUs, std::vector<char> &sample) const;
+
+	const TelemetryBusHeader *header() const { return (const TelemetryBusHeader *)mapping; }
+	const TelemetryBusField *fields() const { return (const TelemetryBusField *)(mapping + sizeof(TelemetryBusHeader)); }
+	char *data() const { return mapping; }
+	size_t size() const { return mappingSize; }
+
+	SIMCONNECT_DATA_DEFINITION_ID defineId;
+	bool exposed; // A JS Buffer over the mapping is alive
+	bool closed;
+
+private:
+	TelemetryBus() : defineId(SIMCONNECT_UNUSED), exposed(false), closed(false), mapping(NULL), mappingSize(0), owner(false), handle(NULL), fd(-1) {}
+	bool map(bool create, size_t size, std::string &error);
+	TelemetryBusSlot *slot(int64_t index) const;
+
+	char *mapping;
+	size_t mappingSize;
+	bool owner;
+	std::string shmName;
+	HANDLE handle;
+	int fd;
+};
@@ -0,0 +1,601 @@
+#include "telemetry_codec.h"
+
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static const uint8_t chunkMagic[4] = { 'S', 'C', 'T', 'C' };
+static const uint8_t chunkVersion = 1;
+static const size_t chunkHeaderSize = 4 + 1 + 2 + 4 + 4; // magic, version, column count, sample count, payload size
+
+static int countLeadingZeros(uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	return _BitScanReverse64(&index, value) ? 63 - (int)index : 64;
+#else
+	return value ? __builtin_clzll(value) : 64;
+#endif
+}
+
+static int countTrailingZeros(uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	return _BitScanForward64(&index, value) ? (int)index : 64;
+#else
+	return value ? __builtin_ctzll(value) : 64;
+#endif
+}
+
+static uint64_t zigzag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void writeU16(std::vector<uint8_t> &out, uint16_t value)
+{
+	out.push_back((uint8_t)value);
+	out.push_back((uint8_t)(value >> 8));
+}
+
+static void writeU32(std::vector<uint8_t> &out, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+static uint32_t readU32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool isTelemetryType(SIMCONNECT_DATATYPE type)
+{
+	return type >= SIMCONNECT_DATATYPE_INT32 && type <= SIMCONNECT_DATATYPE_STRINGV;
+}
+
+// BitWriter / BitReader ////////////////////////////////////////////////////////////////
+
+void BitWriter::writeBits(uint64_t value, int bits)
+{
+	if (bits > 32)
+	{
+		writeBits(value >> 32, bits - 32);
+		value &= 0xFFFFFFFFULL;
+		bits = 32;
+	}
+
+	acc = (acc << bits) | (value & ((1ULL << bits) - 1));
+	accBits += bits;
+	while (accBits >= 8)
+	{
+		accBits -= 8;
+		bytes.push_back((uint8_t)(acc >> accBits));
+	}
+	acc &= (1ULL << accBits) - 1;
+}
+
+void BitWriter::finish()
+{
+	if (accBits > 0)
+	{
+		bytes.push_back((uint8_t)(acc << (8 - accBits)));
+	}
+	acc = 0;
+	accBits = 0;
+}
+
+void BitWriter::clear()
+{
+	bytes.clear();
+	acc = 0;
+	accBits = 0;
+}
+
+uint64_t BitReader::readBits(int bits)
+{
+	if (bits > 32)
+	{
+		uint64_t high = readBits(bits - 32);
+		return (high << 32) | readBits(32);
+	}
+
+	while (accBits < bits)
+	{
+		if (pos < size)
+		{
+			acc = (acc << 8) | data[pos];
+		}
+		else
+		{
+			acc <<= 8;
+			overrun = true;
+		}
+		pos++;
+		accBits += 8;
+	}
+
+	accBits -= bits;
+	uint64_t value = (acc >> accBits) & ((1ULL << bits) - 1);
+	acc &= (1ULL << accBits) - 1;
+	return value;
+}
+
+// Variable-width signed values, used for timestamps and integer columns:
+// '0' = 0, '10' = 7 bits, '110' = 9 bits, '1110' = 12 bits, '11110' = 32 bits, '11111' = 64 bits
+static void writeSigned(BitWriter &writer, int64_t value)
+{
+	if (value == 0)
+	{
+		writer.writeBits(0, 1);
+		return;
+	}
+
+	uint64_t encoded = zigzag(value);
+	if (encoded < (1ULL << 7))
+	{
+		writer.writeBits(0x2, 2);
+		writer.writeBits(encoded, 7);
+	}
+	else if (encoded < (1ULL << 9))
+	{
+		writer.writeBits(0x6, 3);
+		writer.writeBits(encoded, 9);
+	}
+	else if (encoded < (1ULL << 12))
+	{
+		writer.writeBits(0xE, 4);
+		writer.writeBits(encoded, 12);
+	}
+	else if (encoded < (1ULL << 32))
+	{
+		writer.writeBits(0x1E, 5);
+		writer.writeBits(encoded, 32);
+	}
+	else
+	{
+		writer.writeBits(0x1F, 5);
+		writer.writeBits(encoded, 64);
+	}
+}
+
+static int64_t readSigned(BitReader &reader)
+{
+	if (!reader.readBit())
+		return 0;
+	if (!reader.readBit())
+		return unzigzag(reader.readBits(7));
+	if (!reader.readBit())
+		return unzigzag(reader.readBits(9));
+	if (!reader.readBit())
+		return unzigzag(reader.readBits(12));
+	if (!reader.readBit())
+		return unzigzag(reader.readBits(32));
+	return unzigzag(reader.readBits(64));
+}
+
+// TelemetryEncoder //////////////////////////////////////////////////////////////////////
+
+TelemetryEncoder::TelemetryEncoder(const std::vector<SIMCONNECT_DATATYPE> &types, SIMCONNECT_DATA_DEFINITION_ID defineId)
+	: defineId(defineId), types(types), columns(types.size())
+{
+	reset();
+}
+
+void TelemetryEncoder::reset()
+{
+	for (size_t i = 0; i < columns.size(); i++)
+	{
+		columns[i].prevBits = 0;
+		columns[i].prevDelta = 0;
+		columns[i].prevLeading = -1;
+		columns[i].prevTrailing = 0;
+		columns[i].prevString.clear();
+	}
+	writer.clear();
+	column = 0;
+	sampleCount = 0;
+	prevTimestamp = 0;
+	prevTimestampDelta = 0;
+}
+
+void TelemetryEncoder::beginSample(int64_t timestampUs)
+{
+	if (sampleCount == 0)
+	{
+		writer.writeBits((uint64_t)timestampUs, 64);
+	}
+	else
+	{
+		int64_t delta = (int64_t)((uint64_t)timestampUs - (uint64_t)prevTimestamp);
+		writeSigned(writer, (int64_t)((uint64_t)delta - (uint64_t)prevTimestampDelta));
+		prevTimestampDelta = delta;
+	}
+	prevTimestamp = timestampUs;
+	column = 0;
+}
+
+void TelemetryEncoder::endSample()
+{
+	// Pad columns the caller did not provide so the stream stays aligned
+	while (column < types.size())
+	{
+		putNumber(0);
+	}
+	sampleCount++;
+}
+
+void TelemetryEncoder::putSigned(TelemetryColumnState &state, int64_t value)
+{
+	int64_t delta = (int64_t)((uint64_t)value - state.prevBits);
+	writeSigned(writer, (int64_t)((uint64_t)delta - (uint64_t)state.prevDelta));
+	state.prevBits = (uint64_t)value;
+	state.prevDelta = delta;
+}
+
+void TelemetryEncoder::putXor(TelemetryColumnState &state, uint64_t bits, int width)
+{
+	uint64_t xorValue = bits ^ state.prevBits;
+	state.prevBits = bits;
+
+	if (xorValue == 0)
+	{
+		writer.writeBits(0, 1);
+		return;
+	}
+	writer.writeBits(1, 1);
+
+	int fieldBits = width == 64 ? 6 : 5;
+	int leading = countLeadingZeros(xorValue) - (64 - width);
+	int trailing = countTrailingZeros(xorValue);
+
+	if (state.prevLeading >= 0 && leading >= state.prevLeading && trailing >= state.prevTrailing)
+	{
+		// Meaningful bits fit in the previous window
+		writer.writeBits(0, 1);
+		writer.writeBits(xorValue >> state.prevTrailing, width - state.prevLeading - state.prevTrailing);
+	}
+	else
+	{
+		int meaningful = width - leading - trailing;
+		writer.writeBits(1, 1);
+		writer.writeBits((uint64_t)leading, fieldBits);
+		writer.writeBits((uint64_t)(meaningful - 1), fieldBits);
+		writer.writeBits(xorValue >> trailing, meaningful);
+		state.prevLeading = leading;
+		state.prevTrailing = trailing;
+	}
+}
+
+void TelemetryEncoder::putInt32(int32_t value)
+{
+	putSigned(columns[column++], value);
+}
+
+void TelemetryEncoder::putInt64(int64_t value)
+{
+	putSigned(columns[column++], value);
+}
+
+void TelemetryEncoder::putFloat32(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	putXor(columns[column++], bits, 32);
+}
+
+void TelemetryEncoder::putFloat64(double value)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	putXor(columns[column++], bits, 64);
+}
+
+void TelemetryEncoder::putString(const char *value, size_t length)
+{
+	TelemetryColumnState &state = columns[column++];
+	if (length > 0xFFFF)
+	{
+		length = 0xFFFF;
+		while (length > 0 && ((uint8_t)value[length] & 0xC0) == 0x80)
+		{
+			length--; // Not in the middle of a UTF-8 sequence
+		}
+	}
+
+	if (state.prevString.size() == length && memcmp(state.prevString.data(), value, length) == 0)
+	{
+		writer.writeBits(0, 1);
+		return;
+	}
+
+	writer.writeBits(1, 1);
+	writer.writeBits(length, 16);
+	for (size_t i = 0; i < length; i++)
+	{
+		writer.writeBits((uint8_t)value[i], 8);
+	}
+	state.prevString.assign(value, length);
+}
+
+void TelemetryEncoder::putNumber(double value)
+{
+	switch (types[column])
+	{
+	case SIMCONNECT_DATATYPE_INT32:
+		putInt32((int32_t)value);
+		break;
+	case SIMCONNECT_DATATYPE_INT64:
+		putInt64((int64_t)value);
+		break;
+	case SIMCONNECT_DATATYPE_FLOAT32:
+		putFloat32((float)value);
+		break;
+	case SIMCONNECT_DATATYPE_FLOAT64:
+		putFloat64(value);
+		break;
+	default:
+		putString("", 0);
+		break;
+	}
+}
+
+void TelemetryEncoder::putDatum(const char *pDatum, size_t maxLength)
+{
+	SIMCONNECT_DATATYPE type = types[column];
+	switch (type)
+	{
+	case SIMCONNECT_DATATYPE_INT32:
+	{
+		int32_t value;
+		memcpy(&value, pDatum, sizeof(value));
+		putInt32(value);
+		break;
+	}
+	case SIMCONNECT_DATATYPE_INT64:
+	{
+		int64_t value;
+		memcpy(&value, pDatum, sizeof(value));
+		putInt64(value);
+		break;
+	}
+	case SIMCONNECT_DATATYPE_FLOAT32:
+	{
+		float value;
+		memcpy(&value, pDatum, sizeof(value));
+		putFloat32(value);
+		break;
+	}
+	case SIMCONNECT_DATATYPE_FLOAT64:
+	{
+		double value;
+		memcpy(&value, pDatum, sizeof(value));
+		putFloat64(value);
+		break;
+	}
+	default:
+	{
+		size_t limit = type == SIMCONNECT_DATATYPE_STRINGV ? maxLength : datumSize(type);
+		if (limit > maxLength)
+		{
+			limit = maxLength;
+		}
+		const char *end = (const char *)memchr(pDatum, 0, limit);
+		putString(pDatum, end ? end - pDatum : limit);
+		break;
+	}
+	}
+}
+
+std::vector<uint8_t> TelemetryEncoder::flush()
+{
+	writer.finish();
+
+	std::vector<uint8_t> chunk;
+	chunk.reserve(chunkHeaderSize + types.size() + writer.bytes.size());
+	chunk.insert(chunk.end(), chunkMagic, chunkMagic + 4);
+	chunk.push_back(chunkVersion);
+	writeU16(chunk, (uint16_t)types.size());
+	for (size_t i = 0; i < types.size(); i++)
+	{
+		chunk.push_back((uint8_t)types[i]);
+	}
+	writeU32(chunk, sampleCount);
+	writeU32(chunk, (uint32_t)writer.bytes.size());
+	chunk.insert(chunk.end(), writer.bytes.begin(), writer.bytes.end());
+
+	reset();
+	return chunk;
+}
+
+// Decoding ////////////////////////////////////////////////////////////////////////////
+
+static bool decodeChunk(const uint8_t *data, size_t size, size_t &consumed, TelemetryDecoded &out, std::string &error)
+{
+	if (size < chunkHeaderSize || memcmp(data, chunkMagic, 4) != 0)
+	{
+		error = "Not a telemetry chunk";
+		return false;
+	}
+	if (data[4] != chunkVersion)
+	{
+		error = "Unsupported telemetry chunk version";
+		return false;
+	}
+
+	size_t numColumns = (size_t)data[5] | ((size_t)data[6] << 8);
+	if (size < chunkHeaderSize + numColumns)
+	{
+		error = "Truncated telemetry chunk";
+		return false;
+	}
+
+	const uint8_t *p = data + 7;
+	if (out.columns.empty() && out.timestamps.empty())
+	{
+		out.columns.resize(numColumns);
+		for (size_t i = 0; i < numColumns; i++)
+		{
+			out.columns[i].type = SIMCONNECT_DATATYPE(p[i]);
+			if (!isTelemetryType(out.columns[i].type))
+			{
+				error = "Unsupported column type";
+				return false;
+			}
+		}
+	}
+	else
+	{
+		bool sameLayout = out.columns.size() == numColumns;
+		for (size_t i = 0; sameLayout && i < numColumns; i++)
+		{
+			sameLayout = out.columns[i].type == SIMCONNECT_DATATYPE(p[i]);
+		}
+		if (!sameLayout)
+		{
+			error = "Concatenated chunks have different column layouts";
+			return false;
+		}
+	}
+	p += numColumns;
+
+	uint32_t numSamples = readU32(p);
+	uint32_t payloadSize = readU32(p + 4);
+	p += 8;
+	size_t headerSize = p - data;
+	if (size - headerSize < payloadSize)
+	{
+		error = "Truncated telemetry chunk";
+		return false;
+	}
+
+	std::vector<TelemetryColumnState> state(numColumns);
+	for (size_t i = 0; i < numColumns; i++)
+	{
+		state[i].prevBits = 0;
+		state[i].prevDelta = 0;
+		state[i].prevLeading = 0;
+		state[i].prevTrailing = 0;
+	}
+
+	BitReader reader(p, payloadSize);
+	int64_t timestamp = 0;
+	int64_t timestampDelta = 0;
+
+	for (uint32_t s = 0; s < numSamples; s++)
+	{
+		if (s == 0)
+		{
+			timestamp = (int64_t)reader.readBits(64);
+		}
+		else
+		{
+			timestampDelta = (int64_t)((uint64_t)timestampDelta + (uint64_t)readSigned(reader));
+			timestamp = (int64_t)((uint64_t)timestamp + (uint64_t)timestampDelta);
+		}
+		out.timestamps.push_back(timestamp);
+
+		for (size_t c = 0; c < numColumns; c++)
+		{
+			TelemetryColumnState &st = state[c];
+			TelemetryDecodedColumn &col = out.columns[c];
+
+			switch (col.type)
+			{
+			case SIMCONNECT_DATATYPE_INT32:
+			case SIMCONNECT_DATATYPE_INT64:
+			{
+				st.prevDelta = (int64_t)((uint64_t)st.prevDelta + (uint64_t)readSigned(reader));
+				st.prevBits += (uint64_t)st.prevDelta;
+				if (col.type == SIMCONNECT_DATATYPE_INT32)
+					col.int32.push_back((int32_t)st.prevBits);
+				else
+					col.float64.push_back((double)(int64_t)st.prevBits);
+				break;
+			}
+			case SIMCONNECT_DATATYPE_FLOAT32:
+			case SIMCONNECT_DATATYPE_FLOAT64:
+			{
+				int width = col.type == SIMCONNECT_DATATYPE_FLOAT64 ? 64 : 32;
+				int fieldBits = width == 64 ? 6 : 5;
+				if (reader.readBit())
+				{
+					if (reader.readBit())
+					{
+						st.prevLeading = (int)reader.readBits(fieldBits);
+						int meaningful = (int)reader.readBits(fieldBits) + 1;
+						st.prevTrailing = width - st.prevLeading - meaningful;
+						if (st.prevTrailing < 0)
+						{
+							error = "Corrupt float column";
+							return false;
+						}
+					}
+					int meaningful = width - st.prevLeading - st.prevTrailing;
+					st.prevBits ^= reader.readBits(meaningful) << st.prevTrailing;
+				}
+				if (width == 64)
+				{
+					double value;
+					memcpy(&value, &st.prevBits, sizeof(value));
+					col.float64.push_back(value);
+				}
+				else
+				{
+					uint32_t bits = (uint32_t)st.prevBits;
+					float value;
+					memcpy(&value, &bits, sizeof(value));
+					col.float32.push_back(value);
+				}
+				break;
+			}
+			default:
+			{
+				if (reader.readBit())
+				{
+					size_t length = (size_t)reader.readBits(16);
+					st.prevString.resize(length);
+					for (size_t i = 0; i < length; i++)
+					{
+						st.prevString[i] = (char)reader.readBits(8);
+					}
+				}
+				col.strings.push_back(st.prevString);
+				break;
+			}
+			}
+		}
+
+		if (reader.overrun)
+		{
+			error = "Truncated telemetry payload";
+			return false;
+		}
+	}
+
+	consumed = headerSize + payloadSize;
+	return true;
+}
+
+bool decodeTelemetry(const uint8_t *data, size_t size, TelemetryDecoded &out, std::string &error)
+{
+	size_t offset = 0;
+	while (offset < size)
+	{
+		size_t consumed = 0;
+		if (!decodeChunk(data + offset, size - offset, consumed, out, error))
+		{
+			return false;
+		}
+		offset += consumed;
+	}
+	return true;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "datum.h"
+
+// Streaming telemetry codec in the spirit of Facebook's Gorilla TSDB encoding.
+// Timestamps are stored as delta-of-delta, FLOAT32/FLOAT64 values as XOR against
+// the previous value, INT32/INT64 values as zigzagged delta-of-delta and strings
+// as "unchanged" bits. Every flushed chunk is self-describing and can be decoded
+// on its own, so chunks can simply be appended to a file.
+
+class BitWriter
+{
+public:
+	BitWriter() : acc(0), accBits(0) {}
+
+	void writeBits(uint64_t value, int bits);
+	void writeBit(bool bit) { writeBits(bit ? 1 : 0, 1); }
+	void finish();
+	void clear();
+
+	std::vector<uint8_t> bytes;
+
+private:
+	uint64_t acc;
+	int accBits;
+};
+
+class BitReader
+{
+public:
+	BitReader(const uint8_t *data, size_t size) : overrun(false), data(data), size(size), pos(0), acc(0), accBits(0) {}
+
+	uint64_t readBits(int bits);
+	bool readBit() { return readBits(1) != 0; }
+
+	bool overrun;
+
+private:
+	const uint8_t *data;
+	size_t size;
+	size_t pos;
+	uint64_t acc;
+	int accBits;
+};
+
+struct TelemetryColumnState
+{
+	uint64_t prevBits;
+	int64_t prevDelta;
+	int prevLeading;
+	int prevTrailing;
+	std::string prevString;
+};
+
+class TelemetryEncoder
+{
+public:
+	TelemetryEncoder(const std::vector<SIMCONNECT_DATATYPE> &types, SIMCONNECT_DATA_DEFINITION_ID defineId);
+
+	// A sample is written as beginSample() followed by one put per column, in column order.
+	void beginSample(int64_t timestampUs);
+	void putInt32(int32_t value);
+	void putInt64(int64_t value);
+	void putFloat32(float value);
+	void putFloat64(double value);
+	void putString(const char *value, size_t length);
+	void putNumber(double value);				 // Converts to the column's type
+	void putDatum(const char *pDatum, size_t maxLength); // Raw SimConnect payload of the column's type
+	void endSample();
+
+	// Returns the encoded chunk and starts a new one
+	std::vector<uint8_t> flush();
+
+	SIMCONNECT_DATA_DEFINITION_ID defineId;
+	const std::vector<SIMCONNECT_DATATYPE> &columnTypes() const { return types; }
+	uint32_t pendingSamples() const { return sampleCount; }
+
+private:
+	void reset();
+	void putSigned(TelemetryColumnState &state, int64_t value);
+	void putXor(TelemetryColumnState &state, uint64_t bits, int width);
+
+	std::vector<SIMCONNECT_DATATYPE> types;
+	std::vector<TelemetryColumnState> columns;
+	BitWriter writer;
+	size_t column;
+	uint32_t sampleCount;
+	int64_t prevTimestamp;
+	int64_t prevTimestampDelta;
+};
+
+struct TelemetryDecodedColumn
+{
+	SIMCONNECT_DATATYPE type;
+	std::vector<double> float64; // FLOAT64 and INT64
+	std::vector<float> float32;
+	std::vector<int32_t> int32;
+	std::vector<std::string> strings;
+};
+
+struct TelemetryDecoded
+{
+	std::vector<int64_t> timestamps;
+	std::vector<TelemetryDecodedColumn> columns;
+};
+
+bool isTelemetryType(SIMCONNECT_DATATYPE type);
+
+// Decodes one or more concatenated chunks sharing the same column layout
+bool decodeTelemetry(const uint8_t *data, size_t size, TelemetryDecoded &out, std::string &error);
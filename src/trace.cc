@@ -0,0 +1,123 @@
+#include "trace.h"
+
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+struct TraceRing
+{
+	const char *threadName;
+	uint32_t threadId;
+	uint64_t written; // Only changed by the owning thread
+	TraceEvent events[traceRingSize];
+};
+
+std::atomic<bool> traceEnabled(false);
+
+static std::mutex ringsMutex; // Guards the list, not the rings
+static std::vector<TraceRing *> rings; // Live as long as the process
+static thread_local TraceRing *threadRing = NULL;
+static thread_local const char *threadName = NULL;
+
+static TraceRing *ringOfThread()
+{
+	if (!threadRing)
+	{
+		TraceRing *ring = new TraceRing();
+		ring->threadName = threadName ? threadName : "thread";
+		ring->written = 0;
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		ring->threadId = (uint32_t)rings.size() + 1;
+		rings.push_back(ring);
+		threadRing = ring;
+	}
+	return threadRing;
+}
+
+void nameTraceThread(const char *name)
+{
+	threadName = name;
+	if (threadRing)
+		threadRing->threadName = name;
+}
+
+void traceSpan(const char *name, uint64_t start, uint64_t end, const char *argName, uint32_t arg)
+{
+	TraceRing *ring = ringOfThread();
+	TraceEvent &event = ring->events[ring->written++ & (traceRingSize - 1)];
+	uint32_t sequence = event.sequence.load(std::memory_order_relaxed);
+	event.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	event.name = name;
+	event.argName = argName;
+	event.arg = arg;
+	event.start = start;
+	event.duration = end > start ? end - start : 0;
+	event.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+static void appendJsonString(std::string &out, const char *value)
+{
+	out += '"';
+	for (const char *c = value; *c; c++)
+	{
+		if (*c == '"' || *c == '\\')
+			out += '\\';
+		if ((unsigned char)*c >= 0x20)
+			out += *c;
+	}
+	out += '"';
+}
+
+std::string dumpTrace(uint64_t since)
+{
+	std::vector<TraceRing *> snapshot;
+	{
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		snapshot = rings;
+	}
+
+	std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first = true;
+	char number[128];
+	for (TraceRing *ring : snapshot)
+	{
+		out += first ? "" : ",";
+		first = false;
+		snprintf(number, sizeof(number), "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", ring->threadId);
+		out += number;
+		appendJsonString(out, ring->threadName);
+		out += "}}";
+
+		for (uint32_t i = 0; i < traceRingSize; i++)
+		{
+			TraceEvent &event = ring->events[i];
+			uint32_t sequence = event.sequence.load(std::memory_order_acquire);
+			if (sequence == 0 || (sequence & 1))
+				continue;
+			const char *name = event.name;
+			const char *argName = event.argName;
+			uint32_t arg = event.arg;
+			uint64_t start = event.start;
+			uint64_t duration = event.duration;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (event.sequence.load(std::memory_order_relaxed) != sequence || start < since)
+				continue; // Overwritten while reading, or too old
+
+			// Microseconds, as the format expects
+			snprintf(number, sizeof(number), ",{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":", ring->threadId, start / 1e3, duration / 1e3);
+			out += number;
+			appendJsonString(out, name);
+			if (argName)
+			{
+				out += ",\"args\":{";
+				appendJsonString(out, argName);
+				snprintf(number, sizeof(number), ":%u}", arg);
+				out += number;
+			}
+			out += "}";
+		}
+	}
+	out += "]}";
+	return out;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <uv.h>
+
+// Opt-in tracer for the internals of the addon. Every thread records its spans into a
+// ring of its own, so recording takes no lock and costs two clock reads and a store.
+// dumpTrace() renders the spans still in the rings as Chrome trace-event JSON, which
+// loads in chrome://tracing and in the Perfetto UI.
+//
+// Each event is guarded by a seqlock like the slots of the telemetry bus: the sequence
+// is odd while the owning thread writes it, so a dump never reports a torn event.
+
+static const uint32_t traceRingSize = 1 << 16; // Events per thread
+
+struct TraceEvent
+{
+	std::atomic<uint32_t> sequence;
+	const char *name;
+	const char *argName; // NULL without an argument
+	uint32_t arg;
+	uint64_t start; // uv_hrtime()
+	uint64_t duration;
+};
+
+extern std::atomic<bool> traceEnabled;
+
+// Names the calling thread in the dumps
+void nameTraceThread(const char *name);
+
+// Records a finished span on the ring of the calling thread. Names must be string literals.
+void traceSpan(const char *name, uint64_t start, uint64_t end, const char *argName = NULL, uint32_t arg = 0);
+
+// Spans that started at or after since (uv_hrtime()), as a Chrome trace-event JSON document
+std::string dumpTrace(uint64_t since);
+
+// Traces the enclosing scope while tracing is enabled
+class TraceScope
+{
+public:
+	TraceScope(const char *name, const char *argName = NULL, uint32_t arg = 0)
+		: name(name), argName(argName), arg(arg), start(traceEnabled.load(std::memory_order_relaxed) ? uv_hrtime() : 0) {}
+	~TraceScope()
+	{
+		if (start)
+			traceSpan(name, start, uv_hrtime(), argName, arg);
+	}
+
+private:
+	const char *name;
+	const char *argName;
+	uint32_t arg;
+	uint64_t start;
+};
@@ -0,0 +1,325 @@
+// Standalone checks of the Arrow IPC stream of ArrowWriter against a stream written by pyarrow
+// for the same rows. The flatbuffers of the two are laid out differently, so the metadata is
+// compared field by field and the bodies byte by byte. Built as the arrow_writer_test target,
+// run from the repository root or given the fixture path, exits with 1 on failure.
+//
+// test/fixtures/arrow_writer_stream.arrows was written with pyarrow:
+//
+//   fields = [("timestamp", pa.timestamp("us", tz="UTC")), ("altitude", pa.float64()), ("count", pa.int32()),
+//             ("ticks", pa.int64()), ("ratio", pa.float32()), ("title", pa.utf8())]
+//   schema = pa.schema([pa.field(name, type, nullable=False) for name, type in fields])
+//   batch = pa.record_batch([[1700000000000000 + 16667 * i for i in range(3)], [1000.5 * i for i in range(3)],
+//                            [-i for i in range(3)], [(1 << 40) | i for i in range(3)], [0.25 * i for i in range(3)],
+//                            ["A320", "", "Zürich"]], schema=schema)
+//   with pa.ipc.new_stream(path, schema) as writer: writer.write_batch(batch)
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../src/arrow_writer.h"
+
+static int failures = 0;
+static std::string currentCase;
+
+#define CHECK(condition)                                                       \
+	do                                                                         \
+	{                                                                          \
+		if (!(condition))                                                      \
+		{                                                                      \
+			printf("%s:%d: %s failed (%s)\n", __FILE__, __LINE__, #condition, \
+				   currentCase.c_str());                                       \
+			failures++;                                                        \
+		}                                                                      \
+	} while (0)
+
+// Reads the few flatbuffers tables of the Arrow metadata. Every read is bounds checked and
+// marks the buffer as damaged instead of reading past it.
+class FlatReader
+{
+public:
+	FlatReader(const std::vector<uint8_t> &bytes) : bytes(bytes), damaged(false) {}
+
+	uint64_t scalar(size_t position, int size)
+	{
+		if (position + size > bytes.size())
+		{
+			damaged = true;
+			return 0;
+		}
+		uint64_t value = 0;
+		for (int i = 0; i < size; i++)
+			value |= (uint64_t)bytes[position + i] << (8 * i);
+		return value;
+	}
+
+	size_t root() { return (size_t)scalar(0, 4); }
+
+	// Position of field id of a table, 0 when the field is absent
+	size_t field(size_t table, int id)
+	{
+		size_t vtable = table - (size_t)(int32_t)scalar(table, 4);
+		size_t vtableSize = (size_t)scalar(vtable, 2);
+		if (damaged || 4 + 2 * (size_t)id >= vtableSize)
+			return 0;
+		size_t offset = (size_t)scalar(vtable + 4 + 2 * id, 2);
+		return offset ? table + offset : 0;
+	}
+
+	uint64_t scalarField(size_t table, int id, int size, uint64_t fallback = 0)
+	{
+		size_t position = field(table, id);
+		return position ? scalar(position, size) : fallback;
+	}
+
+	// Target of an offset field, 0 when the field is absent
+	size_t offsetField(size_t table, int id)
+	{
+		size_t position = field(table, id);
+		return position ? position + (size_t)scalar(position, 4) : 0;
+	}
+
+	std::string string(size_t position)
+	{
+		size_t length = (size_t)scalar(position, 4);
+		if (damaged || position + 4 + length > bytes.size())
+		{
+			damaged = true;
+			return "";
+		}
+		return std::string((const char *)&bytes[position + 4], length);
+	}
+
+	const std::vector<uint8_t> &bytes;
+	bool damaged;
+};
+
+struct Message
+{
+	std::vector<uint8_t> metadata;
+	std::vector<uint8_t> body;
+};
+
+// Splits a stream into its messages. Returns false unless it ends with the end-of-stream marker.
+static bool splitStream(const std::vector<uint8_t> &stream, std::vector<Message> &messages)
+{
+	size_t position = 0;
+	while (position + 8 <= stream.size())
+	{
+		FlatReader prefix(stream);
+		if (prefix.scalar(position, 4) != 0xFFFFFFFF)
+			return false;
+		size_t size = (size_t)prefix.scalar(position + 4, 4);
+		position += 8;
+		if (size == 0)
+			return position == stream.size();
+		if (size % 8 != 0 || position + size > stream.size())
+			return false;
+
+		Message message;
+		message.metadata.assign(stream.begin() + position, stream.begin() + position + size);
+		position += size;
+
+		FlatReader reader(message.metadata);
+		size_t bodyLength = (size_t)reader.scalarField(reader.root(), 3, 8);
+		if (reader.damaged || bodyLength % 8 != 0 || position + bodyLength > stream.size())
+			return false;
+		message.body.assign(stream.begin() + position, stream.begin() + position + bodyLength);
+		position += bodyLength;
+		messages.push_back(message);
+	}
+	return false;
+}
+
+// The schema as text, eg. "timestamp timestamp(2,UTC) !null; altitude float(2) !null"
+static std::string describeSchema(const Message &message)
+{
+	FlatReader reader(message.metadata);
+	size_t root = reader.root();
+	std::string text = "version " + std::to_string(reader.scalarField(root, 0, 2)) + " header " + std::to_string(reader.scalarField(root, 1, 1));
+	size_t schema = reader.offsetField(root, 2);
+	text += " endianness " + std::to_string(reader.scalarField(schema, 0, 2));
+
+	size_t fields = reader.offsetField(schema, 1);
+	uint32_t count = (uint32_t)reader.scalar(fields, 4);
+	for (uint32_t i = 0; i < count && !reader.damaged; i++)
+	{
+		size_t entry = fields + 4 + 4 * i;
+		size_t field = entry + (size_t)reader.scalar(entry, 4);
+		text += "; " + reader.string(reader.offsetField(field, 0));
+		uint8_t typeType = (uint8_t)reader.scalarField(field, 2, 1);
+		size_t type = reader.offsetField(field, 3);
+		switch (typeType)
+		{
+		case 2:
+			text += " int(" + std::to_string(reader.scalarField(type, 0, 4)) + "," + std::to_string(reader.scalarField(type, 1, 1)) + ")";
+			break;
+		case 3:
+			text += " float(" + std::to_string(reader.scalarField(type, 0, 2)) + ")";
+			break;
+		case 5:
+			text += " utf8";
+			break;
+		case 10:
+			text += " timestamp(" + std::to_string(reader.scalarField(type, 0, 2)) + "," + reader.string(reader.offsetField(type, 1)) + ")";
+			break;
+		default:
+			text += " type " + std::to_string(typeType);
+			break;
+		}
+		text += reader.scalarField(field, 1, 1) ? " null" : " !null";
+		if (reader.field(field, 4))
+			text += " dictionary";
+		size_t children = reader.offsetField(field, 5);
+		if (children && reader.scalar(children, 4))
+			text += " children";
+	}
+	return reader.damaged ? "damaged" : text;
+}
+
+// The record batch as text: length, then length and null count of every column, then offset
+// and length of every buffer
+static std::string describeBatch(const Message &message)
+{
+	FlatReader reader(message.metadata);
+	size_t root = reader.root();
+	std::string text = "version " + std::to_string(reader.scalarField(root, 0, 2)) + " header " + std::to_string(reader.scalarField(root, 1, 1)) +
+					   " body " + std::to_string(reader.scalarField(root, 3, 8));
+	size_t batch = reader.offsetField(root, 2);
+	text += " length " + std::to_string(reader.scalarField(batch, 0, 8));
+	if (reader.field(batch, 3))
+		text += " compressed";
+
+	const char *names[] = {" nodes", " buffers"};
+	for (int list = 0; list < 2; list++)
+	{
+		text += names[list];
+		size_t vector = reader.offsetField(batch, 1 + list);
+		uint32_t count = (uint32_t)reader.scalar(vector, 4);
+		for (uint32_t i = 0; i < count && !reader.damaged; i++)
+			text += " " + std::to_string(reader.scalar(vector + 4 + 16 * i, 8)) + "/" + std::to_string(reader.scalar(vector + 12 + 16 * i, 8));
+	}
+	return reader.damaged ? "damaged" : text;
+}
+
+static ArrowWriter fixtureWriter()
+{
+	return ArrowWriter({"altitude", "count", "ticks", "ratio", "title"},
+					   {SIMCONNECT_DATATYPE_FLOAT64, SIMCONNECT_DATATYPE_INT32, SIMCONNECT_DATATYPE_INT64, SIMCONNECT_DATATYPE_FLOAT32, SIMCONNECT_DATATYPE_STRINGV}, 0);
+}
+
+// The rows of the fixture
+static void writeRows(ArrowWriter &writer)
+{
+	const char *titles[] = {"A320", "", "Z\xC3\xBCrich"};
+	for (int i = 0; i < 3; i++)
+	{
+		writer.beginRow(1700000000000000LL + 16667 * i);
+		writer.putFloat64(1000.5 * i);
+		writer.putInt32(-i);
+		writer.putInt64((1LL << 40) | i);
+		writer.putFloat32(0.25f * i);
+		writer.putString(titles[i], strlen(titles[i]));
+		writer.endRow();
+	}
+}
+
+static void testAgainstFixture(const std::vector<uint8_t> &fixture)
+{
+	currentCase = "fixture";
+	std::vector<Message> expected;
+	CHECK(splitStream(fixture, expected));
+	CHECK(expected.size() == 2);
+	if (expected.size() != 2)
+		return;
+
+	ArrowWriter writer = fixtureWriter();
+	writeRows(writer);
+	CHECK(writer.pendingRows() == 3);
+	std::vector<uint8_t> stream;
+	writer.finish(stream);
+	CHECK(writer.pendingRows() == 0);
+
+	std::vector<Message> messages;
+	CHECK(splitStream(stream, messages));
+	CHECK(messages.size() == 2);
+	if (messages.size() != 2)
+		return;
+
+	currentCase = "schema";
+	CHECK(describeSchema(messages[0]) == describeSchema(expected[0]));
+	CHECK(describeSchema(messages[0]) != "damaged");
+	CHECK(messages[0].body.empty());
+
+	currentCase = "record batch";
+	CHECK(describeBatch(messages[1]) == describeBatch(expected[1]));
+	CHECK(describeBatch(messages[1]) != "damaged");
+	CHECK(messages[1].body == expected[1].body);
+	if (describeBatch(messages[1]) != describeBatch(expected[1]))
+		printf("  written:  %s\n  expected: %s\n", describeBatch(messages[1]).c_str(), describeBatch(expected[1]).c_str());
+}
+
+// The schema is written by the first flush only, the output of several flushes is one stream
+static void testFlushes()
+{
+	currentCase = "flushes";
+	ArrowWriter writer = fixtureWriter();
+	std::vector<uint8_t> stream;
+	writer.flush(stream);
+	writer.flush(stream); // Nothing pending
+	writeRows(writer);
+	writer.flush(stream);
+	writer.beginRow(1);
+	writer.endRow(); // Padded with 0 and empty strings
+	writer.finish(stream);
+
+	std::vector<Message> messages;
+	CHECK(splitStream(stream, messages));
+	CHECK(messages.size() == 3);
+	if (messages.size() != 3)
+		return;
+	FlatReader reader(messages[2].metadata);
+	size_t batch = reader.offsetField(reader.root(), 2);
+	CHECK(reader.scalarField(reader.root(), 1, 1) == 3);
+	CHECK(reader.scalarField(batch, 0, 8) == 1);
+
+	int64_t timestamp;
+	memcpy(&timestamp, &messages[2].body[0], sizeof(timestamp));
+	CHECK(timestamp == 1);
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &bytes)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+	uint8_t chunk[4096];
+	size_t read;
+	while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		bytes.insert(bytes.end(), chunk, chunk + read);
+	fclose(file);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "test/fixtures/arrow_writer_stream.arrows";
+	std::vector<uint8_t> fixture;
+	if (!readFile(path, fixture))
+	{
+		printf("Could not read %s\n", path);
+		return 1;
+	}
+
+	testAgainstFixture(fixture);
+	testFlushes();
+
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("arrow_writer_test passed\n");
+	return 0;
+}
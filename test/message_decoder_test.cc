@@ -0,0 +1,266 @@
+// Standalone checks of decodeMessage: every SIMCONNECT_RECV id is fed a truncated, an exact
+// and an oversized buffer. Built as the message_decoder_test target, exits with 1 on failure.
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "../src/message_decoder.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+	do                                                                         \
+	{                                                                          \
+		if (!(condition))                                                      \
+		{                                                                      \
+			printf("%s:%d: %s failed (%s)\n", __FILE__, __LINE__, #condition, \
+				   currentCase.c_str());                                       \
+			failures++;                                                        \
+		}                                                                      \
+	} while (0)
+
+static std::string currentCase;
+
+// A zeroed message of cbData bytes, 8-byte aligned like the buffers of SimConnect. The buffer
+// has room for the header and a few bytes past cbData, which must never be read.
+struct Message
+{
+	Message(DWORD id, size_t cbData) : words((cbData + sizeof(SIMCONNECT_RECV) + 7) / 8, 0), cbData((DWORD)cbData)
+	{
+		recv()->dwSize = (DWORD)cbData;
+		recv()->dwVersion = 4;
+		recv()->dwID = id;
+	}
+
+	SIMCONNECT_RECV *recv() { return (SIMCONNECT_RECV *)words.data(); }
+	template <typename T>
+	T *as() { return (T *)words.data(); }
+	char *bytes() { return (char *)words.data(); }
+
+	std::vector<uint64_t> words;
+	DWORD cbData;
+};
+
+// The names of the fields of the message itself, then of its first entry, comma separated
+static std::string fieldNames(const DecodedMessage &decoded)
+{
+	std::string names;
+	for (auto &field : decoded.fields)
+	{
+		if (field.entry > 0)
+			break;
+		if (!names.empty())
+			names += ",";
+		names += field.name;
+	}
+	return names;
+}
+
+static const DecodedField *findField(const DecodedMessage &decoded, const char *name, int entry = -1)
+{
+	for (auto &field : decoded.fields)
+		if (field.entry == entry && std::string(field.name) == name)
+			return &field;
+	return NULL;
+}
+
+// offsetof is not defined for the derived SIMCONNECT_RECV structs
+template <typename T>
+static const T &instance()
+{
+	static T value;
+	return value;
+}
+#define MEMBER_OFFSET(type, member) ((size_t)((const char *)&instance<type>().member - (const char *)&instance<type>()))
+
+struct FixedCase
+{
+	DWORD id;
+	size_t size; // Smallest size the message is decoded from
+	const char *names;
+};
+
+#define EVENT_FIELDS "groupId,eventId,data"
+#define RACE_FIELDS "numberOfRacers,missionGuid,playerName,sessionType,aircraft,playerRole,totalTime,penaltyTime,isDisqualified"
+#define LIST_FIELDS "requestId,entryNumber,outOf"
+#define FACILITY_FIELDS "icao,latitude,longitude,altitude"
+
+// Every id, with the size it is decoded from and its fields for a list of a single entry
+static const FixedCase cases[] = {
+	{SIMCONNECT_RECV_ID_NULL, sizeof(SIMCONNECT_RECV), ""},
+	{SIMCONNECT_RECV_ID_EXCEPTION, sizeof(SIMCONNECT_RECV_EXCEPTION), "exception,sendId,index"},
+	{SIMCONNECT_RECV_ID_OPEN, sizeof(SIMCONNECT_RECV_OPEN), "applicationName,applicationVersionMajor,applicationVersionMinor,applicationBuildMajor,applicationBuildMinor,simConnectVersionMajor,simConnectVersionMinor,simConnectBuildMajor,simConnectBuildMinor"},
+	{SIMCONNECT_RECV_ID_QUIT, sizeof(SIMCONNECT_RECV), ""},
+	{SIMCONNECT_RECV_ID_EVENT, sizeof(SIMCONNECT_RECV_EVENT), EVENT_FIELDS},
+	{SIMCONNECT_RECV_ID_EVENT_OBJECT_ADDREMOVE, sizeof(SIMCONNECT_RECV_EVENT_OBJECT_ADDREMOVE), EVENT_FIELDS ",objectType"},
+	{SIMCONNECT_RECV_ID_EVENT_FILENAME, sizeof(SIMCONNECT_RECV_EVENT_FILENAME), EVENT_FIELDS ",fileName,flags"},
+	{SIMCONNECT_RECV_ID_EVENT_FRAME, sizeof(SIMCONNECT_RECV_EVENT_FRAME), EVENT_FIELDS ",frameRate,simSpeed"},
+	{SIMCONNECT_RECV_ID_SIMOBJECT_DATA, MEMBER_OFFSET(SIMCONNECT_RECV_SIMOBJECT_DATA, dwData), "requestId,objectId,defineId,flags,entryNumber,outOf,defineCount,data"},
+	{SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE, MEMBER_OFFSET(SIMCONNECT_RECV_SIMOBJECT_DATA, dwData), "requestId,objectId,defineId,flags,entryNumber,outOf,defineCount,data"},
+	{SIMCONNECT_RECV_ID_WEATHER_OBSERVATION, MEMBER_OFFSET(SIMCONNECT_RECV_WEATHER_OBSERVATION, szMetar), "requestId,metar"},
+	{SIMCONNECT_RECV_ID_CLOUD_STATE, MEMBER_OFFSET(SIMCONNECT_RECV_CLOUD_STATE, rgbData), "requestId,data"},
+	{SIMCONNECT_RECV_ID_ASSIGNED_OBJECT_ID, sizeof(SIMCONNECT_RECV_ASSIGNED_OBJECT_ID), "requestId,objectId"},
+	{SIMCONNECT_RECV_ID_RESERVED_KEY, sizeof(SIMCONNECT_RECV_RESERVED_KEY), "choiceReserved,reservedKey"},
+	{SIMCONNECT_RECV_ID_CUSTOM_ACTION, MEMBER_OFFSET(SIMCONNECT_RECV_CUSTOM_ACTION, szPayLoad), EVENT_FIELDS ",instanceId,waitForCompletion,payload"},
+	{SIMCONNECT_RECV_ID_SYSTEM_STATE, sizeof(SIMCONNECT_RECV_SYSTEM_STATE), "requestId,integer,float,string"},
+	{SIMCONNECT_RECV_ID_CLIENT_DATA, MEMBER_OFFSET(SIMCONNECT_RECV_CLIENT_DATA, dwData), "requestId,objectId,defineId,flags,entryNumber,outOf,defineCount,data"},
+	{SIMCONNECT_RECV_ID_EVENT_WEATHER_MODE, sizeof(SIMCONNECT_RECV_EVENT_WEATHER_MODE), EVENT_FIELDS},
+	{SIMCONNECT_RECV_ID_AIRPORT_LIST, sizeof(SIMCONNECT_RECV_FACILITIES_LIST), LIST_FIELDS},
+	{SIMCONNECT_RECV_ID_VOR_LIST, sizeof(SIMCONNECT_RECV_FACILITIES_LIST), LIST_FIELDS},
+	{SIMCONNECT_RECV_ID_NDB_LIST, sizeof(SIMCONNECT_RECV_FACILITIES_LIST), LIST_FIELDS},
+	{SIMCONNECT_RECV_ID_WAYPOINT_LIST, sizeof(SIMCONNECT_RECV_FACILITIES_LIST), LIST_FIELDS},
+	{SIMCONNECT_RECV_ID_EVENT_MULTIPLAYER_SERVER_STARTED, sizeof(SIMCONNECT_RECV_EVENT), EVENT_FIELDS},
+	{SIMCONNECT_RECV_ID_EVENT_MULTIPLAYER_CLIENT_STARTED, sizeof(SIMCONNECT_RECV_EVENT), EVENT_FIELDS},
+	{SIMCONNECT_RECV_ID_EVENT_MULTIPLAYER_SESSION_ENDED, sizeof(SIMCONNECT_RECV_EVENT), EVENT_FIELDS},
+	{SIMCONNECT_RECV_ID_EVENT_RACE_END, sizeof(SIMCONNECT_RECV_EVENT_RACE_END), EVENT_FIELDS ",racerNumber," RACE_FIELDS},
+	{SIMCONNECT_RECV_ID_EVENT_RACE_LAP, sizeof(SIMCONNECT_RECV_EVENT_RACE_LAP), EVENT_FIELDS ",lapIndex," RACE_FIELDS},
+};
+
+static void testSizes()
+{
+	CHECK(sizeof(cases) / sizeof(cases[0]) == messageIdCount);
+	for (auto &testCase : cases)
+	{
+		DecodedMessage decoded;
+		currentCase = "id " + std::to_string(testCase.id);
+
+		Message truncated(testCase.id, testCase.size - 1);
+		CHECK(!decodeMessage(truncated.recv(), truncated.cbData, decoded));
+		CHECK(decoded.fields.empty());
+
+		Message exact(testCase.id, testCase.size);
+		CHECK(decodeMessage(exact.recv(), exact.cbData, decoded));
+		CHECK(fieldNames(decoded) == testCase.names);
+		CHECK(decoded.entryCount == 0);
+
+		Message oversized(testCase.id, testCase.size + 64);
+		CHECK(decodeMessage(oversized.recv(), oversized.cbData, decoded));
+		CHECK(fieldNames(decoded) == testCase.names);
+		CHECK(decoded.entryCount == 0); // dwArraySize is 0
+	}
+}
+
+static void testHeader()
+{
+	DecodedMessage decoded;
+	currentCase = "header";
+
+	Message unknown(messageIdCount, 256);
+	CHECK(!decodeMessage(unknown.recv(), unknown.cbData, decoded));
+	Message large(0xFFFF, 256);
+	CHECK(!decodeMessage(large.recv(), large.cbData, decoded));
+	Message empty(SIMCONNECT_RECV_ID_NULL, 0);
+	CHECK(!decodeMessage(empty.recv(), empty.cbData, decoded));
+	Message shortHeader(SIMCONNECT_RECV_ID_QUIT, sizeof(SIMCONNECT_RECV) - 1);
+	CHECK(!decodeMessage(shortHeader.recv(), shortHeader.cbData, decoded));
+}
+
+static void testValues()
+{
+	DecodedMessage decoded;
+	currentCase = "values";
+
+	Message exception(SIMCONNECT_RECV_ID_EXCEPTION, sizeof(SIMCONNECT_RECV_EXCEPTION));
+	exception.as<SIMCONNECT_RECV_EXCEPTION>()->dwException = SIMCONNECT_EXCEPTION_NAME_UNRECOGNIZED;
+	exception.as<SIMCONNECT_RECV_EXCEPTION>()->dwSendID = 42;
+	exception.as<SIMCONNECT_RECV_EXCEPTION>()->dwIndex = 3;
+	CHECK(decodeMessage(exception.recv(), exception.cbData, decoded));
+	CHECK(findField(decoded, "exception")->number == SIMCONNECT_EXCEPTION_NAME_UNRECOGNIZED);
+	CHECK(findField(decoded, "sendId")->number == 42);
+	CHECK(findField(decoded, "index")->number == 3);
+
+	// A string filling its whole array is cut at the array, not read past it
+	Message open(SIMCONNECT_RECV_ID_OPEN, sizeof(SIMCONNECT_RECV_OPEN));
+	SIMCONNECT_RECV_OPEN *pOpen = open.as<SIMCONNECT_RECV_OPEN>();
+	memset(pOpen->szApplicationName, 'x', sizeof(pOpen->szApplicationName));
+	CHECK(decodeMessage(open.recv(), open.cbData, decoded));
+	CHECK(findField(decoded, "applicationName")->length == sizeof(pOpen->szApplicationName));
+	strcpy(pOpen->szApplicationName, "KittyHawk");
+	CHECK(decodeMessage(open.recv(), open.cbData, decoded));
+	CHECK(std::string(findField(decoded, "applicationName")->data, findField(decoded, "applicationName")->length) == "KittyHawk");
+
+	// The data of a sample is everything after the header, oversized or not
+	size_t dataOffset = MEMBER_OFFSET(SIMCONNECT_RECV_SIMOBJECT_DATA, dwData);
+	Message sample(SIMCONNECT_RECV_ID_SIMOBJECT_DATA, dataOffset + 16);
+	CHECK(decodeMessage(sample.recv(), sample.cbData, decoded));
+	CHECK(findField(decoded, "data")->kind == FIELD_BYTES);
+	CHECK(findField(decoded, "data")->length == 16);
+	CHECK(findField(decoded, "data")->data == sample.bytes() + dataOffset);
+
+	// The metar and payload strings end with the message when they are not terminated
+	size_t metarOffset = MEMBER_OFFSET(SIMCONNECT_RECV_WEATHER_OBSERVATION, szMetar);
+	Message metar(SIMCONNECT_RECV_ID_WEATHER_OBSERVATION, metarOffset + 4);
+	memcpy(metar.bytes() + metarOffset, "EDDF", 4);
+	metar.bytes()[metarOffset + 4] = 'X'; // Past the message
+	CHECK(decodeMessage(metar.recv(), metar.cbData, decoded));
+	CHECK(std::string(findField(decoded, "metar")->data, findField(decoded, "metar")->length) == "EDDF");
+
+	// The cloud data is limited to the received bytes, whatever its array size says
+	size_t cloudOffset = MEMBER_OFFSET(SIMCONNECT_RECV_CLOUD_STATE, rgbData);
+	Message cloud(SIMCONNECT_RECV_ID_CLOUD_STATE, cloudOffset + 10);
+	cloud.as<SIMCONNECT_RECV_CLOUD_STATE>()->dwArraySize = 64 * 64;
+	CHECK(decodeMessage(cloud.recv(), cloud.cbData, decoded));
+	CHECK(findField(decoded, "data")->length == 10);
+	cloud.as<SIMCONNECT_RECV_CLOUD_STATE>()->dwArraySize = 4;
+	CHECK(decodeMessage(cloud.recv(), cloud.cbData, decoded));
+	CHECK(findField(decoded, "data")->length == 4);
+}
+
+template <typename T>
+static void testFacilitiesList(DWORD id, const char *entryNames)
+{
+	DecodedMessage decoded;
+	currentCase = "list " + std::to_string(id);
+	size_t header = sizeof(SIMCONNECT_RECV_FACILITIES_LIST);
+
+	// Two entries announced, the received size decides how many are decoded
+	Message list(id, header + 2 * sizeof(T));
+	list.as<SIMCONNECT_RECV_FACILITIES_LIST>()->dwArraySize = 2;
+	T *entries = (T *)(list.bytes() + header);
+	strcpy(entries[0].Icao, "EDDF");
+	entries[0].Latitude = 50.0333;
+	strcpy(entries[1].Icao, "EDDM");
+	CHECK(decodeMessage(list.recv(), list.cbData, decoded));
+	CHECK(decoded.entryCount == 2);
+	std::string names;
+	for (auto &field : decoded.fields)
+	{
+		if (field.entry != 0)
+			continue;
+		names += names.empty() ? "" : ",";
+		names += field.name;
+	}
+	CHECK(names == entryNames);
+	CHECK(std::string(findField(decoded, "icao", 1)->data, findField(decoded, "icao", 1)->length) == "EDDM");
+	CHECK(findField(decoded, "latitude", 0)->number == 50.0333);
+
+	Message truncated(id, header + 2 * sizeof(T) - 1);
+	truncated.as<SIMCONNECT_RECV_FACILITIES_LIST>()->dwArraySize = 2;
+	CHECK(decodeMessage(truncated.recv(), truncated.cbData, decoded));
+	CHECK(decoded.entryCount == 1);
+
+	Message oversized(id, header + 3 * sizeof(T));
+	oversized.as<SIMCONNECT_RECV_FACILITIES_LIST>()->dwArraySize = 2;
+	CHECK(decodeMessage(oversized.recv(), oversized.cbData, decoded));
+	CHECK(decoded.entryCount == 2);
+}
+
+int main()
+{
+	testSizes();
+	testHeader();
+	testValues();
+	testFacilitiesList<SIMCONNECT_DATA_FACILITY_AIRPORT>(SIMCONNECT_RECV_ID_AIRPORT_LIST, FACILITY_FIELDS);
+	testFacilitiesList<SIMCONNECT_DATA_FACILITY_WAYPOINT>(SIMCONNECT_RECV_ID_WAYPOINT_LIST, FACILITY_FIELDS ",magVar");
+	testFacilitiesList<SIMCONNECT_DATA_FACILITY_NDB>(SIMCONNECT_RECV_ID_NDB_LIST, FACILITY_FIELDS ",magVar,frequency");
+	testFacilitiesList<SIMCONNECT_DATA_FACILITY_VOR>(SIMCONNECT_RECV_ID_VOR_LIST, FACILITY_FIELDS ",magVar,frequency,flags,localizer,glideLatitude,glideLongitude,glideAltitude,glideSlopeAngle");
+
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("message_decoder_test passed\n");
+	return 0;
+}
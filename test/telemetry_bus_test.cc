@@ -0,0 +1,266 @@
+// Standalone checks of the telemetry bus: a bus is created, published to and attached to in
+// the same process, with a second thread publishing while the samples are read. Built as the
+// telemetry_bus_test target, exits with 1 on failure.
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/telemetry_bus.h"
+
+static int failures = 0;
+static std::string currentCase;
+
+#define CHECK(condition)                                                       \
+	do                                                                         \
+	{                                                                          \
+		if (!(condition))                                                      \
+		{                                                                      \
+			printf("%s:%d: %s failed (%s)\n", __FILE__, __LINE__, #condition, \
+				   currentCase.c_str());                                       \
+			failures++;                                                        \
+		}                                                                      \
+	} while (0)
+
+// Names are unique per run, a bus left behind by a crashed run does not get in the way
+static std::string busName(const char *suffix)
+{
+	return "test-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "-" + suffix;
+}
+
+static const std::vector<std::string> names = {"altitude", "count", "title", "tail"};
+static const std::vector<SIMCONNECT_DATATYPE> types = {SIMCONNECT_DATATYPE_FLOAT64, SIMCONNECT_DATATYPE_INT32, SIMCONNECT_DATATYPE_STRINGV, SIMCONNECT_DATATYPE_STRING8};
+
+// A sample whose every field is derived from its index, so a torn read shows
+struct Sample
+{
+	double altitude;
+	int32_t count;
+	std::string title;
+	char tail[8];
+
+	explicit Sample(int64_t index) : altitude(index * 0.5), count((int32_t)index), title("Sample " + std::to_string(index))
+	{
+		memset(tail, 0, sizeof(tail));
+		snprintf(tail, sizeof(tail), "N%lld", (long long)(index % 100000));
+	}
+
+	void publish(TelemetryBus *bus, int64_t index) const
+	{
+		DatumSlice slices[4] = {
+			{(const char *)&altitude, sizeof(altitude)},
+			{(const char *)&count, sizeof(count)},
+			{title.c_str(), (DWORD)title.size() + 1},
+			{tail, sizeof(tail)}};
+		bus->publish(index * 1000, slices);
+	}
+};
+
+static bool matches(const TelemetryBus *bus, int64_t index, const std::vector<char> &sample)
+{
+	const TelemetryBusField *fields = bus->fields();
+	Sample expected(index);
+	double altitude;
+	int32_t count;
+	memcpy(&altitude, sample.data() + fields[0].offset, sizeof(altitude));
+	memcpy(&count, sample.data() + fields[1].offset, sizeof(count));
+	return altitude == expected.altitude && count == expected.count &&
+		   std::string(sample.data() + fields[2].offset) == expected.title &&
+		   memcmp(sample.data() + fields[3].offset, expected.tail, sizeof(expected.tail)) == 0;
+}
+
+static void testLayout()
+{
+	currentCase = "layout";
+	std::string error;
+	std::string name = busName("layout");
+	TelemetryBus *bus = TelemetryBus::create(name, names, types, 4, error);
+	CHECK(bus != NULL);
+	if (!bus)
+	{
+		printf("create: %s\n", error.c_str());
+		return;
+	}
+
+	const TelemetryBusHeader *header = bus->header();
+	CHECK(header->fieldCount == 4);
+	CHECK(header->slotCount == 4);
+	CHECK(header->slotsOffset % 64 == 0);
+	CHECK(header->slotSize == sizeof(TelemetryBusSlot) + header->sampleSize);
+	CHECK(header->sampleSize % 8 == 0);
+	CHECK(bus->fields()[0].offset == 0);
+	CHECK(bus->fields()[1].offset == 8);
+	CHECK(bus->fields()[2].size == telemetryBusStringCapacity);
+	CHECK(bus->fields()[3].size == 8);
+	CHECK(std::string(bus->fields()[2].name) == "title");
+
+	// A second producer under the same name is turned away instead of overwriting the first
+	currentCase = "second producer";
+	TelemetryBus *duplicate = TelemetryBus::create(name, names, types, 4, error);
+	CHECK(duplicate == NULL);
+	delete duplicate;
+	TelemetryBus *reader = TelemetryBus::attach(name, error);
+	CHECK(reader != NULL);
+	CHECK(reader && reader->header()->slotCount == 4);
+	delete reader;
+
+	currentCase = "unsupported type";
+	CHECK(TelemetryBus::create(busName("xyz"), {"position"}, {SIMCONNECT_DATATYPE_XYZ}, 4, error) == NULL);
+
+	currentCase = "missing bus";
+	CHECK(TelemetryBus::attach(busName("missing"), error) == NULL);
+
+	// Layouts that point past the mapping are rejected by attach
+	currentCase = "damaged layout";
+	TelemetryBusHeader *writable = (TelemetryBusHeader *)bus->data();
+	TelemetryBusField *fields = (TelemetryBusField *)(bus->data() + sizeof(TelemetryBusHeader));
+	uint32_t slotCount = writable->slotCount;
+	writable->slotCount = 0x10000000;
+	CHECK(TelemetryBus::attach(name, error) == NULL);
+	writable->slotCount = 0;
+	CHECK(TelemetryBus::attach(name, error) == NULL);
+	writable->slotCount = slotCount;
+	uint32_t fieldCount = writable->fieldCount;
+	writable->fieldCount = 0xFFFFFFFF;
+	CHECK(TelemetryBus::attach(name, error) == NULL);
+	writable->fieldCount = fieldCount;
+	uint32_t sampleSize = writable->sampleSize;
+	writable->sampleSize = writable->slotSize;
+	CHECK(TelemetryBus::attach(name, error) == NULL);
+	writable->sampleSize = sampleSize;
+	uint32_t offset = fields[3].offset;
+	fields[3].offset = sampleSize - 4;
+	CHECK(TelemetryBus::attach(name, error) == NULL);
+	fields[3].offset = offset;
+	writable->version = telemetryBusVersion + 1;
+	CHECK(TelemetryBus::attach(name, error) == NULL);
+	writable->version = telemetryBusVersion;
+
+	reader = TelemetryBus::attach(name, error);
+	CHECK(reader != NULL);
+	delete reader;
+	delete bus;
+
+	// The producer unlinks the bus when it goes away
+	currentCase = "unlinked";
+	CHECK(TelemetryBus::attach(name, error) == NULL);
+}
+
+static void testReads()
+{
+	currentCase = "reads";
+	std::string error;
+	std::string name = busName("reads");
+	TelemetryBus *bus = TelemetryBus::create(name, names, types, 4, error);
+	TelemetryBus *reader = bus ? TelemetryBus::attach(name, error) : NULL;
+	CHECK(reader != NULL);
+	if (!reader)
+	{
+		printf("attach: %s\n", error.c_str());
+		delete bus;
+		return;
+	}
+
+	int64_t index;
+	int64_t timestamp;
+	std::vector<char> sample;
+	CHECK(!reader->read(-1, false, index, timestamp, sample));
+	CHECK(!reader->read(-1, true, index, timestamp, sample));
+
+	Sample(0).publish(bus, 0);
+	CHECK(reader->read(-1, false, index, timestamp, sample));
+	CHECK(index == 0 && timestamp == 0 && matches(reader, 0, sample));
+	CHECK(!reader->read(0, false, index, timestamp, sample));
+	CHECK(!reader->read(0, true, index, timestamp, sample));
+
+	// Longer strings are cut to the capacity and stay terminated
+	currentCase = "long string";
+	Sample longTitle(1);
+	longTitle.title.assign(1000, 'x');
+	longTitle.publish(bus, 1);
+	CHECK(reader->read(0, true, index, timestamp, sample));
+	CHECK(index == 1 && std::string(sample.data() + reader->fields()[2].offset) == std::string(telemetryBusStringCapacity - 1, 'x'));
+
+	// The ring holds the last slotCount - 1 samples for cursors, the newest is always there
+	currentCase = "wrap";
+	for (int64_t i = 2; i < 11; i++)
+		Sample(i).publish(bus, i);
+	CHECK(reader->header()->published.load() == 11);
+	CHECK(reader->read(-1, false, index, timestamp, sample));
+	CHECK(index == 10 && timestamp == 10000 && matches(reader, 10, sample));
+	CHECK(reader->read(1, true, index, timestamp, sample));
+	CHECK(index == 8 && matches(reader, 8, sample)); // Fell behind, skipped to the oldest
+	CHECK(reader->read(8, true, index, timestamp, sample));
+	CHECK(index == 9 && matches(reader, 9, sample));
+	CHECK(reader->read(9, true, index, timestamp, sample));
+	CHECK(index == 10);
+	CHECK(!reader->read(10, true, index, timestamp, sample));
+
+	delete reader;
+	delete bus;
+}
+
+// A reader that keeps up with a publishing thread sees whole samples in order
+static void testConcurrentReads()
+{
+	currentCase = "concurrent reads";
+	std::string error;
+	std::string name = busName("concurrent");
+	TelemetryBus *bus = TelemetryBus::create(name, names, types, 8, error);
+	TelemetryBus *reader = bus ? TelemetryBus::attach(name, error) : NULL;
+	CHECK(reader != NULL);
+	if (!reader)
+	{
+		delete bus;
+		return;
+	}
+
+	const int64_t total = 200000;
+	std::atomic<bool> done(false);
+	std::thread producer([&] {
+		for (int64_t i = 0; i < total; i++)
+			Sample(i).publish(bus, i);
+		done = true;
+	});
+
+	int64_t cursor = -1;
+	int64_t reads = 0;
+	int64_t torn = 0;
+	std::vector<char> sample;
+	while (!done || cursor < total - 1)
+	{
+		int64_t index;
+		int64_t timestamp;
+		if (!reader->read(cursor, true, index, timestamp, sample))
+			continue;
+		if (index <= cursor || timestamp != index * 1000 || !matches(reader, index, sample))
+			torn++;
+		cursor = index;
+		reads++;
+	}
+	producer.join();
+
+	CHECK(torn == 0);
+	CHECK(reads > 0);
+	CHECK(cursor == total - 1);
+	delete reader;
+	delete bus;
+}
+
+int main()
+{
+	testLayout();
+	testReads();
+	testConcurrentReads();
+
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("telemetry_bus_test passed\n");
+	return 0;
+}
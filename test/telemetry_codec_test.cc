@@ -0,0 +1,328 @@
+// Standalone roundtrip checks of the telemetry codec: every column type, the width buckets
+// of the variable-width integers and the XOR windows of the floats. Built as the
+// telemetry_codec_test target, exits with 1 on failure.
+
+#include <stdio.h>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "../src/telemetry_codec.h"
+
+static int failures = 0;
+static std::string currentCase;
+
+#define CHECK(condition)                                                       \
+	do                                                                         \
+	{                                                                          \
+		if (!(condition))                                                      \
+		{                                                                      \
+			printf("%s:%d: %s failed (%s)\n", __FILE__, __LINE__, #condition, \
+				   currentCase.c_str());                                       \
+			failures++;                                                        \
+		}                                                                      \
+	} while (0)
+
+static bool sameBits(double a, double b)
+{
+	return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static bool sameBits(float a, float b)
+{
+	return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// Delta-of-deltas on both sides of every width bucket: 1, 7, 9, 12, 32 and 64 bits
+static const int64_t bucketEdges[] = {
+	0, 1, -1, 63, 64, -64, -65, 255, 256, -256, -257, 2047, 2048, -2048, -2049,
+	2147483647LL, 2147483648LL, -2147483648LL, -2147483649LL, 0, 0};
+
+// Values whose delta-of-deltas are the bucket edges
+static std::vector<int64_t> fromDeltaOfDeltas(int64_t start)
+{
+	std::vector<int64_t> values;
+	int64_t value = start;
+	int64_t delta = 0;
+	for (auto dod : bucketEdges)
+	{
+		delta += dod;
+		value += delta;
+		values.push_back(value);
+	}
+	return values;
+}
+
+static bool decode(const std::vector<uint8_t> &chunk, TelemetryDecoded &decoded)
+{
+	std::string error;
+	decoded = TelemetryDecoded();
+	bool ok = decodeTelemetry(chunk.data(), chunk.size(), decoded, error);
+	if (!ok)
+		printf("decodeTelemetry: %s (%s)\n", error.c_str(), currentCase.c_str());
+	return ok;
+}
+
+static void testIntegers()
+{
+	currentCase = "integers";
+	std::vector<int64_t> timestamps = fromDeltaOfDeltas(1700000000000000LL);
+	std::vector<int64_t> int64s = fromDeltaOfDeltas(-5);
+	int64s.push_back(std::numeric_limits<int64_t>::max());
+	int64s.push_back(std::numeric_limits<int64_t>::min());
+	int64s.push_back(0);
+	std::vector<int32_t> int32s = {0, 1, -1, 63, -64, 64, 255, -256, 2047, -2048, 2048,
+								   std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::min(),
+								   std::numeric_limits<int32_t>::max(), -1, 0};
+	timestamps.resize(int64s.size(), timestamps.back());
+
+	TelemetryEncoder encoder({SIMCONNECT_DATATYPE_INT32, SIMCONNECT_DATATYPE_INT64}, 1);
+	for (size_t i = 0; i < int64s.size(); i++)
+	{
+		encoder.beginSample(timestamps[i]);
+		encoder.putInt32(int32s[i % int32s.size()]);
+		encoder.putInt64(int64s[i]);
+		encoder.endSample();
+	}
+	CHECK(encoder.pendingSamples() == int64s.size());
+
+	TelemetryDecoded decoded;
+	CHECK(decode(encoder.flush(), decoded));
+	CHECK(encoder.pendingSamples() == 0);
+	CHECK(decoded.timestamps == timestamps);
+	CHECK(decoded.columns.size() == 2);
+	CHECK(decoded.columns[0].type == SIMCONNECT_DATATYPE_INT32);
+	CHECK(decoded.columns[1].type == SIMCONNECT_DATATYPE_INT64);
+	for (size_t i = 0; i < int64s.size(); i++)
+	{
+		CHECK(decoded.columns[0].int32[i] == int32s[i % int32s.size()]);
+		CHECK(decoded.columns[1].float64[i] == (double)int64s[i]);
+	}
+
+	// Timestamps far apart, including one before the epoch
+	currentCase = "timestamps";
+	std::vector<int64_t> jumps = {-1, std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min(), 0, 0, 1};
+	TelemetryEncoder jumping({SIMCONNECT_DATATYPE_INT32}, 1);
+	for (auto timestamp : jumps)
+	{
+		jumping.beginSample(timestamp);
+		jumping.endSample(); // Pads the column with 0
+	}
+	CHECK(decode(jumping.flush(), decoded));
+	CHECK(decoded.timestamps == jumps);
+	CHECK(decoded.columns[0].int32 == std::vector<int32_t>(jumps.size(), 0));
+}
+
+static void testFloats()
+{
+	currentCase = "floats";
+	const double inf = std::numeric_limits<double>::infinity();
+	std::vector<double> doubles = {
+		0.0, 0.0, -0.0, 1.0, 1.0, 1.5, 1.25, 1.0000000000000002, -1.0, 3.141592653589793,
+		std::numeric_limits<double>::denorm_min(), std::numeric_limits<double>::max(),
+		std::numeric_limits<double>::lowest(), inf, -inf, std::numeric_limits<double>::quiet_NaN(),
+		5e-324, 1e308, 0.1, 0.2, 0.30000000000000004, 0.0};
+	const float finf = std::numeric_limits<float>::infinity();
+	std::vector<float> floats = {
+		0.0f, 0.0f, -0.0f, 1.0f, 1.5f, 1.25f, 1.0000001f, -1.0f, 3.1415927f,
+		std::numeric_limits<float>::denorm_min(), std::numeric_limits<float>::max(),
+		std::numeric_limits<float>::lowest(), finf, -finf, std::numeric_limits<float>::quiet_NaN(),
+		0.1f, 0.2f, 0.3f, 0.0f};
+
+	TelemetryEncoder encoder({SIMCONNECT_DATATYPE_FLOAT64, SIMCONNECT_DATATYPE_FLOAT32}, 1);
+	size_t count = doubles.size() > floats.size() ? doubles.size() : floats.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		encoder.beginSample((int64_t)i * 16667);
+		encoder.putFloat64(doubles[i % doubles.size()]);
+		encoder.putFloat32(floats[i % floats.size()]);
+		encoder.endSample();
+	}
+
+	TelemetryDecoded decoded;
+	CHECK(decode(encoder.flush(), decoded));
+	CHECK(decoded.columns[0].float64.size() == count);
+	CHECK(decoded.columns[1].float32.size() == count);
+	for (size_t i = 0; i < count; i++)
+	{
+		CHECK(sameBits(decoded.columns[0].float64[i], doubles[i % doubles.size()]));
+		CHECK(sameBits(decoded.columns[1].float32[i], floats[i % floats.size()]));
+	}
+
+	// Every single-bit XOR, the windows grow and shrink from both ends
+	currentCase = "float windows";
+	TelemetryEncoder windows({SIMCONNECT_DATATYPE_FLOAT64, SIMCONNECT_DATATYPE_FLOAT32}, 1);
+	std::vector<uint64_t> bits64;
+	std::vector<uint32_t> bits32;
+	for (int bit = 0; bit < 64; bit++)
+	{
+		bits64.push_back(1ULL << bit);
+		bits64.push_back(~0ULL ^ (1ULL << (63 - bit)));
+		bits32.push_back(1U << (bit % 32));
+		bits32.push_back(~0U ^ (1U << (31 - bit % 32)));
+	}
+	for (size_t i = 0; i < bits64.size(); i++)
+	{
+		double d;
+		float f;
+		memcpy(&d, &bits64[i], sizeof(d));
+		memcpy(&f, &bits32[i], sizeof(f));
+		windows.beginSample((int64_t)i);
+		windows.putFloat64(d);
+		windows.putFloat32(f);
+		windows.endSample();
+	}
+	CHECK(decode(windows.flush(), decoded));
+	for (size_t i = 0; i < bits64.size(); i++)
+	{
+		uint64_t d;
+		uint32_t f;
+		memcpy(&d, &decoded.columns[0].float64[i], sizeof(d));
+		memcpy(&f, &decoded.columns[1].float32[i], sizeof(f));
+		CHECK(d == bits64[i]);
+		CHECK(f == bits32[i]);
+	}
+}
+
+static void testStrings()
+{
+	currentCase = "strings";
+	std::vector<SIMCONNECT_DATATYPE> types = {
+		SIMCONNECT_DATATYPE_STRING8, SIMCONNECT_DATATYPE_STRING32, SIMCONNECT_DATATYPE_STRING64,
+		SIMCONNECT_DATATYPE_STRING128, SIMCONNECT_DATATYPE_STRING256, SIMCONNECT_DATATYPE_STRING260,
+		SIMCONNECT_DATATYPE_STRINGV};
+	std::string utf8 = "Z\xC3\xBCrich \xE2\x9C\x88 \xF0\x9F\x9B\xA9"; // Zürich ✈ 🛩
+	std::string longest(0xFFFF, 'a');
+	std::vector<std::string> values = {"", "A320", "A320", "", utf8, utf8, longest, "B", std::string("\0x", 2)};
+
+	TelemetryEncoder encoder(types, 1);
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		encoder.beginSample((int64_t)i);
+		for (size_t c = 0; c < types.size(); c++)
+		{
+			const std::string &value = values[(i + c) % values.size()];
+			encoder.putString(value.data(), value.size());
+		}
+		encoder.endSample();
+	}
+
+	TelemetryDecoded decoded;
+	CHECK(decode(encoder.flush(), decoded));
+	for (size_t c = 0; c < types.size(); c++)
+	{
+		CHECK(decoded.columns[c].type == types[c]);
+		for (size_t i = 0; i < values.size(); i++)
+			CHECK(decoded.columns[c].strings[i] == values[(i + c) % values.size()]);
+	}
+
+	// Longer strings are cut to 0xFFFF bytes, without splitting a UTF-8 sequence
+	currentCase = "long strings";
+	std::string tooLong(0xFFFE, 'a');
+	tooLong += "\xC3\xBC\xC3\xBC";
+	TelemetryEncoder truncating({SIMCONNECT_DATATYPE_STRINGV}, 1);
+	truncating.beginSample(0);
+	truncating.putString(tooLong.data(), tooLong.size());
+	truncating.endSample();
+	truncating.beginSample(1);
+	truncating.putString(longest.data(), longest.size()); // Exactly the limit
+	truncating.endSample();
+	CHECK(decode(truncating.flush(), decoded));
+	CHECK(decoded.columns[0].strings[0] == std::string(0xFFFE, 'a'));
+	CHECK(decoded.columns[0].strings[1] == longest);
+
+	// Raw payloads stop at the terminator, or at the size of the type
+	currentCase = "string datums";
+	TelemetryEncoder datums({SIMCONNECT_DATATYPE_STRING8, SIMCONNECT_DATATYPE_STRINGV}, 1);
+	const char full[] = "ABCDEFGHIJ";
+	datums.beginSample(0);
+	datums.putDatum(full, sizeof(full));
+	datums.putDatum("abc\0def", 8);
+	datums.endSample();
+	CHECK(decode(datums.flush(), decoded));
+	CHECK(decoded.columns[0].strings[0] == "ABCDEFGH");
+	CHECK(decoded.columns[1].strings[0] == "abc");
+}
+
+static void testChunks()
+{
+	currentCase = "chunks";
+	std::vector<SIMCONNECT_DATATYPE> types = {SIMCONNECT_DATATYPE_FLOAT64, SIMCONNECT_DATATYPE_INT32, SIMCONNECT_DATATYPE_STRING32};
+	TelemetryEncoder encoder(types, 1);
+	std::vector<uint8_t> stream;
+	size_t firstChunk = 0;
+	for (int chunk = 0; chunk < 3; chunk++)
+	{
+		for (int i = 0; i < 5; i++)
+		{
+			encoder.beginSample(chunk * 100 + i);
+			encoder.putNumber(chunk + i * 0.5);
+			encoder.putNumber(i - chunk);
+			encoder.putNumber(0); // An empty string
+			encoder.endSample();
+		}
+		std::vector<uint8_t> bytes = encoder.flush();
+		stream.insert(stream.end(), bytes.begin(), bytes.end());
+		firstChunk = firstChunk ? firstChunk : bytes.size();
+	}
+
+	TelemetryDecoded decoded;
+	CHECK(decode(stream, decoded));
+	CHECK(decoded.timestamps.size() == 15);
+	CHECK(decoded.timestamps[14] == 204);
+	CHECK(decoded.columns[0].float64[7] == 1 + 2 * 0.5);
+	CHECK(decoded.columns[1].int32[7] == 1);
+	CHECK(decoded.columns[2].strings[7] == "");
+
+	// An empty chunk holds the layout only
+	TelemetryDecoded empty;
+	CHECK(decode(encoder.flush(), empty));
+	CHECK(empty.timestamps.empty());
+	CHECK(empty.columns.size() == types.size());
+
+	currentCase = "damaged chunks";
+	std::string error;
+	for (size_t size = 1; size < firstChunk; size++)
+	{
+		TelemetryDecoded truncated;
+		currentCase = "truncated to " + std::to_string(size);
+		CHECK(!decodeTelemetry(stream.data(), size, truncated, error));
+	}
+	currentCase = "damaged chunks";
+	std::vector<uint8_t> damaged = stream;
+	damaged[0] = 'X';
+	CHECK(!decodeTelemetry(damaged.data(), damaged.size(), decoded, error));
+	damaged = stream;
+	damaged[4] = 2; // Version
+	CHECK(!decodeTelemetry(damaged.data(), damaged.size(), decoded, error));
+	damaged = stream;
+	damaged[7] = SIMCONNECT_DATATYPE_XYZ;
+	decoded = TelemetryDecoded();
+	CHECK(!decodeTelemetry(damaged.data(), damaged.size(), decoded, error));
+
+	TelemetryEncoder other({SIMCONNECT_DATATYPE_INT32}, 1);
+	other.beginSample(0);
+	other.putInt32(1);
+	other.endSample();
+	std::vector<uint8_t> mixed = stream;
+	std::vector<uint8_t> otherChunk = other.flush();
+	mixed.insert(mixed.end(), otherChunk.begin(), otherChunk.end());
+	decoded = TelemetryDecoded();
+	CHECK(!decodeTelemetry(mixed.data(), mixed.size(), decoded, error));
+}
+
+int main()
+{
+	testIntegers();
+	testFloats();
+	testStrings();
+	testChunks();
+
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("telemetry_codec_test passed\n");
+	return 0;
+}